@@ -3,6 +3,8 @@
 // - Not tailing properly
 // - wrap cargo with xmake for build and run
 
+mod syscall_trace;
+
 use std::fs::File;
 use std::io::{BufRead, BufReader, Seek, SeekFrom};
 use std::sync::mpsc::{channel, Receiver, Sender};
@@ -19,10 +21,16 @@ use structopt::StructOpt;
 struct Opt {
     #[structopt(short, long, parse(from_os_str))]
     file: std::path::PathBuf,
+
+    /// Decode the last system call dump (debug_dump_syscalls) in the log to
+    /// stdout instead of opening the viewer
+    #[structopt(long)]
+    syscall_trace: bool,
 }
 
 #[derive(Clone, Debug)]
 struct LogEntry {
+    timestamp_ns: Option<u64>,
     level: String,
     component: String,
     message: String,
@@ -79,8 +87,19 @@ impl eframe::App for LogViewer {
                             .to_lowercase()
                             .contains(&self.search_term.to_lowercase())
                     {
-                        let label =
-                            format!("[{}] {} - {}", entry.level, entry.component, entry.message);
+                        let label = match entry.timestamp_ns {
+                            Some(ns) => format!(
+                                "{:>12.6} [{}] {} - {}",
+                                ns as f64 / 1e9,
+                                entry.level,
+                                entry.component,
+                                entry.message
+                            ),
+                            None => format!(
+                                "[{}] {} - {}",
+                                entry.level, entry.component, entry.message
+                            ),
+                        };
                         let color = self.level_color(&entry.level);
                         if ui
                             .selectable_label(
@@ -164,6 +183,7 @@ fn parse_log_entry(line: &str) -> Option<LogEntry> {
     let obj = parsed.as_object()?;
 
     Some(LogEntry {
+        timestamp_ns: obj.get("timestamp_ns").and_then(Value::as_u64),
         level: obj.get("level")?.as_str()?.to_string(),
         component: obj.get("component")?.as_str()?.to_string(),
         message: obj.get("message")?.as_str()?.to_string(),
@@ -193,8 +213,28 @@ fn tail_log(file_path: std::path::PathBuf, tx: Sender<LogEntry>) {
     }
 }
 
+fn print_syscall_trace(file_path: &std::path::Path) {
+    let file = File::open(file_path).expect("Failed to open file");
+    let dump = BufReader::new(file)
+        .lines()
+        .map_while(Result::ok)
+        .filter_map(|line| parse_log_entry(&line))
+        .filter(|entry| entry.component == "syscalls" && entry.data.is_some())
+        .last();
+
+    match dump.and_then(|entry| entry.data) {
+        Some(data) => syscall_trace::print(&data),
+        None => eprintln!("No system call dump in {}", file_path.display()),
+    }
+}
+
 fn main() -> Result<(), eframe::Error> {
     let opt = Opt::from_args();
+    if opt.syscall_trace {
+        print_syscall_trace(&opt.file);
+        return Ok(());
+    }
+
     let (tx, rx) = channel();
 
     thread::spawn(move || {
@@ -0,0 +1,165 @@
+// Decoder for the system call trace in the output of debug_dump_syscalls
+// (kernel/debug/syscalls.c). The records are SystemCallTraceRecord from
+// kernel/syscall_stats.h, hex-encoded.
+
+use std::collections::HashMap;
+
+use serde_json::Value;
+
+const RECORD_SIZE: usize = 32;
+const TRACE_ENTER: u8 = 0;
+const TRACE_EXIT: u8 = 1;
+
+#[derive(Clone, Debug)]
+struct Record {
+    tsc: u64,
+    thread: u32,
+    number: u16,
+    kind: u8,
+    data: [u64; 2],
+}
+
+fn le_u64(bytes: &[u8]) -> u64 {
+    u64::from_le_bytes(bytes[..8].try_into().unwrap())
+}
+
+fn decode_record(hex: &str) -> Option<Record> {
+    if hex.len() != RECORD_SIZE * 2 {
+        return None;
+    }
+    let bytes = (0..RECORD_SIZE)
+        .map(|i| u8::from_str_radix(hex.get(i * 2..i * 2 + 2)?, 16).ok())
+        .collect::<Option<Vec<u8>>>()?;
+
+    Some(Record {
+        tsc: le_u64(&bytes[0..]),
+        thread: u32::from_le_bytes(bytes[8..12].try_into().unwrap()),
+        number: u16::from_le_bytes(bytes[12..14].try_into().unwrap()),
+        kind: bytes[14],
+        data: [le_u64(&bytes[16..]), le_u64(&bytes[24..])],
+    })
+}
+
+fn call_name(names: &[&str], number: u16) -> String {
+    names
+        .get(number as usize)
+        .map(|name| name.to_string())
+        .unwrap_or_else(|| format!("#{}", number))
+}
+
+fn print_unfinished(entry: &Record, at: u64, names: &[&str]) {
+    println!(
+        "{:>12} thread {:<4} {}(0x{:x}, 0x{:x}) = ?",
+        at,
+        entry.thread,
+        call_name(names, entry.number),
+        entry.data[0],
+        entry.data[1]
+    );
+}
+
+/// Prints the per-call statistics and one line per traced call, with entries
+/// and exits of the same thread paired up
+pub fn print(data: &Value) {
+    let tsc_hz = data.get("tsc_hz").and_then(Value::as_u64).unwrap_or(0);
+    let to_ns = |cycles: u64| {
+        if tsc_hz == 0 {
+            0
+        } else {
+            (cycles as u128 * 1_000_000_000 / tsc_hz as u128) as u64
+        }
+    };
+    let names: Vec<&str> = data
+        .get("names")
+        .and_then(Value::as_array)
+        .map(|names| names.iter().filter_map(Value::as_str).collect())
+        .unwrap_or_default();
+
+    println!(
+        "{:<24} {:>10} {:>8} {:>10} {:>12}",
+        "call", "count", "errors", "avg ns", "max ns"
+    );
+    for call in data
+        .get("calls")
+        .and_then(Value::as_array)
+        .into_iter()
+        .flatten()
+    {
+        let field = |key| call.get(key).and_then(Value::as_u64).unwrap_or(0);
+        println!(
+            "{:<24} {:>10} {:>8} {:>10} {:>12}",
+            call.get("name").and_then(Value::as_str).unwrap_or("?"),
+            field("count"),
+            field("errors"),
+            field("avg_ns"),
+            to_ns(field("max_cycles"))
+        );
+    }
+
+    for cpu in data
+        .get("trace")
+        .and_then(Value::as_array)
+        .into_iter()
+        .flatten()
+    {
+        let id = cpu.get("cpu").and_then(Value::as_u64).unwrap_or(0);
+        let dropped = cpu.get("dropped").and_then(Value::as_u64).unwrap_or(0);
+        println!();
+        println!("cpu {} ({} older records overwritten)", id, dropped);
+
+        let records: Vec<Record> = cpu
+            .get("records")
+            .and_then(Value::as_array)
+            .into_iter()
+            .flatten()
+            .filter_map(|record| decode_record(record.as_str()?))
+            .collect();
+        let Some(start) = records.iter().map(|record| record.tsc).min() else {
+            continue;
+        };
+
+        // A thread has at most one call in flight, calls that never returned
+        // (exit) or lost their entry to the ring wrapping print alone
+        let mut pending: HashMap<u32, Record> = HashMap::new();
+        for record in &records {
+            let at = to_ns(record.tsc - start);
+            let name = call_name(&names, record.number);
+            match record.kind {
+                TRACE_ENTER => {
+                    if let Some(open) = pending.insert(record.thread, record.clone()) {
+                        print_unfinished(&open, to_ns(open.tsc - start), &names);
+                    }
+                }
+                TRACE_EXIT => match pending.remove(&record.thread) {
+                    Some(entry) if entry.number == record.number => println!(
+                        "{:>12} thread {:<4} {}(0x{:x}, 0x{:x}) = {} error {} ({} ns)",
+                        to_ns(entry.tsc - start),
+                        record.thread,
+                        name,
+                        entry.data[0],
+                        entry.data[1],
+                        record.data[0] as i64,
+                        record.data[1] as i64,
+                        to_ns(record.tsc.saturating_sub(entry.tsc))
+                    ),
+                    other => {
+                        if let Some(entry) = other {
+                            print_unfinished(&entry, to_ns(entry.tsc - start), &names);
+                        }
+                        println!(
+                            "{:>12} thread {:<4} {}(?) = {} error {}",
+                            at, record.thread, name, record.data[0] as i64, record.data[1] as i64
+                        );
+                    }
+                },
+                _ => println!("{:>12} unknown record type {}", at, record.kind),
+            }
+        }
+
+        let mut open: Vec<&Record> = pending.values().collect();
+        open.sort_by_key(|record| record.tsc);
+        for record in open {
+            print_unfinished(record, to_ns(record.tsc - start), &names);
+        }
+    }
+}
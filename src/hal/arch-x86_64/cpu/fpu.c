@@ -0,0 +1,204 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libk/string.h>
+
+#include <hal/cpu.h>
+#include <hal/fpu.h>
+#include <hal/hal_logger.h>
+
+#define CPUID_1_ECX_XSAVE (1 << 26)
+#define CPUID_D_1_EAX_XSAVEOPT (1 << 0)
+#define CPUID_D_1_EAX_XSAVES (1 << 3)
+
+#define MSR_XSS 0xDA0
+
+/**
+ * Offsets into the legacy region and the XSAVE header of a save area
+ */
+#define FXSAVE_FCW 0
+#define FXSAVE_MXCSR 24
+#define FXSAVE_SIZE 512
+#define XSAVE_HEADER_XSTATE_BV 512
+#define XSAVE_HEADER_XCOMP_BV 520
+#define XCOMP_BV_COMPACTED (1ULL << 63)
+
+#define FCW_DEFAULT 0x037F
+#define MXCSR_DEFAULT 0x1F80
+
+/**
+ * User state components we enable when the CPU has them
+ */
+#define XFEATURES_WANTED                                                       \
+	(XFEATURE_X87 | XFEATURE_SSE | XFEATURE_AVX | XFEATURE_OPMASK |            \
+	 XFEATURE_ZMM_HI256 | XFEATURE_HI16_ZMM)
+
+static bool configured;
+static FpuSaveMode save_mode;
+static uint64_t xfeatures;
+static size_t state_size;
+
+static inline void xsetbv(uint32_t index, uint64_t value) {
+	asm volatile("xsetbv"
+				 :
+				 : "c"(index), "a"((uint32_t)value), "d"((uint32_t)(value >> 32))
+				 : "memory");
+}
+
+/**
+ * Picks the save instructions and enabled components (first CPU only)
+ */
+static void fpu_configure(bool has_xsave) {
+	if (!has_xsave) {
+		save_mode = FPU_SAVE_FXSAVE;
+		xfeatures = XFEATURE_X87 | XFEATURE_SSE;
+		return;
+	}
+
+	CpuidResult leaf = cpuid(0xD, 0);
+	xfeatures = (((uint64_t)leaf.edx << 32) | leaf.eax) & XFEATURES_WANTED;
+
+	// AVX-512 state is only usable as a whole
+	uint64_t avx512 =
+		XFEATURE_OPMASK | XFEATURE_ZMM_HI256 | XFEATURE_HI16_ZMM;
+	if ((xfeatures & avx512) != avx512) {
+		xfeatures &= ~avx512;
+	}
+
+	CpuidResult options = cpuid(0xD, 1);
+	if (options.eax & CPUID_D_1_EAX_XSAVES) {
+		save_mode = FPU_SAVE_XSAVES;
+	} else if (options.eax & CPUID_D_1_EAX_XSAVEOPT) {
+		save_mode = FPU_SAVE_XSAVEOPT;
+	} else {
+		save_mode = FPU_SAVE_XSAVE;
+	}
+}
+
+void fpu_initialize() {
+	bool has_xsave = (cpuid(1, 0).ecx & CPUID_1_ECX_XSAVE) != 0;
+	if (!configured) {
+		fpu_configure(has_xsave);
+	}
+
+	uint64_t cr0;
+	asm volatile("mov %%cr0, %0" : "=r"(cr0));
+	cr0 = (cr0 & ~(uint64_t)(CR0_EM | CR0_TS)) | CR0_MP | CR0_NE;
+	asm volatile("mov %0, %%cr0" ::"r"(cr0) : "memory");
+
+	uint64_t cr4;
+	asm volatile("mov %%cr4, %0" : "=r"(cr4));
+	cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+	if (has_xsave) {
+		cr4 |= CR4_OSXSAVE;
+	}
+	asm volatile("mov %0, %%cr4" ::"r"(cr4) : "memory");
+
+	if (has_xsave) {
+		xsetbv(0, xfeatures);
+		if (save_mode == FPU_SAVE_XSAVES) {
+			// No supervisor state components
+			wrmsr(MSR_XSS, 0);
+		}
+	}
+
+	asm volatile("fninit");
+
+	if (configured) {
+		return;
+	}
+	configured = true;
+
+	// The size CPUID reports depends on the components enabled above
+	switch (save_mode) {
+	case FPU_SAVE_XSAVES:
+		state_size = cpuid(0xD, 1).ebx;
+		break;
+	case FPU_SAVE_XSAVEOPT:
+	case FPU_SAVE_XSAVE:
+		state_size = cpuid(0xD, 0).ebx;
+		break;
+	case FPU_SAVE_FXSAVE:
+		state_size = FXSAVE_SIZE;
+		break;
+	}
+
+	static const char *mode_names[] = {
+		[FPU_SAVE_XSAVES] = "xsaves",
+		[FPU_SAVE_XSAVEOPT] = "xsaveopt",
+		[FPU_SAVE_XSAVE] = "xsave",
+		[FPU_SAVE_FXSAVE] = "fxsave",
+	};
+	log_message(
+		&hal_logger,
+		LOG_INFO,
+		"fpu",
+		"FPU state management configured {mode=%s, xfeatures=0x%llx, "
+		"size=%llu}\n",
+		mode_names[save_mode],
+		xfeatures,
+		(uint64_t)state_size
+	);
+}
+
+size_t fpu_state_size() { return state_size; }
+
+FpuSaveMode fpu_save_mode() { return save_mode; }
+
+void fpu_init_state(void *area) {
+	uint8_t *bytes = (uint8_t *)area;
+
+	memset(area, 0, state_size);
+	*(uint16_t *)(bytes + FXSAVE_FCW) = FCW_DEFAULT;
+	*(uint32_t *)(bytes + FXSAVE_MXCSR) = MXCSR_DEFAULT;
+
+	// An empty XSTATE_BV makes XRSTOR load the init state of every component
+	if (save_mode == FPU_SAVE_XSAVES) {
+		*(uint64_t *)(bytes + XSAVE_HEADER_XCOMP_BV) =
+			XCOMP_BV_COMPACTED | xfeatures;
+	}
+}
+
+void fpu_save(void *area) {
+	uint32_t low = (uint32_t)xfeatures;
+	uint32_t high = (uint32_t)(xfeatures >> 32);
+
+	switch (save_mode) {
+	case FPU_SAVE_XSAVES:
+		asm volatile("xsaves64 (%0)" ::"r"(area), "a"(low), "d"(high)
+					 : "memory");
+		break;
+	case FPU_SAVE_XSAVEOPT:
+		asm volatile("xsaveopt64 (%0)" ::"r"(area), "a"(low), "d"(high)
+					 : "memory");
+		break;
+	case FPU_SAVE_XSAVE:
+		asm volatile("xsave64 (%0)" ::"r"(area), "a"(low), "d"(high)
+					 : "memory");
+		break;
+	case FPU_SAVE_FXSAVE:
+		asm volatile("fxsave64 (%0)" ::"r"(area) : "memory");
+		break;
+	}
+}
+
+void fpu_restore(void *area) {
+	uint32_t low = (uint32_t)xfeatures;
+	uint32_t high = (uint32_t)(xfeatures >> 32);
+
+	switch (save_mode) {
+	case FPU_SAVE_XSAVES:
+		asm volatile("xrstors64 (%0)" ::"r"(area), "a"(low), "d"(high)
+					 : "memory");
+		break;
+	case FPU_SAVE_XSAVEOPT:
+	case FPU_SAVE_XSAVE:
+		asm volatile("xrstor64 (%0)" ::"r"(area), "a"(low), "d"(high)
+					 : "memory");
+		break;
+	case FPU_SAVE_FXSAVE:
+		asm volatile("fxrstor64 (%0)" ::"r"(area) : "memory");
+		break;
+	}
+}
@@ -32,3 +32,4 @@ flush_cs:
 
 next_label_in_code:
   ; The code continues executing here in the new code segment.
+  ret
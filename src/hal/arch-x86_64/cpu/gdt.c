@@ -21,6 +21,32 @@ GdtSegmentDescriptor gdt_create_segment_descriptor(
 	  .base_high = (base >> 24) & 0xFF};
 }
 
+/**
+ * Fills the two GDT entries of a 64-bit TSS descriptor
+ */
+static void gdt_set_tss(
+	GdtSegmentDescriptor *table, TssSegmentDescriptor *task_state
+) {
+	uint64_t tss_base = (uint64_t)task_state;
+	uint32_t tss_limit = sizeof(TssSegmentDescriptor) - 1;
+
+	table[5] = (GdtSegmentDescriptor
+	){.limit_low = tss_limit & 0xFFFF,
+	  .base_low = tss_base & 0xFFFF,
+	  .base_middle = (tss_base >> 16) & 0xFF,
+	  .access = ACCESS_TSS,
+	  .limit_high_flags = ((tss_limit >> 16) & 0x0F) | 0x00,
+	  .base_high = (tss_base >> 24) & 0xFF};
+
+	table[6] = (GdtSegmentDescriptor
+	){.limit_low = (tss_base >> 32) & 0xFFFF,
+	  .base_low = (tss_base >> 48) & 0xFFFF,
+	  .base_middle = 0,
+	  .access = 0,
+	  .limit_high_flags = 0,
+	  .base_high = 0};
+}
+
 void gdt_initialize(uintptr_t kernel_stack_ptr) {
 	log_message(&hal_logger, LOG_INFO, "gdt", "Building GDT entries\n");
 
@@ -37,14 +63,15 @@ void gdt_initialize(uintptr_t kernel_stack_ptr) {
 		SEGMENT_BASE, SEGMENT_LIMIT, ACCESS_KERNEL_DATA, FLAG_GRANULARITY_4KB
 	);
 
-	// User Mode Code Segment
+	// User Mode Data Segment, in front of the code segment because SYSRET
+	// loads SS and CS from consecutive entries (see GDT_USER_DATA)
 	gdt[3] = gdt_create_segment_descriptor(
-		SEGMENT_BASE, SEGMENT_LIMIT, ACCESS_USER_CODE, FLAG_GRANULARITY_BYTE
+		SEGMENT_BASE, SEGMENT_LIMIT, ACCESS_USER_DATA, FLAG_GRANULARITY_4KB
 	);
 
-	// User Mode Data Segment
+	// User Mode Code Segment
 	gdt[4] = gdt_create_segment_descriptor(
-		SEGMENT_BASE, SEGMENT_LIMIT, ACCESS_USER_DATA, FLAG_GRANULARITY_4KB
+		SEGMENT_BASE, SEGMENT_LIMIT, ACCESS_USER_CODE, FLAG_GRANULARITY_BYTE
 	);
 
 	// Set up the TSS
@@ -52,25 +79,7 @@ void gdt_initialize(uintptr_t kernel_stack_ptr) {
 	tss.iomap_base = sizeof(tss);
 	tss.rsp[0] = kernel_stack_ptr;
 
-	// Create the TSS descriptor
-	uint64_t tss_base = (uint64_t)&tss;
-	uint32_t tss_limit = sizeof(tss) - 1;
-
-	gdt[5] = (GdtSegmentDescriptor
-	){.limit_low = tss_limit & 0xFFFF,
-	  .base_low = tss_base & 0xFFFF,
-	  .base_middle = (tss_base >> 16) & 0xFF,
-	  .access = ACCESS_TSS,
-	  .limit_high_flags = ((tss_limit >> 16) & 0x0F) | 0x00,
-	  .base_high = (tss_base >> 24) & 0xFF};
-
-	gdt[6] = (GdtSegmentDescriptor
-	){.limit_low = (tss_base >> 32) & 0xFFFF,
-	  .base_low = (tss_base >> 48) & 0xFFFF,
-	  .base_middle = 0,
-	  .access = 0,
-	  .limit_high_flags = 0,
-	  .base_high = 0};
+	gdt_set_tss(gdt, &tss);
 	log_message(&hal_logger, LOG_INFO, "gdt", "TSS entries built\n");
 
 	log_message(&hal_logger, LOG_INFO, "gdt", "GDT entries built\n");
@@ -86,8 +95,26 @@ void gdt_initialize(uintptr_t kernel_stack_ptr) {
 	log_message(&hal_logger, LOG_INFO, "gdt", "Segments reloaded\n");
 
 	log_message(&hal_logger, LOG_INFO, "gdt", "Loading TSS\n");
-	asm volatile("ltr %%ax"
-				 :
-				 : "a"(0x28)); // 0x28 is the offset of TSS in GDT (5 * 8)
+	asm volatile("ltr %%ax" : : "a"(GDT_TSS));
 	log_message(&hal_logger, LOG_INFO, "gdt", "TSS loaded\n");
 }
+
+void gdt_install_cpu(GdtCpu *tables, uintptr_t kernel_stack_ptr) {
+	// Every CPU needs its own TSS, and with it its own GDT since ltr marks the
+	// descriptor busy. The segments are copied from the boot CPU's GDT.
+	for (size_t i = 0; i < 5; i++) {
+		tables->gdt[i] = gdt[i];
+	}
+
+	tables->tss = (TssSegmentDescriptor){0};
+	tables->tss.iomap_base = sizeof(TssSegmentDescriptor);
+	tables->tss.rsp[0] = kernel_stack_ptr;
+	gdt_set_tss(tables->gdt, &tables->tss);
+
+	tables->gdtr.limit = sizeof(tables->gdt) - 1;
+	tables->gdtr.base = (uint64_t)tables->gdt;
+	gdt_load(&tables->gdtr);
+	gdt_reload_segments();
+
+	asm volatile("ltr %%ax" : : "a"(GDT_TSS));
+}
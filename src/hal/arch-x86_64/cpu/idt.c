@@ -24,8 +24,16 @@ IdtSegmentDescriptor idt_segment_create(
 
 void idt_set_entry(int index, void *handler) {
 	uint64_t handler_address = (uint64_t)handler;
+	IdtSegmentDescriptor entry =
+		idt_segment_create(handler_address, 0x08, 0x8E, 0);
 
-	idt[index] = idt_segment_create(handler_address, 0x08, 0x8E, 0);
+	// Entries can change while other CPUs take interrupts. Handlers in the
+	// kernel image share the upper half, so a single store of the lower half
+	// switches the entry atomically.
+	uint64_t halves[2];
+	memcpy(halves, &entry, sizeof(halves));
+	__atomic_store_n((uint64_t *)&idt[index] + 1, halves[1], __ATOMIC_RELAXED);
+	__atomic_store_n((uint64_t *)&idt[index], halves[0], __ATOMIC_RELEASE);
 }
 
 void idt_initialize() {
@@ -48,6 +56,8 @@ void idt_initialize() {
 	log_message(&hal_logger, LOG_INFO, "idt", "IDT loaded\n");
 }
 
+void idt_install_ap() { idt_load(&idtr); }
+
 void default_interrupt_handler(InterruptFrame *frame) {
 	log_message(
 		&hal_logger, LOG_INFO, "idt", "Default interrupt handler hit\n"
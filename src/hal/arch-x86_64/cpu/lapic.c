@@ -0,0 +1,156 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <hal/cpu.h>
+#include <hal/hal_logger.h>
+#include <hal/lapic.h>
+
+#define APIC_BASE_ENABLE (1 << 11)
+#define APIC_BASE_X2APIC (1 << 10)
+#define APIC_SVR_ENABLE (1 << 8)
+
+#define X2APIC_MSR_BASE 0x800
+
+static volatile uint32_t *lapic_mmio;
+static bool x2apic_mode;
+static bool tsc_deadline_supported;
+
+uint32_t lapic_read(uint32_t reg) {
+	if (x2apic_mode) {
+		return (uint32_t)rdmsr(X2APIC_MSR_BASE + (reg >> 4));
+	}
+
+	return lapic_mmio[reg / sizeof(uint32_t)];
+}
+
+void lapic_write(uint32_t reg, uint32_t value) {
+	if (x2apic_mode) {
+		wrmsr(X2APIC_MSR_BASE + (reg >> 4), value);
+		return;
+	}
+
+	lapic_mmio[reg / sizeof(uint32_t)] = value;
+}
+
+/**
+ * The timer mode currently programmed into the LVT is cached per CPU, so
+ * re-arming in the same mode does not cost an extra (slow) LVT write
+ */
+static bool lapic_timer_set_lvt(uint32_t lvt) {
+	HalCpu *cpu = hal_cpu();
+	if (cpu->lapic_timer_lvt == lvt) {
+		return false;
+	}
+
+	cpu->lapic_timer_lvt = lvt;
+	lapic_write(LAPIC_REG_LVT_TIMER, lvt);
+	return true;
+}
+
+void lapic_initialize(uintptr_t mmio_base) {
+	CpuidResult features = cpuid(1, 0);
+
+	lapic_mmio = (volatile uint32_t *)mmio_base;
+	x2apic_mode = (features.ecx & CPUID_1_ECX_X2APIC) != 0;
+	tsc_deadline_supported = (features.ecx & CPUID_1_ECX_TSC_DEADLINE) != 0;
+
+	// xAPIC has to be enabled before switching to x2APIC, going straight from
+	// disabled to x2APIC is an invalid transition
+	uint64_t apic_base = rdmsr(MSR_APIC_BASE) | APIC_BASE_ENABLE;
+	wrmsr(MSR_APIC_BASE, apic_base);
+	if (x2apic_mode) {
+		wrmsr(MSR_APIC_BASE, apic_base | APIC_BASE_X2APIC);
+	}
+
+	log_message(
+		&hal_logger,
+		LOG_INFO,
+		"lapic",
+		"Local APIC enabled {mode=%s, tsc_deadline=%s}\n",
+		x2apic_mode ? "x2apic" : "xapic",
+		tsc_deadline_supported ? "yes" : "no"
+	);
+
+	// Accept all priorities, mask the timer until someone arms it
+	lapic_write(LAPIC_REG_TPR, 0);
+	hal_cpu()->lapic_timer_lvt = LAPIC_LVT_MASKED | LAPIC_TIMER_VECTOR;
+	lapic_write(LAPIC_REG_LVT_TIMER, hal_cpu()->lapic_timer_lvt);
+	lapic_write(LAPIC_REG_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_16);
+
+	// Software enable with the spurious vector
+	lapic_write(LAPIC_REG_SVR, APIC_SVR_ENABLE | LAPIC_SPURIOUS_VECTOR);
+	lapic_eoi();
+}
+
+bool lapic_is_x2apic() { return x2apic_mode; }
+
+bool lapic_has_tsc_deadline() { return tsc_deadline_supported; }
+
+uint32_t lapic_id() {
+	uint32_t id = lapic_read(LAPIC_REG_ID);
+	return x2apic_mode ? id : id >> 24;
+}
+
+void lapic_eoi() { lapic_write(LAPIC_REG_EOI, 0); }
+
+void lapic_send_ipi(uint32_t apic_id, uint8_t vector) {
+	uint32_t icr = LAPIC_ICR_LEVEL_ASSERT | vector;
+
+	// x2APIC merges the ICR into a single 64-bit MSR write
+	if (x2apic_mode) {
+		wrmsr(
+			X2APIC_MSR_BASE + (LAPIC_REG_ICR_LOW >> 4),
+			((uint64_t)apic_id << 32) | icr
+		);
+		return;
+	}
+
+	while (lapic_read(LAPIC_REG_ICR_LOW) & LAPIC_ICR_DELIVERY_PENDING) {
+		cpu_relax();
+	}
+	lapic_write(LAPIC_REG_ICR_HIGH, apic_id << 24);
+	lapic_write(LAPIC_REG_ICR_LOW, icr);
+}
+
+void lapic_timer_stop() {
+	lapic_timer_set_lvt(LAPIC_LVT_MASKED | LAPIC_TIMER_VECTOR);
+	lapic_write(LAPIC_REG_TIMER_INITIAL, 0);
+	if (tsc_deadline_supported) {
+		wrmsr(MSR_TSC_DEADLINE, 0);
+	}
+}
+
+void lapic_timer_calibration_start() {
+	lapic_timer_set_lvt(
+		LAPIC_LVT_MASKED | LAPIC_TIMER_MODE_ONESHOT | LAPIC_TIMER_VECTOR
+	);
+	lapic_write(LAPIC_REG_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_16);
+	lapic_write(LAPIC_REG_TIMER_INITIAL, 0xFFFFFFFF);
+}
+
+uint32_t lapic_timer_current_count() {
+	return lapic_read(LAPIC_REG_TIMER_CURRENT);
+}
+
+void lapic_timer_oneshot(uint32_t count) {
+	lapic_timer_set_lvt(LAPIC_TIMER_MODE_ONESHOT | LAPIC_TIMER_VECTOR);
+	lapic_write(LAPIC_REG_TIMER_INITIAL, count);
+}
+
+void lapic_timer_periodic(uint32_t count) {
+	lapic_timer_set_lvt(LAPIC_TIMER_MODE_PERIODIC | LAPIC_TIMER_VECTOR);
+	lapic_write(LAPIC_REG_TIMER_INITIAL, count);
+}
+
+void lapic_timer_deadline(uint64_t deadline) {
+	if (lapic_timer_set_lvt(
+			LAPIC_TIMER_MODE_TSC_DEADLINE | LAPIC_TIMER_VECTOR
+		)) {
+		// The LVT write must be globally visible before the deadline MSR is
+		// written, otherwise the deadline may be dropped (SDM 10.5.4.1)
+		asm volatile("mfence" ::: "memory");
+	}
+
+	wrmsr(MSR_TSC_DEADLINE, deadline);
+}
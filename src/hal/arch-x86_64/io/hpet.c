@@ -0,0 +1,46 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <hal/hal_logger.h>
+#include <hal/hpet.h>
+
+#define HPET_REG_CAPABILITIES 0x000
+#define HPET_REG_CONFIG 0x010
+#define HPET_REG_MAIN_COUNTER 0x0F0
+
+#define HPET_CONFIG_ENABLE (1 << 0)
+
+static volatile uint8_t *hpet_mmio;
+static uint64_t period_fs;
+
+static inline uint64_t hpet_read(uint32_t reg) {
+	return *(volatile uint64_t *)(hpet_mmio + reg);
+}
+
+static inline void hpet_write(uint32_t reg, uint64_t value) {
+	*(volatile uint64_t *)(hpet_mmio + reg) = value;
+}
+
+void hpet_initialize(uintptr_t mmio_base) {
+	hpet_mmio = (volatile uint8_t *)mmio_base;
+	period_fs = hpet_read(HPET_REG_CAPABILITIES) >> 32;
+
+	hpet_write(
+		HPET_REG_CONFIG, hpet_read(HPET_REG_CONFIG) | HPET_CONFIG_ENABLE
+	);
+
+	log_message(
+		&hal_logger,
+		LOG_INFO,
+		"hpet",
+		"HPET enabled {period_fs=%llu}\n",
+		period_fs
+	);
+}
+
+bool hpet_available() { return hpet_mmio != NULL && period_fs != 0; }
+
+uint64_t hpet_period_fs() { return period_fs; }
+
+uint64_t hpet_read_counter() { return hpet_read(HPET_REG_MAIN_COUNTER); }
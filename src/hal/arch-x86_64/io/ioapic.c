@@ -0,0 +1,130 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libk/spinlock.h>
+
+#include <hal/hal_logger.h>
+#include <hal/ioapic.h>
+
+#define IOAPIC_REG_SELECT 0x00
+#define IOAPIC_REG_WINDOW 0x10
+
+#define IOAPIC_ID 0x00
+#define IOAPIC_VERSION 0x01
+#define IOAPIC_REDIRECTION_TABLE 0x10
+
+typedef struct {
+	volatile uint32_t *mmio;
+	uint8_t id;
+	uint32_t gsi_base;
+	uint32_t gsi_count;
+} IoApic;
+
+static IoApic ioapics[IOAPIC_MAX];
+static uint32_t ioapic_count;
+
+/**
+ * The register window is select-then-access, so accesses must not interleave
+ */
+static TicketLock ioapic_lock = TICKET_LOCK_INIT("ioapic");
+
+static uint32_t ioapic_read(IoApic *ioapic, uint32_t reg) {
+	ioapic->mmio[IOAPIC_REG_SELECT / sizeof(uint32_t)] = reg;
+	return ioapic->mmio[IOAPIC_REG_WINDOW / sizeof(uint32_t)];
+}
+
+static void ioapic_write(IoApic *ioapic, uint32_t reg, uint32_t value) {
+	ioapic->mmio[IOAPIC_REG_SELECT / sizeof(uint32_t)] = reg;
+	ioapic->mmio[IOAPIC_REG_WINDOW / sizeof(uint32_t)] = value;
+}
+
+static IoApic *ioapic_for_gsi(uint32_t gsi, uint32_t *pin) {
+	for (uint32_t i = 0; i < ioapic_count; i++) {
+		IoApic *ioapic = &ioapics[i];
+		if (gsi >= ioapic->gsi_base &&
+			gsi < ioapic->gsi_base + ioapic->gsi_count) {
+			*pin = gsi - ioapic->gsi_base;
+			return ioapic;
+		}
+	}
+
+	return NULL;
+}
+
+bool ioapic_register(uint8_t id, uintptr_t mmio_base, uint32_t gsi_base) {
+	if (ioapic_count == IOAPIC_MAX) {
+		return false;
+	}
+
+	IoApic *ioapic = &ioapics[ioapic_count];
+	ioapic->mmio = (volatile uint32_t *)mmio_base;
+	ioapic->id = id;
+	ioapic->gsi_base = gsi_base;
+
+	// Bits 16-23 of the version register hold the last redirection entry
+	uint32_t version = ioapic_read(ioapic, IOAPIC_VERSION);
+	ioapic->gsi_count = ((version >> 16) & 0xFF) + 1;
+
+	for (uint32_t pin = 0; pin < ioapic->gsi_count; pin++) {
+		ioapic_write(ioapic, IOAPIC_REDIRECTION_TABLE + pin * 2, IOAPIC_MASKED);
+		ioapic_write(ioapic, IOAPIC_REDIRECTION_TABLE + pin * 2 + 1, 0);
+	}
+
+	ioapic_count++;
+
+	log_message(
+		&hal_logger,
+		LOG_INFO,
+		"ioapic",
+		"IOAPIC registered {id=%d, gsi_base=%d, pins=%d}\n",
+		id,
+		gsi_base,
+		ioapic->gsi_count
+	);
+	return true;
+}
+
+bool ioapic_has_gsi(uint32_t gsi) {
+	uint32_t pin;
+	return ioapic_for_gsi(gsi, &pin) != NULL;
+}
+
+bool ioapic_route(
+	uint32_t gsi, uint8_t vector, uint32_t apic_id, uint32_t flags
+) {
+	uint32_t pin;
+	IoApic *ioapic = ioapic_for_gsi(gsi, &pin);
+	if (ioapic == NULL || apic_id > 0xFF) {
+		return false;
+	}
+
+	// Fixed delivery, physical destination
+	uint32_t low = IOAPIC_MASKED | vector |
+				   (flags & (IOAPIC_ACTIVE_LOW | IOAPIC_LEVEL_TRIGGERED));
+
+	uint64_t rflags = ticket_lock_acquire_irqsave(&ioapic_lock);
+	ioapic_write(ioapic, IOAPIC_REDIRECTION_TABLE + pin * 2, low);
+	ioapic_write(ioapic, IOAPIC_REDIRECTION_TABLE + pin * 2 + 1, apic_id << 24);
+	ticket_lock_release_irqrestore(&ioapic_lock, rflags);
+
+	return true;
+}
+
+static void ioapic_set_mask(uint32_t gsi, bool masked) {
+	uint32_t pin;
+	IoApic *ioapic = ioapic_for_gsi(gsi, &pin);
+	if (ioapic == NULL) {
+		return;
+	}
+
+	uint64_t rflags = ticket_lock_acquire_irqsave(&ioapic_lock);
+	uint32_t low = ioapic_read(ioapic, IOAPIC_REDIRECTION_TABLE + pin * 2);
+	low = masked ? (low | IOAPIC_MASKED) : (low & ~IOAPIC_MASKED);
+	ioapic_write(ioapic, IOAPIC_REDIRECTION_TABLE + pin * 2, low);
+	ticket_lock_release_irqrestore(&ioapic_lock, rflags);
+}
+
+void ioapic_mask(uint32_t gsi) { ioapic_set_mask(gsi, true); }
+
+void ioapic_unmask(uint32_t gsi) { ioapic_set_mask(gsi, false); }
@@ -0,0 +1,237 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libk/spinlock.h>
+
+#include <hal/pci.h>
+
+#define PCI_CONFIG_ADDRESS 0xCF8
+#define PCI_CONFIG_DATA 0xCFC
+#define PCI_CONFIG_ENABLE (1U << 31)
+
+#define PCI_BAR_IO (1 << 0)
+#define PCI_BAR_TYPE_64 (2 << 1)
+#define PCI_BAR_TYPE_MASK (3 << 1)
+
+#define MSI_ADDRESS_BASE 0xFEE00000
+
+/**
+ * MSI capability layout
+ */
+#define MSI_CONTROL 0x02
+#define MSI_ADDRESS_LOW 0x04
+#define MSI_ADDRESS_HIGH 0x08
+#define MSI_CONTROL_ENABLE (1 << 0)
+#define MSI_CONTROL_MULTIPLE_ENABLE (7 << 4)
+#define MSI_CONTROL_64BIT (1 << 7)
+
+/**
+ * MSI-X capability layout
+ */
+#define MSIX_CONTROL 0x02
+#define MSIX_TABLE 0x04
+#define MSIX_CONTROL_TABLE_SIZE 0x7FF
+#define MSIX_CONTROL_MASK_ALL (1 << 14)
+#define MSIX_CONTROL_ENABLE (1 << 15)
+#define MSIX_TABLE_BIR 0x7
+#define MSIX_ENTRY_VECTOR_CONTROL 12
+#define MSIX_ENTRY_MASKED (1 << 0)
+
+/**
+ * The address and data ports are shared by every access
+ */
+static TicketLock pci_config_lock = TICKET_LOCK_INIT("pci_config");
+
+static inline void write_dword(uint16_t port, uint32_t value) {
+	asm volatile("outl %0, %1" : : "a"(value), "Nd"(port));
+}
+
+static inline uint32_t read_dword(uint16_t port) {
+	uint32_t value;
+	asm volatile("inl %1, %0" : "=a"(value) : "Nd"(port));
+	return value;
+}
+
+static uint32_t pci_config_select(PciAddress address, uint16_t offset) {
+	return PCI_CONFIG_ENABLE | ((uint32_t)address.bus << 16) |
+		   ((uint32_t)(address.device & 0x1F) << 11) |
+		   ((uint32_t)(address.function & 0x7) << 8) | (offset & 0xFC);
+}
+
+uint32_t pci_config_read32(PciAddress address, uint16_t offset) {
+	uint64_t rflags = ticket_lock_acquire_irqsave(&pci_config_lock);
+	write_dword(PCI_CONFIG_ADDRESS, pci_config_select(address, offset));
+	uint32_t value = read_dword(PCI_CONFIG_DATA);
+	ticket_lock_release_irqrestore(&pci_config_lock, rflags);
+
+	return value;
+}
+
+uint16_t pci_config_read16(PciAddress address, uint16_t offset) {
+	uint32_t value = pci_config_read32(address, offset & ~3);
+	return (uint16_t)(value >> ((offset & 2) * 8));
+}
+
+void pci_config_write32(PciAddress address, uint16_t offset, uint32_t value) {
+	uint64_t rflags = ticket_lock_acquire_irqsave(&pci_config_lock);
+	write_dword(PCI_CONFIG_ADDRESS, pci_config_select(address, offset));
+	write_dword(PCI_CONFIG_DATA, value);
+	ticket_lock_release_irqrestore(&pci_config_lock, rflags);
+}
+
+void pci_config_write16(PciAddress address, uint16_t offset, uint16_t value) {
+	// Read-modify-write of the containing dword. Fine for the command and
+	// capability control registers, which have no write-one-to-clear
+	// neighbours that matter here.
+	uint32_t shift = (offset & 2) * 8;
+	uint32_t dword = pci_config_read32(address, offset & ~3);
+	dword = (dword & ~(0xFFFFU << shift)) | ((uint32_t)value << shift);
+	pci_config_write32(address, offset & ~3, dword);
+}
+
+uint8_t pci_find_capability(PciAddress address, uint8_t id) {
+	if (!(pci_config_read16(address, PCI_REG_STATUS) &
+		  PCI_STATUS_CAPABILITIES)) {
+		return 0;
+	}
+
+	uint8_t offset = pci_config_read32(address, PCI_REG_CAPABILITIES) & 0xFC;
+
+	// The list is at most 48 entries long, guard against loops
+	for (int i = 0; i < 48 && offset != 0; i++) {
+		uint32_t header = pci_config_read32(address, offset);
+		if ((header & 0xFF) == id) {
+			return offset;
+		}
+		offset = (header >> 8) & 0xFC;
+	}
+
+	return 0;
+}
+
+uint64_t pci_bar_address(PciAddress address, uint8_t bar) {
+	uint16_t offset = PCI_REG_BAR0 + bar * sizeof(uint32_t);
+	uint32_t low = pci_config_read32(address, offset);
+
+	if (low & PCI_BAR_IO) {
+		return 0;
+	}
+
+	uint64_t base = low & ~0xFULL;
+	if ((low & PCI_BAR_TYPE_MASK) == PCI_BAR_TYPE_64 && bar < 5) {
+		base |= (uint64_t)pci_config_read32(address, offset + 4) << 32;
+	}
+
+	return base;
+}
+
+MsiMessage msi_message(uint32_t apic_id, uint8_t vector) {
+	// Fixed delivery, edge triggered, physical destination
+	return (MsiMessage){
+		.address = MSI_ADDRESS_BASE | ((apic_id & 0xFF) << 12),
+		.data = vector,
+	};
+}
+
+static void pci_intx_disable(PciAddress address) {
+	uint16_t command = pci_config_read16(address, PCI_REG_COMMAND);
+	pci_config_write16(
+		address, PCI_REG_COMMAND, command | PCI_COMMAND_INTX_DISABLE
+	);
+}
+
+bool pci_msi_enable(PciAddress address, MsiMessage message) {
+	uint8_t cap = pci_find_capability(address, PCI_CAP_MSI);
+	if (cap == 0) {
+		return false;
+	}
+
+	uint16_t control = pci_config_read16(address, cap + MSI_CONTROL);
+
+	// The data register follows the address, which is one dword longer for
+	// 64-bit capable functions
+	pci_config_write32(
+		address, cap + MSI_ADDRESS_LOW, (uint32_t)message.address
+	);
+	uint16_t data_offset = MSI_ADDRESS_HIGH;
+	if (control & MSI_CONTROL_64BIT) {
+		pci_config_write32(
+			address, cap + MSI_ADDRESS_HIGH, (uint32_t)(message.address >> 32)
+		);
+		data_offset += sizeof(uint32_t);
+	}
+	pci_config_write16(address, cap + data_offset, (uint16_t)message.data);
+
+	control &= ~MSI_CONTROL_MULTIPLE_ENABLE;
+	pci_config_write16(
+		address, cap + MSI_CONTROL, control | MSI_CONTROL_ENABLE
+	);
+
+	pci_intx_disable(address);
+	return true;
+}
+
+void pci_msi_disable(PciAddress address) {
+	uint8_t cap = pci_find_capability(address, PCI_CAP_MSI);
+	if (cap == 0) {
+		return;
+	}
+
+	uint16_t control = pci_config_read16(address, cap + MSI_CONTROL);
+	pci_config_write16(
+		address, cap + MSI_CONTROL, control & ~MSI_CONTROL_ENABLE
+	);
+}
+
+bool pci_msix_table(
+	PciAddress address, uint64_t *table_phys, uint16_t *entries
+) {
+	uint8_t cap = pci_find_capability(address, PCI_CAP_MSIX);
+	if (cap == 0) {
+		return false;
+	}
+
+	uint16_t control = pci_config_read16(address, cap + MSIX_CONTROL);
+	uint32_t table = pci_config_read32(address, cap + MSIX_TABLE);
+
+	*table_phys = pci_bar_address(address, table & MSIX_TABLE_BIR) +
+				  (table & ~MSIX_TABLE_BIR);
+	*entries = (control & MSIX_CONTROL_TABLE_SIZE) + 1;
+	return true;
+}
+
+void pci_msix_set_enabled(PciAddress address, bool enabled) {
+	uint8_t cap = pci_find_capability(address, PCI_CAP_MSIX);
+	if (cap == 0) {
+		return;
+	}
+
+	uint16_t control = pci_config_read16(address, cap + MSIX_CONTROL);
+	control &= ~MSIX_CONTROL_MASK_ALL;
+	if (enabled) {
+		control |= MSIX_CONTROL_ENABLE;
+	} else {
+		control &= ~MSIX_CONTROL_ENABLE;
+	}
+	pci_config_write16(address, cap + MSIX_CONTROL, control);
+
+	if (enabled) {
+		pci_intx_disable(address);
+	}
+}
+
+void pci_msix_write_entry(
+	volatile void *table, uint16_t index, MsiMessage message, bool masked
+) {
+	volatile uint32_t *entry =
+		(volatile uint32_t *)((volatile uint8_t *)table +
+							  index * PCI_MSIX_ENTRY_SIZE);
+
+	// Mask while the entry is inconsistent
+	entry[MSIX_ENTRY_VECTOR_CONTROL / 4] = MSIX_ENTRY_MASKED;
+	entry[0] = (uint32_t)message.address;
+	entry[1] = (uint32_t)(message.address >> 32);
+	entry[2] = message.data;
+	entry[MSIX_ENTRY_VECTOR_CONTROL / 4] = masked ? MSIX_ENTRY_MASKED : 0;
+}
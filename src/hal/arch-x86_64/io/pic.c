@@ -0,0 +1,47 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <hal/hal_logger.h>
+#include <hal/pic.h>
+#include <hal/serial.h>
+
+#define PIC1_COMMAND 0x20
+#define PIC1_DATA 0x21
+#define PIC2_COMMAND 0xA0
+#define PIC2_DATA 0xA1
+
+#define PIC_ICW1_INIT 0x10
+#define PIC_ICW1_ICW4 0x01
+#define PIC_ICW4_8086 0x01
+
+/**
+ * Any write to an unused port takes long enough for the PIC to settle between
+ * initialization words
+ */
+static inline void pic_io_wait() { write_byte(0x80, 0); }
+
+void pic_disable() {
+	// Even masked, the PICs need sane vectors for spurious interrupts
+	write_byte(PIC1_COMMAND, PIC_ICW1_INIT | PIC_ICW1_ICW4);
+	pic_io_wait();
+	write_byte(PIC2_COMMAND, PIC_ICW1_INIT | PIC_ICW1_ICW4);
+	pic_io_wait();
+	write_byte(PIC1_DATA, PIC_VECTOR_BASE);
+	pic_io_wait();
+	write_byte(PIC2_DATA, PIC_VECTOR_BASE + 8);
+	pic_io_wait();
+	write_byte(PIC1_DATA, 1 << 2); // Slave on IRQ 2
+	pic_io_wait();
+	write_byte(PIC2_DATA, 2); // Cascade identity
+	pic_io_wait();
+	write_byte(PIC1_DATA, PIC_ICW4_8086);
+	pic_io_wait();
+	write_byte(PIC2_DATA, PIC_ICW4_8086);
+	pic_io_wait();
+
+	write_byte(PIC1_DATA, 0xFF);
+	write_byte(PIC2_DATA, 0xFF);
+
+	log_message(&hal_logger, LOG_INFO, "pic", "Legacy PICs masked\n");
+}
@@ -0,0 +1,36 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <hal/pit.h>
+#include <hal/serial.h>
+
+#define PIT_CHANNEL2 0x42
+#define PIT_COMMAND 0x43
+#define PIT_GATE 0x61
+
+#define PIT_GATE_ENABLE (1 << 0)
+#define PIT_GATE_SPEAKER (1 << 1)
+#define PIT_GATE_OUTPUT (1 << 5)
+
+void pit_oneshot_start(uint32_t microseconds) {
+	uint32_t count = (uint32_t)(((uint64_t)PIT_FREQUENCY * microseconds) /
+								1000000);
+	if (count > 0xFFFF) {
+		count = 0xFFFF;
+	}
+
+	// Gate low, speaker off, so the counter does not start yet
+	uint8_t gate = read_byte(PIT_GATE) & ~(PIT_GATE_ENABLE | PIT_GATE_SPEAKER);
+	write_byte(PIT_GATE, gate);
+
+	// Channel 2, lobyte/hibyte, mode 0 (interrupt on terminal count)
+	write_byte(PIT_COMMAND, 0xB0);
+	write_byte(PIT_CHANNEL2, count & 0xFF);
+	write_byte(PIT_CHANNEL2, (count >> 8) & 0xFF);
+
+	// Raise the gate to start counting
+	write_byte(PIT_GATE, gate | PIT_GATE_ENABLE);
+}
+
+bool pit_oneshot_expired() { return (read_byte(PIT_GATE) & PIT_GATE_OUTPUT); }
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libk/irqsoff.h>
+
+/**
+ * Model specific registers used by the kernel
+ */
+#define MSR_APIC_BASE 0x1B
+#define MSR_TSC_DEADLINE 0x6E0
+#define MSR_EFER 0xC0000080
+#define MSR_STAR 0xC0000081
+#define MSR_LSTAR 0xC0000082
+#define MSR_SFMASK 0xC0000084
+#define MSR_FS_BASE 0xC0000100
+#define MSR_GS_BASE 0xC0000101
+#define MSR_KERNEL_GS_BASE 0xC0000102
+#define MSR_TSC_AUX 0xC0000103
+
+/**
+ * CPUID leaf 0x1 feature bits
+ */
+#define CPUID_1_ECX_MONITOR (1 << 3)
+#define CPUID_1_ECX_X2APIC (1 << 21)
+#define CPUID_1_ECX_TSC_DEADLINE (1 << 24)
+#define CPUID_1_EDX_APIC (1 << 9)
+
+/**
+ * CPUID leaf 0x5 (MONITOR/MWAIT). EDX holds the number of MWAIT sub-states of
+ * C-state n in bits 4n to 4n + 3.
+ */
+#define CPUID_5_ECX_EXTENSIONS (1 << 0)
+#define CPUID_5_ECX_INTERRUPT_BREAK (1 << 1)
+#define CPUID_5_EDX_SUBSTATES(edx, n) (((edx) >> ((n) * 4)) & 0xF)
+
+/**
+ * CPUID leaf 0x7 and 0x80000001 feature bits, both read MSR_TSC_AUX from
+ * ring 3
+ */
+#define CPUID_7_ECX_RDPID (1 << 22)
+#define CPUID_80000001_EDX_RDTSCP (1 << 27)
+
+/**
+ * EFER bits
+ */
+#define EFER_SCE (1 << 0)
+
+/**
+ * RFLAGS bits: trap, interrupt enable, direction and alignment check
+ */
+#define RFLAGS_TF (1 << 8)
+#define RFLAGS_IF (1 << 9)
+#define RFLAGS_DF (1 << 10)
+#define RFLAGS_AC (1 << 18)
+
+/**
+ * Result registers of the CPUID instruction
+ */
+typedef struct {
+	uint32_t eax;
+	uint32_t ebx;
+	uint32_t ecx;
+	uint32_t edx;
+} CpuidResult;
+
+/**
+ * Execute CPUID for the given leaf and subleaf
+ *
+ * @param leaf Value loaded into EAX
+ * @param subleaf Value loaded into ECX
+ * @return The values of EAX, EBX, ECX and EDX after CPUID
+ */
+static inline CpuidResult cpuid(uint32_t leaf, uint32_t subleaf) {
+	CpuidResult r;
+	asm volatile("cpuid"
+				 : "=a"(r.eax), "=b"(r.ebx), "=c"(r.ecx), "=d"(r.edx)
+				 : "a"(leaf), "c"(subleaf));
+	return r;
+}
+
+/**
+ * Read a model specific register
+ *
+ * @param msr The MSR index
+ * @return The 64-bit MSR value
+ */
+static inline uint64_t rdmsr(uint32_t msr) {
+	uint32_t low, high;
+	asm volatile("rdmsr" : "=a"(low), "=d"(high) : "c"(msr));
+	return ((uint64_t)high << 32) | low;
+}
+
+/**
+ * Write a model specific register
+ *
+ * @param msr The MSR index
+ * @param value The 64-bit value to write
+ */
+static inline void wrmsr(uint32_t msr, uint64_t value) {
+	asm volatile("wrmsr"
+				 :
+				 : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32))
+				 : "memory");
+}
+
+/**
+ * Read the time stamp counter. Not serializing, so it may be reordered with
+ * surrounding instructions.
+ */
+static inline uint64_t rdtsc() {
+	uint32_t low, high;
+	asm volatile("rdtsc" : "=a"(low), "=d"(high));
+	return ((uint64_t)high << 32) | low;
+}
+
+/**
+ * Read the time stamp counter after every earlier instruction has finished
+ * and before any later one starts, for the bounds of a timed region. LFENCE
+ * rather than RDTSCP, which not every CPU model QEMU emulates has.
+ */
+static inline uint64_t rdtsc_serialized() {
+	uint32_t low, high;
+	asm volatile("lfence\n"
+				 "rdtsc\n"
+				 "lfence"
+				 : "=a"(low), "=d"(high)
+				 :
+				 : "memory");
+	return ((uint64_t)high << 32) | low;
+}
+
+/**
+ * Spin-wait hint for busy loops
+ */
+static inline void cpu_relax() { asm volatile("pause" ::: "memory"); }
+
+/**
+ * Read the RFLAGS register
+ */
+static inline uint64_t read_rflags() {
+	uint64_t rflags;
+	asm volatile("pushfq\n"
+				 "popq %0"
+				 : "=r"(rflags)
+				 :
+				 : "memory");
+	return rflags;
+}
+
+/**
+ * Returns true if maskable interrupts are enabled on this CPU
+ */
+static inline bool interrupts_enabled() {
+	return (read_rflags() & RFLAGS_IF) != 0;
+}
+
+/**
+ * Disables interrupts and returns the previous RFLAGS so the caller can
+ * restore the interrupt state with interrupts_restore. A macro so the irqs-off
+ * tracer charges the section to the caller.
+ */
+#define interrupts_save_disable() irqsoff_save(IRQSOFF_SITE())
+
+/**
+ * Re-enables interrupts if they were enabled when the matching
+ * interrupts_save_disable was called
+ *
+ * @param rflags The value returned by interrupts_save_disable
+ */
+static inline void interrupts_restore(uint64_t rflags) {
+	irqsoff_restore(rflags);
+}
+
+/**
+ * Disables interrupts, for code that knows they are enabled
+ */
+#define interrupts_disable() irqsoff_disable(IRQSOFF_SITE())
+
+/**
+ * Enables interrupts unconditionally
+ */
+static inline void interrupts_enable() { irqsoff_enable(); }
+
+/**
+ * Enables interrupts and halts until the next one. sti only takes effect
+ * after the following instruction, so an interrupt cannot slip in between.
+ */
+static inline void interrupts_enable_halt() {
+	irqsoff_end();
+	asm volatile("sti; hlt" ::: "memory");
+}
+
+/**
+ * Arms address monitoring for the cache line containing address. A write to
+ * the line by any CPU ends the next interrupts_enable_mwait.
+ */
+static inline void cpu_monitor(const volatile void *address) {
+	asm volatile("monitor" : : "a"(address), "c"(0), "d"(0) : "memory");
+}
+
+/**
+ * Enables interrupts and waits in MWAIT until the monitored line is written
+ * or an interrupt arrives. Like sti; hlt, nothing can slip in between.
+ *
+ * @param hint Target C-state in bits 7:4 (minus one), sub-state in bits 3:0
+ */
+static inline void interrupts_enable_mwait(uint32_t hint) {
+	irqsoff_end();
+	asm volatile("sti; mwait" : : "a"(hint), "c"(0) : "memory");
+}
+
+/**
+ * Per-CPU state owned by the HAL. The kernel embeds it in its own per-CPU
+ * structure at HAL_CPU_OFFSET from the GS base.
+ */
+typedef struct {
+	/**
+	 * Timer LVT value currently programmed into this CPU's local APIC
+	 */
+	uint32_t lapic_timer_lvt;
+} HalCpu;
+
+#define HAL_CPU_OFFSET 8
+
+/**
+ * Returns the HAL per-CPU state of the calling CPU
+ */
+static inline HalCpu *hal_cpu() {
+	uintptr_t base;
+	asm volatile("movq %%gs:0, %0" : "=r"(base));
+	return (HalCpu *)(base + HAL_CPU_OFFSET);
+}
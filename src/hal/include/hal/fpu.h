@@ -0,0 +1,102 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Control register bits used for FPU management
+ */
+#define CR0_MP (1 << 1)
+#define CR0_EM (1 << 2)
+#define CR0_TS (1 << 3)
+#define CR0_NE (1 << 5)
+#define CR4_OSFXSR (1 << 9)
+#define CR4_OSXMMEXCPT (1 << 10)
+#define CR4_OSXSAVE (1 << 18)
+
+/**
+ * XCR0 state components
+ */
+#define XFEATURE_X87 (1 << 0)
+#define XFEATURE_SSE (1 << 1)
+#define XFEATURE_AVX (1 << 2)
+#define XFEATURE_OPMASK (1 << 5)
+#define XFEATURE_ZMM_HI256 (1 << 6)
+#define XFEATURE_HI16_ZMM (1 << 7)
+
+/**
+ * Alignment required for FPU state save areas
+ */
+#define FPU_STATE_ALIGN 64
+
+/**
+ * Instruction pair used to save and restore FPU/SIMD state, best first
+ */
+typedef enum {
+	/**
+	 * XSAVES/XRSTORS: compacted format, only saves components that are in use
+	 * and modified since the last restore
+	 */
+	FPU_SAVE_XSAVES,
+	/**
+	 * XSAVEOPT/XRSTOR: standard format with the init and modified
+	 * optimizations
+	 */
+	FPU_SAVE_XSAVEOPT,
+	FPU_SAVE_XSAVE,
+	FPU_SAVE_FXSAVE,
+} FpuSaveMode;
+
+/**
+ * Enables the FPU, SSE and every AVX state the CPU supports on the calling CPU.
+ * The first call also picks the save instructions and the state size.
+ */
+void fpu_initialize();
+
+/**
+ * Returns the size of a state save area in bytes
+ */
+size_t fpu_state_size();
+
+/**
+ * Returns the instructions used to save and restore state
+ */
+FpuSaveMode fpu_save_mode();
+
+/**
+ * Fills a save area with the initial FPU state. Restoring it puts every
+ * component in its init state without touching the rest of the area.
+ *
+ * @param area Save area of fpu_state_size() bytes, FPU_STATE_ALIGN aligned
+ */
+void fpu_init_state(void *area);
+
+/**
+ * Saves the FPU/SIMD registers of the calling CPU
+ *
+ * @param area Save area, FPU_STATE_ALIGN aligned
+ */
+void fpu_save(void *area);
+
+/**
+ * Loads the FPU/SIMD registers of the calling CPU
+ *
+ * @param area Save area written by fpu_save or fpu_init_state
+ */
+void fpu_restore(void *area);
+
+/**
+ * Allows FPU/SIMD instructions (clears CR0.TS)
+ */
+static inline void fpu_enable() { asm volatile("clts" ::: "memory"); }
+
+/**
+ * Makes the next FPU/SIMD instruction raise a device-not-available exception
+ * (sets CR0.TS)
+ */
+static inline void fpu_disable() {
+	uint64_t cr0;
+	asm volatile("mov %%cr0, %0" : "=r"(cr0));
+	asm volatile("mov %0, %%cr0" ::"r"(cr0 | CR0_TS) : "memory");
+}
@@ -4,6 +4,17 @@
 #include <stdint.h>
 
 #define GDT_ENTRIES 7
+
+/**
+ * Segment selectors. SYSCALL loads CS and SS from STAR[47:32] (kernel code,
+ * then kernel data), SYSRET from STAR[63:48] + 16 and + 8 (user code and
+ * user data), so the user data segment comes first.
+ */
+#define GDT_KERNEL_CODE 0x08
+#define GDT_KERNEL_DATA 0x10
+#define GDT_USER_DATA (0x18 | 3)
+#define GDT_USER_CODE (0x20 | 3)
+#define GDT_TSS 0x28
 #define SEGMENT_BASE 0x0
 #define SEGMENT_LIMIT 0xFFFFF
 
@@ -68,6 +79,35 @@ GdtSegmentDescriptor gdt_create_segment_descriptor(
  */
 void gdt_initialize(uintptr_t kernel_stack_ptr);
 
+/**
+ * GDT and TSS of one CPU, embedded in the kernel's per-CPU data
+ */
+typedef struct {
+	GdtSegmentDescriptor gdt[GDT_ENTRIES];
+	GDTR gdtr;
+	TssSegmentDescriptor tss;
+} __attribute__((aligned(16))) GdtCpu;
+
+/**
+ * Gives the calling CPU its own copy of the GDT built by gdt_initialize and
+ * its own TSS, and loads both. Reloads the segment registers, which clears
+ * the GS base.
+ *
+ * @param tables Storage of the CPU's tables, must stay valid
+ * @param kernel_stack_ptr Initial stack for entries from ring 3
+ */
+void gdt_install_cpu(GdtCpu *tables, uintptr_t kernel_stack_ptr);
+
+/**
+ * Sets the stack the CPU switches to on an interrupt or exception from ring
+ * 3, called whenever another thread starts running
+ */
+static inline void gdt_set_kernel_stack(
+	GdtCpu *tables, uintptr_t kernel_stack_ptr
+) {
+	tables->tss.rsp[0] = kernel_stack_ptr;
+}
+
 /**
  * Calls the LGDT instruction with the given GDTR
  *
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Size of the HPET register block
+ */
+#define HPET_MMIO_SIZE 0x400
+
+/**
+ * Enables the HPET main counter
+ *
+ * @param mmio_base Virtual address of the (mapped) HPET register block
+ */
+void hpet_initialize(uintptr_t mmio_base);
+
+/**
+ * Returns true if an HPET has been initialized
+ */
+bool hpet_available();
+
+/**
+ * Returns the period of the main counter in femtoseconds
+ */
+uint64_t hpet_period_fs();
+
+/**
+ * Reads the main counter
+ */
+uint64_t hpet_read_counter();
@@ -81,6 +81,11 @@ void idt_set_entry(int index, void *handler);
  */
 void idt_initialize();
 
+/**
+ * Loads the IDT built by idt_initialize on an application processor
+ */
+void idt_install_ap();
+
 /**
  * Calls the LIDT instruction with the given IDTR
  *
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Maximum number of IOAPICs supported
+ */
+#define IOAPIC_MAX 8
+
+/**
+ * Size of the IOAPIC register window
+ */
+#define IOAPIC_MMIO_SIZE 0x20
+
+/**
+ * Redirection entry flags
+ */
+#define IOAPIC_ACTIVE_LOW (1 << 13)
+#define IOAPIC_LEVEL_TRIGGERED (1 << 15)
+#define IOAPIC_MASKED (1 << 16)
+
+/**
+ * Adds an IOAPIC and masks all of its inputs
+ *
+ * @param id IOAPIC ID from the MADT
+ * @param mmio_base Virtual address of the (mapped) register window
+ * @param gsi_base First global system interrupt handled by this IOAPIC
+ * @return false if there are too many IOAPICs
+ */
+bool ioapic_register(uint8_t id, uintptr_t mmio_base, uint32_t gsi_base);
+
+/**
+ * Returns true if some IOAPIC handles the global system interrupt
+ */
+bool ioapic_has_gsi(uint32_t gsi);
+
+/**
+ * Programs the redirection entry of a global system interrupt. The entry is
+ * left masked, see ioapic_unmask.
+ *
+ * @param gsi Global system interrupt
+ * @param vector Vector raised on the destination CPU
+ * @param apic_id APIC ID of the destination CPU, must fit in 8 bits (there is
+ *                no interrupt remapping)
+ * @param flags IOAPIC_ACTIVE_LOW and IOAPIC_LEVEL_TRIGGERED
+ * @return false if no IOAPIC handles the GSI or the APIC ID is too large
+ */
+bool ioapic_route(
+	uint32_t gsi, uint8_t vector, uint32_t apic_id, uint32_t flags
+);
+
+/**
+ * Stops a global system interrupt from being delivered
+ */
+void ioapic_mask(uint32_t gsi);
+
+/**
+ * Allows a routed global system interrupt to be delivered
+ */
+void ioapic_unmask(uint32_t gsi);
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Default physical address of the local APIC register page
+ */
+#define LAPIC_DEFAULT_BASE 0xFEE00000
+
+/**
+ * Interrupt vectors owned by the local APIC
+ */
+#define LAPIC_TIMER_VECTOR 0xF0
+#define LAPIC_SPURIOUS_VECTOR 0xFF
+
+/**
+ * Local APIC register offsets (xAPIC MMIO layout, x2APIC uses MSR 0x800 +
+ * offset / 16)
+ */
+#define LAPIC_REG_ID 0x020
+#define LAPIC_REG_VERSION 0x030
+#define LAPIC_REG_TPR 0x080
+#define LAPIC_REG_EOI 0x0B0
+#define LAPIC_REG_SVR 0x0F0
+#define LAPIC_REG_ESR 0x280
+#define LAPIC_REG_ICR_LOW 0x300
+#define LAPIC_REG_ICR_HIGH 0x310
+#define LAPIC_REG_LVT_TIMER 0x320
+#define LAPIC_REG_LVT_LINT0 0x350
+#define LAPIC_REG_LVT_LINT1 0x360
+#define LAPIC_REG_LVT_ERROR 0x370
+#define LAPIC_REG_TIMER_INITIAL 0x380
+#define LAPIC_REG_TIMER_CURRENT 0x390
+#define LAPIC_REG_TIMER_DIVIDE 0x3E0
+
+/**
+ * ICR bits
+ */
+#define LAPIC_ICR_DELIVERY_PENDING (1 << 12)
+#define LAPIC_ICR_LEVEL_ASSERT (1 << 14)
+
+/**
+ * LVT bits
+ */
+#define LAPIC_LVT_DELIVERY_NMI (4 << 8)
+#define LAPIC_LVT_ACTIVE_LOW (1 << 13)
+#define LAPIC_LVT_LEVEL_TRIGGERED (1 << 15)
+#define LAPIC_LVT_MASKED (1 << 16)
+#define LAPIC_TIMER_MODE_ONESHOT (0 << 17)
+#define LAPIC_TIMER_MODE_PERIODIC (1 << 17)
+#define LAPIC_TIMER_MODE_TSC_DEADLINE (2 << 17)
+
+/**
+ * Timer divide configuration value for divide-by-16
+ */
+#define LAPIC_TIMER_DIVIDE_16 0x3
+
+/**
+ * Enables the local APIC of the calling CPU. Uses x2APIC mode when the CPU
+ * supports it, otherwise the xAPIC register page at the given address. The
+ * per-CPU area (see hal_cpu) must be installed first.
+ *
+ * @param mmio_base Virtual address of the xAPIC register page
+ */
+void lapic_initialize(uintptr_t mmio_base);
+
+/**
+ * Returns true if the local APIC is running in x2APIC mode
+ */
+bool lapic_is_x2apic();
+
+/**
+ * Returns true if the local APIC timer supports TSC-deadline mode
+ */
+bool lapic_has_tsc_deadline();
+
+/**
+ * Read a local APIC register
+ *
+ * @param reg Register offset (LAPIC_REG_*)
+ */
+uint32_t lapic_read(uint32_t reg);
+
+/**
+ * Write a local APIC register
+ *
+ * @param reg Register offset (LAPIC_REG_*)
+ * @param value Value to write
+ */
+void lapic_write(uint32_t reg, uint32_t value);
+
+/**
+ * Returns the APIC ID of the calling CPU
+ */
+uint32_t lapic_id();
+
+/**
+ * Signal end of interrupt to the local APIC
+ */
+void lapic_eoi();
+
+/**
+ * Sends a fixed interrupt to another CPU
+ *
+ * @param apic_id APIC ID of the target CPU
+ * @param vector Interrupt vector to raise on the target
+ */
+void lapic_send_ipi(uint32_t apic_id, uint8_t vector);
+
+/**
+ * Stops the local APIC timer and masks its interrupt
+ */
+void lapic_timer_stop();
+
+/**
+ * Starts the timer counting down from the maximum count with its interrupt
+ * masked. Used to measure the timer frequency against a reference clock.
+ */
+void lapic_timer_calibration_start();
+
+/**
+ * Returns the current count of the local APIC timer
+ */
+uint32_t lapic_timer_current_count();
+
+/**
+ * Arms the timer to fire once after the given number of timer ticks
+ *
+ * @param count Number of (divided) timer ticks
+ */
+void lapic_timer_oneshot(uint32_t count);
+
+/**
+ * Starts the timer in periodic mode
+ *
+ * @param count Number of (divided) timer ticks between interrupts
+ */
+void lapic_timer_periodic(uint32_t count);
+
+/**
+ * Arms the timer in TSC-deadline mode. Writing a deadline of zero disarms it.
+ *
+ * @param deadline Absolute TSC value at which the timer fires
+ */
+void lapic_timer_deadline(uint64_t deadline);
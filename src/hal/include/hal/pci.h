@@ -0,0 +1,121 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Configuration space registers used by the kernel
+ */
+#define PCI_REG_VENDOR_ID 0x00
+#define PCI_REG_COMMAND 0x04
+#define PCI_REG_STATUS 0x06
+#define PCI_REG_BAR0 0x10
+#define PCI_REG_CAPABILITIES 0x34
+
+#define PCI_COMMAND_INTX_DISABLE (1 << 10)
+#define PCI_STATUS_CAPABILITIES (1 << 4)
+
+/**
+ * Capability IDs
+ */
+#define PCI_CAP_MSI 0x05
+#define PCI_CAP_MSIX 0x11
+
+/**
+ * Size of an MSI-X table entry
+ */
+#define PCI_MSIX_ENTRY_SIZE 16
+
+/**
+ * Location of a PCI function
+ */
+typedef struct {
+	uint8_t bus;
+	uint8_t device;
+	uint8_t function;
+} PciAddress;
+
+/**
+ * Address and data a device writes to raise a message signalled interrupt
+ */
+typedef struct {
+	uint64_t address;
+	uint32_t data;
+} MsiMessage;
+
+/**
+ * Read and write configuration space through the legacy 0xCF8/0xCFC ports.
+ * Offsets must be naturally aligned.
+ */
+uint32_t pci_config_read32(PciAddress address, uint16_t offset);
+uint16_t pci_config_read16(PciAddress address, uint16_t offset);
+void pci_config_write32(PciAddress address, uint16_t offset, uint32_t value);
+void pci_config_write16(PciAddress address, uint16_t offset, uint16_t value);
+
+/**
+ * Finds a capability in the function's capability list
+ *
+ * @param id Capability ID (PCI_CAP_*)
+ * @return Configuration space offset of the capability, or 0 if absent
+ */
+uint8_t pci_find_capability(PciAddress address, uint8_t id);
+
+/**
+ * Returns the physical address a memory BAR points to, combining both halves
+ * of a 64-bit BAR
+ *
+ * @param bar BAR index, 0 to 5
+ * @return The address, or 0 for I/O BARs
+ */
+uint64_t pci_bar_address(PciAddress address, uint8_t bar);
+
+/**
+ * Builds the message that raises a fixed, edge-triggered interrupt
+ *
+ * @param apic_id Destination CPU, must fit in 8 bits (there is no interrupt
+ *                remapping)
+ * @param vector Vector raised on the destination
+ */
+MsiMessage msi_message(uint32_t apic_id, uint8_t vector);
+
+/**
+ * Programs and enables MSI with a single vector, and disables legacy INTx
+ *
+ * @return false if the function has no MSI capability
+ */
+bool pci_msi_enable(PciAddress address, MsiMessage message);
+
+/**
+ * Disables MSI
+ */
+void pci_msi_disable(PciAddress address);
+
+/**
+ * Describes the MSI-X table of a function
+ *
+ * @param table_phys Receives the physical address of the table
+ * @param entries Receives the number of table entries
+ * @return false if the function has no MSI-X capability
+ */
+bool pci_msix_table(
+	PciAddress address, uint64_t *table_phys, uint16_t *entries
+);
+
+/**
+ * Enables or disables MSI-X for the whole function. Enabling also disables
+ * legacy INTx.
+ */
+void pci_msix_set_enabled(PciAddress address, bool enabled);
+
+/**
+ * Writes an MSI-X table entry
+ *
+ * @param table Virtual address of the (mapped) table
+ * @param index Entry to write
+ * @param message Message the entry sends
+ * @param masked Whether the entry stays masked
+ */
+void pci_msix_write_entry(
+	volatile void *table, uint16_t index, MsiMessage message, bool masked
+);
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Vectors the legacy PICs are remapped to. They are masked, but a spurious
+ * IRQ 7 or 15 can still arrive and must not be mistaken for an exception.
+ */
+#define PIC_VECTOR_BASE 0x20
+#define PIC_VECTOR_COUNT 16
+
+/**
+ * Remaps the legacy 8259 PICs away from the exception vectors and masks all of
+ * their inputs, so only the IOAPIC delivers device interrupts
+ */
+void pic_disable();
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Input frequency of the 8253/8254 programmable interval timer
+ */
+#define PIT_FREQUENCY 1193182
+
+/**
+ * Starts PIT channel 2 counting down for the given number of microseconds.
+ * Channel 2 is gated through port 0x61 and does not raise an interrupt, so
+ * this can be used as a polled reference clock with interrupts disabled.
+ *
+ * @param microseconds Duration, at most ~54ms (16-bit counter)
+ */
+void pit_oneshot_start(uint32_t microseconds);
+
+/**
+ * Returns true once the countdown started by pit_oneshot_start has expired
+ */
+bool pit_oneshot_expired();
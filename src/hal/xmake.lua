@@ -7,6 +7,9 @@ target("hal")
     add_deps("libk")
     add_deps("logger")
 
+    -- Runs in kernel and interrupt context, see the kernel target
+    add_cxflags("-mgeneral-regs-only")
+
     add_ldflags("-T$(projectdir)/meta/linker.ld", { force = true })
     add_ldflags("-pie", { force = true })
     add_ldflags("-z text", { force = true })
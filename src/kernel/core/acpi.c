@@ -0,0 +1,91 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libk/string.h>
+
+#include <kernel/acpi.h>
+#include <kernel/debug.h>
+#include <kernel/paging.h>
+
+static AcpiSdtHeader *root_table;
+static bool root_is_xsdt;
+
+static bool acpi_checksum_valid(const void *table, size_t length) {
+	const uint8_t *bytes = (const uint8_t *)table;
+	uint8_t sum = 0;
+
+	for (size_t i = 0; i < length; i++) {
+		sum += bytes[i];
+	}
+
+	return sum == 0;
+}
+
+void acpi_initialize(void *rsdp_address) {
+	AcpiRsdp *rsdp = (AcpiRsdp *)rsdp_address;
+
+	if (rsdp == NULL || memcmp(rsdp->signature, "RSD PTR ", 8) != 0) {
+		log_message(
+			&kernel_debug_logger, LOG_ERROR, "acpi", "No valid RSDP found\n"
+		);
+		return;
+	}
+
+	if (rsdp->revision >= 2 && rsdp->xsdt_address != 0) {
+		root_table = phys_to_virt(rsdp->xsdt_address, paging_hhdm_offset());
+		root_is_xsdt = true;
+	} else {
+		root_table = phys_to_virt(rsdp->rsdt_address, paging_hhdm_offset());
+		root_is_xsdt = false;
+	}
+
+	if (!acpi_checksum_valid(root_table, root_table->length)) {
+		log_message(
+			&kernel_debug_logger,
+			LOG_ERROR,
+			"acpi",
+			"Root table checksum mismatch\n"
+		);
+		root_table = NULL;
+		return;
+	}
+
+	log_message(
+		&kernel_debug_logger,
+		LOG_INFO,
+		"acpi",
+		"Found root table {type=%s, revision=%d}\n",
+		root_is_xsdt ? "XSDT" : "RSDT",
+		rsdp->revision
+	);
+}
+
+void *acpi_find_table(const char *signature) {
+	if (root_table == NULL) {
+		return NULL;
+	}
+
+	size_t entry_size = root_is_xsdt ? sizeof(uint64_t) : sizeof(uint32_t);
+	size_t entries = (root_table->length - sizeof(AcpiSdtHeader)) / entry_size;
+	uint8_t *entry_base = (uint8_t *)root_table + sizeof(AcpiSdtHeader);
+
+	for (size_t i = 0; i < entries; i++) {
+		uint64_t phys;
+		if (root_is_xsdt) {
+			memcpy(&phys, entry_base + i * entry_size, sizeof(uint64_t));
+		} else {
+			uint32_t phys32;
+			memcpy(&phys32, entry_base + i * entry_size, sizeof(uint32_t));
+			phys = phys32;
+		}
+
+		AcpiSdtHeader *table = phys_to_virt(phys, paging_hhdm_offset());
+		if (memcmp(table->signature, signature, 4) == 0 &&
+			acpi_checksum_valid(table, table->length)) {
+			return table;
+		}
+	}
+
+	return NULL;
+}
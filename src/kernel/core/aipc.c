@@ -0,0 +1,422 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libk/spinlock.h>
+#include <libk/string.h>
+
+#include <kernel/aipc.h>
+#include <kernel/debug.h>
+#include <kernel/handle.h>
+#include <kernel/kobject.h>
+#include <kernel/paging.h>
+#include <kernel/pin.h>
+#include <kernel/pmm.h>
+#include <kernel/thread.h>
+
+static bool aipc_user_range(uint64_t address, uint64_t length) {
+	return address + length >= address && address + length <= PAGING_USER_END;
+}
+
+/**
+ * Looks up a channel handle and takes a reference, or returns NULL
+ */
+static AipcChannel *aipc_channel_get(uint32_t handle) {
+	return (AipcChannel *)handle_get(
+		handle_table_current(), handle, KOBJECT_AIPC_CHANNEL
+	);
+}
+
+static void aipc_channel_put(AipcChannel *channel) {
+	kobject_put(&channel->object);
+}
+
+/**
+ * Unmaps the first size bytes of a channel's user mapping, leaving the frames
+ * to the channel's memory block
+ */
+static void aipc_unmap(uintptr_t base, size_t size) {
+	for (size_t offset = 0; offset < size; offset += PAGE_SIZE) {
+		uintptr_t frame;
+		paging_unmap_pages(base + offset, 1, &frame);
+	}
+}
+
+/**
+ * Wakes the receivers, they find the channel closed. User space loses the
+ * queues here, the kernel keeps them until the last reference is dropped.
+ */
+static void aipc_close(KObject *object) {
+	AipcChannel *channel = (AipcChannel *)object;
+
+	aipc_unmap(channel->user_address, channel->size);
+
+	for (uint32_t i = 0; i < 2; i++) {
+		AipcChannelQueue *queue = &channel->queues[i];
+		uint64_t rflags = ticket_lock_acquire_irqsave(&queue->lock);
+		channel->closed = true;
+		Thread *waiter = queue->waiter;
+		queue->waiter = NULL;
+		ticket_lock_release_irqrestore(&queue->lock, rflags);
+
+		if (waiter != NULL) {
+			thread_wake(waiter);
+		}
+	}
+}
+
+/**
+ * Frees the channel and its queues. Pages still in flight are left alone:
+ * they are user memory of unknown origin, a frame may belong to a larger
+ * block that is still in use.
+ */
+static void aipc_release(KObject *object) {
+	AipcChannel *channel = (AipcChannel *)object;
+
+	pmm_free((uintptr_t)channel->header);
+	pmm_free((uintptr_t)channel);
+}
+
+static const KObjectOps aipc_ops = {
+	.close = aipc_close,
+	.release = aipc_release,
+};
+
+int64_t aipc_create(void *address, uint32_t entries) {
+	uintptr_t base = (uintptr_t)address;
+
+	if (entries == 0 || entries > AIPC_MAX_ENTRIES ||
+		(entries & (entries - 1)) != 0 || (base & (PAGE_SIZE - 1)) != 0) {
+		return SYSCALL_ERROR_INVALID_ARGS;
+	}
+
+	// Header page, then the messages of queue 0 and those of queue 1
+	size_t queue_size = entries * sizeof(AipcMessage);
+	size_t size = PAGE_SIZE + 2 * queue_size;
+	size = (size + PAGE_SIZE - 1) & ~(size_t)(PAGE_SIZE - 1);
+	if (!aipc_user_range(base, size) || base + size > VDSO_DATA_ADDRESS) {
+		return SYSCALL_ERROR_INVALID_ARGS;
+	}
+
+	// Mapping over a page would leak its frame
+	for (size_t offset = 0; offset < size; offset += PAGE_SIZE) {
+		uintptr_t phys;
+		if (paging_translate(base + offset, &phys)) {
+			return SYSCALL_ERROR_INVALID_ARGS;
+		}
+	}
+
+	AipcChannel *channel = (AipcChannel *)pmm_alloc(sizeof(AipcChannel));
+	uintptr_t memory = pmm_alloc(size);
+	if (channel == NULL || memory == 0) {
+		if (channel != NULL) {
+			pmm_free((uintptr_t)channel);
+		}
+		if (memory != 0) {
+			pmm_free(memory);
+		}
+		return SYSCALL_ERROR_NO_MEMORY;
+	}
+	memset(channel, 0, sizeof(AipcChannel));
+	memset((void *)memory, 0, size);
+
+	size_t mapped = 0;
+	while (mapped < size &&
+		   paging_map_page(
+			   base + mapped,
+			   virt_to_phys((void *)(memory + mapped)),
+			   PAGE_PRESENT | PAGE_WRITABLE | PAGE_USER | PAGE_NO_EXECUTE
+		   )) {
+		mapped += PAGE_SIZE;
+	}
+
+	// Until the object is set up, failing is ours to clean up
+	if (mapped != size ||
+		!kobject_init(&channel->object, KOBJECT_AIPC_CHANNEL, &aipc_ops)) {
+		aipc_unmap(base, mapped);
+		pmm_free(memory);
+		pmm_free((uintptr_t)channel);
+		return SYSCALL_ERROR_NO_MEMORY;
+	}
+
+	// Like rings, the kernel goes through the direct map
+	channel->header = (AipcHeader *)memory;
+	channel->user_address = base;
+	channel->size = size;
+	for (uint32_t i = 0; i < 2; i++) {
+		AipcQueue *queue = &channel->header->queues[i];
+		queue->entries = entries;
+		queue->offset = PAGE_SIZE + i * queue_size;
+
+		channel->queues[i].queue = queue;
+		channel->queues[i].mask = entries - 1;
+		ticket_lock_init(&channel->queues[i].lock, "aipc_queue");
+	}
+	ticket_lock_init(&channel->transfer_lock, "aipc_transfer");
+
+	int64_t handle = handle_open(handle_table_current(), &channel->object);
+	if (handle < 0) {
+		kobject_kill(&channel->object);
+		return handle;
+	}
+
+	if (DEBUG) {
+		log_message(
+			&kernel_debug_logger,
+			LOG_INFO,
+			"aipc",
+			"Channel created {channel=0x%llx, address=%p, entries=%d}\n",
+			handle,
+			address,
+			entries
+		);
+	}
+
+	return handle;
+}
+
+static int64_t aipc_channel_wait(AipcChannel *channel, uint32_t endpoint) {
+	if (endpoint > 1) {
+		return SYSCALL_ERROR_INVALID_ARGS;
+	}
+
+	AipcChannelQueue *receive = &channel->queues[1 - endpoint];
+	AipcQueue *queue = receive->queue;
+	Thread *current = thread_current();
+
+	for (;;) {
+		uint64_t rflags = ticket_lock_acquire_irqsave(&receive->lock);
+
+		// Senders store the tail, then read the flags. Either they see the
+		// flag and ring the doorbell, or we see their messages here.
+		__atomic_fetch_or(&queue->flags, AIPC_WAITING, __ATOMIC_SEQ_CST);
+		uint32_t ready =
+			__atomic_load_n(&queue->index.tail, __ATOMIC_SEQ_CST) -
+			__atomic_load_n(&queue->index.head, __ATOMIC_ACQUIRE);
+
+		if (ready != 0) {
+			__atomic_fetch_and(&queue->flags, ~AIPC_WAITING, __ATOMIC_RELAXED);
+			ticket_lock_release_irqrestore(&receive->lock, rflags);
+
+			// User space owns the indexes, do not trust their distance
+			return ready <= receive->mask + 1 ? ready : receive->mask + 1;
+		}
+
+		if (channel->closed) {
+			__atomic_fetch_and(&queue->flags, ~AIPC_WAITING, __ATOMIC_RELAXED);
+			ticket_lock_release_irqrestore(&receive->lock, rflags);
+			return SYSCALL_ERROR_CANCELED;
+		}
+
+		// One receiver per queue
+		if (receive->waiter != NULL && receive->waiter != current) {
+			ticket_lock_release_irqrestore(&receive->lock, rflags);
+			return SYSCALL_ERROR_WOULD_BLOCK;
+		}
+
+		receive->waiter = current;
+		current->state = THREAD_BLOCKED;
+		ticket_lock_release_irqrestore(&receive->lock, rflags);
+
+		thread_block();
+	}
+}
+
+int64_t aipc_wait(uint32_t handle, uint32_t endpoint) {
+	AipcChannel *channel = aipc_channel_get(handle);
+	if (channel == NULL) {
+		return SYSCALL_ERROR_INVALID_ARGS;
+	}
+	int64_t result = aipc_channel_wait(channel, endpoint);
+	aipc_channel_put(channel);
+	return result;
+}
+
+static int64_t aipc_channel_notify(AipcChannel *channel, uint32_t endpoint) {
+	if (endpoint > 1) {
+		return SYSCALL_ERROR_INVALID_ARGS;
+	}
+
+	// Clearing the flag keeps the rest of the sender's batch from ringing
+	// again, the receiver sets it anew once it drained the queue
+	AipcChannelQueue *send = &channel->queues[endpoint];
+	uint64_t rflags = ticket_lock_acquire_irqsave(&send->lock);
+	Thread *waiter = send->waiter;
+	send->waiter = NULL;
+	__atomic_fetch_and(&send->queue->flags, ~AIPC_WAITING, __ATOMIC_RELAXED);
+	ticket_lock_release_irqrestore(&send->lock, rflags);
+
+	return waiter != NULL && thread_wake(waiter) ? 1 : 0;
+}
+
+int64_t aipc_notify(uint32_t handle, uint32_t endpoint) {
+	AipcChannel *channel = aipc_channel_get(handle);
+	if (channel == NULL) {
+		return SYSCALL_ERROR_INVALID_ARGS;
+	}
+	int64_t result = aipc_channel_notify(channel, endpoint);
+	aipc_channel_put(channel);
+	return result;
+}
+
+/*
+ * ============================================================================
+ * Page transfers
+ * ============================================================================
+ */
+
+/**
+ * Transfer ids are the slot in the low half and its generation in the high
+ * half
+ */
+static uint64_t aipc_transfer_id(uint32_t slot, uint32_t generation) {
+	return ((uint64_t)generation << 32) | slot;
+}
+
+static int64_t aipc_channel_give(
+	AipcChannel *channel, uintptr_t address, uint32_t count
+) {
+	if (count == 0 || count > AIPC_MAX_PAGES ||
+		(address & (PAGE_SIZE - 1)) != 0 ||
+		!aipc_user_range(address, count * PAGE_SIZE)) {
+		return SYSCALL_ERROR_INVALID_ARGS;
+	}
+
+	// A device may be writing to pinned frames, they stay where they are
+	uint64_t required = PAGE_PRESENT | PAGE_WRITABLE | PAGE_USER;
+	for (uint32_t i = 0; i < count; i++) {
+		uintptr_t phys;
+		uint64_t flags;
+		if (!paging_lookup(address + i * PAGE_SIZE, &phys, &flags) ||
+			(flags & required) != required) {
+			return SYSCALL_ERROR_INVALID_ARGS;
+		}
+		if (pin_frame_pinned(phys)) {
+			return SYSCALL_ERROR_WOULD_BLOCK;
+		}
+	}
+
+	// Reserve a slot first, unmapping waits for the other CPUs and cannot
+	// happen under the lock. Taking a reserved slot fails until it has pages.
+	uint64_t rflags = ticket_lock_acquire_irqsave(&channel->transfer_lock);
+	uint32_t slot = 0;
+	while (slot < AIPC_MAX_TRANSFERS && channel->transfers[slot].busy) {
+		slot++;
+	}
+	if (slot == AIPC_MAX_TRANSFERS) {
+		ticket_lock_release_irqrestore(&channel->transfer_lock, rflags);
+		return SYSCALL_ERROR_NO_MEMORY;
+	}
+	AipcTransfer *transfer = &channel->transfers[slot];
+	transfer->busy = true;
+	transfer->count = 0;
+	uint32_t generation = ++transfer->generation;
+	ticket_lock_release_irqrestore(&channel->transfer_lock, rflags);
+
+	uintptr_t frames[AIPC_MAX_PAGES];
+	bool unmapped = paging_unmap_pages(address, count, frames);
+
+	rflags = ticket_lock_acquire_irqsave(&channel->transfer_lock);
+	if (unmapped) {
+		memcpy(transfer->frames, frames, count * sizeof(uintptr_t));
+		transfer->count = count;
+	} else {
+		transfer->busy = false;
+	}
+	ticket_lock_release_irqrestore(&channel->transfer_lock, rflags);
+
+	if (!unmapped) {
+		return SYSCALL_ERROR_INVALID_ARGS;
+	}
+	return aipc_transfer_id(slot, generation);
+}
+
+int64_t aipc_give(uint32_t handle, uintptr_t address, uint32_t count) {
+	AipcChannel *channel = aipc_channel_get(handle);
+	if (channel == NULL) {
+		return SYSCALL_ERROR_INVALID_ARGS;
+	}
+	int64_t result = aipc_channel_give(channel, address, count);
+	aipc_channel_put(channel);
+	return result;
+}
+
+static int64_t aipc_channel_take(
+	AipcChannel *channel, uint64_t id, uintptr_t address
+) {
+	uint32_t slot = (uint32_t)id;
+	if (slot >= AIPC_MAX_TRANSFERS ||
+		(address & (PAGE_SIZE - 1)) != 0) {
+		return SYSCALL_ERROR_INVALID_ARGS;
+	}
+
+	// Claim the pages, a second take of the same id finds none
+	AipcTransfer *transfer = &channel->transfers[slot];
+	uint64_t rflags = ticket_lock_acquire_irqsave(&channel->transfer_lock);
+	uint32_t count = transfer->count;
+	if (!transfer->busy || count == 0 ||
+		transfer->generation != (uint32_t)(id >> 32)) {
+		ticket_lock_release_irqrestore(&channel->transfer_lock, rflags);
+		return SYSCALL_ERROR_INVALID_ARGS;
+	}
+	transfer->count = 0;
+	ticket_lock_release_irqrestore(&channel->transfer_lock, rflags);
+
+	// Mapping over a page would leak its frame
+	bool vacant = aipc_user_range(address, count * PAGE_SIZE);
+	for (uint32_t i = 0; vacant && i < count; i++) {
+		uintptr_t phys;
+		vacant = !paging_translate(address + i * PAGE_SIZE, &phys);
+	}
+
+	uint32_t mapped = 0;
+	while (vacant && mapped < count &&
+		   paging_map_page(
+			   address + mapped * PAGE_SIZE,
+			   transfer->frames[mapped],
+			   PAGE_PRESENT | PAGE_WRITABLE | PAGE_USER | PAGE_NO_EXECUTE
+		   )) {
+		mapped++;
+	}
+
+	// Give the transfer back untouched if any page could not be mapped
+	if (mapped != count) {
+		uintptr_t frames[AIPC_MAX_PAGES];
+		if (mapped != 0) {
+			paging_unmap_pages(address, mapped, frames);
+		}
+
+		rflags = ticket_lock_acquire_irqsave(&channel->transfer_lock);
+		transfer->count = count;
+		ticket_lock_release_irqrestore(&channel->transfer_lock, rflags);
+		return vacant ? SYSCALL_ERROR_NO_MEMORY : SYSCALL_ERROR_INVALID_ARGS;
+	}
+
+	rflags = ticket_lock_acquire_irqsave(&channel->transfer_lock);
+	transfer->busy = false;
+	ticket_lock_release_irqrestore(&channel->transfer_lock, rflags);
+
+	return count;
+}
+
+int64_t aipc_take(uint32_t handle, uint64_t id, uintptr_t address) {
+	AipcChannel *channel = aipc_channel_get(handle);
+	if (channel == NULL) {
+		return SYSCALL_ERROR_INVALID_ARGS;
+	}
+	int64_t result = aipc_channel_take(channel, id, address);
+	aipc_channel_put(channel);
+	return result;
+}
+
+AipcHeader *aipc_header(uint32_t handle) {
+	AipcChannel *channel = aipc_channel_get(handle);
+	if (channel == NULL) {
+		return NULL;
+	}
+
+	// The header stays mapped for as long as the channel exists
+	AipcHeader *header = channel->header;
+	aipc_channel_put(channel);
+	return header;
+}
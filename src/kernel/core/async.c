@@ -0,0 +1,137 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libk/spinlock.h>
+
+#include <hal/cpu.h>
+
+#include <kernel/async.h>
+#include <kernel/percpu.h>
+#include <kernel/ring.h>
+#include <kernel/smp.h>
+#include <kernel/syscalls.h>
+#include <kernel/thread.h>
+
+/**
+ * Calls are handed out from a fixed pool, first never used ones, then those
+ * returned to the free list
+ */
+static AsyncCall async_calls[ASYNC_MAX_CALLS];
+static uint32_t async_calls_used;
+static AsyncCall *async_free_list;
+static TicketLock async_lock = TICKET_LOCK_INIT("async");
+
+SystemCallReturn async_syscall_handler(
+	SystemCallNumber number, SystemCallArgs *args
+) {
+	Thread *current = thread_current();
+
+	// Without a ring there is nowhere to complete to, run it synchronously
+	uint64_t id = 0;
+	if (current->ring != NULL) {
+		id = ++current->async_last_id;
+	}
+
+	current->async_id = id;
+	SystemCallReturn result = syscall_handler(number, args);
+	current->async_id = 0;
+
+	if (result.error == SYSCALL_PENDING) {
+		result.value = id;
+	}
+	return result;
+}
+
+AsyncCall *async_call_begin(AsyncResume resume, AsyncCancel cancel) {
+	Thread *current = thread_current();
+	if (current->async_id == 0) {
+		return NULL;
+	}
+
+	uint64_t rflags = ticket_lock_acquire_irqsave(&async_lock);
+	AsyncCall *call = async_free_list;
+	if (call != NULL) {
+		async_free_list = call->next;
+	} else if (async_calls_used < ASYNC_MAX_CALLS) {
+		call = &async_calls[async_calls_used++];
+	}
+	ticket_lock_release_irqrestore(&async_lock, rflags);
+
+	if (call == NULL) {
+		return NULL;
+	}
+
+	call->next = NULL;
+	call->ring = current->ring;
+	call->id = current->async_id;
+	call->cpu = this_cpu()->id;
+	call->resume = resume;
+	call->cancel = cancel;
+	__atomic_fetch_add(&call->ring->async_inflight, 1, __ATOMIC_RELAXED);
+
+	// One call per system call, a second begin gets nothing
+	current->async_id = 0;
+	return call;
+}
+
+void async_call_free(AsyncCall *call) {
+	uint64_t rflags = ticket_lock_acquire_irqsave(&async_lock);
+	call->ring = NULL;
+	call->next = async_free_list;
+	async_free_list = call;
+	ticket_lock_release_irqrestore(&async_lock, rflags);
+}
+
+void async_call_discard(AsyncCall *call) {
+	Ring *ring = call->ring;
+	async_call_free(call);
+	__atomic_fetch_sub(&ring->async_inflight, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Runs on the CPU that started the call, where its continuation may cancel
+ * timers it armed
+ */
+static void async_call_finish(void *argument) {
+	AsyncCall *call = (AsyncCall *)argument;
+
+	if (call->resume != NULL) {
+		call->resume(call);
+	}
+
+	// The call may be freed once it is posted
+	Ring *ring = call->ring;
+	ring_complete_async(ring, call);
+	__atomic_fetch_sub(&ring->async_inflight, 1, __ATOMIC_RELEASE);
+}
+
+void async_call_complete(AsyncCall *call, SystemCallReturn result) {
+	call->result = result;
+
+	// CPUs do not go offline yet, but should the call's CPU be gone, post
+	// the result from here rather than leaving the ring waiting on it
+	if (call->cpu == this_cpu()->id ||
+		!smp_call(call->cpu, async_call_finish, call)) {
+		async_call_finish(call);
+	}
+}
+
+void async_cancel_ring(Ring *ring) {
+	// Calls of the ring only finish on this CPU, none of them is freed and
+	// reused while interrupts are off. Cancelling finishes a call right here.
+	uint64_t rflags = interrupts_save_disable();
+	uint32_t used = __atomic_load_n(&async_calls_used, __ATOMIC_RELAXED);
+	for (uint32_t i = 0; i < used; i++) {
+		AsyncCall *call = &async_calls[i];
+		if (call->ring == ring && call->cancel != NULL) {
+			call->cancel(call);
+		}
+	}
+	interrupts_restore(rflags);
+
+	// Calls whose result was on the way finish through an IPI or a timer
+	while (__atomic_load_n(&ring->async_inflight, __ATOMIC_ACQUIRE) != 0) {
+		thread_yield();
+	}
+}
@@ -0,0 +1,423 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libk/spinlock.h>
+
+#include <kernel/async.h>
+#include <kernel/futex.h>
+#include <kernel/paging.h>
+#include <kernel/syscalls.h>
+#include <kernel/thread.h>
+#include <kernel/timer.h>
+
+/**
+ * Hash bucket of futex wait queues. Waiters for every futex that hashes here
+ * share one FIFO list.
+ */
+typedef struct {
+	TicketLock lock;
+	struct FutexWaiter *head;
+	struct FutexWaiter *tail;
+
+	/**
+	 * Queued waiters plus those about to queue, lets futex_wake skip the lock
+	 * when nobody waits
+	 */
+	_Atomic uint32_t waiters;
+} __attribute__((aligned(64))) FutexBucket;
+
+/**
+ * A thread waiting on a futex, lives on the waiting thread's stack. Waits of
+ * asynchronous system calls live in the AsyncCall instead and have no
+ * thread.
+ */
+typedef struct FutexWaiter {
+	struct FutexWaiter *next;
+	struct FutexWaiter *prev;
+
+	/**
+	 * Physical address of the futex word
+	 */
+	uintptr_t key;
+	uint32_t bitset;
+	Thread *thread;
+	AsyncCall *call;
+
+	/**
+	 * Bucket the waiter is queued on, NULL once it has been woken or timed
+	 * out. Only changes with the bucket lock held, requeueing moves it.
+	 */
+	_Atomic(FutexBucket *) bucket;
+
+	/**
+	 * What the wait returns, set before the waiter is woken
+	 */
+	SystemCallError result;
+	Timer timer;
+} FutexWaiter;
+
+_Static_assert(
+	sizeof(FutexWaiter) <= ASYNC_CONTEXT_SIZE,
+	"A FutexWaiter must fit in AsyncCall.context"
+);
+
+static FutexBucket futex_buckets[FUTEX_HASH_SIZE] = {
+	[0 ... FUTEX_HASH_SIZE - 1] = {.lock = TICKET_LOCK_INIT("futex_bucket")}
+};
+
+/**
+ * Resolves a futex word to its key. Keying by physical address makes a futex
+ * shared between address spaces that map the same page.
+ *
+ * Only user memory can be a futex: waiting on a kernel word would tell user
+ * space whether it holds the expected value.
+ */
+static bool futex_key(uint32_t *address, uintptr_t *key) {
+	uintptr_t virt = (uintptr_t)address;
+	if (address == NULL || (virt & (sizeof(uint32_t) - 1)) ||
+		virt >= PAGING_USER_END) {
+		return false;
+	}
+
+	uint64_t flags;
+	return paging_lookup(virt, key, &flags) && (flags & PAGE_USER);
+}
+
+static FutexBucket *futex_bucket(uintptr_t key) {
+	// Fibonacci hashing, the low bits of the key are always zero
+	uint64_t hash = (key >> 2) * 0x9E3779B97F4A7C15ULL;
+	return &futex_buckets[hash >> (64 - FUTEX_HASH_BITS)];
+}
+
+/**
+ * Reads the futex word through the direct map, which cannot fault even with
+ * the bucket lock held
+ */
+static uint32_t futex_read(uintptr_t key) {
+	uint32_t *word = phys_to_virt(key, paging_hhdm_offset());
+	return __atomic_load_n(word, __ATOMIC_SEQ_CST);
+}
+
+static void futex_enqueue(FutexBucket *bucket, FutexWaiter *waiter) {
+	waiter->next = NULL;
+	waiter->prev = bucket->tail;
+	if (bucket->tail != NULL) {
+		bucket->tail->next = waiter;
+	} else {
+		bucket->head = waiter;
+	}
+	bucket->tail = waiter;
+
+	atomic_store_explicit(&waiter->bucket, bucket, memory_order_relaxed);
+}
+
+static void futex_dequeue(FutexBucket *bucket, FutexWaiter *waiter) {
+	atomic_fetch_sub_explicit(&bucket->waiters, 1, memory_order_relaxed);
+
+	if (waiter->prev != NULL) {
+		waiter->prev->next = waiter->next;
+	} else {
+		bucket->head = waiter->next;
+	}
+	if (waiter->next != NULL) {
+		waiter->next->prev = waiter->prev;
+	} else {
+		bucket->tail = waiter->prev;
+	}
+}
+
+/**
+ * Dequeues a waiter and wakes its thread. Called with the bucket lock held,
+ * so asynchronous waiters are only collected on completed, to be finished
+ * with futex_complete once the lock is dropped.
+ */
+static void futex_wake_waiter(
+	FutexBucket *bucket, FutexWaiter *waiter, AsyncCall **completed
+) {
+	// The waiter may return and drop its stack frame as soon as it sees the
+	// cleared bucket, so nothing in it may be touched after the store
+	Thread *thread = waiter->thread;
+	AsyncCall *call = waiter->call;
+
+	futex_dequeue(bucket, waiter);
+	atomic_store_explicit(&waiter->bucket, NULL, memory_order_release);
+
+	if (call != NULL) {
+		call->next = *completed;
+		*completed = call;
+	} else {
+		thread_wake(thread);
+	}
+}
+
+/**
+ * Finishes the asynchronous waits collected by futex_wake_waiter
+ */
+static void futex_complete(AsyncCall *completed) {
+	while (completed != NULL) {
+		AsyncCall *call = completed;
+		FutexWaiter *waiter = (FutexWaiter *)call->context;
+		completed = call->next;
+
+		async_call_complete(
+			call,
+			(SystemCallReturn){.value = 0, .error = waiter->result}
+		);
+	}
+}
+
+/**
+ * Continuation of an asynchronous wait, on the CPU that armed its timer
+ */
+static void futex_resume(AsyncCall *call) {
+	FutexWaiter *waiter = (FutexWaiter *)call->context;
+	timer_cancel(&waiter->timer);
+}
+
+/**
+ * Locks the bucket a waiter is queued on. Requeueing can move the waiter
+ * while we wait for the lock, so check again once we hold it.
+ *
+ * @return The locked bucket, or NULL if the waiter is no longer queued
+ */
+static FutexBucket *futex_lock_waiter(FutexWaiter *waiter, uint64_t *rflags) {
+	for (;;) {
+		FutexBucket *bucket =
+			atomic_load_explicit(&waiter->bucket, memory_order_acquire);
+		if (bucket == NULL) {
+			return NULL;
+		}
+
+		*rflags = ticket_lock_acquire_irqsave(&bucket->lock);
+		if (atomic_load_explicit(&waiter->bucket, memory_order_relaxed) ==
+			bucket) {
+			return bucket;
+		}
+		ticket_lock_release_irqrestore(&bucket->lock, *rflags);
+	}
+}
+
+/**
+ * Ends a wait with an error, unless it was woken already
+ */
+static void futex_abort(FutexWaiter *waiter, SystemCallError result) {
+	uint64_t rflags;
+
+	FutexBucket *bucket = futex_lock_waiter(waiter, &rflags);
+	if (bucket != NULL) {
+		AsyncCall *completed = NULL;
+		waiter->result = result;
+		futex_wake_waiter(bucket, waiter, &completed);
+		ticket_lock_release_irqrestore(&bucket->lock, rflags);
+		futex_complete(completed);
+	}
+}
+
+static void futex_timeout(Timer *timer) {
+	futex_abort((FutexWaiter *)timer->data, SYSCALL_ERROR_TIMED_OUT);
+}
+
+static void futex_cancel(AsyncCall *call) {
+	futex_abort((FutexWaiter *)call->context, SYSCALL_ERROR_CANCELED);
+}
+
+/**
+ * Locks two buckets in address order so concurrent requeues cannot deadlock
+ */
+static uint64_t futex_lock_pair(FutexBucket *first, FutexBucket *second) {
+	if (first == second) {
+		return ticket_lock_acquire_irqsave(&first->lock);
+	}
+
+	if (first > second) {
+		FutexBucket *swap = first;
+		first = second;
+		second = swap;
+	}
+
+	uint64_t rflags = ticket_lock_acquire_irqsave(&first->lock);
+	ticket_lock_acquire(&second->lock);
+	return rflags;
+}
+
+static void futex_unlock_pair(
+	FutexBucket *first, FutexBucket *second, uint64_t rflags
+) {
+	if (first != second) {
+		ticket_lock_release(&second->lock);
+	}
+	ticket_lock_release_irqrestore(&first->lock, rflags);
+}
+
+SystemCallError futex_wait(
+	uint32_t *address, uint32_t expected, uint64_t timeout_ns, uint32_t bitset
+) {
+	uintptr_t key;
+	if (bitset == 0 || !futex_key(address, &key)) {
+		return SYSCALL_ERROR_INVALID_ARGS;
+	}
+
+	// Asynchronous waits keep the waiter in the call and return at once
+	Thread *current = thread_current();
+	AsyncCall *call = async_call_begin(futex_resume, futex_cancel);
+	FutexWaiter local;
+	FutexWaiter *waiter = call != NULL ? (FutexWaiter *)call->context : &local;
+	*waiter = (FutexWaiter){
+		.key = key,
+		.bitset = bitset,
+		.thread = call != NULL ? NULL : current,
+		.call = call,
+	};
+	timer_init(&waiter->timer, futex_timeout, waiter);
+
+	FutexBucket *bucket = futex_bucket(key);
+
+	// Count ourselves before reading the value. Pairs with the fence in
+	// futex_wake: either the waker sees us, or we see its new value.
+	atomic_fetch_add_explicit(&bucket->waiters, 1, memory_order_seq_cst);
+
+	uint64_t rflags = ticket_lock_acquire_irqsave(&bucket->lock);
+
+	if (futex_read(key) != expected) {
+		atomic_fetch_sub_explicit(&bucket->waiters, 1, memory_order_relaxed);
+		ticket_lock_release_irqrestore(&bucket->lock, rflags);
+		if (call != NULL) {
+			async_call_discard(call);
+		}
+		return SYSCALL_ERROR_WOULD_BLOCK;
+	}
+
+	futex_enqueue(bucket, waiter);
+	if (call == NULL) {
+		current->state = THREAD_BLOCKED;
+	}
+
+	// Threads do not migrate, so the timer is cancelled on the CPU that armed
+	// it, asynchronous waits resume there too. Most waits are woken well
+	// before they time out.
+	if (timeout_ns != FUTEX_NO_TIMEOUT) {
+		timer_start_timeout(&waiter->timer, timeout_ns);
+	}
+
+	ticket_lock_release_irqrestore(&bucket->lock, rflags);
+
+	// The call may already be finished and reused, do not touch it
+	if (call != NULL) {
+		return SYSCALL_PENDING;
+	}
+
+	for (;;) {
+		thread_block();
+
+		bucket = futex_lock_waiter(waiter, &rflags);
+		if (bucket == NULL) {
+			break;
+		}
+
+		// Woken by someone other than a futex wake, go back to sleep
+		current->state = THREAD_BLOCKED;
+		ticket_lock_release_irqrestore(&bucket->lock, rflags);
+	}
+
+	timer_cancel(&waiter->timer);
+
+	return waiter->result;
+}
+
+int64_t futex_wake(uint32_t *address, uint32_t count, uint32_t bitset) {
+	uintptr_t key;
+	if (bitset == 0 || !futex_key(address, &key)) {
+		return SYSCALL_ERROR_INVALID_ARGS;
+	}
+
+	FutexBucket *bucket = futex_bucket(key);
+	int64_t woken = 0;
+
+	// Nobody waits in the common case, skip the lock. The caller changed the
+	// futex word before calling, see futex_wait for the other half.
+	atomic_thread_fence(memory_order_seq_cst);
+	if (atomic_load_explicit(&bucket->waiters, memory_order_relaxed) == 0) {
+		return 0;
+	}
+
+	uint64_t rflags = ticket_lock_acquire_irqsave(&bucket->lock);
+
+	AsyncCall *completed = NULL;
+	FutexWaiter *waiter = bucket->head;
+	while (waiter != NULL && woken < count) {
+		FutexWaiter *next = waiter->next;
+
+		if (waiter->key == key && (waiter->bitset & bitset)) {
+			futex_wake_waiter(bucket, waiter, &completed);
+			woken++;
+		}
+
+		waiter = next;
+	}
+
+	ticket_lock_release_irqrestore(&bucket->lock, rflags);
+	futex_complete(completed);
+	return woken;
+}
+
+int64_t futex_requeue(
+	uint32_t *address,
+	uint32_t count,
+	uint32_t *target,
+	uint32_t requeue_count,
+	uint32_t expected
+) {
+	uintptr_t key, target_key;
+	if (!futex_key(address, &key) || !futex_key(target, &target_key)) {
+		return SYSCALL_ERROR_INVALID_ARGS;
+	}
+
+	// Requeued waiters would go back to the tail of the list being walked
+	if (key == target_key) {
+		return SYSCALL_ERROR_INVALID_ARGS;
+	}
+
+	FutexBucket *bucket = futex_bucket(key);
+	FutexBucket *target_bucket = futex_bucket(target_key);
+	uint64_t rflags = futex_lock_pair(bucket, target_bucket);
+
+	if (futex_read(key) != expected) {
+		futex_unlock_pair(bucket, target_bucket, rflags);
+		return SYSCALL_ERROR_WOULD_BLOCK;
+	}
+
+	int64_t woken = 0;
+	int64_t requeued = 0;
+	AsyncCall *completed = NULL;
+
+	FutexWaiter *waiter = bucket->head;
+	while (waiter != NULL && (woken < count || requeued < requeue_count)) {
+		FutexWaiter *next = waiter->next;
+
+		if (waiter->key != key) {
+			waiter = next;
+			continue;
+		}
+
+		if (woken < count) {
+			futex_wake_waiter(bucket, waiter, &completed);
+			woken++;
+		} else {
+			futex_dequeue(bucket, waiter);
+			waiter->key = target_key;
+			atomic_fetch_add_explicit(
+				&target_bucket->waiters, 1, memory_order_relaxed
+			);
+			futex_enqueue(target_bucket, waiter);
+			requeued++;
+		}
+
+		waiter = next;
+	}
+
+	futex_unlock_pair(bucket, target_bucket, rflags);
+	futex_complete(completed);
+	return woken + requeued;
+}
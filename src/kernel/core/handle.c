@@ -0,0 +1,190 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libk/spinlock.h>
+#include <libk/string.h>
+
+#include <kernel/handle.h>
+#include <kernel/kobject.h>
+#include <kernel/paging.h>
+#include <kernel/percpu.h>
+#include <kernel/pmm.h>
+#include <kernel/preempt.h>
+#include <kernel/rcu.h>
+#include <kernel/syscall_abi.h>
+
+static HandleTable user_handles = {.lock = TICKET_LOCK_INIT("handles")};
+
+HandleTable *handle_table_current() { return &user_handles; }
+
+static HandleSlot *handle_slot(HandleTable *table, uint32_t index) {
+	HandleSlot *leaf = __atomic_load_n(
+		&table->leaves[index >> HANDLE_LEAF_BITS], __ATOMIC_ACQUIRE
+	);
+	return leaf != NULL ? &leaf[index & (HANDLE_LEAF_SLOTS - 1)] : NULL;
+}
+
+/**
+ * Generations fill the bits above the index and skip 0, so no handle is 0.
+ * Drops HANDLE_SLOT_FREE.
+ */
+static uint32_t handle_next_generation(uint32_t generation) {
+	generation = (generation + 1) & (UINT32_MAX >> HANDLE_INDEX_BITS);
+	return generation != 0 ? generation : 1;
+}
+
+/**
+ * Adds a leaf and puts its slots on the free list. Called with the table
+ * lock held.
+ */
+static bool handle_grow(HandleTable *table) {
+	if (table->leaf_count == HANDLE_ROOT_SIZE) {
+		return false;
+	}
+
+	HandleSlot *leaf = (HandleSlot *)pmm_alloc(PAGE_SIZE);
+	if (leaf == NULL) {
+		return false;
+	}
+	memset(leaf, 0, PAGE_SIZE);
+
+	uint32_t base = table->leaf_count << HANDLE_LEAF_BITS;
+	for (uint32_t i = HANDLE_LEAF_SLOTS; i-- > 0;) {
+		leaf[i].generation = HANDLE_SLOT_FREE;
+		leaf[i].next = table->free_head;
+		table->free_head = base + i + 1;
+	}
+
+	// Readers may find the leaf as soon as it is in the root
+	__atomic_store_n(&table->leaves[table->leaf_count], leaf, __ATOMIC_RELEASE);
+	table->leaf_count++;
+	return true;
+}
+
+/**
+ * Moves up to HANDLE_CACHE_BATCH free slots from the table to an empty cache
+ */
+static void handle_cache_refill(HandleTable *table, HandleCache *cache) {
+	uint64_t rflags = ticket_lock_acquire_irqsave(&table->lock);
+	while (cache->count < HANDLE_CACHE_BATCH) {
+		if (table->free_head == 0 && !handle_grow(table)) {
+			break;
+		}
+		uint32_t index = table->free_head - 1;
+		table->free_head = handle_slot(table, index)->next;
+		cache->slots[cache->count++] = index;
+	}
+	ticket_lock_release_irqrestore(&table->lock, rflags);
+}
+
+/**
+ * Moves HANDLE_CACHE_BATCH free slots from a full cache back to the table
+ */
+static void handle_cache_drain(HandleTable *table, HandleCache *cache) {
+	uint64_t rflags = ticket_lock_acquire_irqsave(&table->lock);
+	while (cache->count > HANDLE_CACHE_SIZE - HANDLE_CACHE_BATCH) {
+		uint32_t index = cache->slots[--cache->count];
+		handle_slot(table, index)->next = table->free_head;
+		table->free_head = index + 1;
+	}
+	ticket_lock_release_irqrestore(&table->lock, rflags);
+}
+
+int64_t handle_open(HandleTable *table, KObject *object) {
+	// The cache belongs to this CPU, another thread may only use it once
+	// we are done
+	preempt_disable();
+	HandleCache *cache = &table->caches[this_cpu()->id];
+	if (cache->count == 0) {
+		handle_cache_refill(table, cache);
+	}
+	if (cache->count == 0) {
+		preempt_enable();
+		return SYSCALL_ERROR_NO_MEMORY;
+	}
+	uint32_t index = cache->slots[--cache->count];
+	preempt_enable();
+
+	// No handle matches a free slot, so nothing else touches it until the
+	// new generation publishes the object
+	HandleSlot *slot = handle_slot(table, index);
+	uint32_t generation = handle_next_generation(slot->generation);
+	__atomic_store_n(&slot->object, object, __ATOMIC_RELAXED);
+	__atomic_store_n(&slot->generation, generation, __ATOMIC_RELEASE);
+
+	return ((int64_t)generation << HANDLE_INDEX_BITS) | index;
+}
+
+KObject *handle_get(HandleTable *table, uint32_t handle, KObjectType type) {
+	uint32_t generation = handle >> HANDLE_INDEX_BITS;
+	KObject *object = NULL;
+
+	// Objects are switched to the shared count, and so released, only a
+	// grace period after their handle is closed
+	rcu_read_lock();
+	HandleSlot *slot = handle_slot(table, handle & HANDLE_INDEX_MASK);
+	if (slot != NULL &&
+		__atomic_load_n(&slot->generation, __ATOMIC_ACQUIRE) == generation) {
+		object = __atomic_load_n(&slot->object, __ATOMIC_ACQUIRE);
+		if (object != NULL && object->type == type) {
+			kobject_get(object);
+
+			// Closed, and maybe reused, since we read the generation
+			if (__atomic_load_n(&slot->generation, __ATOMIC_ACQUIRE) !=
+				generation) {
+				kobject_put(object);
+				object = NULL;
+			}
+		} else {
+			object = NULL;
+		}
+	}
+	rcu_read_unlock();
+
+	return object;
+}
+
+/**
+ * Returns a slot whose object was taken out to this CPU's cache
+ */
+static void handle_slot_free(HandleTable *table, uint32_t index) {
+	preempt_disable();
+	HandleCache *cache = &table->caches[this_cpu()->id];
+	if (cache->count == HANDLE_CACHE_SIZE) {
+		handle_cache_drain(table, cache);
+	}
+	cache->slots[cache->count++] = index;
+	preempt_enable();
+}
+
+int64_t handle_close(HandleTable *table, uint32_t handle) {
+	uint32_t index = handle & HANDLE_INDEX_MASK;
+	uint32_t generation = handle >> HANDLE_INDEX_BITS;
+	HandleSlot *slot = handle_slot(table, index);
+	if (slot == NULL) {
+		return SYSCALL_ERROR_INVALID_ARGS;
+	}
+
+	// Marking the slot free first turns lookups away before the object goes.
+	// Fails on free slots and stale handles, and for all but one of several
+	// closes of one handle.
+	if (!__atomic_compare_exchange_n(
+			&slot->generation,
+			&generation,
+			generation | HANDLE_SLOT_FREE,
+			false,
+			__ATOMIC_ACQ_REL,
+			__ATOMIC_RELAXED
+		)) {
+		return SYSCALL_ERROR_INVALID_ARGS;
+	}
+
+	// Published by handle_open before the generation we matched
+	KObject *object = __atomic_load_n(&slot->object, __ATOMIC_RELAXED);
+	__atomic_store_n(&slot->object, NULL, __ATOMIC_RELAXED);
+
+	handle_slot_free(table, index);
+	kobject_kill(object);
+	return 0;
+}
@@ -0,0 +1,202 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <hal/cpu.h>
+
+#include <kernel/debug.h>
+#include <kernel/idle.h>
+#include <kernel/percpu.h>
+#include <kernel/rcu.h>
+#include <kernel/smp.h>
+#include <kernel/thread.h>
+#include <kernel/tick.h>
+
+/**
+ * Per-CPU idle governor state, only touched by its own CPU
+ */
+typedef struct {
+	uint64_t predicted_ns;
+	IdleStats stats[IDLE_MAX_STATES];
+} __attribute__((aligned(64))) IdleCpu;
+
+static IdleCpu idle_cpus[MAX_CPUS];
+
+static IdleState idle_states[IDLE_MAX_STATES];
+static uint32_t idle_state_total;
+static bool idle_mwait_supported;
+static bool idle_mwait_enabled;
+
+/**
+ * MWAIT C-states by number. Without ACPI _CST we do not know the real exit
+ * latencies, these are typical values and keep the deep states for long
+ * idle periods.
+ */
+static const IdleState idle_mwait_states[8] = {
+	[1] = {"C1", 0x00, 2 * NS_PER_US, 2 * NS_PER_US},
+	[2] = {"C2", 0x10, 20 * NS_PER_US, 60 * NS_PER_US},
+	[3] = {"C3", 0x20, 80 * NS_PER_US, 250 * NS_PER_US},
+	[4] = {"C4", 0x30, 100 * NS_PER_US, 400 * NS_PER_US},
+	[5] = {"C5", 0x40, 150 * NS_PER_US, 600 * NS_PER_US},
+	[6] = {"C6", 0x50, 200 * NS_PER_US, 800 * NS_PER_US},
+	[7] = {"C7", 0x60, 250 * NS_PER_US, 1000 * NS_PER_US},
+};
+
+void idle_initialize() {
+	idle_states[0] = (IdleState){"HLT", 0, NS_PER_US, 0};
+	idle_state_total = 1;
+
+	if (cpuid(0, 0).eax < 5 || !(cpuid(1, 0).ecx & CPUID_1_ECX_MONITOR)) {
+		log_message(
+			&kernel_debug_logger,
+			LOG_INFO,
+			"idle",
+			"MWAIT not supported, idling with HLT\n"
+		);
+		return;
+	}
+
+	idle_states[0] = idle_mwait_states[1];
+
+	// The sub-state counts are only valid with the extensions bit
+	CpuidResult leaf5 = cpuid(5, 0);
+	if (leaf5.ecx & CPUID_5_ECX_EXTENSIONS) {
+		for (uint32_t n = 2; n < 8 && idle_state_total < IDLE_MAX_STATES;
+			 n++) {
+			if (CPUID_5_EDX_SUBSTATES(leaf5.edx, n) != 0) {
+				idle_states[idle_state_total++] = idle_mwait_states[n];
+			}
+		}
+	}
+
+	idle_mwait_supported = true;
+	idle_mwait_enabled = true;
+
+	log_message(
+		&kernel_debug_logger,
+		LOG_INFO,
+		"idle",
+		"Idling with MWAIT {states=%d, deepest=%s}\n",
+		idle_state_total,
+		idle_states[idle_state_total - 1].name
+	);
+}
+
+/**
+ * Picks the deepest state worth entering. The idle period is predicted from
+ * the recent ones, and cut short by the next timer event.
+ */
+static uint32_t idle_select(Cpu *cpu, IdleCpu *idle) {
+	if (!idle_mwait_enabled) {
+		return 0;
+	}
+
+	uint64_t predicted = idle->predicted_ns;
+	if (cpu->tick_event != 0) {
+		uint64_t now = rdtsc();
+		uint64_t until =
+			cpu->tick_event > now ? tsc_to_ns(cpu->tick_event - now) : 0;
+		if (until < predicted) {
+			predicted = until;
+		}
+	}
+
+	uint32_t index = 0;
+	for (uint32_t i = 1; i < idle_state_total; i++) {
+		if (idle_states[i].target_residency_ns <= predicted) {
+			index = i;
+		}
+	}
+	return index;
+}
+
+/**
+ * Waits in MWAIT on the doorbell, called and returns with interrupts disabled
+ */
+static void idle_mwait(Cpu *cpu, uint32_t hint) {
+	cpu->idle_polling = true;
+
+	// Pairs with the fence in smp_resched
+	atomic_thread_fence(memory_order_seq_cst);
+
+	cpu_monitor(&cpu->need_resched);
+	if (cpu->need_resched) {
+		interrupts_enable();
+	} else {
+		interrupts_enable_mwait(hint);
+	}
+
+	// Until here wakers skip the IPI, the loop checks need_resched again
+	cpu->idle_polling = false;
+	interrupts_disable();
+}
+
+void idle_loop() {
+	Cpu *cpu = this_cpu();
+	IdleCpu *idle = &idle_cpus[cpu->id];
+
+	for (;;) {
+		interrupts_disable();
+
+		// Woken threads set need_resched before sending the wakeup
+		if (cpu->need_resched) {
+			schedule();
+			interrupts_enable();
+			continue;
+		}
+
+		tick_idle_enter();
+		rcu_idle_enter();
+
+		uint32_t index = idle_select(cpu, idle);
+		uint64_t start = rdtsc();
+
+		if (idle_mwait_enabled) {
+			idle_mwait(cpu, idle_states[index].mwait_hint);
+		} else {
+			// An interrupt arriving after tick_idle_enter still wakes us from
+			// hlt
+			interrupts_enable_halt();
+			interrupts_disable();
+		}
+
+		// Includes the interrupt that woke us, close enough for prediction
+		uint64_t cycles = rdtsc() - start;
+		uint64_t ns = tsc_to_ns(cycles);
+		idle->predicted_ns = idle->predicted_ns -
+							 (idle->predicted_ns >> IDLE_PREDICT_SHIFT) +
+							 (ns >> IDLE_PREDICT_SHIFT);
+		idle->stats[index].entries++;
+		idle->stats[index].cycles += cycles;
+
+		rcu_idle_exit();
+		tick_idle_exit();
+		interrupts_enable();
+	}
+}
+
+bool idle_use_mwait(bool enabled) {
+	if (enabled && !idle_mwait_supported) {
+		return false;
+	}
+
+	idle_mwait_enabled = enabled;
+	return true;
+}
+
+uint32_t idle_state_count() { return idle_state_total; }
+
+const IdleState *idle_state(uint32_t index) { return &idle_states[index]; }
+
+IdleStats idle_stats(uint32_t index) {
+	IdleStats total = {0};
+
+	for (uint32_t cpu = 0; cpu < smp_cpu_count(); cpu++) {
+		IdleStats *stats = &idle_cpus[cpu].stats[index];
+		total.entries += __atomic_load_n(&stats->entries, __ATOMIC_RELAXED);
+		total.cycles += __atomic_load_n(&stats->cycles, __ATOMIC_RELAXED);
+	}
+
+	return total;
+}
@@ -1,4 +1,9 @@
 extern isr_handler
+extern isr_lean_handler
+extern isr_lean_exit
+
+; Offset of the IRQ stack top in the per-CPU area (see kernel/percpu.h)
+%define CPU_IRQ_STACK_OFFSET 16
 
 ; Macro for ISRs without error codes
 %macro ISR_NOERRCODE 1
@@ -17,42 +22,28 @@ isr%1:
   jmp isr_common_stub
 %endmacro
 
-; Define ISRs
-ISR_NOERRCODE 0  ; Division by zero
-ISR_NOERRCODE 1  ; Debug
-ISR_NOERRCODE 2  ; Non-maskable interrupt
-ISR_NOERRCODE 3  ; Breakpoint
-ISR_NOERRCODE 4  ; Overflow (INTO)
-ISR_NOERRCODE 5  ; Bound range exceeded
-ISR_NOERRCODE 6  ; Invalid opcode
-ISR_NOERRCODE 7  ; Device not available
-ISR_ERRCODE   8  ; Double fault
-ISR_NOERRCODE 9  ; Coprocessor segment overrun (reserved)
-ISR_ERRCODE   10 ; Invalid TSS
-ISR_ERRCODE   11 ; Segment not present
-ISR_ERRCODE   12 ; Stack-segment fault
-ISR_ERRCODE   13 ; General protection fault
-ISR_ERRCODE   14 ; Page fault
-ISR_NOERRCODE 15 ; Reserved
-ISR_NOERRCODE 16 ; x87 Floating-point exception
-ISR_ERRCODE   17 ; Alignment check
-ISR_NOERRCODE 18 ; Machine check
-ISR_NOERRCODE 19 ; SIMD Floating-point exception
-ISR_NOERRCODE 20 ; Virtualization exception
-ISR_NOERRCODE 21 ; Control protection exception
-ISR_NOERRCODE 22 ; Reserved
-ISR_NOERRCODE 23 ; Reserved
-ISR_NOERRCODE 24 ; Reserved
-ISR_NOERRCODE 25 ; Reserved
-ISR_NOERRCODE 26 ; Reserved
-ISR_NOERRCODE 27 ; Reserved
-ISR_NOERRCODE 28 ; Reserved
-ISR_NOERRCODE 29 ; Reserved
-ISR_NOERRCODE 30 ; Reserved
-ISR_NOERRCODE 31 ; Reserved
+; Define ISRs for all vectors. The CPU pushes an error code for double faults
+; (8), invalid TSS through page faults (10-14), alignment checks (17), control
+; protection (21), VMM communication (29) and security exceptions (30).
+%assign vector 0
+%rep 256
+%if vector == 8 || (vector >= 10 && vector <= 14) || vector == 17 || \
+    vector == 21 || vector == 29 || vector == 30
+ISR_ERRCODE vector
+%else
+ISR_NOERRCODE vector
+%endif
+%assign vector vector + 1
+%endrep
 
 ; Common ISR stub
 isr_common_stub:
+  ; Interrupted user code runs with the user GS base
+  test qword [rsp + 24], 3 ; CS of the interrupted context
+  jz .from_kernel
+  swapgs
+.from_kernel:
+
   ; Save all registers
   push rax
   push rbx
@@ -95,8 +86,105 @@ isr_common_stub:
   ; Clean up stack
   add rsp, 16     ; Remove error code and interrupt number
 
+  test qword [rsp + 8], 3
+  jz .to_kernel
+  swapgs
+.to_kernel:
+
   ; Return from interrupt
   iretq
 
+; Lean entry for vectors 32 to 255 whose handlers do not need the
+; InterruptFrame (see interrupt_register)
+%macro IRQ_LEAN 1
+global irq_lean%1
+irq_lean%1:
+  push %1                 ; Push interrupt number, there is no error code
+  jmp irq_lean_stub
+%endmacro
+
+%assign vector 32
+%rep 224
+IRQ_LEAN vector
+%assign vector vector + 1
+%endrep
+
+; Common lean stub. Saves only the registers C code may clobber and runs the
+; handlers on the per-CPU IRQ stack. The exit work (softirqs, preemption) runs
+; back on the interrupted stack with interrupts enabled or switched away from,
+; which the IRQ stack must not be.
+irq_lean_stub:
+  test qword [rsp + 16], 3 ; CS of the interrupted context
+  jz .from_kernel
+  swapgs
+.from_kernel:
+
+  push rax
+  push rcx
+  push rdx
+  push rsi
+  push rdi
+  push r8
+  push r9
+  push r10
+  push r11
+
+  mov rdi, [rsp + 72]     ; Interrupt number (9 registers * 8 bytes = 72)
+
+  ; Handlers run with interrupts disabled, so the IRQ stack is always free
+  mov rax, rsp
+  mov rsp, [gs:CPU_IRQ_STACK_OFFSET]
+  push rax                ; Interrupted stack pointer
+  sub rsp, 8              ; Keep the stack 16-byte aligned for the call
+  call isr_lean_handler   ; Returns whether the CPU was idle
+  mov rsp, [rsp + 8]
+
+  ; 5 CPU-pushed values, the interrupt number and 9 registers leave the stack
+  ; 8 bytes off alignment
+  movzx edi, al
+  sub rsp, 8
+  call isr_lean_exit
+  add rsp, 8
+
+  pop r11
+  pop r10
+  pop r9
+  pop r8
+  pop rdi
+  pop rsi
+  pop rdx
+  pop rcx
+  pop rax
+
+  add rsp, 8              ; Remove interrupt number
+
+  test qword [rsp + 8], 3
+  jz .to_kernel
+  swapgs
+.to_kernel:
+  iretq
+
 ; Export symbols
 global isr_common_stub
+
+; Stub tables, in .data rather than .rodata: their entries are absolute and
+; the loader relocates them
+
+; Stubs of all vectors, indexed by vector (see isr_initialize)
+section .data
+global isr_stub_table
+isr_stub_table:
+%assign vector 0
+%rep 256
+  dq isr%+vector
+%assign vector vector + 1
+%endrep
+
+; Lean stubs of vectors 32 to 255, indexed by vector - 32
+global irq_lean_stub_table
+irq_lean_stub_table:
+%assign vector 32
+%rep 224
+  dq irq_lean%+vector
+%assign vector vector + 1
+%endrep
@@ -1,11 +1,25 @@
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
+#include <libk/spinlock.h>
+
+#include <hal/cpu.h>
 #include <hal/idt.h>
+#include <hal/lapic.h>
+#include <hal/pic.h>
 
 #include <kernel/debug.h>
 #include <kernel/interrupts.h>
+#include <kernel/irq.h>
 #include <kernel/panic.h>
+#include <kernel/percpu.h>
+#include <kernel/rcu.h>
+#include <kernel/smp.h>
+#include <kernel/softirq.h>
+#include <kernel/thread.h>
+#include <kernel/tick.h>
 
 // TODO: put somewhere else
 static uint64_t read_cr2() {
@@ -14,77 +28,127 @@ static uint64_t read_cr2() {
 	return value;
 }
 
-// Declare ISR handlers
-extern void isr0();
-extern void isr1();
-extern void isr2();
-extern void isr3();
-extern void isr4();
-extern void isr5();
-extern void isr6();
-extern void isr7();
-extern void isr8();
-extern void isr9();
-extern void isr10();
-extern void isr11();
-extern void isr12();
-extern void isr13();
-extern void isr14();
-extern void isr15();
-extern void isr16();
-extern void isr17();
-extern void isr18();
-extern void isr19();
-extern void isr20();
-extern void isr21();
-extern void isr22();
-extern void isr23();
-extern void isr24();
-extern void isr25();
-extern void isr26();
-extern void isr27();
-extern void isr28();
-extern void isr29();
-extern void isr30();
-extern void isr31();
+/**
+ * Entry stubs generated in interrupts.asm. Every vector has a full stub that
+ * builds an InterruptFrame, vectors 32 and up also have a lean one.
+ */
+extern void *isr_stub_table[IDT_ENTRIES];
+extern void *irq_lean_stub_table[IDT_ENTRIES - 32];
+
+/**
+ * Action chains indexed by vector. Read on every interrupt and rarely
+ * written, readers follow the chains under RCU.
+ */
+static InterruptAction *interrupt_actions[IDT_ENTRIES]
+	__attribute__((aligned(64)));
+
+/**
+ * Serializes changes to the action chains
+ */
+static TicketLock interrupt_lock = TICKET_LOCK_INIT("interrupts");
+
+/**
+ * Per-CPU interrupt load, only written by the owning CPU
+ */
+static InterruptStats interrupt_cpu_stats[MAX_CPUS][IDT_ENTRIES];
+
+static const char *const exception_names[32] = {
+	[0] = "Division by zero error",
+	[1] = "Debug exception",
+	[2] = "Non-maskable interrupt exception",
+	[3] = "Breakpoint exception",
+	[4] = "Overflow exception",
+	[5] = "Bound range exceeded exception",
+	[6] = "Invalid opcode exception",
+	[7] = "Device not available exception",
+	[8] = "Double fault exception",
+	[9] = "Coprocessor segment overrun exception",
+	[10] = "Invalid TSS exception",
+	[11] = "Segment not present exception",
+	[12] = "Stack fault exception",
+	[13] = "General protection fault exception",
+	[14] = "Page fault exception",
+	[16] = "x87 Floating point exception",
+	[17] = "Alignment check exception",
+	[18] = "Machine check exception",
+	[19] = "SIMD Floating point exception",
+	[20] = "Virtualization exception",
+	[21] = "Control protection exception",
+};
+
+static bool page_fault_handler(InterruptFrame *frame, void *context) {
+	(void)context;
+
+	uint64_t fault_address = read_cr2();
+	uint64_t error_code = frame->error_code;
+
+	const char *present = (error_code & 0x1) ? "present" : "not present";
+	const char *write = (error_code & 0x2) ? "write" : "read";
+	const char *user = (error_code & 0x4) ? "user" : "supervisor";
+	const char *reserved =
+		(error_code & 0x8) ? "reserved write" : "not reserved write";
+	const char *instruction =
+		(error_code & 0x10) ? "instruction fetch" : "not instruction fetch";
+
+	kernel_panic_detailed(
+		"Page Fault",
+		frame,
+		"A page fault occurred.\n"
+		"Faulting address: 0x%016llx\n"
+		"Error code: 0x%lX\n"
+		"The fault was caused by a %s during a %s in %s mode.\n"
+		"The fault %s.\n"
+		"The fault %s.\n",
+		fault_address,
+		error_code,
+		write,
+		user,
+		present,
+		reserved,
+		instruction
+	);
+
+	return true;
+}
+
+/**
+ * Built-in actions, registered by isr_initialize
+ */
+static InterruptAction fpu_trap_action;
+static InterruptAction page_fault_action;
+static InterruptAction tick_action;
+static InterruptAction smp_call_action;
+static InterruptAction smp_resched_action;
 
 void isr_initialize() {
 	log_message(
 		&kernel_debug_logger, LOG_INFO, "interrupts", "Registering ISRs\n"
 	);
 
-	idt_set_entry(0, isr0);
-	idt_set_entry(1, isr1);
-	idt_set_entry(2, isr2);
-	idt_set_entry(3, isr3);
-	idt_set_entry(4, isr4);
-	idt_set_entry(5, isr5);
-	idt_set_entry(6, isr6);
-	idt_set_entry(7, isr7);
-	idt_set_entry(8, isr8);
-	idt_set_entry(9, isr9);
-	idt_set_entry(10, isr10);
-	idt_set_entry(11, isr11);
-	idt_set_entry(12, isr12);
-	idt_set_entry(13, isr13);
-	idt_set_entry(14, isr14);
-	idt_set_entry(15, isr15);
-	idt_set_entry(16, isr16);
-	idt_set_entry(17, isr17);
-	idt_set_entry(18, isr18);
-	idt_set_entry(19, isr19);
-	idt_set_entry(20, isr20);
-	idt_set_entry(21, isr21);
-	idt_set_entry(22, isr22);
-	idt_set_entry(23, isr23);
-	idt_set_entry(24, isr24);
-	idt_set_entry(25, isr25);
-	idt_set_entry(26, isr26);
-	idt_set_entry(27, isr27);
-	idt_set_entry(28, isr28);
-	idt_set_entry(29, isr29);
-	idt_set_entry(30, isr30);
-	idt_set_entry(31, isr31);
+	for (int vector = 0; vector < 32; vector++) {
+		idt_set_entry(vector, isr_stub_table[vector]);
+	}
+	for (int vector = 32; vector < IDT_ENTRIES; vector++) {
+		idt_set_entry(vector, irq_lean_stub_table[vector - 32]);
+	}
+
+	interrupt_action_init(&fpu_trap_action, "fpu", thread_fpu_trap, NULL, 0);
+	interrupt_action_init(
+		&page_fault_action, "page_fault", page_fault_handler, NULL, 0
+	);
+	interrupt_action_init(&tick_action, "tick", tick_handler, NULL, 0);
+	interrupt_action_init(
+		&smp_call_action, "smp_call", smp_call_handler, NULL, 0
+	);
+	interrupt_action_init(
+		&smp_resched_action, "smp_resched", smp_resched_handler, NULL, 0
+	);
+
+	interrupt_register(7, &fpu_trap_action);
+	interrupt_register(14, &page_fault_action);
+	interrupt_register(LAPIC_TIMER_VECTOR, &tick_action);
+	interrupt_register(SMP_CALL_VECTOR, &smp_call_action);
+	interrupt_register(SMP_RESCHED_VECTOR, &smp_resched_action);
 
 	log_message(
 		&kernel_debug_logger, LOG_INFO, "interrupts", "Built IDT entries\n"
@@ -92,107 +156,199 @@ void isr_initialize() {
 	log_message(
 		&kernel_debug_logger, LOG_INFO, "interrupts", "Enabling interrupts\n"
 	);
-	__asm__ volatile("sti");
+	interrupts_enable();
 	log_message(
 		&kernel_debug_logger, LOG_INFO, "interrupts", "Interrupts enabled\n"
 	);
 }
 
-void isr_handler(InterruptFrame *frame, uint64_t interrupt_number) {
-	switch (interrupt_number) {
-	case 0:
-		kernel_panic("Division by zero error", frame);
-		break;
-	case 1:
-		kernel_panic("Debug exception", frame);
-		break;
-	case 2:
-		kernel_panic("Non-maskable interrupt exception", frame);
-		break;
-	case 3:
-		kernel_panic("Breakpoint exception", frame);
-		break;
-	case 4:
-		kernel_panic("Overflow exception", frame);
-		break;
-	case 5:
-		kernel_panic("Bound range exceeded exception", frame);
-		break;
-	case 6:
-		kernel_panic("Invalid opcode exception", frame);
-		break;
-	case 7:
-		kernel_panic("Device not available exception", frame);
-		break;
-	case 8:
-		kernel_panic("Double fault exception", frame);
-		break;
-	case 9:
-		kernel_panic("Coprocessor segment overrun exception", frame);
-		break;
-	case 10:
-		kernel_panic("Invalid TSS exception", frame);
-		break;
-	case 11:
-		kernel_panic("Segment not present exception", frame);
-		break;
-	case 12:
-		kernel_panic("Stack fault exception", frame);
-		break;
-	case 13:
-		kernel_panic("General protection fault exception", frame);
-		break;
-	case 14:
-		uint64_t fault_address = read_cr2();
-		uint64_t error_code = frame->error_code;
-
-		const char *present = (error_code & 0x1) ? "present" : "not present";
-		const char *write = (error_code & 0x2) ? "write" : "read";
-		const char *user = (error_code & 0x4) ? "user" : "supervisor";
-		const char *reserved =
-			(error_code & 0x8) ? "reserved write" : "not reserved write";
-		const char *instruction =
-			(error_code & 0x10) ? "instruction fetch" : "not instruction fetch";
-
-		kernel_panic_detailed(
-			"Page Fault",
-			frame,
-			"A page fault occurred.\n"
-			"Faulting address: 0x%016llx\n"
-			"Error code: 0x%lX\n"
-			"The fault was caused by a %s during a %s in %s mode.\n"
-			"The fault %s.\n"
-			"The fault %s.\n",
-			fault_address,
-			error_code,
-			write,
-			user,
-			present,
-			reserved,
-			instruction
+/**
+ * Handles a vector no action claimed
+ */
+static void interrupt_unhandled(InterruptFrame *frame, uint8_t vector) {
+	if (vector < 32) {
+		const char *name = exception_names[vector];
+		kernel_panic(name != NULL ? name : "Reserved exception", frame);
+	}
+
+	// Spurious interrupts from the masked PICs or the local APIC must not be
+	// acknowledged
+	if ((vector >= PIC_VECTOR_BASE &&
+		 vector < PIC_VECTOR_BASE + PIC_VECTOR_COUNT) ||
+		vector == LAPIC_SPURIOUS_VECTOR) {
+		return;
+	}
+
+	if (vector >= IRQ_VECTOR_FIRST && vector <= IRQ_VECTOR_LAST) {
+		// Raced with interrupt_unregister, or a device nobody claimed
+		log_message(
+			&kernel_debug_logger,
+			LOG_WARNING,
+			"interrupts",
+			"Unhandled device interrupt {vector=0x%x}\n",
+			vector
 		);
+		return;
+	}
+
+	kernel_panic("Unexpected interrupt", frame);
+}
+
+/**
+ * Runs the actions of a vector with interrupts disabled
+ */
+static void interrupt_dispatch(InterruptFrame *frame, uint8_t vector) {
+	uint64_t start = rdtsc();
+	Cpu *cpu = this_cpu();
+
+	// An exception in a handler dispatches too, restore the outer vector
+	uint8_t outer_vector = cpu->irq_vector;
+	cpu->irq_vector = vector;
 
-		break;
-	case 16:
-		kernel_panic("x87 Floating point exception", frame);
-		break;
-	case 17:
-		kernel_panic("Alignment check exception", frame);
-		break;
-	case 18:
-		kernel_panic("Machine check exception", frame);
-		break;
-	case 19:
-		kernel_panic("SIMD Floating point exception", frame);
-		break;
-	case 20:
-		kernel_panic("Virtualization exception", frame);
-		break;
-	case 21:
-		kernel_panic("Control protection exception", frame);
-		break;
-	default:
-		kernel_panic("Reserved exception", frame);
-		break;
+	// Interrupt handlers run with interrupts disabled, which keeps them inside
+	// a read-side section as far as RCU is concerned
+	bool handled = false;
+	InterruptAction *action = rcu_dereference(interrupt_actions[vector]);
+	while (action != NULL) {
+		handled |= action->handler(frame, action->context);
+		action = rcu_dereference(action->next);
 	}
+
+	if (!handled) {
+		interrupt_unhandled(frame, vector);
+	}
+
+	// Level-triggered IOAPIC inputs are re-armed by this EOI, after the
+	// handlers quietened their devices
+	if (vector >= IRQ_VECTOR_FIRST && vector <= IRQ_VECTOR_LAST) {
+		lapic_eoi();
+	}
+
+	cpu->irq_vector = outer_vector;
+
+	InterruptStats *stats = &interrupt_cpu_stats[cpu->id][vector];
+	stats->count++;
+	stats->cycles += rdtsc() - start;
+}
+
+static void interrupt_exit(bool from_idle) {
+	// Deferred work runs with interrupts enabled, keeping hard IRQ time short
+	softirq_irq_exit();
+
+	rcu_irq_exit(from_idle);
+
+	// Interrupts stay disabled until the next thread returns from its own
+	// interrupt or switch
+	thread_preempt();
+}
+
+void isr_handler(InterruptFrame *frame, uint64_t interrupt_number) {
+	// The CPU disabled interrupts on entry. The handler counts as irqs-off
+	// time of the interrupted code only if it had them enabled, iretq turns
+	// them back on.
+	bool irqs_enabled = (frame->rflags & RFLAGS_IF) != 0;
+	if (irqs_enabled) {
+		irqsoff_begin(IRQSOFF_SITE());
+	}
+
+	bool from_idle = rcu_irq_enter();
+	interrupt_dispatch(frame, (uint8_t)interrupt_number);
+	interrupt_exit(from_idle);
+
+	if (irqs_enabled) {
+		irqsoff_end();
+	}
+}
+
+bool isr_lean_handler(uint64_t interrupt_number) {
+	// Only maskable interrupts take the lean path, they arrive with
+	// interrupts enabled
+	irqsoff_begin(IRQSOFF_SITE());
+
+	bool from_idle = rcu_irq_enter();
+	interrupt_dispatch(NULL, (uint8_t)interrupt_number);
+	return from_idle;
+}
+
+void isr_lean_exit(bool from_idle) {
+	interrupt_exit(from_idle);
+	irqsoff_end();
+}
+
+void interrupt_action_init(
+	InterruptAction *action,
+	const char *name,
+	InterruptHandler handler,
+	void *context,
+	uint32_t flags
+) {
+	action->next = NULL;
+	action->handler = handler;
+	action->context = context;
+	action->name = name;
+	action->flags = flags;
+}
+
+bool interrupt_register(uint8_t vector, InterruptAction *action) {
+	uint64_t rflags = ticket_lock_acquire_irqsave(&interrupt_lock);
+
+	InterruptAction **link = &interrupt_actions[vector];
+	InterruptAction *head = *link;
+	if (head != NULL && !(head->flags & action->flags & INTERRUPT_SHARED)) {
+		ticket_lock_release_irqrestore(&interrupt_lock, rflags);
+		return false;
+	}
+
+	while (*link != NULL) {
+		link = &(*link)->next;
+	}
+
+	// Switch to the full stub before the action is published. An entry
+	// already on its way through the lean stub cannot see the action, and the
+	// vector keeps the full stub from then on.
+	if ((action->flags & INTERRUPT_FRAME) && vector >= 32) {
+		idt_set_entry(vector, isr_stub_table[vector]);
+	}
+
+	action->next = NULL;
+	rcu_assign_pointer(*link, action);
+
+	ticket_lock_release_irqrestore(&interrupt_lock, rflags);
+	return true;
+}
+
+void interrupt_unregister(uint8_t vector, InterruptAction *action) {
+	uint64_t rflags = ticket_lock_acquire_irqsave(&interrupt_lock);
+
+	InterruptAction **link = &interrupt_actions[vector];
+	while (*link != NULL && *link != action) {
+		link = &(*link)->next;
+	}
+
+	bool found = *link != NULL;
+	if (found) {
+		// Readers on the action keep following its next pointer, which stays
+		// intact until the grace period is over
+		rcu_assign_pointer(*link, action->next);
+	}
+
+	ticket_lock_release_irqrestore(&interrupt_lock, rflags);
+
+	if (found) {
+		synchronize_rcu();
+	}
+}
+
+uint8_t interrupt_current_vector() { return this_cpu()->irq_vector; }
+
+InterruptStats interrupt_stats(uint8_t vector) {
+	InterruptStats total = {0};
+
+	for (uint32_t cpu = 0; cpu < smp_cpu_count(); cpu++) {
+		InterruptStats *stats = &interrupt_cpu_stats[cpu][vector];
+		total.count += __atomic_load_n(&stats->count, __ATOMIC_RELAXED);
+		total.cycles += __atomic_load_n(&stats->cycles, __ATOMIC_RELAXED);
+	}
+
+	return total;
 }
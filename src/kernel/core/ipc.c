@@ -0,0 +1,248 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libk/spinlock.h>
+#include <libk/string.h>
+
+#include <kernel/debug.h>
+#include <kernel/handle.h>
+#include <kernel/ipc.h>
+#include <kernel/kobject.h>
+#include <kernel/pmm.h>
+#include <kernel/thread.h>
+
+/**
+ * Looks up an endpoint handle and takes a reference, or returns NULL
+ */
+static IpcEndpoint *ipc_endpoint_get(uint32_t handle) {
+	return (IpcEndpoint *)handle_get(
+		handle_table_current(), handle, KOBJECT_IPC_ENDPOINT
+	);
+}
+
+/**
+ * Cancels the calls no server picked up yet and wakes the waiting server.
+ * Calls a server did pick up still get their reply.
+ */
+static void ipc_close(KObject *object) {
+	IpcEndpoint *endpoint = (IpcEndpoint *)object;
+
+	uint64_t rflags = ticket_lock_acquire_irqsave(&endpoint->lock);
+	endpoint->closed = true;
+	Thread *server = endpoint->server;
+	Thread *callers = endpoint->callers_head;
+	endpoint->server = NULL;
+	endpoint->callers_head = NULL;
+	endpoint->callers_tail = NULL;
+	for (Thread *caller = callers; caller != NULL; caller = caller->ipc_next) {
+		caller->ipc_status = SYSCALL_ERROR_CANCELED;
+	}
+	ticket_lock_release_irqrestore(&endpoint->lock, rflags);
+
+	// Read each link first, a woken caller may call again right away
+	while (callers != NULL) {
+		Thread *next = callers->ipc_next;
+		thread_wake(callers);
+		callers = next;
+	}
+	if (server != NULL) {
+		thread_wake(server);
+	}
+}
+
+/**
+ * Frees the endpoint. Every caller and server held a reference while it
+ * used the endpoint, so none is left.
+ */
+static void ipc_release(KObject *object) {
+	IpcEndpoint *endpoint = (IpcEndpoint *)object;
+	pmm_free((uintptr_t)endpoint);
+}
+
+static const KObjectOps ipc_ops = {
+	.close = ipc_close,
+	.release = ipc_release,
+};
+
+int64_t ipc_create() {
+	IpcEndpoint *endpoint = (IpcEndpoint *)pmm_alloc(sizeof(IpcEndpoint));
+	if (endpoint == NULL) {
+		return SYSCALL_ERROR_NO_MEMORY;
+	}
+	memset(endpoint, 0, sizeof(IpcEndpoint));
+	ticket_lock_init(&endpoint->lock, "ipc_endpoint");
+
+	if (!kobject_init(&endpoint->object, KOBJECT_IPC_ENDPOINT, &ipc_ops)) {
+		pmm_free((uintptr_t)endpoint);
+		return SYSCALL_ERROR_NO_MEMORY;
+	}
+	int64_t handle = handle_open(handle_table_current(), &endpoint->object);
+	if (handle < 0) {
+		kobject_kill(&endpoint->object);
+		return handle;
+	}
+
+	if (DEBUG) {
+		log_message(
+			&kernel_debug_logger,
+			LOG_INFO,
+			"ipc",
+			"Endpoint created {endpoint=0x%llx}\n",
+			handle
+		);
+	}
+
+	return handle;
+}
+
+static int64_t ipc_endpoint_call(IpcEndpoint *endpoint, IpcMessage *message) {
+	Thread *current = thread_current();
+	uint64_t rflags = ticket_lock_acquire_irqsave(&endpoint->lock);
+
+	if (endpoint->closed) {
+		ticket_lock_release_irqrestore(&endpoint->lock, rflags);
+		return SYSCALL_ERROR_CANCELED;
+	}
+
+	current->ipc_message = *message;
+	current->ipc_endpoint = endpoint;
+	current->ipc_status = SYSCALL_PENDING;
+
+	// Hand the call straight to a waiting server, else queue up for it
+	Thread *server = endpoint->server;
+	if (server != NULL) {
+		endpoint->server = NULL;
+		server->ipc_message = *message;
+		server->ipc_caller = current;
+	} else {
+		current->ipc_next = NULL;
+		if (endpoint->callers_tail != NULL) {
+			endpoint->callers_tail->ipc_next = current;
+		} else {
+			endpoint->callers_head = current;
+		}
+		endpoint->callers_tail = current;
+	}
+
+	while (current->ipc_status == SYSCALL_PENDING) {
+		current->state = THREAD_BLOCKED;
+		ticket_lock_release_irqrestore(&endpoint->lock, rflags);
+
+		// The server runs next, on what is left of our timeslice
+		if (server != NULL) {
+			thread_handoff(server);
+			server = NULL;
+		} else {
+			thread_block();
+		}
+
+		rflags = ticket_lock_acquire_irqsave(&endpoint->lock);
+	}
+
+	SystemCallError status = current->ipc_status;
+	if (status == SYSCALL_SUCCESS) {
+		*message = current->ipc_message;
+	}
+	ticket_lock_release_irqrestore(&endpoint->lock, rflags);
+	return status;
+}
+
+int64_t ipc_call(uint32_t handle, IpcMessage *message) {
+	IpcEndpoint *endpoint = ipc_endpoint_get(handle);
+	if (endpoint == NULL) {
+		return SYSCALL_ERROR_INVALID_ARGS;
+	}
+	int64_t result = ipc_endpoint_call(endpoint, message);
+	kobject_put(&endpoint->object);
+	return result;
+}
+
+/**
+ * Hands a reply to a caller, which still needs to be woken. The caller holds
+ * a reference to the endpoint it called until it has the reply.
+ */
+static void ipc_reply(Thread *caller, const IpcMessage *message) {
+	IpcEndpoint *endpoint = caller->ipc_endpoint;
+	uint64_t rflags = ticket_lock_acquire_irqsave(&endpoint->lock);
+	caller->ipc_message = *message;
+	caller->ipc_status = SYSCALL_SUCCESS;
+	ticket_lock_release_irqrestore(&endpoint->lock, rflags);
+}
+
+static int64_t ipc_endpoint_reply_wait(
+	IpcEndpoint *endpoint, IpcMessage *message
+) {
+	Thread *current = thread_current();
+	Thread *caller = current->ipc_caller;
+	current->ipc_caller = NULL;
+	if (caller != NULL) {
+		ipc_reply(caller, message);
+	}
+
+	uint64_t rflags = ticket_lock_acquire_irqsave(&endpoint->lock);
+
+	// One server per endpoint, and none once it is closed
+	if (endpoint->closed || endpoint->server != NULL) {
+		int64_t error = endpoint->closed ? SYSCALL_ERROR_CANCELED
+										 : SYSCALL_ERROR_WOULD_BLOCK;
+		ticket_lock_release_irqrestore(&endpoint->lock, rflags);
+		if (caller != NULL) {
+			thread_wake(caller);
+		}
+		return error;
+	}
+
+	// With calls queued up the server keeps the CPU, the caller it replied to
+	// takes the slow path through the run queue
+	Thread *next = endpoint->callers_head;
+	if (next != NULL) {
+		endpoint->callers_head = next->ipc_next;
+		if (endpoint->callers_head == NULL) {
+			endpoint->callers_tail = NULL;
+		}
+		current->ipc_caller = next;
+		*message = next->ipc_message;
+		ticket_lock_release_irqrestore(&endpoint->lock, rflags);
+
+		if (caller != NULL) {
+			thread_wake(caller);
+		}
+		return 0;
+	}
+
+	endpoint->server = current;
+	while (current->ipc_caller == NULL && !endpoint->closed) {
+		current->state = THREAD_BLOCKED;
+		ticket_lock_release_irqrestore(&endpoint->lock, rflags);
+
+		// Back to the caller, which will likely call again from here
+		if (caller != NULL) {
+			thread_handoff(caller);
+			caller = NULL;
+		} else {
+			thread_block();
+		}
+
+		rflags = ticket_lock_acquire_irqsave(&endpoint->lock);
+	}
+
+	// A call that came in before the close still counts
+	int64_t result = SYSCALL_ERROR_CANCELED;
+	if (current->ipc_caller != NULL) {
+		*message = current->ipc_message;
+		result = 0;
+	}
+	ticket_lock_release_irqrestore(&endpoint->lock, rflags);
+	return result;
+}
+
+int64_t ipc_reply_wait(uint32_t handle, IpcMessage *message) {
+	IpcEndpoint *endpoint = ipc_endpoint_get(handle);
+	if (endpoint == NULL) {
+		return SYSCALL_ERROR_INVALID_ARGS;
+	}
+	int64_t result = ipc_endpoint_reply_wait(endpoint, message);
+	kobject_put(&endpoint->object);
+	return result;
+}
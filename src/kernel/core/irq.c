@@ -0,0 +1,776 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libk/spinlock.h>
+
+#include <hal/cpu.h>
+#include <hal/ioapic.h>
+#include <hal/lapic.h>
+#include <hal/pci.h>
+#include <hal/pic.h>
+
+#include <kernel/acpi.h>
+#include <kernel/debug.h>
+#include <kernel/irq.h>
+#include <kernel/paging.h>
+#include <kernel/percpu.h>
+#include <kernel/smp.h>
+#include <kernel/thread.h>
+#include <kernel/time.h>
+
+#define IRQ_VECTOR_COUNT (IRQ_VECTOR_LAST - IRQ_VECTOR_FIRST + 1)
+
+typedef enum {
+	IRQ_SOURCE_NONE,
+	IRQ_SOURCE_IOAPIC,
+	IRQ_SOURCE_MSI,
+	IRQ_SOURCE_MSIX,
+} IrqSource;
+
+/**
+ * Where a device vector comes from. The vector is global (all CPUs share one
+ * IDT), cpu is where the source currently delivers it.
+ */
+typedef struct {
+	IrqSource source;
+	uint32_t cpu;
+
+	/**
+	 * Actions registered through the routing functions, more than one only
+	 * for shared GSIs
+	 */
+	uint32_t users;
+
+	/**
+	 * IRQ_SOURCE_IOAPIC
+	 */
+	uint32_t gsi;
+	uint32_t flags;
+
+	/**
+	 * IRQ_SOURCE_MSI and IRQ_SOURCE_MSIX
+	 */
+	PciAddress pci;
+	volatile void *msix_table;
+	uint16_t msix_entry;
+} IrqDescriptor;
+
+/**
+ * GSI and IOAPIC flags of an ISA interrupt after MADT source overrides
+ */
+typedef struct {
+	uint32_t gsi;
+	uint32_t flags;
+} IrqIsaRoute;
+
+static IrqDescriptor irq_descriptors[IRQ_VECTOR_COUNT];
+
+/**
+ * Vectors delivered to each CPU, used to spread interrupts
+ */
+static uint32_t irq_cpu_load[MAX_CPUS];
+
+/**
+ * Protects the descriptors and CPU loads
+ */
+static TicketLock irq_lock = TICKET_LOCK_INIT("irq");
+
+static IrqIsaRoute irq_isa_routes[IRQ_ISA_COUNT];
+static AcpiMadt *irq_madt;
+static uintptr_t irq_lapic_phys;
+
+typedef void (*MadtVisitor)(AcpiMadtEntry *entry, void *argument);
+
+static void irq_madt_walk(MadtVisitor visitor, void *argument) {
+	if (irq_madt == NULL) {
+		return;
+	}
+
+	uint8_t *entry = (uint8_t *)(irq_madt + 1);
+	uint8_t *end = (uint8_t *)irq_madt + irq_madt->header.length;
+
+	while (entry + sizeof(AcpiMadtEntry) <= end) {
+		AcpiMadtEntry *header = (AcpiMadtEntry *)entry;
+		if (header->length < sizeof(AcpiMadtEntry) ||
+			entry + header->length > end) {
+			break;
+		}
+
+		visitor(header, argument);
+		entry += header->length;
+	}
+}
+
+/**
+ * Converts MPS INTI flags to IOAPIC redirection flags
+ */
+static uint32_t irq_mps_flags(uint16_t mps_flags) {
+	uint32_t flags = 0;
+	if ((mps_flags & ACPI_MADT_POLARITY_MASK) == ACPI_MADT_POLARITY_LOW) {
+		flags |= IOAPIC_ACTIVE_LOW;
+	}
+	if ((mps_flags & ACPI_MADT_TRIGGER_MASK) == ACPI_MADT_TRIGGER_LEVEL) {
+		flags |= IOAPIC_LEVEL_TRIGGERED;
+	}
+	return flags;
+}
+
+static void irq_madt_setup(AcpiMadtEntry *entry, void *argument) {
+	(void)argument;
+
+	switch (entry->type) {
+	case ACPI_MADT_IO_APIC: {
+		AcpiMadtIoApic *ioapic = (AcpiMadtIoApic *)entry;
+		void *base = paging_map_mmio(ioapic->address, IOAPIC_MMIO_SIZE);
+
+		if (base == NULL ||
+			!ioapic_register(ioapic->id, (uintptr_t)base, ioapic->gsi_base)) {
+			log_message(
+				&kernel_debug_logger,
+				LOG_ERROR,
+				"irq",
+				"Could not add IOAPIC {id=%d, address=0x%x}\n",
+				ioapic->id,
+				ioapic->address
+			);
+			break;
+		}
+
+		log_message(
+			&kernel_debug_logger,
+			LOG_INFO,
+			"irq",
+			"Found IOAPIC {id=%d, address=0x%x, gsi_base=%d}\n",
+			ioapic->id,
+			ioapic->address,
+			ioapic->gsi_base
+		);
+		break;
+	}
+	case ACPI_MADT_INTERRUPT_OVERRIDE: {
+		AcpiMadtInterruptOverride *override =
+			(AcpiMadtInterruptOverride *)entry;
+
+		// Bus 0 is ISA, the only bus overrides are defined for
+		if (override->bus != 0 || override->source >= IRQ_ISA_COUNT) {
+			break;
+		}
+
+		irq_isa_routes[override->source] = (IrqIsaRoute){
+			.gsi = override->gsi,
+			.flags = irq_mps_flags(override->flags),
+		};
+		break;
+	}
+	case ACPI_MADT_LOCAL_APIC_OVERRIDE: {
+		AcpiMadtLocalApicOverride *override =
+			(AcpiMadtLocalApicOverride *)entry;
+		irq_lapic_phys = override->address;
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+void irq_initialize() {
+	// Nothing is routed through the PICs, but they still raise spurious
+	// interrupts unless remapped away from the exception vectors and masked
+	pic_disable();
+
+	for (uint8_t isa = 0; isa < IRQ_ISA_COUNT; isa++) {
+		irq_isa_routes[isa] = (IrqIsaRoute){.gsi = isa, .flags = 0};
+	}
+
+	irq_madt = (AcpiMadt *)acpi_find_table("APIC");
+	if (irq_madt == NULL) {
+		irq_lapic_phys = rdmsr(MSR_APIC_BASE) & ~0xFFFULL;
+		log_message(
+			&kernel_debug_logger,
+			LOG_WARNING,
+			"irq",
+			"No MADT, device interrupts are unavailable\n"
+		);
+		return;
+	}
+
+	irq_lapic_phys = irq_madt->local_apic_address;
+	irq_madt_walk(irq_madt_setup, NULL);
+
+	log_message(
+		&kernel_debug_logger,
+		LOG_INFO,
+		"irq",
+		"Parsed MADT {lapic=0x%llx, pcat_compat=%d}\n",
+		(unsigned long long)irq_lapic_phys,
+		(irq_madt->flags & ACPI_MADT_PCAT_COMPAT) != 0
+	);
+}
+
+/**
+ * Processor UID of the calling CPU, found by its APIC ID
+ */
+typedef struct {
+	uint32_t apic_id;
+	uint32_t uid;
+	bool found;
+} IrqProcessorLookup;
+
+static void irq_madt_find_processor(AcpiMadtEntry *entry, void *argument) {
+	IrqProcessorLookup *lookup = (IrqProcessorLookup *)argument;
+
+	if (entry->type == ACPI_MADT_LOCAL_APIC) {
+		AcpiMadtLocalApic *lapic = (AcpiMadtLocalApic *)entry;
+		if (lapic->apic_id == lookup->apic_id) {
+			lookup->uid = lapic->processor_uid;
+			lookup->found = true;
+		}
+	} else if (entry->type == ACPI_MADT_LOCAL_X2APIC) {
+		AcpiMadtLocalX2Apic *x2apic = (AcpiMadtLocalX2Apic *)entry;
+		if (x2apic->x2apic_id == lookup->apic_id) {
+			lookup->uid = x2apic->processor_uid;
+			lookup->found = true;
+		}
+	}
+}
+
+static void irq_program_nmi(uint8_t lint, uint16_t mps_flags) {
+	uint32_t lvt = LAPIC_LVT_DELIVERY_NMI;
+	if ((mps_flags & ACPI_MADT_POLARITY_MASK) == ACPI_MADT_POLARITY_LOW) {
+		lvt |= LAPIC_LVT_ACTIVE_LOW;
+	}
+	if ((mps_flags & ACPI_MADT_TRIGGER_MASK) == ACPI_MADT_TRIGGER_LEVEL) {
+		lvt |= LAPIC_LVT_LEVEL_TRIGGERED;
+	}
+
+	lapic_write(lint == 0 ? LAPIC_REG_LVT_LINT0 : LAPIC_REG_LVT_LINT1, lvt);
+}
+
+static void irq_madt_setup_nmi(AcpiMadtEntry *entry, void *argument) {
+	IrqProcessorLookup *lookup = (IrqProcessorLookup *)argument;
+
+	if (entry->type == ACPI_MADT_LOCAL_APIC_NMI) {
+		AcpiMadtLocalApicNmi *nmi = (AcpiMadtLocalApicNmi *)entry;
+		if (nmi->processor_uid == ACPI_MADT_ALL_PROCESSORS ||
+			(lookup->found && nmi->processor_uid == lookup->uid)) {
+			irq_program_nmi(nmi->lint, nmi->flags);
+		}
+	} else if (entry->type == ACPI_MADT_LOCAL_X2APIC_NMI) {
+		AcpiMadtLocalX2ApicNmi *nmi = (AcpiMadtLocalX2ApicNmi *)entry;
+		if (nmi->processor_uid == ACPI_MADT_ALL_X2_PROCESSORS ||
+			(lookup->found && nmi->processor_uid == lookup->uid)) {
+			irq_program_nmi(nmi->lint, nmi->flags);
+		}
+	}
+}
+
+void irq_initialize_cpu() {
+	IrqProcessorLookup lookup = {.apic_id = lapic_id()};
+
+	irq_madt_walk(irq_madt_find_processor, &lookup);
+	irq_madt_walk(irq_madt_setup_nmi, &lookup);
+}
+
+uintptr_t irq_lapic_address() { return irq_lapic_phys; }
+
+/*
+ * ============================================================================
+ * Vector allocation and routing
+ * ============================================================================
+ */
+
+/**
+ * Picks the CPU an interrupt is delivered to. Called with irq_lock held.
+ *
+ * @return The CPU index, or IRQ_AFFINITY_ANY if the requested CPU is invalid
+ */
+static uint32_t irq_pick_cpu(uint32_t cpu) {
+	uint32_t count = smp_cpu_count();
+
+	if (cpu != IRQ_AFFINITY_ANY) {
+		return cpu < count ? cpu : IRQ_AFFINITY_ANY;
+	}
+
+	// Least loaded CPU, so busy devices do not all land on the boot CPU
+	uint32_t best = 0;
+	for (uint32_t i = 1; i < count; i++) {
+		if (irq_cpu_load[i] < irq_cpu_load[best]) {
+			best = i;
+		}
+	}
+	return best;
+}
+
+/**
+ * Points the source of a descriptor at its CPU and unmasks it. Called with
+ * irq_lock held.
+ */
+static bool irq_program(IrqDescriptor *descriptor, uint8_t vector) {
+	uint32_t apic_id = cpu_get(descriptor->cpu)->apic_id;
+
+	switch (descriptor->source) {
+	case IRQ_SOURCE_IOAPIC:
+		if (!ioapic_route(
+				descriptor->gsi, vector, apic_id, descriptor->flags
+			)) {
+			return false;
+		}
+		ioapic_unmask(descriptor->gsi);
+		return true;
+	case IRQ_SOURCE_MSI:
+		// Message addresses only hold 8-bit destinations
+		if (apic_id > 0xFF) {
+			return false;
+		}
+		return pci_msi_enable(descriptor->pci, msi_message(apic_id, vector));
+	case IRQ_SOURCE_MSIX:
+		if (apic_id > 0xFF) {
+			return false;
+		}
+		pci_msix_write_entry(
+			descriptor->msix_table,
+			descriptor->msix_entry,
+			msi_message(apic_id, vector),
+			false
+		);
+		return true;
+	default:
+		return false;
+	}
+}
+
+static void irq_mask_source(IrqDescriptor *descriptor) {
+	switch (descriptor->source) {
+	case IRQ_SOURCE_IOAPIC:
+		ioapic_mask(descriptor->gsi);
+		break;
+	case IRQ_SOURCE_MSI:
+		pci_msi_disable(descriptor->pci);
+		break;
+	case IRQ_SOURCE_MSIX:
+		pci_msix_write_entry(
+			descriptor->msix_table,
+			descriptor->msix_entry,
+			(MsiMessage){0},
+			true
+		);
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * Allocates a vector for a source, registers the action on it, then programs
+ * and unmasks the source
+ *
+ * @param source Descriptor to copy, without the CPU
+ * @return The vector, or -1 on failure
+ */
+static int irq_setup(
+	const IrqDescriptor *source, InterruptAction *action, uint32_t cpu
+) {
+	uint64_t rflags = ticket_lock_acquire_irqsave(&irq_lock);
+
+	cpu = irq_pick_cpu(cpu);
+	if (cpu == IRQ_AFFINITY_ANY) {
+		ticket_lock_release_irqrestore(&irq_lock, rflags);
+		return -1;
+	}
+
+	int vector = -1;
+	for (uint32_t i = 0; i < IRQ_VECTOR_COUNT; i++) {
+		if (irq_descriptors[i].source == IRQ_SOURCE_NONE) {
+			vector = IRQ_VECTOR_FIRST + i;
+			break;
+		}
+	}
+
+	// The handler goes in first, the source may fire as soon as it is
+	// programmed
+	if (vector < 0 || !interrupt_register(vector, action)) {
+		ticket_lock_release_irqrestore(&irq_lock, rflags);
+		return -1;
+	}
+
+	IrqDescriptor *descriptor = &irq_descriptors[vector - IRQ_VECTOR_FIRST];
+	*descriptor = *source;
+	descriptor->cpu = cpu;
+	descriptor->users = 1;
+
+	if (!irq_program(descriptor, vector)) {
+		descriptor->source = IRQ_SOURCE_NONE;
+		ticket_lock_release_irqrestore(&irq_lock, rflags);
+
+		// The source never fired, this only waits out the grace period
+		interrupt_unregister(vector, action);
+		return -1;
+	}
+
+	irq_cpu_load[cpu]++;
+	ticket_lock_release_irqrestore(&irq_lock, rflags);
+
+	log_message(
+		&kernel_debug_logger,
+		LOG_INFO,
+		"irq",
+		"Routed interrupt {name=%s, vector=0x%x, cpu=%d, source=%d}\n",
+		action->name,
+		vector,
+		cpu,
+		source->source
+	);
+	return vector;
+}
+
+int irq_route_isa(uint8_t isa, InterruptAction *action, uint32_t cpu) {
+	if (isa >= IRQ_ISA_COUNT) {
+		return -1;
+	}
+
+	IrqIsaRoute *route = &irq_isa_routes[isa];
+	return irq_route_gsi(route->gsi, route->flags, action, cpu);
+}
+
+/**
+ * Adds a shared action to a GSI that is already routed
+ *
+ * @return The vector, -1 if the GSI is routed but cannot be shared, or 0 if it
+ *         is not routed yet
+ */
+static int irq_share_gsi(uint32_t gsi, InterruptAction *action) {
+	uint64_t rflags = ticket_lock_acquire_irqsave(&irq_lock);
+
+	for (uint32_t i = 0; i < IRQ_VECTOR_COUNT; i++) {
+		IrqDescriptor *descriptor = &irq_descriptors[i];
+		if (descriptor->source != IRQ_SOURCE_IOAPIC || descriptor->gsi != gsi) {
+			continue;
+		}
+
+		int vector = IRQ_VECTOR_FIRST + i;
+		if (!interrupt_register(vector, action)) {
+			vector = -1;
+		} else {
+			descriptor->users++;
+		}
+
+		ticket_lock_release_irqrestore(&irq_lock, rflags);
+		return vector;
+	}
+
+	ticket_lock_release_irqrestore(&irq_lock, rflags);
+	return 0;
+}
+
+int irq_route_gsi(
+	uint32_t gsi, uint32_t flags, InterruptAction *action, uint32_t cpu
+) {
+	if (!ioapic_has_gsi(gsi)) {
+		return -1;
+	}
+
+	int vector = irq_share_gsi(gsi, action);
+	if (vector != 0) {
+		return vector;
+	}
+
+	IrqDescriptor source = {
+		.source = IRQ_SOURCE_IOAPIC,
+		.gsi = gsi,
+		.flags = flags & (IOAPIC_ACTIVE_LOW | IOAPIC_LEVEL_TRIGGERED),
+	};
+	return irq_setup(&source, action, cpu);
+}
+
+int irq_msi_enable(PciAddress address, InterruptAction *action, uint32_t cpu) {
+	if (pci_find_capability(address, PCI_CAP_MSI) == 0) {
+		return -1;
+	}
+
+	IrqDescriptor source = {
+		.source = IRQ_SOURCE_MSI,
+		.pci = address,
+	};
+	return irq_setup(&source, action, cpu);
+}
+
+int irq_msix_enable(
+	PciAddress address, uint16_t entry, InterruptAction *action, uint32_t cpu
+) {
+	uint64_t table_phys;
+	uint16_t entries;
+	if (!pci_msix_table(address, &table_phys, &entries) || entry >= entries) {
+		return -1;
+	}
+
+	// Mapping again for every entry is harmless, it lands on the same pages
+	void *table = paging_map_mmio(table_phys, entries * PCI_MSIX_ENTRY_SIZE);
+	if (table == NULL) {
+		return -1;
+	}
+
+	IrqDescriptor source = {
+		.source = IRQ_SOURCE_MSIX,
+		.pci = address,
+		.msix_table = table,
+		.msix_entry = entry,
+	};
+
+	int vector = irq_setup(&source, action, cpu);
+	if (vector >= 0) {
+		pci_msix_set_enabled(address, true);
+	}
+	return vector;
+}
+
+bool irq_set_affinity(uint8_t vector, uint32_t cpu) {
+	if (vector < IRQ_VECTOR_FIRST || vector > IRQ_VECTOR_LAST) {
+		return false;
+	}
+
+	IrqDescriptor *descriptor = &irq_descriptors[vector - IRQ_VECTOR_FIRST];
+	uint64_t rflags = ticket_lock_acquire_irqsave(&irq_lock);
+
+	uint32_t old_cpu = descriptor->cpu;
+	if (descriptor->source != IRQ_SOURCE_NONE) {
+		// Leave the vector's own load out when picking a new CPU
+		irq_cpu_load[old_cpu]--;
+		cpu = irq_pick_cpu(cpu);
+	} else {
+		cpu = IRQ_AFFINITY_ANY;
+	}
+
+	bool moved = false;
+	if (cpu != IRQ_AFFINITY_ANY) {
+		descriptor->cpu = cpu;
+		moved = irq_program(descriptor, vector);
+		if (!moved) {
+			descriptor->cpu = old_cpu;
+			irq_program(descriptor, vector);
+		}
+	}
+
+	if (descriptor->source != IRQ_SOURCE_NONE) {
+		irq_cpu_load[descriptor->cpu]++;
+	}
+
+	ticket_lock_release_irqrestore(&irq_lock, rflags);
+	return moved;
+}
+
+void irq_free(uint8_t vector, InterruptAction *action) {
+	if (vector < IRQ_VECTOR_FIRST || vector > IRQ_VECTOR_LAST) {
+		return;
+	}
+
+	IrqDescriptor *descriptor = &irq_descriptors[vector - IRQ_VECTOR_FIRST];
+
+	// Mask before the last handler goes away, a level-triggered source would
+	// otherwise keep firing with nobody to quieten it
+	uint64_t rflags = ticket_lock_acquire_irqsave(&irq_lock);
+	if (descriptor->source != IRQ_SOURCE_NONE && descriptor->users == 1) {
+		irq_mask_source(descriptor);
+	}
+	ticket_lock_release_irqrestore(&irq_lock, rflags);
+
+	interrupt_unregister(vector, action);
+
+	rflags = ticket_lock_acquire_irqsave(&irq_lock);
+	if (descriptor->source != IRQ_SOURCE_NONE && --descriptor->users == 0) {
+		irq_cpu_load[descriptor->cpu]--;
+		descriptor->source = IRQ_SOURCE_NONE;
+	}
+	ticket_lock_release_irqrestore(&irq_lock, rflags);
+}
+
+/*
+ * ============================================================================
+ * Threaded handlers
+ * ============================================================================
+ */
+
+/**
+ * Masks the source of a vector if it is level-triggered, an edge-triggered
+ * source cannot storm while its thread catches up
+ *
+ * @return true if the source was masked
+ */
+static bool irq_mask_level(uint8_t vector) {
+	if (vector < IRQ_VECTOR_FIRST || vector > IRQ_VECTOR_LAST) {
+		return false;
+	}
+
+	IrqDescriptor *descriptor = &irq_descriptors[vector - IRQ_VECTOR_FIRST];
+	uint64_t rflags = ticket_lock_acquire_irqsave(&irq_lock);
+
+	bool masked = descriptor->source == IRQ_SOURCE_IOAPIC &&
+				  (descriptor->flags & IOAPIC_LEVEL_TRIGGERED);
+	if (masked) {
+		ioapic_mask(descriptor->gsi);
+	}
+
+	ticket_lock_release_irqrestore(&irq_lock, rflags);
+	return masked;
+}
+
+static void irq_unmask_level(uint8_t vector) {
+	IrqDescriptor *descriptor = &irq_descriptors[vector - IRQ_VECTOR_FIRST];
+	uint64_t rflags = ticket_lock_acquire_irqsave(&irq_lock);
+
+	if (descriptor->source == IRQ_SOURCE_IOAPIC) {
+		ioapic_unmask(descriptor->gsi);
+	}
+
+	ticket_lock_release_irqrestore(&irq_lock, rflags);
+}
+
+/**
+ * Hard interrupt part of a threaded handler
+ */
+static bool irq_thread_hard(InterruptFrame *frame, void *context) {
+	(void)frame;
+
+	IrqThread *irq_thread = (IrqThread *)context;
+	uint8_t vector = interrupt_current_vector();
+
+	ticket_lock_acquire(&irq_thread->lock);
+	irq_thread->pending = true;
+	if (!irq_thread->masked && irq_mask_level(vector)) {
+		irq_thread->masked = true;
+		irq_thread->vector = vector;
+	}
+	Thread *thread = irq_thread->thread;
+	ticket_lock_release(&irq_thread->lock);
+
+	// Before irq_thread_start the thread finds pending set when it starts
+	if (thread != NULL) {
+		thread_wake(thread);
+	}
+
+	// The device is only checked in the thread, claim every interrupt
+	return true;
+}
+
+static void irq_thread_main(void *argument) {
+	IrqThread *irq_thread = (IrqThread *)argument;
+	Thread *self = thread_current();
+	uint64_t burst_start = ktime_ns();
+
+	for (;;) {
+		uint64_t rflags = ticket_lock_acquire_irqsave(&irq_thread->lock);
+
+		if (!irq_thread->pending) {
+			// The hard part takes the same lock before waking us
+			self->state = THREAD_BLOCKED;
+			thread_set_priority(self, irq_thread->priority);
+
+			ticket_lock_release_irqrestore(&irq_thread->lock, rflags);
+			thread_block();
+
+			burst_start = ktime_ns();
+			continue;
+		}
+
+		irq_thread->pending = false;
+		bool masked = irq_thread->masked;
+		ticket_lock_release_irqrestore(&irq_thread->lock, rflags);
+
+		irq_thread->function(irq_thread->context);
+
+		if (masked) {
+			rflags = ticket_lock_acquire_irqsave(&irq_thread->lock);
+			irq_thread->masked = false;
+			irq_unmask_level(irq_thread->vector);
+			ticket_lock_release_irqrestore(&irq_thread->lock, rflags);
+		}
+
+		// Still busy after a whole budget, compete with ordinary threads
+		// until the device calms down
+		if (ktime_ns() - burst_start > IRQ_THREAD_BUDGET_NS &&
+			self->priority < THREAD_PRIORITY_NORMAL) {
+			thread_set_priority(self, THREAD_PRIORITY_NORMAL);
+			thread_yield();
+		}
+	}
+}
+
+void irq_thread_init(
+	IrqThread *irq_thread,
+	const char *name,
+	IrqThreadFunction function,
+	void *context,
+	ThreadPriority priority,
+	uint32_t flags
+) {
+	interrupt_action_init(
+		&irq_thread->action,
+		name,
+		irq_thread_hard,
+		irq_thread,
+		flags & INTERRUPT_SHARED
+	);
+	irq_thread->function = function;
+	irq_thread->context = context;
+	irq_thread->priority = priority;
+	irq_thread->thread = NULL;
+	ticket_lock_init(&irq_thread->lock, name);
+	irq_thread->pending = false;
+	irq_thread->masked = false;
+	irq_thread->vector = 0;
+}
+
+/**
+ * Creates the thread on the calling CPU
+ */
+static void irq_thread_spawn(void *argument) {
+	IrqThread *irq_thread = (IrqThread *)argument;
+
+	Thread *thread =
+		thread_create(irq_thread->action.name, irq_thread_main, irq_thread);
+	if (thread == NULL) {
+		return;
+	}
+	thread_set_priority(thread, irq_thread->priority);
+
+	uint64_t rflags = ticket_lock_acquire_irqsave(&irq_thread->lock);
+	irq_thread->thread = thread;
+	ticket_lock_release_irqrestore(&irq_thread->lock, rflags);
+
+	thread_start(thread);
+}
+
+bool irq_thread_start(IrqThread *irq_thread, uint8_t vector) {
+	uint32_t cpu = this_cpu()->id;
+	if (vector >= IRQ_VECTOR_FIRST && vector <= IRQ_VECTOR_LAST) {
+		uint64_t rflags = ticket_lock_acquire_irqsave(&irq_lock);
+		IrqDescriptor *descriptor =
+			&irq_descriptors[vector - IRQ_VECTOR_FIRST];
+		if (descriptor->source != IRQ_SOURCE_NONE) {
+			cpu = descriptor->cpu;
+		}
+		ticket_lock_release_irqrestore(&irq_lock, rflags);
+	}
+
+	// Threads never migrate, so create it where the interrupt arrives
+	if (cpu == this_cpu()->id) {
+		irq_thread_spawn(irq_thread);
+	} else if (smp_call(cpu, irq_thread_spawn, irq_thread)) {
+		smp_call_wait(cpu);
+	}
+
+	if (irq_thread->thread == NULL) {
+		return false;
+	}
+
+	log_message(
+		&kernel_debug_logger,
+		LOG_INFO,
+		"irq",
+		"Started interrupt thread {name=%s, vector=0x%x, cpu=%d}\n",
+		irq_thread->action.name,
+		vector,
+		cpu
+	);
+	return true;
+}
@@ -11,18 +11,34 @@
 
 #include <hal/gdt.h>
 #include <hal/hal_logger.h>
+#include <hal/cpu.h>
+#include <hal/fpu.h>
 #include <hal/idt.h>
+#include <hal/lapic.h>
 #include <hal/serial.h>
 
+#include <kernel/acpi.h>
 #include <kernel/bootloader.h>
 #include <kernel/debug.h>
+#include <kernel/idle.h>
 #include <kernel/interrupts.h>
+#include <kernel/irq.h>
+#include <kernel/kbench.h>
 #include <kernel/paging.h>
 #include <kernel/panic.h>
+#include <kernel/percpu.h>
 #include <kernel/pmm.h>
 #include <kernel/process.h>
+#include <kernel/smp.h>
+#include <kernel/softirq.h>
 #include <kernel/stack.h>
 #include <kernel/syscalls.h>
+#include <kernel/thread.h>
+#include <kernel/tick.h>
+#include <kernel/time.h>
+#include <kernel/timer.h>
+#include <kernel/vdso.h>
+#include <kernel/workqueue.h>
 
 #include <drivers/terminal.h>
 
@@ -202,6 +218,9 @@ void _start(void) {
 		"Successfully initialized GDT\n"
 	);
 
+	// Point GS at the boot CPU's per-CPU area (the GDT reload clears it)
+	percpu_initialize();
+
 	// Set up the IDT
 	log_message(
 		&kernel_debug_logger,
@@ -246,7 +265,8 @@ void _start(void) {
 		kernel_file_request.response,
 		hhdm_request.response
 	);
-	// TODO: Initialize paging
+	// TODO: Set up our own page tables, for now we extend the bootloader's
+	paging_initialize(hhdm_request.response->offset);
 	log_message(
 		&kernel_debug_logger,
 		LOG_INFO,
@@ -254,6 +274,11 @@ void _start(void) {
 		"Successfully initialized physical memory manager\n"
 	);
 
+	// Find the ACPI tables
+	acpi_initialize(
+		rsdp_request.response != NULL ? rsdp_request.response->address : NULL
+	);
+
 	// Set up system calls
 	log_message(
 		&kernel_debug_logger,
@@ -269,6 +294,104 @@ void _start(void) {
 		"Successfully initialized system calls\n"
 	);
 
+	// Calibrate the TSC and start timestamping log records
+	log_message(
+		&kernel_debug_logger,
+		LOG_INFO,
+		"kernel",
+		"Starting clocksource initialization\n"
+	);
+	time_initialize();
+	log_set_clock(&kernel_debug_logger, ktime_ns);
+	log_set_clock(&hal_logger, ktime_ns);
+	log_message(
+		&kernel_debug_logger,
+		LOG_INFO,
+		"kernel",
+		"Successfully initialized clocksource\n"
+	);
+
+	// Hand interrupt delivery from the legacy PICs to the APICs
+	log_message(
+		&kernel_debug_logger,
+		LOG_INFO,
+		"kernel",
+		"Starting interrupt controller initialization\n"
+	);
+	irq_initialize();
+	log_message(
+		&kernel_debug_logger,
+		LOG_INFO,
+		"kernel",
+		"Successfully initialized interrupt controllers\n"
+	);
+
+	// Bring up the local APIC and the preemption timer
+	log_message(
+		&kernel_debug_logger,
+		LOG_INFO,
+		"kernel",
+		"Starting local APIC timer initialization\n"
+	);
+	void *lapic = paging_map_mmio(irq_lapic_address(), PAGE_SIZE);
+	if (lapic == NULL) {
+		kernel_panic("Could not map the local APIC", NULL);
+	}
+	lapic_initialize((uintptr_t)lapic);
+	this_cpu()->apic_id = lapic_id();
+	irq_initialize_cpu();
+	timer_initialize();
+	tick_initialize();
+	log_message(
+		&kernel_debug_logger,
+		LOG_INFO,
+		"kernel",
+		"Successfully initialized local APIC timer\n"
+	);
+
+	// Enable the FPU, turn the boot context into the idle thread and start the
+	// softirq thread
+	log_message(
+		&kernel_debug_logger,
+		LOG_INFO,
+		"kernel",
+		"Starting thread initialization\n"
+	);
+	fpu_initialize();
+	thread_initialize();
+	softirq_initialize();
+	log_message(
+		&kernel_debug_logger,
+		LOG_INFO,
+		"kernel",
+		"Successfully initialized threads\n"
+	);
+
+	// Publish the clock and CPU data to user space, the application
+	// processors add themselves as they come up
+	vdso_initialize();
+
+	// Pick how CPUs idle before any of them does
+	idle_initialize();
+
+	// Start the other CPUs, they idle until someone sends them work
+	log_message(
+		&kernel_debug_logger,
+		LOG_INFO,
+		"kernel",
+		"Starting application processors\n"
+	);
+	smp_initialize(smp_request.response);
+	log_message(
+		&kernel_debug_logger,
+		LOG_INFO,
+		"kernel",
+		"Successfully started application processors\n"
+	);
+
+	// Worker threads for deferred work that may sleep, on every CPU
+	workqueue_initialize();
+
 	// We're done! Let the user know
 	// TODO: This will eventually be replaced with a userspace jump to the
 	//       init process.
@@ -282,6 +405,13 @@ void _start(void) {
 
 	pmm_debug_print_state();
 
-	// If we got here, just chill. Halt the CPU.
-	hcf();
+	// Run the benchmarks the command line asks for, see the kbench xmake task
+	struct limine_kernel_file_response *kernel_file =
+		kernel_file_request.response;
+	kbench_initialize(
+		kernel_file != NULL ? kernel_file->kernel_file->cmdline : NULL
+	);
+
+	// If we got here, just chill. Idle without ticking until there is work.
+	idle_loop();
 }
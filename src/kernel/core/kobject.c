@@ -0,0 +1,118 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libk/spinlock.h>
+
+#include <kernel/kobject.h>
+#include <kernel/percpu.h>
+#include <kernel/preempt.h>
+#include <kernel/rcu.h>
+
+/**
+ * Per-CPU reference counters, one row per CPU so no two CPUs write the same
+ * cache line. A counter may go negative when a reference is dropped on
+ * another CPU than it was taken on, only the sum over all CPUs means
+ * anything.
+ */
+static int32_t kobject_refs[MAX_CPUS][KOBJECT_MAX]
+	__attribute__((aligned(64)));
+
+/**
+ * Ids of released objects, and the first id never handed out
+ */
+static uint16_t kobject_free_ids[KOBJECT_MAX];
+static uint32_t kobject_free_count;
+static uint32_t kobject_next_id;
+static TicketLock kobject_lock = TICKET_LOCK_INIT("kobject");
+
+bool kobject_init(KObject *object, KObjectType type, const KObjectOps *ops) {
+	uint64_t rflags = ticket_lock_acquire_irqsave(&kobject_lock);
+	uint32_t id;
+	if (kobject_free_count != 0) {
+		id = kobject_free_ids[--kobject_free_count];
+	} else if (kobject_next_id < KOBJECT_MAX) {
+		id = kobject_next_id++;
+	} else {
+		ticket_lock_release_irqrestore(&kobject_lock, rflags);
+		return false;
+	}
+	ticket_lock_release_irqrestore(&kobject_lock, rflags);
+
+	object->type = type;
+	object->ops = ops;
+	object->id = id;
+	object->shared = false;
+	object->count = KOBJECT_BIAS + 1;
+	return true;
+}
+
+static void kobject_release(KObject *object) {
+	// Every counter of the id was folded in and zeroed
+	uint64_t rflags = ticket_lock_acquire_irqsave(&kobject_lock);
+	kobject_free_ids[kobject_free_count++] = (uint16_t)object->id;
+	ticket_lock_release_irqrestore(&kobject_lock, rflags);
+
+	if (object->ops->release != NULL) {
+		object->ops->release(object);
+	}
+}
+
+void kobject_get(KObject *object) {
+	// The read-side section keeps the switch to the shared count from
+	// summing the counters while we update ours
+	rcu_read_lock();
+	if (!__atomic_load_n(&object->shared, __ATOMIC_ACQUIRE)) {
+		int32_t *ref = &kobject_refs[this_cpu()->id][object->id];
+		asm volatile("incl %0" : "+m"(*ref));
+		rcu_read_unlock();
+		return;
+	}
+	rcu_read_unlock();
+
+	__atomic_fetch_add(&object->count, 1, __ATOMIC_RELAXED);
+}
+
+void kobject_put(KObject *object) {
+	rcu_read_lock();
+	if (!__atomic_load_n(&object->shared, __ATOMIC_ACQUIRE)) {
+		int32_t *ref = &kobject_refs[this_cpu()->id][object->id];
+		asm volatile("decl %0" : "+m"(*ref));
+		rcu_read_unlock();
+		return;
+	}
+	rcu_read_unlock();
+
+	if (__atomic_sub_fetch(&object->count, 1, __ATOMIC_ACQ_REL) == 0) {
+		kobject_release(object);
+	}
+}
+
+/**
+ * Folds the per-CPU counters into the shared count, once every CPU has seen
+ * KObject.shared, and drops the handle's reference
+ */
+static void kobject_switch(RcuHead *head) {
+	KObject *object = (KObject *)((uintptr_t)head - offsetof(KObject, rcu));
+
+	int64_t sum = 0;
+	for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+		int32_t *ref = &kobject_refs[cpu][object->id];
+		sum += __atomic_load_n(ref, __ATOMIC_RELAXED);
+		__atomic_store_n(ref, 0, __ATOMIC_RELAXED);
+	}
+
+	int64_t delta = sum - KOBJECT_BIAS - 1;
+	if (__atomic_add_fetch(&object->count, delta, __ATOMIC_ACQ_REL) == 0) {
+		kobject_release(object);
+	}
+}
+
+void kobject_kill(KObject *object) {
+	if (object->ops->close != NULL) {
+		object->ops->close(object);
+	}
+
+	__atomic_store_n(&object->shared, true, __ATOMIC_RELEASE);
+	call_rcu(&object->rcu, kobject_switch);
+}
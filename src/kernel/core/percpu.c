@@ -0,0 +1,62 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libk/irqsoff.h>
+
+#include <hal/cpu.h>
+#include <hal/gdt.h>
+
+#include <kernel/debug.h>
+#include <kernel/percpu.h>
+
+__attribute__((aligned(64))) static Cpu cpus[MAX_CPUS];
+
+/**
+ * Static so interrupts can be taken before the memory manager is up
+ */
+__attribute__((aligned(16))) static uint8_t
+	irq_stacks[MAX_CPUS][IRQ_STACK_SIZE];
+
+Cpu *cpu_get(uint32_t id) { return &cpus[id]; }
+
+static IrqsOffCpu *percpu_irqsoff() { return &this_cpu()->irqsoff; }
+
+static Cpu *percpu_install(uint32_t id) {
+	Cpu *cpu = &cpus[id];
+	cpu->self = cpu;
+	cpu->id = id;
+	cpu->irq_stack_top = (uintptr_t)&irq_stacks[id][IRQ_STACK_SIZE];
+
+	// The boot context never enters ring 3, so there is no kernel stack for
+	// it until the first thread with one runs
+	cpu->kernel_stack_top = 0;
+
+	// Reloads the segment registers, so it has to come before the GS base
+	gdt_install_cpu(&cpu->gdt, cpu->kernel_stack_top);
+
+	// GS_BASE is the active base while in the kernel. KERNEL_GS_BASE holds the
+	// user value and is swapped in with swapgs on the way back to ring 3.
+	wrmsr(MSR_GS_BASE, (uint64_t)cpu);
+	wrmsr(MSR_KERNEL_GS_BASE, 0);
+
+	return cpu;
+}
+
+void percpu_initialize() {
+	Cpu *bsp = percpu_install(0);
+	bsp->online = true;
+
+	// Application processors install their GS base before anything on them
+	// disables interrupts
+	irqsoff_set_cpu_hook(percpu_irqsoff);
+
+	log_message(
+		&kernel_debug_logger,
+		LOG_INFO,
+		"percpu",
+		"Boot CPU area installed at %p\n",
+		(void *)bsp
+	);
+}
+
+void percpu_initialize_ap(uint32_t id) { percpu_install(id); }
@@ -1,25 +1,41 @@
 #include <kernel/debug.h>
+#include <kernel/panic.h>
+#include <kernel/percpu.h>
 #include <kernel/process.h>
 
 // TODO: use jemi for logging
 
-void jump_to_usermode(void *user_function, void *user_stack) {
+void jump_to_usermode(
+	void *user_function, void *user_stack, void *argument
+) {
 	if (DEBUG) {
 		log_message(
 			&kernel_debug_logger,
 			LOG_INFO,
 			"process",
-			"Jumping to usermode {entry=%p, user_stack=%p}\n",
+			"Jumping to usermode {entry=%p, user_stack=%p, argument=%p}\n",
 			user_function,
-			user_stack
+			user_stack,
+			argument
 		);
 	}
 
-	asm volatile("mov %0, %%rcx\n"	   // RIP for sysretq (address to return to)
+	// System calls and interrupts from ring 3 need somewhere to land
+	if (this_cpu()->kernel_stack_top == 0) {
+		kernel_panic("Jumping to usermode without a kernel stack", NULL);
+	}
+
+	// Interrupts stay off until sysretq loads the user rflags, the user GS
+	// base goes live with swapgs
+	asm volatile("cli\n"
+				 "swapgs\n"
+				 "mov %0, %%rcx\n"	   // RIP for sysretq (address to return to)
 				 "mov %1, %%rsp\n"	   // Set up the user stack
+				 "mov %2, %%rdi\n"	   // First argument of the user function
 				 "mov $0x202, %%r11\n" // RFLAGS for sysretq
 				 "sysretq\n"
 				 :
-				 : "r"(user_function), "r"(user_stack)
-				 : "rcx", "r11");
+				 : "r"(user_function), "r"(user_stack), "r"(argument)
+				 : "rcx", "rdi", "r11", "memory");
+	__builtin_unreachable();
 }
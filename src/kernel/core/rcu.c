@@ -0,0 +1,280 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libk/spinlock.h>
+
+#include <hal/cpu.h>
+
+#include <kernel/debug.h>
+#include <kernel/paging.h>
+#include <kernel/percpu.h>
+#include <kernel/pmm.h>
+#include <kernel/rcu.h>
+#include <kernel/smp.h>
+#include <kernel/softirq.h>
+#include <kernel/timer.h>
+
+/**
+ * Per-CPU RCU state
+ */
+typedef struct {
+	/**
+	 * Incremented on every idle transition, odd while the CPU is idle
+	 * (outside of interrupt handlers). Zero-initialized CPUs count as busy.
+	 */
+	_Atomic uint64_t dynticks;
+
+	/**
+	 * Callbacks not yet assigned to a grace period
+	 */
+	RcuHead *next_list;
+
+	/**
+	 * Callbacks waiting for grace period wait_seq to complete
+	 */
+	RcuHead *wait_list;
+	uint64_t wait_seq;
+
+	/**
+	 * Drives grace periods while this CPU has callbacks
+	 */
+	Timer timer;
+} __attribute__((aligned(64))) RcuCpu;
+
+static RcuCpu rcu_cpus[MAX_CPUS];
+
+/**
+ * Grace period state. A grace period completes once every CPU that was busy
+ * when it started has cleared its bit in gp_pending_cpus by passing through a
+ * quiescent state (a tick outside of a read-side section, or idle).
+ */
+static TicketLock rcu_lock = TICKET_LOCK_INIT("rcu");
+static uint64_t gp_started;
+static _Atomic uint64_t gp_completed;
+static bool gp_requested;
+static _Atomic uint64_t gp_pending_cpus;
+
+static void rcu_gp_start();
+
+/**
+ * Marks the current grace period complete and starts the next one if needed.
+ * Called with rcu_lock held.
+ */
+static void rcu_gp_end() {
+	atomic_store_explicit(&gp_completed, gp_started, memory_order_release);
+
+	if (gp_requested) {
+		gp_requested = false;
+		rcu_gp_start();
+	}
+}
+
+/**
+ * Clears the bits of CPUs that passed through a quiescent state
+ *
+ * @return true if that completed the grace period
+ */
+static bool rcu_clear_pending(uint64_t cpus) {
+	uint64_t old = atomic_fetch_and(&gp_pending_cpus, ~cpus);
+	return (old & cpus) != 0 && (old & ~cpus) == 0;
+}
+
+/**
+ * Starts a new grace period. Called with rcu_lock held.
+ */
+static void rcu_gp_start() {
+	uint32_t count = smp_cpu_count();
+	uint64_t mask = 0;
+
+	gp_started++;
+
+	for (uint32_t i = 0; i < count; i++) {
+		if (cpu_get(i)->online) {
+			mask |= 1ULL << i;
+		}
+	}
+	atomic_store(&gp_pending_cpus, mask);
+
+	// Idle CPUs cannot hold references. Checking after publishing the mask
+	// pairs with rcu_idle_enter, so a CPU going idle right now is seen either
+	// here or by its own report.
+	uint64_t idle = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		uint64_t bit = 1ULL << i;
+		if ((mask & bit) && (atomic_load(&rcu_cpus[i].dynticks) & 1)) {
+			idle |= bit;
+		}
+	}
+
+	if (mask == 0 || (idle != 0 && rcu_clear_pending(idle))) {
+		rcu_gp_end();
+	}
+}
+
+/**
+ * Returns the number of a grace period that starts after this call, starting
+ * one if none is in progress. Called with rcu_lock held.
+ */
+static uint64_t rcu_request_gp() {
+	uint64_t completed =
+		atomic_load_explicit(&gp_completed, memory_order_relaxed);
+
+	if (gp_started == completed) {
+		rcu_gp_start();
+		return gp_started;
+	}
+
+	gp_requested = true;
+	return gp_started + 1;
+}
+
+/**
+ * Reports a quiescent state of the calling CPU to the current grace period
+ */
+static void rcu_report_quiescent() {
+	uint64_t bit = 1ULL << this_cpu()->id;
+
+	if (!(atomic_load(&gp_pending_cpus) & bit)) {
+		return;
+	}
+
+	if (rcu_clear_pending(bit)) {
+		uint64_t rflags = ticket_lock_acquire_irqsave(&rcu_lock);
+		rcu_gp_end();
+		ticket_lock_release_irqrestore(&rcu_lock, rflags);
+	}
+}
+
+/**
+ * Takes the callbacks whose grace period completed and queues new ones for a
+ * grace period. Called with interrupts disabled.
+ *
+ * @return The callbacks that are ready to run
+ */
+static RcuHead *rcu_advance(RcuCpu *rcu_cpu) {
+	uint64_t completed =
+		atomic_load_explicit(&gp_completed, memory_order_acquire);
+	RcuHead *done = NULL;
+
+	if (rcu_cpu->wait_list != NULL && completed >= rcu_cpu->wait_seq) {
+		done = rcu_cpu->wait_list;
+		rcu_cpu->wait_list = NULL;
+	}
+
+	if (rcu_cpu->wait_list == NULL && rcu_cpu->next_list != NULL) {
+		rcu_cpu->wait_list = rcu_cpu->next_list;
+		rcu_cpu->next_list = NULL;
+
+		ticket_lock_acquire(&rcu_lock);
+		rcu_cpu->wait_seq = rcu_request_gp();
+		ticket_lock_release(&rcu_lock);
+	}
+
+	if (rcu_cpu->wait_list != NULL || rcu_cpu->next_list != NULL) {
+		timer_start_timeout(&rcu_cpu->timer, RCU_POLL_NS);
+	}
+
+	return done;
+}
+
+static void rcu_poll(Timer *timer) {
+	(void)timer;
+	softirq_raise(SOFTIRQ_RCU);
+}
+
+void rcu_process_callbacks() {
+	uint64_t rflags = interrupts_save_disable();
+	RcuHead *head = rcu_advance(&rcu_cpus[this_cpu()->id]);
+	interrupts_restore(rflags);
+
+	while (head != NULL) {
+		// The callback frees the object holding head
+		RcuHead *next = head->next;
+		head->callback(head);
+		head = next;
+	}
+}
+
+void call_rcu(RcuHead *head, RcuCallback callback) {
+	uint64_t rflags = interrupts_save_disable();
+	RcuCpu *rcu_cpu = &rcu_cpus[this_cpu()->id];
+
+	// Callbacks run newest first, ordering between them is not guaranteed
+	head->callback = callback;
+	head->next = rcu_cpu->next_list;
+	rcu_cpu->next_list = head;
+
+	if (!timer_pending(&rcu_cpu->timer)) {
+		timer_init(&rcu_cpu->timer, rcu_poll, rcu_cpu);
+		timer_start_timeout(&rcu_cpu->timer, RCU_POLL_NS);
+	}
+
+	interrupts_restore(rflags);
+}
+
+static void rcu_free_pages_callback(RcuHead *head) {
+	pmm_free((uintptr_t)head & ~(uintptr_t)(PAGE_SIZE - 1));
+}
+
+void rcu_free_pages(RcuHead *head) { call_rcu(head, rcu_free_pages_callback); }
+
+void synchronize_rcu() {
+	if (!preemptible()) {
+		log_message(
+			&kernel_debug_logger,
+			LOG_ERROR,
+			"rcu",
+			"synchronize_rcu called from a read-side critical section\n"
+		);
+		return;
+	}
+
+	uint64_t rflags = ticket_lock_acquire_irqsave(&rcu_lock);
+	uint64_t target = rcu_request_gp();
+	ticket_lock_release_irqrestore(&rcu_lock, rflags);
+
+	while (atomic_load_explicit(&gp_completed, memory_order_acquire) <
+		   target) {
+		// Waiting here is a quiescent state for this CPU
+		rflags = interrupts_save_disable();
+		rcu_report_quiescent();
+		interrupts_restore(rflags);
+
+		cpu_relax();
+	}
+}
+
+void rcu_tick() {
+	if (this_cpu()->preempt_count == 0) {
+		rcu_report_quiescent();
+	}
+}
+
+void rcu_idle_enter() {
+	atomic_fetch_add(&rcu_cpus[this_cpu()->id].dynticks, 1);
+	rcu_report_quiescent();
+}
+
+void rcu_idle_exit() {
+	atomic_fetch_add(&rcu_cpus[this_cpu()->id].dynticks, 1);
+}
+
+bool rcu_irq_enter() {
+	RcuCpu *rcu_cpu = &rcu_cpus[this_cpu()->id];
+
+	// Interrupt handlers may read, so an idle CPU is busy while they run
+	if (atomic_load_explicit(&rcu_cpu->dynticks, memory_order_relaxed) & 1) {
+		atomic_fetch_add(&rcu_cpu->dynticks, 1);
+		return true;
+	}
+
+	return false;
+}
+
+void rcu_irq_exit(bool from_idle) {
+	if (from_idle) {
+		rcu_idle_enter();
+	}
+}
@@ -0,0 +1,594 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libk/spinlock.h>
+#include <libk/string.h>
+
+#include <hal/cpu.h>
+
+#include <kernel/async.h>
+#include <kernel/debug.h>
+#include <kernel/paging.h>
+#include <kernel/pin.h>
+#include <kernel/pmm.h>
+#include <kernel/preempt.h>
+#include <kernel/ring.h>
+#include <kernel/syscalls.h>
+#include <kernel/thread.h>
+#include <kernel/time.h>
+
+static bool ring_user_range(uint64_t address, uint64_t length) {
+	return address + length >= address && address + length <= PAGING_USER_END;
+}
+
+/**
+ * Indexes written by the other side are read once per batch with acquire,
+ * our own are published once per batch with release
+ */
+static uint32_t ring_load(volatile uint32_t *index) {
+	return __atomic_load_n(index, __ATOMIC_ACQUIRE);
+}
+
+static void ring_store(volatile uint32_t *index, uint32_t value) {
+	__atomic_store_n(index, value, __ATOMIC_RELEASE);
+}
+
+static bool ring_pending(Ring *ring) {
+	return ring_load(&ring->header->submission.tail) != ring->submission_head;
+}
+
+static uint32_t ring_completions_ready(Ring *ring) {
+	return ring_load(&ring->header->completion.tail) -
+		   ring_load(&ring->header->completion.head);
+}
+
+/**
+ * Runs one request with the system call handler behind it
+ */
+static SystemCallReturn ring_execute(
+	Ring *ring, const RingSubmission *submission
+) {
+	const SystemCallReturn invalid = {
+		.value = 0, .error = SYSCALL_ERROR_INVALID_ARGS
+	};
+
+	if (submission->opcode == RING_OP_NOP) {
+		return (SystemCallReturn){.value = 0, .error = SYSCALL_SUCCESS};
+	}
+	if (submission->opcode >= RING_OP_COUNT ||
+		!syscall_valid_SIZE(submission->length, sizeof(size_t))) {
+		return invalid;
+	}
+
+	// Registered buffers are pinned, only the bounds are left
+	uint64_t address = submission->address;
+	if (submission->flags & RING_SUBMIT_FIXED_BUFFER) {
+		uint32_t count =
+			__atomic_load_n(&ring->buffer_count, __ATOMIC_ACQUIRE);
+		if (submission->buffer >= count) {
+			return invalid;
+		}
+
+		RingBuffer *buffer = &ring->buffers[submission->buffer];
+		if (address > buffer->length ||
+			submission->length > buffer->length - address) {
+			return invalid;
+		}
+		address += buffer->address;
+	} else if (!ring_user_range(address, submission->length)) {
+		return invalid;
+	}
+
+	switch (submission->opcode) {
+	case RING_OP_READ:
+		return syscall_read(
+			submission->fd, (void *)address, submission->length
+		);
+	case RING_OP_WRITE:
+		return syscall_write(
+			submission->fd, (const void *)address, submission->length
+		);
+	default:
+		return invalid;
+	}
+}
+
+/**
+ * Wakes the thread in ring_enter once enough completions are visible
+ */
+static void ring_wake_waiter(Ring *ring) {
+	uint64_t rflags = ticket_lock_acquire_irqsave(&ring->wait_lock);
+
+	Thread *waiter = ring->waiter;
+	if (waiter != NULL && (ring_completions_ready(ring) >= ring->wait_target ||
+						   ring->stopping)) {
+		ring->waiter = NULL;
+	} else {
+		waiter = NULL;
+	}
+
+	ticket_lock_release_irqrestore(&ring->wait_lock, rflags);
+
+	if (waiter != NULL) {
+		thread_wake(waiter);
+	}
+}
+
+static bool ring_async_pending(Ring *ring) {
+	return __atomic_load_n(&ring->async_head, __ATOMIC_ACQUIRE) != NULL;
+}
+
+/**
+ * Posts the completions of finished asynchronous system calls, as many as fit
+ *
+ * @return The number of completions posted
+ */
+static uint32_t ring_flush_async(Ring *ring) {
+	if (!ring_async_pending(ring)) {
+		return 0;
+	}
+
+	uint32_t completion_head = ring_load(&ring->header->completion.head);
+	uint32_t posted = 0;
+
+	while (ring->completion_tail - completion_head <= ring->completion_mask) {
+		uint64_t rflags = ticket_lock_acquire_irqsave(&ring->async_lock);
+		AsyncCall *call = ring->async_head;
+		if (call != NULL) {
+			ring->async_head = call->next;
+			if (ring->async_head == NULL) {
+				ring->async_tail = NULL;
+			}
+		}
+		ticket_lock_release_irqrestore(&ring->async_lock, rflags);
+
+		if (call == NULL) {
+			break;
+		}
+
+		RingCompletion *completion =
+			&ring->completions[ring->completion_tail & ring->completion_mask];
+		completion->user_data = RING_ASYNC_USER_DATA | call->id;
+		completion->value = call->result.value;
+		completion->error = call->result.error;
+		completion->reserved = 0;
+		ring->completion_tail++;
+		posted++;
+
+		async_call_free(call);
+	}
+
+	if (posted != 0) {
+		ring_store(&ring->header->completion.tail, ring->completion_tail);
+	}
+	return posted;
+}
+
+void ring_complete_async(Ring *ring, AsyncCall *call) {
+	// Nobody reaps completions of a released ring
+	if (ring->stopping) {
+		async_call_free(call);
+		return;
+	}
+
+	call->next = NULL;
+
+	uint64_t rflags = ticket_lock_acquire_irqsave(&ring->async_lock);
+	if (ring->async_tail != NULL) {
+		ring->async_tail->next = call;
+	} else {
+		ring->async_head = call;
+	}
+	ring->async_tail = call;
+	ticket_lock_release_irqrestore(&ring->async_lock, rflags);
+
+	if (ring->poller != NULL) {
+		thread_wake(ring->poller);
+		return;
+	}
+
+	// The owner posts it, wake it if it waits in ring_enter
+	rflags = ticket_lock_acquire_irqsave(&ring->wait_lock);
+	Thread *waiter = ring->waiter;
+	ring->waiter = NULL;
+	ticket_lock_release_irqrestore(&ring->wait_lock, rflags);
+
+	if (waiter != NULL) {
+		thread_wake(waiter);
+	}
+}
+
+/**
+ * Runs up to limit queued submissions and posts their completions. Both
+ * indexes are published once for the whole batch. Stops early when the
+ * completion ring is full, the rest stays queued.
+ *
+ * @return The number of submissions consumed
+ */
+static uint32_t ring_drain(Ring *ring, uint32_t limit) {
+	RingHeader *header = ring->header;
+
+	uint32_t pending =
+		ring_load(&header->submission.tail) - ring->submission_head;
+	if (pending > ring->submission_mask + 1) {
+		pending = ring->submission_mask + 1;
+	}
+	if (pending > limit) {
+		pending = limit;
+	}
+
+	uint32_t completion_head = ring_load(&header->completion.head);
+	uint32_t consumed = 0;
+
+	while (consumed < pending) {
+		if (ring->completion_tail - completion_head > ring->completion_mask) {
+			completion_head = ring_load(&header->completion.head);
+			if (ring->completion_tail - completion_head >
+				ring->completion_mask) {
+				break;
+			}
+		}
+
+		// Copied once, user space may rewrite the entry behind our back
+		RingSubmission submission =
+			ring->submissions[ring->submission_head & ring->submission_mask];
+		ring->submission_head++;
+		consumed++;
+
+		SystemCallReturn result;
+		if (ring->chain_failed) {
+			result = (SystemCallReturn){
+				.value = 0, .error = SYSCALL_ERROR_CANCELED
+			};
+		} else {
+			result = ring_execute(ring, &submission);
+		}
+
+		// A failure cancels the rest of its chain, the first entry without
+		// RING_SUBMIT_LINK ends it
+		if (submission.flags & RING_SUBMIT_LINK) {
+			ring->chain_failed |= result.error != SYSCALL_SUCCESS;
+		} else {
+			ring->chain_failed = false;
+		}
+
+		RingCompletion *completion =
+			&ring->completions[ring->completion_tail & ring->completion_mask];
+		completion->user_data = submission.user_data;
+		completion->value = result.value;
+		completion->error = result.error;
+		completion->reserved = 0;
+		ring->completion_tail++;
+	}
+
+	if (consumed != 0) {
+		ring_store(&header->submission.head, ring->submission_head);
+		ring_store(&header->completion.tail, ring->completion_tail);
+	}
+	return consumed;
+}
+
+/**
+ * Body of the RING_SETUP_POLL thread. Polls while submissions keep coming,
+ * yielding in between, and sleeps after RING_POLL_IDLE_NS without any.
+ */
+static void ring_poll_thread(void *argument) {
+	Ring *ring = (Ring *)argument;
+	uint64_t idle_since = ktime_ns();
+
+	while (!ring->stopping) {
+		uint32_t posted = ring_flush_async(ring);
+		if (ring_drain(ring, UINT32_MAX) != 0 || posted != 0) {
+			ring_wake_waiter(ring);
+			idle_since = ktime_ns();
+			thread_yield();
+			continue;
+		}
+
+		if (ktime_ns() - idle_since < RING_POLL_IDLE_NS) {
+			thread_yield();
+			continue;
+		}
+
+		// Submitters store the tail, then read the flags. Either they see
+		// the flag and wake us, or we see their submission below.
+		__atomic_fetch_or(
+			&ring->header->flags, RING_NEED_WAKEUP, __ATOMIC_SEQ_CST
+		);
+
+		// Only ring_enter on this CPU wakes us, disabling interrupts is
+		// enough to not miss it
+		uint64_t rflags = interrupts_save_disable();
+		if (!ring_pending(ring) && !ring_async_pending(ring) &&
+			!ring->stopping) {
+			thread_current()->state = THREAD_BLOCKED;
+			thread_block();
+		}
+		interrupts_restore(rflags);
+
+		__atomic_fetch_and(
+			&ring->header->flags, ~RING_NEED_WAKEUP, __ATOMIC_RELAXED
+		);
+		idle_since = ktime_ns();
+	}
+
+	ring_wake_waiter(ring);
+
+	// Last access to the ring, ring_release unpins the buffers after this
+	__atomic_store_n(&ring->poller_done, true, __ATOMIC_RELEASE);
+}
+
+/**
+ * Blocks until min_complete completions are visible or the ring stops.
+ * Without a polling thread, posts finished asynchronous calls meanwhile.
+ */
+static void ring_wait(Ring *ring, uint32_t min_complete) {
+	Thread *current = thread_current();
+	bool owner_posts = ring->poller == NULL;
+
+	for (;;) {
+		if (owner_posts) {
+			ring_flush_async(ring);
+		}
+
+		uint64_t rflags = ticket_lock_acquire_irqsave(&ring->wait_lock);
+
+		if (ring_completions_ready(ring) >= min_complete || ring->stopping) {
+			ticket_lock_release_irqrestore(&ring->wait_lock, rflags);
+			return;
+		}
+
+		// Finished after the flush above, go around again. The completion
+		// ring is not full, or min_complete would be met.
+		if (owner_posts && ring_async_pending(ring)) {
+			ticket_lock_release_irqrestore(&ring->wait_lock, rflags);
+			continue;
+		}
+
+		ring->waiter = current;
+		ring->wait_target = min_complete;
+		current->state = THREAD_BLOCKED;
+
+		ticket_lock_release_irqrestore(&ring->wait_lock, rflags);
+
+		thread_block();
+	}
+}
+
+/**
+ * Unmaps the first size bytes of a ring's user mapping, leaving the frames to
+ * the ring's memory block
+ */
+static void ring_unmap(uintptr_t base, size_t size) {
+	for (size_t offset = 0; offset < size; offset += PAGE_SIZE) {
+		uintptr_t frame;
+		paging_unmap_pages(base + offset, 1, &frame);
+	}
+}
+
+int64_t ring_setup(void *address, uint32_t entries, uint32_t flags) {
+	Thread *current = thread_current();
+	uintptr_t base = (uintptr_t)address;
+
+	if (current->ring != NULL || entries == 0 || entries > RING_MAX_ENTRIES ||
+		(entries & (entries - 1)) != 0 || (base & (PAGE_SIZE - 1)) != 0 ||
+		(flags & ~RING_SETUP_POLL) != 0) {
+		return SYSCALL_ERROR_INVALID_ARGS;
+	}
+
+	// Header page, then the submissions, then twice as many completions
+	uint32_t completion_entries = entries * 2;
+	size_t completion_offset = PAGE_SIZE + entries * sizeof(RingSubmission);
+	size_t size =
+		completion_offset + completion_entries * sizeof(RingCompletion);
+	size = (size + PAGE_SIZE - 1) & ~(size_t)(PAGE_SIZE - 1);
+	if (!ring_user_range(base, size) || base + size > VDSO_DATA_ADDRESS) {
+		return SYSCALL_ERROR_INVALID_ARGS;
+	}
+
+	// Mapping over a page would leak its frame
+	for (size_t offset = 0; offset < size; offset += PAGE_SIZE) {
+		uintptr_t phys;
+		if (paging_translate(base + offset, &phys)) {
+			return SYSCALL_ERROR_INVALID_ARGS;
+		}
+	}
+
+	Ring *ring = (Ring *)pmm_alloc(sizeof(Ring));
+	uintptr_t memory = pmm_alloc(size);
+	if (ring == NULL || memory == 0) {
+		if (ring != NULL) {
+			pmm_free((uintptr_t)ring);
+		}
+		if (memory != 0) {
+			pmm_free(memory);
+		}
+		return SYSCALL_ERROR_NO_MEMORY;
+	}
+	memset(ring, 0, sizeof(Ring));
+	memset((void *)memory, 0, size);
+
+	size_t mapped = 0;
+	while (mapped < size &&
+		   paging_map_page(
+			   base + mapped,
+			   virt_to_phys((void *)(memory + mapped)),
+			   PAGE_PRESENT | PAGE_WRITABLE | PAGE_USER | PAGE_NO_EXECUTE
+		   )) {
+		mapped += PAGE_SIZE;
+	}
+
+	// The kernel works through the direct map, the user mapping is only for
+	// user space
+	ring->header = (RingHeader *)memory;
+	ring->user_address = base;
+	ring->size = size;
+	ring->submissions = (RingSubmission *)(memory + PAGE_SIZE);
+	ring->completions = (RingCompletion *)(memory + completion_offset);
+	ring->submission_mask = entries - 1;
+	ring->completion_mask = completion_entries - 1;
+	ticket_lock_init(&ring->wait_lock, "ring_wait");
+	ticket_lock_init(&ring->async_lock, "ring_async");
+
+	ring->header->submission_entries = entries;
+	ring->header->completion_entries = completion_entries;
+	ring->header->submission_offset = PAGE_SIZE;
+	ring->header->completion_offset = completion_offset;
+
+	// Created on this CPU like every thread, so it shares it with its owner
+	if (mapped == size && (flags & RING_SETUP_POLL)) {
+		ring->poller = thread_create("ring_poll", ring_poll_thread, ring);
+	}
+	if (mapped != size || ((flags & RING_SETUP_POLL) && ring->poller == NULL)) {
+		ring_unmap(base, mapped);
+		pmm_free(memory);
+		pmm_free((uintptr_t)ring);
+		return SYSCALL_ERROR_NO_MEMORY;
+	}
+
+	current->ring = ring;
+	if (ring->poller != NULL) {
+		thread_start(ring->poller);
+	}
+
+	if (DEBUG) {
+		log_message(
+			&kernel_debug_logger,
+			LOG_INFO,
+			"ring",
+			"Ring set up {thread=%s, address=%p, entries=%d, poll=%d}\n",
+			current->name,
+			address,
+			entries,
+			ring->poller != NULL
+		);
+	}
+
+	return SYSCALL_SUCCESS;
+}
+
+int64_t ring_enter(uint32_t to_submit, uint32_t min_complete, uint32_t flags) {
+	Ring *ring = thread_current()->ring;
+	if (ring == NULL ||
+		(flags & ~(RING_ENTER_GETEVENTS | RING_ENTER_POLL_WAKEUP)) != 0) {
+		return SYSCALL_ERROR_INVALID_ARGS;
+	}
+
+	if ((flags & RING_ENTER_GETEVENTS) &&
+		min_complete > ring->completion_mask + 1) {
+		return SYSCALL_ERROR_INVALID_ARGS;
+	}
+
+	// Every request completes before ring_drain returns, without a polling
+	// thread only asynchronous system calls are left to wait for
+	if (ring->poller == NULL) {
+		ring_flush_async(ring);
+		uint32_t consumed = ring_drain(ring, to_submit);
+		if (flags & RING_ENTER_GETEVENTS) {
+			ring_wait(ring, min_complete);
+		}
+		return consumed;
+	}
+
+	// Waiting on a sleeping poller would never end
+	if (flags & (RING_ENTER_POLL_WAKEUP | RING_ENTER_GETEVENTS)) {
+		thread_wake(ring->poller);
+	}
+	if (flags & RING_ENTER_GETEVENTS) {
+		ring_wait(ring, min_complete);
+	}
+	return 0;
+}
+
+int64_t ring_register_buffers(const RingBuffer *buffers, uint32_t count) {
+	Ring *ring = thread_current()->ring;
+	if (ring == NULL || count == 0 || count > RING_MAX_BUFFERS ||
+		!ring_user_range((uint64_t)buffers, count * sizeof(RingBuffer))) {
+		return SYSCALL_ERROR_INVALID_ARGS;
+	}
+
+	// The polling thread reads them without a lock, so they never change
+	// once published
+	if (ring->buffer_count != 0) {
+		return SYSCALL_ERROR_INVALID_ARGS;
+	}
+
+	RingBuffer copies[RING_MAX_BUFFERS];
+	if (!user_copy_from(
+			copies, (uintptr_t)buffers, count * sizeof(RingBuffer)
+		)) {
+		return SYSCALL_ERROR_INVALID_ARGS;
+	}
+
+	// Pinned writable for as long as the ring lives, so requests on them
+	// need no checks. Each must fit in one scatter-gather list.
+	for (uint32_t i = 0; i < count; i++) {
+		RingBuffer *buffer = &copies[i];
+		int64_t pinned = pin_user_pages(
+			buffer->address, buffer->length, PIN_WRITE, &ring->pins[i]
+		);
+		if (pinned < 0 || (uint64_t)pinned != buffer->length) {
+			for (uint32_t j = 0; j <= i; j++) {
+				pin_release(&ring->pins[j]);
+			}
+			return pinned < 0 ? pinned : SYSCALL_ERROR_INVALID_ARGS;
+		}
+	}
+
+	memcpy(ring->buffers, copies, count * sizeof(RingBuffer));
+	__atomic_store_n(&ring->buffer_count, count, __ATOMIC_RELEASE);
+
+	return SYSCALL_SUCCESS;
+}
+
+void ring_release() {
+	Thread *current = thread_current();
+	Ring *ring = current->ring;
+	if (ring == NULL) {
+		return;
+	}
+
+	current->ring = NULL;
+
+	// The polling thread shares our CPU, it cannot exit before it is woken
+	preempt_disable();
+	ring->stopping = true;
+	if (ring->poller != NULL) {
+		thread_wake(ring->poller);
+	}
+	preempt_enable();
+
+	// Calls still in flight would complete into the released ring whenever
+	// their event comes
+	async_cancel_ring(ring);
+
+	// Its fixed-buffer I/O may still be using the pinned frames
+	if (ring->poller != NULL) {
+		while (!__atomic_load_n(&ring->poller_done, __ATOMIC_ACQUIRE)) {
+			thread_yield();
+		}
+	}
+
+	// Finished before the ring stopped, but nobody posts them any more
+	uint64_t rflags = ticket_lock_acquire_irqsave(&ring->async_lock);
+	AsyncCall *call = ring->async_head;
+	ring->async_head = NULL;
+	ring->async_tail = NULL;
+	ticket_lock_release_irqrestore(&ring->async_lock, rflags);
+	while (call != NULL) {
+		AsyncCall *next = call->next;
+		async_call_free(call);
+		call = next;
+	}
+
+	uint32_t count = __atomic_load_n(&ring->buffer_count, __ATOMIC_ACQUIRE);
+	for (uint32_t i = 0; i < count; i++) {
+		pin_release(&ring->pins[i]);
+	}
+
+	// Nothing in the kernel refers to the ring any more
+	ring_unmap(ring->user_address, ring->size);
+	pmm_free((uintptr_t)ring->header);
+	pmm_free((uintptr_t)ring);
+}
@@ -0,0 +1,233 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <limine/limine.h>
+
+#include <hal/cpu.h>
+#include <hal/fpu.h>
+#include <hal/idt.h>
+#include <hal/lapic.h>
+
+#include <kernel/debug.h>
+#include <kernel/idle.h>
+#include <kernel/irq.h>
+#include <kernel/paging.h>
+#include <kernel/panic.h>
+#include <kernel/percpu.h>
+#include <kernel/smp.h>
+#include <kernel/softirq.h>
+#include <kernel/syscalls.h>
+#include <kernel/thread.h>
+#include <kernel/tick.h>
+#include <kernel/time.h>
+#include <kernel/timer.h>
+#include <kernel/vdso.h>
+
+/**
+ * How long to wait for an application processor to come up
+ */
+#define AP_STARTUP_TIMEOUT_NS (100 * NS_PER_MS)
+
+/**
+ * Mailbox value of a call whose caller is still writing the argument
+ */
+#define SMP_CALL_CLAIMED ((SmpCallFunction)1)
+
+static uint32_t cpu_count = 1;
+static uintptr_t lapic_base;
+
+/**
+ * Entry point of the application processors, jumped to by the bootloader on
+ * its own stack with interrupts disabled
+ */
+static void smp_ap_entry(struct limine_smp_info *info) {
+	uint32_t id = (uint32_t)info->extra_argument;
+
+	percpu_initialize_ap(id);
+	idt_install_ap();
+
+	lapic_initialize(lapic_base);
+	Cpu *cpu = this_cpu();
+	cpu->apic_id = lapic_id();
+	irq_initialize_cpu();
+
+	timer_initialize();
+	tick_initialize_ap();
+
+	syscalls_initialize_ap();
+	vdso_register_cpu();
+	fpu_initialize();
+	thread_initialize();
+	softirq_initialize();
+
+	atomic_thread_fence(memory_order_release);
+	cpu->online = true;
+
+	idle_loop();
+}
+
+void smp_initialize(struct limine_smp_response *smp_response) {
+	if (smp_response == NULL) {
+		log_message(
+			&kernel_debug_logger,
+			LOG_WARNING,
+			"smp",
+			"No SMP information from the bootloader, running on one CPU\n"
+		);
+		return;
+	}
+
+	void *lapic = paging_map_mmio(irq_lapic_address(), PAGE_SIZE);
+	if (lapic == NULL) {
+		kernel_panic("Could not map the local APIC", NULL);
+	}
+	lapic_base = (uintptr_t)lapic;
+
+	// Bring the CPUs up one at a time, the early per-CPU setup (timers, the
+	// physical memory manager) is not safe to run concurrently
+	for (uint64_t i = 0; i < smp_response->cpu_count; i++) {
+		struct limine_smp_info *info = smp_response->cpus[i];
+		if (info->lapic_id == smp_response->bsp_lapic_id) {
+			continue;
+		}
+		if (cpu_count == MAX_CPUS) {
+			log_message(
+				&kernel_debug_logger,
+				LOG_WARNING,
+				"smp",
+				"Ignoring CPUs beyond MAX_CPUS {max=%d}\n",
+				MAX_CPUS
+			);
+			break;
+		}
+
+		uint32_t id = cpu_count;
+		Cpu *cpu = cpu_get(id);
+
+		info->extra_argument = id;
+		// The AP is spinning on goto_address and jumps as soon as it changes
+		__atomic_store_n(&info->goto_address, smp_ap_entry, __ATOMIC_RELEASE);
+
+		uint64_t deadline = ktime_ns() + AP_STARTUP_TIMEOUT_NS;
+		while (!cpu->online && ktime_ns() < deadline) {
+			cpu_relax();
+		}
+
+		if (!cpu->online) {
+			log_message(
+				&kernel_debug_logger,
+				LOG_ERROR,
+				"smp",
+				"CPU did not come up {lapic_id=%d}\n",
+				info->lapic_id
+			);
+			continue;
+		}
+
+		cpu_count++;
+	}
+
+	log_message(
+		&kernel_debug_logger,
+		LOG_INFO,
+		"smp",
+		"Application processors started {cpus=%d}\n",
+		cpu_count
+	);
+}
+
+uint32_t smp_cpu_count() { return cpu_count; }
+
+bool smp_call(uint32_t cpu, SmpCallFunction function, void *argument) {
+	Cpu *target = cpu_get(cpu);
+	if (cpu >= cpu_count || !target->online) {
+		return false;
+	}
+
+	// Claim the mailbox before writing the argument, so concurrent callers
+	// can neither overwrite each other's argument nor lose a call
+	for (;;) {
+		smp_call_wait(cpu);
+
+		SmpCallFunction expected = NULL;
+		if (__atomic_compare_exchange_n(
+				&target->call_function,
+				&expected,
+				SMP_CALL_CLAIMED,
+				false,
+				__ATOMIC_ACQUIRE,
+				__ATOMIC_RELAXED
+			)) {
+			break;
+		}
+	}
+
+	target->call_argument = argument;
+	__atomic_store_n(&target->call_function, function, __ATOMIC_RELEASE);
+
+	lapic_send_ipi(target->apic_id, SMP_CALL_VECTOR);
+	return true;
+}
+
+void smp_call_wait(uint32_t cpu) {
+	Cpu *target = cpu_get(cpu);
+
+	while (target->call_function != NULL) {
+		cpu_relax();
+	}
+	atomic_thread_fence(memory_order_acquire);
+}
+
+bool smp_resched(uint32_t cpu) {
+	Cpu *target = cpu_get(cpu);
+	if (cpu >= cpu_count || !target->online) {
+		return false;
+	}
+
+	// An idle CPU in MWAIT wakes up from the store alone. Pairs with the
+	// fence in idle_mwait: either it sees need_resched before waiting, or we
+	// see it still polling and its monitor catches the store.
+	if (target->idle_polling) {
+		target->need_resched = true;
+		atomic_thread_fence(memory_order_seq_cst);
+		if (target->idle_polling) {
+			return true;
+		}
+	}
+
+	lapic_send_ipi(target->apic_id, SMP_RESCHED_VECTOR);
+	return true;
+}
+
+bool smp_resched_handler(InterruptFrame *frame, void *context) {
+	(void)frame;
+	(void)context;
+
+	// Picked up by thread_preempt or the idle loop on the way out
+	this_cpu()->need_resched = true;
+	lapic_eoi();
+	return true;
+}
+
+bool smp_call_handler(InterruptFrame *frame, void *context) {
+	(void)frame;
+	(void)context;
+
+	Cpu *cpu = this_cpu();
+	SmpCallFunction function = cpu->call_function;
+
+	lapic_eoi();
+
+	// A claimed mailbox is not filled in yet, its caller sends another IPI
+	if (function != NULL && function != SMP_CALL_CLAIMED) {
+		atomic_thread_fence(memory_order_acquire);
+		function(cpu->call_argument);
+
+		atomic_thread_fence(memory_order_release);
+		cpu->call_function = NULL;
+	}
+
+	return true;
+}
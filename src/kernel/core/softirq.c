@@ -0,0 +1,216 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <hal/cpu.h>
+
+#include <kernel/panic.h>
+#include <kernel/percpu.h>
+#include <kernel/preempt.h>
+#include <kernel/rcu.h>
+#include <kernel/softirq.h>
+#include <kernel/thread.h>
+#include <kernel/time.h>
+
+typedef void (*SoftirqHandler)();
+
+/**
+ * Per-CPU list of scheduled tasklets, one for each tasklet softirq vector.
+ * Only touched by its own CPU with interrupts disabled.
+ */
+typedef struct {
+	Tasklet *head;
+	Tasklet *tail;
+} TaskletList;
+
+static TaskletList tasklet_lists[MAX_CPUS][SOFTIRQ_COUNT];
+
+static void tasklet_hi_action();
+static void tasklet_action();
+
+static const SoftirqHandler softirq_handlers[SOFTIRQ_COUNT] = {
+	[SOFTIRQ_HI] = tasklet_hi_action,
+	[SOFTIRQ_RCU] = rcu_process_callbacks,
+	[SOFTIRQ_TASKLET] = tasklet_action,
+};
+
+/**
+ * Runs pending softirqs until none are left or the budget is used up. Called
+ * and returns with interrupts disabled, handlers run with them enabled.
+ *
+ * @return true if softirqs are still pending
+ */
+static bool softirq_run(Cpu *cpu) {
+	uint64_t deadline = ktime_ns() + SOFTIRQ_BUDGET_NS;
+	uint32_t restarts = SOFTIRQ_MAX_RESTART;
+
+	cpu->softirq_active = true;
+	preempt_disable();
+
+	uint32_t pending;
+	while ((pending = cpu->softirq_pending) != 0) {
+		cpu->softirq_pending = 0;
+		interrupts_enable();
+
+		while (pending != 0) {
+			uint32_t vector = __builtin_ctz(pending);
+			pending &= pending - 1;
+			softirq_handlers[vector]();
+		}
+
+		interrupts_disable();
+		if (--restarts == 0 || ktime_ns() >= deadline) {
+			break;
+		}
+	}
+
+	preempt_enable();
+	cpu->softirq_active = false;
+
+	return cpu->softirq_pending != 0;
+}
+
+/**
+ * Per-CPU thread that takes over softirqs the interrupt exit path could not
+ * finish, and those raised from thread context
+ */
+static void softirq_thread(void *argument) {
+	(void)argument;
+
+	Cpu *cpu = this_cpu();
+
+	for (;;) {
+		interrupts_disable();
+
+		if (cpu->softirq_pending == 0) {
+			// Raising a softirq wakes us, interrupts keep that from racing
+			// with the check
+			thread_current()->state = THREAD_BLOCKED;
+			thread_block();
+		} else {
+			softirq_run(cpu);
+		}
+
+		interrupts_enable();
+
+		// Let other threads in between batches
+		thread_yield();
+	}
+}
+
+void softirq_initialize() {
+	Cpu *cpu = this_cpu();
+
+	cpu->softirq_thread = thread_create("softirq", softirq_thread, NULL);
+	if (cpu->softirq_thread == NULL) {
+		kernel_panic("Out of memory for the softirq thread", NULL);
+	}
+	thread_start(cpu->softirq_thread);
+}
+
+void softirq_raise(SoftirqVector vector) {
+	uint64_t rflags = interrupts_save_disable();
+	Cpu *cpu = this_cpu();
+
+	cpu->softirq_pending |= 1 << vector;
+
+	// Interrupt handlers run with interrupts disabled and drain on exit
+	if ((rflags & RFLAGS_IF) && !cpu->softirq_active &&
+		cpu->softirq_thread != NULL) {
+		thread_wake(cpu->softirq_thread);
+	}
+
+	interrupts_restore(rflags);
+}
+
+void softirq_irq_exit() {
+	Cpu *cpu = this_cpu();
+
+	if (cpu->softirq_pending == 0 || cpu->softirq_active) {
+		return;
+	}
+
+	if (softirq_run(cpu) && cpu->softirq_thread != NULL) {
+		thread_wake(cpu->softirq_thread);
+	}
+}
+
+/*
+ * ============================================================================
+ * Tasklets
+ * ============================================================================
+ */
+
+void tasklet_init(Tasklet *tasklet, TaskletFunction function, void *data) {
+	tasklet->next = NULL;
+	tasklet->function = function;
+	tasklet->data = data;
+	atomic_store(&tasklet->state, 0);
+}
+
+static void tasklet_enqueue(Tasklet *tasklet, SoftirqVector vector) {
+	uint64_t rflags = interrupts_save_disable();
+	TaskletList *tasklets = &tasklet_lists[this_cpu()->id][vector];
+
+	tasklet->next = NULL;
+	if (tasklets->tail != NULL) {
+		tasklets->tail->next = tasklet;
+	} else {
+		tasklets->head = tasklet;
+	}
+	tasklets->tail = tasklet;
+
+	softirq_raise(vector);
+	interrupts_restore(rflags);
+}
+
+static bool tasklet_schedule_vector(Tasklet *tasklet, SoftirqVector vector) {
+	if (atomic_fetch_or(&tasklet->state, TASKLET_SCHEDULED) &
+		TASKLET_SCHEDULED) {
+		return false;
+	}
+
+	tasklet_enqueue(tasklet, vector);
+	return true;
+}
+
+bool tasklet_schedule(Tasklet *tasklet) {
+	return tasklet_schedule_vector(tasklet, SOFTIRQ_TASKLET);
+}
+
+bool tasklet_hi_schedule(Tasklet *tasklet) {
+	return tasklet_schedule_vector(tasklet, SOFTIRQ_HI);
+}
+
+static void tasklet_run(SoftirqVector vector) {
+	uint64_t rflags = interrupts_save_disable();
+	TaskletList *tasklets = &tasklet_lists[this_cpu()->id][vector];
+	Tasklet *tasklet = tasklets->head;
+	tasklets->head = NULL;
+	tasklets->tail = NULL;
+	interrupts_restore(rflags);
+
+	while (tasklet != NULL) {
+		Tasklet *next = tasklet->next;
+
+		// Still running on another CPU, try again on the next run
+		if (atomic_fetch_or(&tasklet->state, TASKLET_RUNNING) &
+			TASKLET_RUNNING) {
+			tasklet_enqueue(tasklet, vector);
+			tasklet = next;
+			continue;
+		}
+
+		// Cleared first so the tasklet can be scheduled again while it runs
+		atomic_fetch_and(&tasklet->state, ~TASKLET_SCHEDULED);
+		tasklet->function(tasklet);
+		atomic_fetch_and(&tasklet->state, ~TASKLET_RUNNING);
+
+		tasklet = next;
+	}
+}
+
+static void tasklet_hi_action() { tasklet_run(SOFTIRQ_HI); }
+
+static void tasklet_action() { tasklet_run(SOFTIRQ_TASKLET); }
@@ -0,0 +1,40 @@
+bits 64
+section .text
+
+extern thread_bootstrap
+
+; void context_switch(SwitchFrame **prev_context, SwitchFrame *next_context)
+;
+; Switches kernel stacks. Only the callee-saved registers are saved, the
+; caller (schedule, through a normal C function call) already assumes everything
+; else is clobbered. The pushes build a SwitchFrame (see kernel/thread.h),
+; which keeps the registers in the same order as InterruptFrame.
+global context_switch
+context_switch:
+  push rbx
+  push rbp
+  push r12
+  push r13
+  push r14
+  push r15
+
+  mov [rdi], rsp          ; Save the outgoing stack
+  mov rsp, rsi            ; Switch to the incoming stack
+
+  pop r15
+  pop r14
+  pop r13
+  pop r12
+  pop rbp
+  pop rbx
+  ret                     ; Into the incoming thread's last context_switch call
+                          ; or thread_trampoline
+
+; First return target of a new thread. thread_create leaves the Thread
+; pointer in rbx.
+global thread_trampoline
+thread_trampoline:
+  mov rdi, rbx
+  xor rbp, rbp            ; Terminate stack traces here
+  call thread_bootstrap   ; Does not return
+  ud2
@@ -0,0 +1,174 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libk/spinlock.h>
+#include <libk/string.h>
+
+#include <hal/cpu.h>
+
+#include <kernel/percpu.h>
+#include <kernel/pmm.h>
+#include <kernel/smp.h>
+#include <kernel/syscall_stats.h>
+#include <kernel/thread.h>
+
+/**
+ * Counters and trace ring of one CPU, only written by that CPU
+ */
+typedef struct {
+	SystemCallStats calls[SYSCALL_COUNT];
+	SystemCallTraceRecord *trace;
+	uint64_t trace_head;
+} __attribute__((aligned(64))) SystemCallCpuStats;
+
+static SystemCallCpuStats syscall_cpu_stats[MAX_CPUS];
+
+volatile bool syscall_trace_enabled = false;
+
+/**
+ * Serializes allocating the trace rings
+ */
+static TicketLock syscall_trace_lock = TICKET_LOCK_INIT("syscall_trace");
+
+/*
+ * A single read-modify-write instruction without a lock prefix cannot be
+ * split by an interrupt, which is all the per-CPU counters need. Threads
+ * never migrate, so the CPU does not change under the caller.
+ */
+
+static inline void syscall_stats_add64(uint64_t *counter, uint64_t value) {
+	asm volatile("addq %1, %0" : "+m"(*counter) : "er"(value));
+}
+
+static inline void syscall_stats_inc32(uint32_t *counter) {
+	asm volatile("incl %0" : "+m"(*counter));
+}
+
+static inline uint64_t syscall_stats_fetch_inc64(uint64_t *counter) {
+	uint64_t value = 1;
+	asm volatile("xaddq %0, %1" : "+r"(value), "+m"(*counter));
+	return value;
+}
+
+void syscall_stats_account(
+	SystemCallNumber number, uint64_t cycles, SystemCallError error
+) {
+	SystemCallStats *stats = &syscall_cpu_stats[this_cpu()->id].calls[number];
+
+	uint32_t bucket = 63 - __builtin_clzll(cycles | 1);
+	if (bucket >= SYSCALL_HISTOGRAM_BUCKETS) {
+		bucket = SYSCALL_HISTOGRAM_BUCKETS - 1;
+	}
+
+	syscall_stats_add64(&stats->count, 1);
+	syscall_stats_add64(&stats->total_cycles, cycles);
+	syscall_stats_inc32(&stats->histogram[bucket]);
+	if (error != SYSCALL_SUCCESS) {
+		syscall_stats_add64(&stats->errors, 1);
+	}
+
+	// May lose to a preempting call, the maximum is only a hint
+	if (cycles > stats->max_cycles) {
+		stats->max_cycles = cycles;
+	}
+}
+
+void syscall_stats_collect(
+	SystemCallStats *stats, uint32_t first, uint32_t count
+) {
+	memset(stats, 0, count * sizeof(SystemCallStats));
+
+	// Racy snapshot, counters of a call in flight may be torn
+	for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+		for (uint32_t i = 0; i < count; i++) {
+			const SystemCallStats *source =
+				&syscall_cpu_stats[cpu].calls[first + i];
+			stats[i].count += source->count;
+			stats[i].errors += source->errors;
+			stats[i].total_cycles += source->total_cycles;
+			if (source->max_cycles > stats[i].max_cycles) {
+				stats[i].max_cycles = source->max_cycles;
+			}
+			for (size_t j = 0; j < SYSCALL_HISTOGRAM_BUCKETS; j++) {
+				stats[i].histogram[j] += source->histogram[j];
+			}
+		}
+	}
+}
+
+void syscall_stats_reset() {
+	for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+		memset(
+			syscall_cpu_stats[cpu].calls,
+			0,
+			sizeof(syscall_cpu_stats[cpu].calls)
+		);
+	}
+}
+
+bool syscall_trace_set(bool enabled) {
+	if (!enabled) {
+		syscall_trace_enabled = false;
+		return true;
+	}
+
+	// The rings are kept once allocated, the dump reads them after the trace
+	// is turned off
+	uint64_t rflags = ticket_lock_acquire_irqsave(&syscall_trace_lock);
+	bool allocated = true;
+	for (uint32_t cpu = 0; cpu < smp_cpu_count(); cpu++) {
+		SystemCallCpuStats *stats = &syscall_cpu_stats[cpu];
+		if (stats->trace != NULL) {
+			continue;
+		}
+
+		size_t size = SYSCALL_TRACE_ENTRIES * sizeof(SystemCallTraceRecord);
+		SystemCallTraceRecord *trace = (SystemCallTraceRecord *)pmm_alloc(size);
+		if (trace == NULL) {
+			allocated = false;
+			break;
+		}
+		memset(trace, 0, size);
+		__atomic_store_n(&stats->trace, trace, __ATOMIC_RELEASE);
+	}
+	ticket_lock_release_irqrestore(&syscall_trace_lock, rflags);
+
+	if (allocated) {
+		syscall_trace_enabled = true;
+	}
+	return allocated;
+}
+
+void syscall_trace_record(
+	SystemCallTraceType type,
+	SystemCallNumber number,
+	uint64_t first,
+	uint64_t second
+) {
+	SystemCallCpuStats *stats = &syscall_cpu_stats[this_cpu()->id];
+	SystemCallTraceRecord *trace =
+		__atomic_load_n(&stats->trace, __ATOMIC_ACQUIRE);
+	if (trace == NULL) {
+		// CPU came online after the trace was turned on
+		return;
+	}
+
+	// Claim the slot first, a call preempting us takes the next one
+	uint64_t index = syscall_stats_fetch_inc64(&stats->trace_head);
+	SystemCallTraceRecord *record =
+		&trace[index & (SYSCALL_TRACE_ENTRIES - 1)];
+	*record = (SystemCallTraceRecord){
+		.tsc = rdtsc(),
+		.thread = thread_current()->id,
+		.number = (uint16_t)number,
+		.type = (uint8_t)type,
+		.data = {first, second},
+	};
+}
+
+const SystemCallTraceRecord *syscall_trace_ring(uint32_t cpu, uint64_t *head) {
+	SystemCallCpuStats *stats = &syscall_cpu_stats[cpu];
+	*head = stats->trace_head;
+	return __atomic_load_n(&stats->trace, __ATOMIC_ACQUIRE);
+}
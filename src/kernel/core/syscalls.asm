@@ -0,0 +1,76 @@
+bits 64
+section .text
+
+extern syscall_dispatch
+extern syscall_bad_return
+
+; Offsets in the per-CPU area (see kernel/percpu.h)
+%define CPU_KERNEL_STACK_OFFSET 24
+%define CPU_USER_RSP_OFFSET 32
+
+; Offsets in SystemCallFrame (see kernel/syscalls.h)
+%define FRAME_RIP 56
+%define FRAME_RFLAGS 64
+
+; Entry point of the syscall instruction (MSR_LSTAR)
+;
+; SYSCALL leaves the user rip in rcx and the user rflags in r11, and masks
+; interrupts through MSR_SFMASK. Nothing else changes, we are still on the
+; user stack with the user GS base. The arguments come in rdi, rsi, rdx, r10,
+; r8 and r9, the number in rax. rax and rdx return the SystemCallReturn.
+; Callee-saved registers are left to the C code, everything else but rcx and
+; r11 is restored.
+global syscall_entry
+syscall_entry:
+  swapgs
+  mov [gs:CPU_USER_RSP_OFFSET], rsp
+  mov rsp, [gs:CPU_KERNEL_STACK_OFFSET]
+
+  ; Build a SystemCallFrame, 10 values keep the stack 16-byte aligned
+  push qword [gs:CPU_USER_RSP_OFFSET]
+  push r11
+  push rcx
+  push rax
+  push r9
+  push r8
+  push r10
+  push rdx
+  push rsi
+  push rdi
+
+  ; Safe now that we are on the thread's own stack, the handler may sleep
+  sti
+  mov rdi, rsp
+  call syscall_dispatch
+  cli
+
+  mov rcx, [rsp + FRAME_RIP]
+  mov r11, [rsp + FRAME_RFLAGS]
+
+  ; SYSRET raises #GP in ring 0, on the user stack and with the user GS
+  ; base, if rip is not canonical. Never return anywhere outside the lower
+  ; half: a syscall in the last bytes of it is the usual culprit.
+  mov r10, rcx
+  shl r10, 16
+  sar r10, 16
+  cmp r10, rcx
+  jne .bad_rip
+  bt rcx, 47
+  jc .bad_rip
+
+  pop rdi
+  pop rsi
+  add rsp, 8              ; rdx holds the error
+  pop r10
+  pop r8
+  pop r9
+  add rsp, 24             ; Number, rip and rflags
+  pop rsp                 ; User stack
+
+  swapgs
+  o64 sysret
+
+.bad_rip:
+  sti
+  call syscall_bad_return ; Ends the thread, does not return
+  ud2
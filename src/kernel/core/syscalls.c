@@ -1,16 +1,26 @@
-#include <stdarg.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
 #include <libk/string.h>
-#include <printf/printf.h>
 
+#include <hal/cpu.h>
+#include <hal/gdt.h>
+
+#include <kernel/aipc.h>
+#include <kernel/async.h>
 #include <kernel/debug.h>
-#include <kernel/stack.h>
+#include <kernel/futex.h>
+#include <kernel/handle.h>
+#include <kernel/ipc.h>
+#include <kernel/paging.h>
+#include <kernel/percpu.h>
+#include <kernel/pin.h>
+#include <kernel/ring.h>
+#include <kernel/syscall_stats.h>
 #include <kernel/syscalls.h>
-
-// TODO: use jemi for logging
+#include <kernel/thread.h>
+#include <kernel/time.h>
 
 /*
  * ============================================================================
@@ -18,270 +28,424 @@
  * ============================================================================
  */
 
-// Dummy write implementation
-DEFINE_SYSCALL(read, 3, ARG_INT, ARG_PTR, ARG_SIZE) {
-	if (!syscall_validate_args(args, 3, ARG_INT, ARG_PTR, ARG_SIZE)) {
-		return (SystemCallReturn
-		){.value = 0, .error = SYSCALL_ERROR_INVALID_ARGS};
+/**
+ * Wraps the result of a kernel service, negative values are errors
+ */
+static SystemCallReturn syscall_return(int64_t result) {
+	if (result < 0) {
+		return (SystemCallReturn){.value = 0, .error = (SystemCallError)result};
 	}
+	return (SystemCallReturn){.value = result, .error = SYSCALL_SUCCESS};
+}
+
+/**
+ * Wraps a bare status, SYSCALL_PENDING included
+ */
+static SystemCallReturn syscall_status(SystemCallError error) {
+	return (SystemCallReturn){.value = 0, .error = error};
+}
 
-	int fd = (int)args->args[0];
-	void *buf = (void *)args->args[1];
-	size_t count = (size_t)args->args[2];
+/**
+ * Stands in for the device behind every file descriptor until there are real
+ * ones, like /dev/zero: reads fill the buffer with zeros, writes are dropped.
+ * Both transfer paths go through it, so they behave the same.
+ */
+static void syscall_zero_device(void *data, size_t length, bool to_user) {
+	if (to_user) {
+		memset(data, 0, length);
+	}
+}
 
-	// Implement read syscall
-	// For now, just return the count
-	return (SystemCallReturn){.value = count, .error = SYSCALL_SUCCESS};
+/**
+ * The zero device's side of a pinned transfer, reaching each segment through
+ * the direct map as a device would through DMA
+ */
+static void syscall_zero_device_pinned(const PinList *list, bool to_user) {
+	for (uint32_t i = 0; i < list->count; i++) {
+		syscall_zero_device(
+			phys_to_virt(list->segments[i].phys, paging_hhdm_offset()),
+			list->segments[i].length,
+			to_user
+		);
+	}
 }
 
-// Dummy read implementation
-DEFINE_SYSCALL(write, 3, ARG_INT, ARG_PTR, ARG_SIZE) {
-	if (!syscall_validate_args(args, 3, ARG_INT, ARG_PTR, ARG_SIZE)) {
-		return (SystemCallReturn
-		){.value = 0, .error = SYSCALL_ERROR_INVALID_ARGS};
+/**
+ * Moves count bytes between a user buffer and the device behind fd. Small
+ * transfers are copied through a kernel buffer, large ones are pinned and go
+ * to the device as scatter-gather lists, one list at a time.
+ *
+ * @param to_user Whether the device fills the buffer (read)
+ * @return The number of bytes moved, or a negative SystemCallError if none
+ */
+static int64_t syscall_transfer(
+	int fd, uintptr_t buffer, size_t count, bool to_user
+) {
+	// TODO: There are no devices behind file descriptors yet, every one is
+	//       the zero device
+	(void)fd;
+
+	if (count <= PIN_COPY_THRESHOLD) {
+		uint8_t bounce[PIN_COPY_THRESHOLD];
+		bool copied;
+		if (to_user) {
+			syscall_zero_device(bounce, count, to_user);
+			copied = user_copy_to(buffer, bounce, count);
+		} else {
+			copied = user_copy_from(bounce, buffer, count);
+			syscall_zero_device(bounce, count, to_user);
+		}
+		return copied ? (int64_t)count : SYSCALL_ERROR_INVALID_ARGS;
 	}
 
-	int fd = (int)args->args[0];
-	const void *buf = (const void *)args->args[1];
-	size_t count = (size_t)args->args[2];
+	size_t done = 0;
+	while (done < count) {
+		PinList list;
+		int64_t pinned = pin_user_pages(
+			buffer + done, count - done, to_user ? PIN_WRITE : 0, &list
+		);
+		if (pinned < 0) {
+			return done != 0 ? (int64_t)done : pinned;
+		}
 
-	// Implement write syscall
-	// For now, just return the count
-	return (SystemCallReturn){.value = count, .error = SYSCALL_SUCCESS};
+		syscall_zero_device_pinned(&list, to_user);
+		pin_release(&list);
+		done += pinned;
+	}
+	return done;
 }
 
-__attribute__((aligned(64))
-) static const SystemCallEntry syscall_table[SYSCALL_COUNT] = {
-	[SYSCALL_READ] = {syscall_read, "read", 3},
-	[SYSCALL_WRITE] = {syscall_write, "write", 3},
-	// Add other syscalls here
-};
+SystemCallReturn syscall_read(int fd, void *buf, size_t count) {
+	return syscall_return(syscall_transfer(fd, (uintptr_t)buf, count, true));
+}
 
-/*
- * ============================================================================
- * System call utility functions
- * ============================================================================
+SystemCallReturn syscall_write(int fd, const void *buf, size_t count) {
+	return syscall_return(syscall_transfer(fd, (uintptr_t)buf, count, false));
+}
+
+SystemCallReturn syscall_futex_wait(
+	uint32_t *address, uint32_t expected, uint64_t timeout_ns
+) {
+	return syscall_status(
+		futex_wait(address, expected, timeout_ns, FUTEX_BITSET_ANY)
+	);
+}
+
+SystemCallReturn syscall_futex_wake(uint32_t *address, uint32_t count) {
+	return syscall_return(futex_wake(address, count, FUTEX_BITSET_ANY));
+}
+
+SystemCallReturn syscall_futex_wait_bitset(
+	uint32_t *address, uint32_t expected, uint64_t timeout_ns, uint32_t bitset
+) {
+	return syscall_status(futex_wait(address, expected, timeout_ns, bitset));
+}
+
+SystemCallReturn syscall_futex_wake_bitset(
+	uint32_t *address, uint32_t count, uint32_t bitset
+) {
+	return syscall_return(futex_wake(address, count, bitset));
+}
+
+SystemCallReturn syscall_futex_requeue(
+	uint32_t *address,
+	uint32_t count,
+	uint32_t *target,
+	uint32_t requeue_count,
+	uint32_t expected
+) {
+	return syscall_return(
+		futex_requeue(address, count, target, requeue_count, expected)
+	);
+}
+
+SystemCallReturn syscall_null() {
+	return (SystemCallReturn){.value = 0, .error = SYSCALL_SUCCESS};
+}
+
+SystemCallReturn syscall_exit() {
+	ring_release();
+	thread_exit();
+}
+
+SystemCallReturn syscall_clock_get(uint32_t clock) {
+	if (clock != CLOCK_MONOTONIC) {
+		return (SystemCallReturn
+		){.value = 0, .error = SYSCALL_ERROR_INVALID_ARGS};
+	}
+	return (SystemCallReturn){.value = ktime_ns(), .error = SYSCALL_SUCCESS};
+}
+
+SystemCallReturn syscall_getcpu() {
+	return (SystemCallReturn
+	){.value = this_cpu()->id, .error = SYSCALL_SUCCESS};
+}
+
+/**
+ * System calls syscall_stats sums into its kernel buffer at once
  */
+#define SYSCALL_STATS_BATCH 4
 
-// TODO: Not thread safe due to static buffer
-// TODO: Treats all argument types as hexedecimal. Add special conditions for
-//       other types.
-char *format_syscall_args(const SystemCallArgs *args, int num_args) {
-	static char arg_str[256];
-	memset(arg_str, 0, sizeof(arg_str));
-
-	int offset = 0;
-
-	for (int i = 0; i < num_args && i < 6; i++) {
-		offset += snprintf_(
-			arg_str + offset,
-			sizeof(arg_str) - offset,
-			"arg%d=0x%llx",
-			i + 1,
-			args->args[i]
-		);
+SystemCallReturn syscall_stats(
+	SystemCallStats *stats, uint32_t count, uint32_t flags
+) {
+	if (count > SYSCALL_COUNT) {
+		count = SYSCALL_COUNT;
+	}
 
-		if (i < num_args - 1 && i < 5) {
-			offset +=
-				snprintf_(arg_str + offset, sizeof(arg_str) - offset, ", ");
+	// A batch at a time, so the buffer stays small as system calls are added
+	SystemCallStats buffer[SYSCALL_STATS_BATCH];
+	for (uint32_t first = 0; first < count; first += SYSCALL_STATS_BATCH) {
+		uint32_t batch = count - first;
+		if (batch > SYSCALL_STATS_BATCH) {
+			batch = SYSCALL_STATS_BATCH;
+		}
+		syscall_stats_collect(buffer, first, batch);
+		if (!user_copy_to(
+				(uintptr_t)(stats + first),
+				buffer,
+				batch * sizeof(SystemCallStats)
+			)) {
+			return (SystemCallReturn
+			){.value = 0, .error = SYSCALL_ERROR_INVALID_ARGS};
 		}
 	}
+	if (flags & SYSCALL_STATS_RESET) {
+		syscall_stats_reset();
+	}
+	if ((flags & SYSCALL_STATS_TRACE_ON) && !syscall_trace_set(true)) {
+		return (SystemCallReturn){.value = 0, .error = SYSCALL_ERROR_NO_MEMORY};
+	}
+	if (flags & SYSCALL_STATS_TRACE_OFF) {
+		syscall_trace_set(false);
+	}
+	return (SystemCallReturn){.value = SYSCALL_COUNT, .error = SYSCALL_SUCCESS};
+}
 
-	return arg_str;
-}
-
-bool syscall_validate_args(const SystemCallArgs *args, int num_args, ...) {
-	va_list ap;
-	va_start(ap, num_args);
-	bool valid = true;
-	for (int i = 0; i < num_args && valid; i++) {
-		SystemCallArgType type = va_arg(ap, SystemCallArgType);
-		switch (type) {
-		case ARG_INT:
-		case ARG_UINT:
-		case ARG_PTR:
-			break;
-		case ARG_SIZE:
-			valid = args->args[i] > 0;
-			break;
-		default:
-			valid = false;
-		}
+SystemCallReturn syscall_ring_setup(
+	void *address, uint32_t entries, uint32_t flags
+) {
+	return syscall_return(ring_setup(address, entries, flags));
+}
+
+SystemCallReturn syscall_ring_enter(
+	uint32_t to_submit, uint32_t min_complete, uint32_t flags
+) {
+	return syscall_return(ring_enter(to_submit, min_complete, flags));
+}
+
+SystemCallReturn syscall_ring_register_buffers(
+	const RingBuffer *buffers, uint32_t count
+) {
+	return syscall_return(ring_register_buffers(buffers, count));
+}
+
+SystemCallReturn syscall_aipc_create(void *address, uint32_t entries) {
+	return syscall_return(aipc_create(address, entries));
+}
+
+SystemCallReturn syscall_aipc_wait(uint32_t channel, uint32_t endpoint) {
+	return syscall_return(aipc_wait(channel, endpoint));
+}
+
+SystemCallReturn syscall_aipc_notify(uint32_t channel, uint32_t endpoint) {
+	return syscall_return(aipc_notify(channel, endpoint));
+}
+
+SystemCallReturn syscall_aipc_give(
+	uint32_t channel, void *address, uint32_t count
+) {
+	return syscall_return(aipc_give(channel, (uintptr_t)address, count));
+}
+
+SystemCallReturn syscall_aipc_take(
+	uint32_t channel, uint64_t transfer, void *address
+) {
+	return syscall_return(aipc_take(channel, transfer, (uintptr_t)address));
+}
+
+SystemCallReturn syscall_ipc_create() { return syscall_return(ipc_create()); }
+
+/**
+ * Puts the words of a reply or request where syscall_entry restores the
+ * argument registers from: rdi, rsi, r10 and r8. Only for handlers reached
+ * through the syscall instruction, its frame is at the top of the stack.
+ */
+static void syscall_ipc_deliver(const IpcMessage *message) {
+	SystemCallFrame *frame =
+		(SystemCallFrame *)(thread_current()->stack + THREAD_STACK_SIZE) - 1;
+
+	frame->args.args[0] = message->words[0];
+	frame->args.args[1] = message->words[1];
+	frame->args.args[3] = message->words[2];
+	frame->args.args[4] = message->words[3];
+}
+
+SystemCallReturn syscall_ipc_call(
+	uint32_t endpoint,
+	uint64_t word0,
+	uint64_t word1,
+	uint64_t word2,
+	uint64_t word3
+) {
+	IpcMessage message = {{word0, word1, word2, word3}};
+	int64_t result = ipc_call(endpoint, &message);
+	if (result == 0) {
+		syscall_ipc_deliver(&message);
 	}
-	va_end(ap);
-	return valid;
+	return syscall_return(result);
 }
 
-SystemCallReturn syscall_handler(
-	SystemCallNumber syscall_number, SystemCallArgs *args
+SystemCallReturn syscall_ipc_reply_wait(
+	uint32_t endpoint,
+	uint64_t word0,
+	uint64_t word1,
+	uint64_t word2,
+	uint64_t word3
 ) {
-	SystemCallReturn result = {0};
-
-	if (DEBUG) {
-		log_message(
-			&kernel_debug_logger,
-			LOG_DEBUG,
-			"syscalls",
-			"System call entered: {number=%d}\n",
-			syscall_number
-		);
+	IpcMessage message = {{word0, word1, word2, word3}};
+	int64_t result = ipc_reply_wait(endpoint, &message);
+	if (result == 0) {
+		syscall_ipc_deliver(&message);
 	}
+	return syscall_return(result);
+}
 
-	if (__builtin_expect(syscall_number >= SYSCALL_COUNT, 0) ||
-		__builtin_expect(syscall_table[syscall_number].handler == NULL, 0)) {
-		if (DEBUG) {
-			log_message(
-				&kernel_debug_logger,
-				LOG_ERROR,
-				"syscalls",
-				"Invalid system call: No system call found\n",
-				syscall_number
-			);
-		}
+SystemCallReturn syscall_handle_close(uint32_t handle) {
+	return syscall_return(handle_close(handle_table_current(), handle));
+}
 
-		return (SystemCallReturn
-		){.value = 0, .error = SYSCALL_ERROR_INVALID_SYSCALL};
+/*
+ * ============================================================================
+ * System call table
+ * ============================================================================
+ */
+
+#define SYSCALL_THUNK_VALID(index, arg)                                        \
+	&&SYSCALL_VALID(                                                           \
+		SYSCALL_ARG_KIND(arg), SYSCALL_ARG_TYPE(arg), args->args[index]        \
+	)
+#define SYSCALL_THUNK_ARG(index, arg) (SYSCALL_ARG_TYPE(arg))args->args[index]
+
+/**
+ * One thunk per system call: validates every argument against its kind and
+ * calls the typed handler. The checks are inline and constant-folded, there
+ * is no per-call metadata to walk.
+ */
+#define SYSCALL(number, name, NAME, ...)                                       \
+	static SystemCallReturn syscall_thunk_##name(SystemCallArgs *args) {       \
+		(void)args;                                                            \
+		if (!(true SYSCALL_MAP(                                                \
+				SYSCALL_THUNK_VALID, SYSCALL_NOTHING, ##__VA_ARGS__            \
+			))) {                                                              \
+			return (SystemCallReturn                                           \
+			){.value = 0, .error = SYSCALL_ERROR_INVALID_ARGS};                \
+		}                                                                      \
+		return syscall_##name(                                                 \
+			SYSCALL_MAP(SYSCALL_THUNK_ARG, SYSCALL_COMMA, ##__VA_ARGS__)       \
+		);                                                                     \
 	}
+#include <kernel/syscalls.def>
+#undef SYSCALL
 
-	const SystemCallEntry *entry = &syscall_table[syscall_number];
+__attribute__((aligned(64))
+) static const SystemCallEntry syscall_table[SYSCALL_COUNT] = {
+#define SYSCALL(number, name, NAME, ...)                                       \
+	[number] = {syscall_thunk_##name, #name, SYSCALL_NARGS(__VA_ARGS__)},
+#include <kernel/syscalls.def>
+#undef SYSCALL
+};
+
+/*
+ * ============================================================================
+ * System call dispatch
+ * ============================================================================
+ */
 
-	// Validate number of arguments
-	if (syscall_table[syscall_number].num_args > 6) {
-		if (DEBUG) {
-			log_message(
-				&kernel_debug_logger,
-				LOG_ERROR,
-				"syscalls",
-				"Invalid system call: Too many arguments\n"
-			);
+SystemCallReturn syscall_handler(
+	SystemCallNumber syscall_number, SystemCallArgs *args
+) {
+	// Every number below SYSCALL_COUNT has a generated entry
+	if (__builtin_expect((uint64_t)syscall_number >= SYSCALL_COUNT, 0)) {
+		uint64_t number = (uint64_t)syscall_number & ~(uint64_t)SYSCALL_ASYNC;
+		if (((uint64_t)syscall_number & SYSCALL_ASYNC) &&
+			number < SYSCALL_COUNT) {
+			return async_syscall_handler((SystemCallNumber)number, args);
 		}
 
 		return (SystemCallReturn
-		){.value = 0, .error = SYSCALL_ERROR_INVALID_ARGS};
+		){.value = 0, .error = SYSCALL_ERROR_INVALID_SYSCALL};
 	}
 
-	if (DEBUG) {
-		char *formatted_args = format_syscall_args(args, entry->num_args);
+	const SystemCallEntry *entry = &syscall_table[syscall_number];
+	bool trace = __builtin_expect(syscall_trace_enabled, 0);
 
-		log_message(
-			&kernel_debug_logger,
-			LOG_DEBUG,
-			"syscalls",
-			"Dispatching system call: {name=%s, args={%s}}\n",
-			syscall_table[syscall_number].name,
-			formatted_args
+	if (trace) {
+		syscall_trace_record(
+			SYSCALL_TRACE_ENTER, syscall_number, args->args[0], args->args[1]
 		);
 	}
 
-	result = entry->handler(args);
+	uint64_t start = rdtsc();
+	SystemCallReturn result = entry->handler(args);
+	syscall_stats_account(syscall_number, rdtsc() - start, result.error);
 
-	if (DEBUG) {
-		log_message(
-			&kernel_debug_logger,
-			LOG_DEBUG,
-			"syscalls",
-			"System call completed: {return=%lld, error=%d}\n",
-			result.value,
-			result.error
+	if (trace) {
+		syscall_trace_record(
+			SYSCALL_TRACE_EXIT,
+			syscall_number,
+			(uint64_t)result.value,
+			(uint64_t)(int64_t)result.error
 		);
 	}
 
 	return result;
 }
 
-__attribute__((naked)) void syscall_entry() {
-	asm volatile(
-		"movq %%rsp, %%r10\n" // Save the user stack pointer in r11 (rflags is
-							  // already in r11, we'll handle that)
-		"movq %0, %%rsp\n"	  // Switch to the kernel stack
-		"pushq %%r11\n"		  // Save user rflags (from r11)
-		"pushq %%rcx\n"		  // Save user rip (from rcx)
-		"pushq %%r10\n"		  // Save user rsp (from r10)
-
-		// Save general purpose registers
-		"pushq %%rax\n" // Save syscall number
-		"pushq %%rdi\n" // Save arg1
-		"pushq %%rsi\n" // Save arg2
-		"pushq %%rdx\n" // Save arg3
-		"pushq %%r10\n" // Save arg4 (r10 is used instead of rcx in syscalls)
-		"pushq %%r8\n"	// Save arg5
-		"pushq %%r9\n"	// Save arg6
-		"pushq %%rbx\n" // Save rbx
-		"pushq %%rbp\n" // Save rbp
-		"pushq %%r12\n" // Save r12
-		"pushq %%r13\n" // Save r13
-		"pushq %%r14\n" // Save r14
-		"pushq %%r15\n" // Save r15
-
-		"movq %%rsp, %%rdi\n"	 // Pass the stack pointer as the first argument
-		"call syscall_handler\n" // Call the C handler
-
-		// Restore registers
-		"popq %%r15\n" // Restore r15
-		"popq %%r14\n" // Restore r14
-		"popq %%r13\n" // Restore r13
-		"popq %%r12\n" // Restore r12
-		"popq %%rbp\n" // Restore rbp
-		"popq %%rbx\n" // Restore rbx
-		"popq %%r9\n"  // Restore arg6
-		"popq %%r8\n"  // Restore arg5
-		"popq %%r10\n" // Restore arg4 (r10 is used instead of rcx in syscalls)
-		"popq %%rdx\n" // Restore arg3
-		"popq %%rsi\n" // Restore arg2
-		"popq %%rdi\n" // Restore arg1
-		"popq %%rax\n" // Restore syscall number
-
-		"popq %%rsp\n" // Restore user rsp
-		"popq %%rcx\n" // Restore user rip into rcx
-		"popq %%r11\n" // Restore user rflags into r11
-		"sysretq\n"	   // Return to user mode
-		:
-		: "r"(get_kernel_stack_ptr())
-		: "memory"
-	);
+SystemCallReturn syscall_dispatch(SystemCallFrame *frame) {
+	return syscall_handler((SystemCallNumber)frame->number, &frame->args);
 }
 
-void syscalls_initialize() {
-	// Set up MSRs for syscall
+void syscall_bad_return(SystemCallFrame *frame) {
 	log_message(
-		&kernel_debug_logger, LOG_INFO, "syscalls", "Enabling syscall MSRs\n"
+		&kernel_debug_logger,
+		LOG_ERROR,
+		"syscalls",
+		"Cannot return to user rip, ending thread {rip=0x%llx, thread=%s}\n",
+		frame->rip,
+		thread_current()->name
 	);
+	ring_release();
+	thread_exit();
+}
 
-	uint64_t star = (uint64_t)0x0013000800000000ULL;
-	uint64_t lstar = (uint64_t)syscall_entry;
-	uint64_t sfmask = (uint64_t)0x200;
-
-	asm volatile("wrmsr"
-				 :
-				 : "c"(0xC0000081),
-				   "a"((uint32_t)star),
-				   "d"((uint32_t)(star >> 32)));
-	asm volatile("wrmsr"
-				 :
-				 : "c"(0xC0000082),
-				   "a"((uint32_t)lstar),
-				   "d"((uint32_t)(lstar >> 32)));
-	asm volatile("wrmsr"
-				 :
-				 : "c"(0xC0000084),
-				   "a"((uint32_t)sfmask),
-				   "d"((uint32_t)(sfmask >> 32)));
+/**
+ * Points the syscall instruction at syscall_entry on the calling CPU
+ */
+static void syscalls_program_msrs() {
+	// SYSCALL loads the kernel selectors from STAR[47:32], SYSRET derives the
+	// user ones from STAR[63:48] (see hal/gdt.h)
+	uint64_t star = ((uint64_t)(GDT_USER_DATA - 8) << 48) |
+					((uint64_t)GDT_KERNEL_CODE << 32);
+	wrmsr(MSR_STAR, star);
+	wrmsr(MSR_LSTAR, (uint64_t)syscall_entry);
+
+	// Enter with interrupts off until we are on the kernel stack, and without
+	// single-stepping, alignment checks or a reversed direction flag
+	wrmsr(MSR_SFMASK, RFLAGS_IF | RFLAGS_TF | RFLAGS_DF | RFLAGS_AC);
+
+	wrmsr(MSR_EFER, rdmsr(MSR_EFER) | EFER_SCE);
+}
 
-	log_message(
-		&kernel_debug_logger, LOG_INFO, "syscalls", "Enabled syscall MSRs\n"
-	);
+void syscalls_initialize_ap() { syscalls_program_msrs(); }
 
-	// Enable syscall instruction
+void syscalls_initialize() {
+	// Set up MSRs for syscall
 	log_message(
-		&kernel_debug_logger,
-		LOG_INFO,
-		"syscalls",
-		"Enabling syscall instruction in EFER\n"
+		&kernel_debug_logger, LOG_INFO, "syscalls", "Enabling syscall MSRs\n"
 	);
-	uint64_t efer;
-	asm volatile("rdmsr" : "=A"(efer) : "c"(0xC0000080));
-	efer |= 1ULL << 0; // Set SCE (System Call Enable) bit
-	asm volatile("wrmsr" : : "c"(0xC0000080), "A"(efer));
+
+	syscalls_program_msrs();
 
 	log_message(
 		&kernel_debug_logger,
@@ -0,0 +1,397 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libk/spinlock.h>
+#include <libk/string.h>
+
+#include <hal/cpu.h>
+#include <hal/fpu.h>
+#include <hal/gdt.h>
+#include <hal/lapic.h>
+
+#include <kernel/debug.h>
+#include <kernel/panic.h>
+#include <kernel/percpu.h>
+#include <kernel/pmm.h>
+#include <kernel/smp.h>
+#include <kernel/thread.h>
+
+/**
+ * Lazy FPU switching
+ *
+ * Switching threads leaves the FPU/SIMD registers alone and sets CR0.TS unless
+ * the incoming thread's state is still loaded on this CPU. The first FPU/SIMD
+ * instruction of a thread after that traps (#NM) and thread_fpu_trap loads its
+ * state, so threads that never touch SIMD never pay for an XRSTOR.
+ *
+ * A thread that had the FPU enabled is saved when it is switched out. With
+ * XSAVEOPT/XSAVES this only writes components that were modified since they
+ * were restored from the same area (and skips those in their init state), so
+ * a thread that did not touch SIMD during its timeslice costs very little.
+ * Saving on switch-out keeps every switched-out thread's save area current.
+ *
+ * Kernel code that uses SIMD registers counts as the current thread using
+ * them. Interrupt handlers must not, the interrupt entry does not save them.
+ */
+
+/**
+ * Per-CPU run queue, one FIFO list per priority
+ */
+typedef struct {
+	TicketLock lock;
+	Thread *heads[THREAD_PRIORITY_COUNT];
+	Thread *tails[THREAD_PRIORITY_COUNT];
+} __attribute__((aligned(64))) RunQueue;
+
+static RunQueue run_queues[MAX_CPUS];
+static Thread idle_threads[MAX_CPUS];
+static _Atomic uint32_t next_thread_id = MAX_CPUS;
+
+extern void context_switch(SwitchFrame **prev_context, SwitchFrame *next);
+extern void thread_trampoline();
+
+static void run_queue_push(RunQueue *queue, Thread *thread) {
+	ThreadPriority priority = thread->priority;
+
+	thread->next = NULL;
+	if (queue->tails[priority] != NULL) {
+		queue->tails[priority]->next = thread;
+	} else {
+		queue->heads[priority] = thread;
+	}
+	queue->tails[priority] = thread;
+}
+
+static Thread *run_queue_pop(RunQueue *queue) {
+	for (int priority = 0; priority < THREAD_PRIORITY_COUNT; priority++) {
+		Thread *thread = queue->heads[priority];
+		if (thread != NULL) {
+			queue->heads[priority] = thread->next;
+			if (queue->heads[priority] == NULL) {
+				queue->tails[priority] = NULL;
+			}
+			return thread;
+		}
+	}
+	return NULL;
+}
+
+static void *fpu_state_alloc() {
+	void *area = (void *)pmm_alloc(fpu_state_size());
+	if (area != NULL) {
+		fpu_init_state(area);
+	}
+	return area;
+}
+
+/**
+ * Frees the stack and save area of a thread. The Thread itself stays, whoever
+ * created the thread may still hold on to it.
+ */
+static void thread_free_stacks(Thread *thread) {
+	if (thread->stack != 0) {
+		pmm_free(thread->stack);
+		thread->stack = 0;
+	}
+	if (thread->fpu_state != NULL) {
+		pmm_free((uintptr_t)thread->fpu_state);
+		thread->fpu_state = NULL;
+	}
+}
+
+/**
+ * Frees the stacks of a thread that exited on its way into the switch that
+ * just returned. Runs on the stack of the thread switched to.
+ */
+static void thread_reap(Cpu *cpu) {
+	Thread *dead = cpu->dead_thread;
+	if (dead != NULL) {
+		cpu->dead_thread = NULL;
+		thread_free_stacks(dead);
+	}
+}
+
+/**
+ * Hands the FPU from prev to next. Called with interrupts disabled.
+ */
+static void fpu_switch(Cpu *cpu, Thread *prev, Thread *next) {
+	// prev may have modified its registers, write back what changed
+	if (cpu->fpu_enabled && cpu->fpu_owner == prev) {
+		fpu_save(prev->fpu_state);
+	}
+
+	bool loaded = cpu->fpu_owner == next && next->fpu_cpu == cpu->id;
+	if (loaded != cpu->fpu_enabled) {
+		if (loaded) {
+			fpu_enable();
+		} else {
+			fpu_disable();
+		}
+		cpu->fpu_enabled = loaded;
+	}
+}
+
+bool thread_fpu_trap(InterruptFrame *frame, void *context) {
+	(void)context;
+
+	// Before anything else, so the handler itself may touch SIMD registers
+	fpu_enable();
+
+	Cpu *cpu = this_cpu();
+	Thread *current = cpu->current_thread;
+	cpu->fpu_enabled = true;
+
+	if (current == NULL) {
+		kernel_panic("FPU trap before threads were set up", frame);
+	}
+
+	// The previous owner was saved when it was switched out
+	if (cpu->fpu_owner != current || current->fpu_cpu != cpu->id) {
+		fpu_restore(current->fpu_state);
+		cpu->fpu_owner = current;
+		current->fpu_cpu = cpu->id;
+	}
+
+	return true;
+}
+
+void thread_initialize() {
+	Cpu *cpu = this_cpu();
+	Thread *idle = &idle_threads[cpu->id];
+
+	idle->id = cpu->id;
+	idle->cpu = cpu->id;
+	idle->state = THREAD_RUNNING;
+	idle->priority = THREAD_PRIORITY_LOW;
+	idle->name = "idle";
+	idle->fpu_state = fpu_state_alloc();
+	if (idle->fpu_state == NULL) {
+		kernel_panic("Out of memory for the idle thread's FPU state", NULL);
+	}
+
+	// Whatever is in the registers now belongs to the boot context
+	idle->fpu_cpu = cpu->id;
+	cpu->fpu_owner = idle;
+	cpu->fpu_enabled = true;
+
+	cpu->idle_thread = idle;
+	cpu->current_thread = idle;
+}
+
+Thread *thread_create(const char *name, ThreadEntry entry, void *argument) {
+	Thread *thread = (Thread *)pmm_alloc(sizeof(Thread));
+	if (thread == NULL) {
+		return NULL;
+	}
+	memset(thread, 0, sizeof(Thread));
+
+	thread->stack = pmm_alloc(THREAD_STACK_SIZE);
+	thread->fpu_state = fpu_state_alloc();
+	if (thread->stack == 0 || thread->fpu_state == NULL) {
+		thread_free_stacks(thread);
+		pmm_free((uintptr_t)thread);
+		return NULL;
+	}
+
+	thread->id = atomic_fetch_add(&next_thread_id, 1);
+	thread->cpu = this_cpu()->id;
+	thread->state = THREAD_BLOCKED;
+	thread->priority = THREAD_PRIORITY_NORMAL;
+	thread->name = name;
+	thread->entry = entry;
+	thread->argument = argument;
+	thread->fpu_cpu = UINT32_MAX;
+
+	// First switch "returns" into thread_trampoline with the thread in rbx and
+	// the stack 16-byte aligned for its call
+	uintptr_t stack_top = thread->stack + THREAD_STACK_SIZE - 16;
+	SwitchFrame *frame = (SwitchFrame *)(stack_top - sizeof(SwitchFrame));
+	memset(frame, 0, sizeof(SwitchFrame));
+	frame->rbx = (uint64_t)thread;
+	frame->rip = (uint64_t)thread_trampoline;
+	thread->context = frame;
+
+	return thread;
+}
+
+void thread_start(Thread *thread) { thread_wake(thread); }
+
+void thread_set_priority(Thread *thread, ThreadPriority priority) {
+	thread->priority = priority;
+}
+
+Thread *thread_current() { return this_cpu()->current_thread; }
+
+/**
+ * First C code of a new thread, called from thread_trampoline
+ */
+__attribute__((noreturn)) void thread_bootstrap(Thread *thread) {
+	// Switched to from schedule, which runs with interrupts disabled
+	thread_reap(this_cpu());
+	interrupts_enable();
+
+	thread->entry(thread->argument);
+	thread_exit();
+}
+
+/**
+ * Switches the CPU from prev to next, with both already in their new state.
+ * Called with interrupts disabled, returns once prev runs again.
+ */
+static void thread_switch(Cpu *cpu, Thread *prev, Thread *next) {
+	cpu->current_thread = next;
+	fpu_switch(cpu, prev, next);
+
+	// Entries from ring 3 land on the thread's own stack. The idle threads
+	// never leave the kernel and get none, rather than keeping the previous
+	// thread's, which may be freed by then.
+	uintptr_t stack_top = 0;
+	if (next->stack != 0) {
+		stack_top = next->stack + THREAD_STACK_SIZE;
+	}
+	cpu->kernel_stack_top = stack_top;
+	gdt_set_kernel_stack(&cpu->gdt, stack_top);
+	context_switch(&prev->context, next->context);
+
+	// Back in prev, possibly switched to from a thread that exited
+	thread_reap(cpu);
+}
+
+void schedule() {
+	Cpu *cpu = this_cpu();
+	RunQueue *queue = &run_queues[cpu->id];
+	Thread *prev = cpu->current_thread;
+
+	ticket_lock_acquire(&queue->lock);
+
+	// A woken thread that has not switched out yet is already queued
+	if (prev->state == THREAD_RUNNING && prev != cpu->idle_thread) {
+		prev->state = THREAD_RUNNABLE;
+		run_queue_push(queue, prev);
+	}
+
+	Thread *next = run_queue_pop(queue);
+	if (next == NULL) {
+		next = prev->state == THREAD_RUNNING ? prev : cpu->idle_thread;
+	}
+	next->state = THREAD_RUNNING;
+
+	ticket_lock_release(&queue->lock);
+
+	cpu->need_resched = false;
+	if (next == prev) {
+		return;
+	}
+
+	thread_switch(cpu, prev, next);
+}
+
+void thread_yield() {
+	uint64_t rflags = interrupts_save_disable();
+	schedule();
+	interrupts_restore(rflags);
+}
+
+void thread_block() {
+	uint64_t rflags = interrupts_save_disable();
+	schedule();
+	interrupts_restore(rflags);
+}
+
+bool thread_wake(Thread *thread) {
+	RunQueue *queue = &run_queues[thread->cpu];
+	uint64_t rflags = ticket_lock_acquire_irqsave(&queue->lock);
+
+	if (thread->state != THREAD_BLOCKED) {
+		ticket_lock_release_irqrestore(&queue->lock, rflags);
+		return false;
+	}
+
+	thread->state = THREAD_RUNNABLE;
+	run_queue_push(queue, thread);
+
+	ticket_lock_release_irqrestore(&queue->lock, rflags);
+
+	// Kick the owning CPU out of idle, or off a less important thread
+	Cpu *target = cpu_get(thread->cpu);
+	Thread *running = target->current_thread;
+	if (running == target->idle_thread ||
+		thread->priority < running->priority) {
+		if (target == this_cpu()) {
+			target->need_resched = true;
+		} else {
+			smp_resched(thread->cpu);
+		}
+	}
+
+	return true;
+}
+
+void thread_handoff(Thread *next) {
+	uint64_t rflags = interrupts_save_disable();
+	Cpu *cpu = this_cpu();
+	RunQueue *queue = &run_queues[cpu->id];
+	Thread *prev = cpu->current_thread;
+
+	// Threads never migrate, one on another CPU can only be woken there
+	if (next->cpu != cpu->id) {
+		thread_wake(next);
+		schedule();
+		interrupts_restore(rflags);
+		return;
+	}
+
+	ticket_lock_acquire(&queue->lock);
+
+	// Already queued or running, the run queue decides
+	if (next->state != THREAD_BLOCKED) {
+		ticket_lock_release(&queue->lock);
+		schedule();
+		interrupts_restore(rflags);
+		return;
+	}
+
+	// Same as in schedule, a woken prev is queued already
+	if (prev->state == THREAD_RUNNING && prev != cpu->idle_thread) {
+		prev->state = THREAD_RUNNABLE;
+		run_queue_push(queue, prev);
+	}
+	next->state = THREAD_RUNNING;
+
+	ticket_lock_release(&queue->lock);
+
+	// The timeslice belongs to the CPU, tick_slice_end carries over
+	thread_switch(cpu, prev, next);
+	interrupts_restore(rflags);
+}
+
+void thread_exit() {
+	interrupts_disable();
+
+	Cpu *cpu = this_cpu();
+	Thread *current = cpu->current_thread;
+	current->state = THREAD_DEAD;
+
+	// The FPU registers hold nothing worth saving any more
+	if (cpu->fpu_owner == current) {
+		cpu->fpu_owner = NULL;
+	}
+
+	// Still running on the stack, the next thread frees it
+	cpu->dead_thread = current;
+	schedule();
+	__builtin_unreachable();
+}
+
+void thread_preempt() {
+	Cpu *cpu = this_cpu();
+
+	// The idle thread switches away from its own loop, where it has left idle
+	// for the tick and RCU first
+	if (cpu->need_resched && cpu->preempt_count == 0 &&
+		cpu->current_thread != cpu->idle_thread) {
+		schedule();
+	}
+}
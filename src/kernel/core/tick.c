@@ -0,0 +1,197 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <hal/cpu.h>
+#include <hal/lapic.h>
+
+#include <kernel/debug.h>
+#include <kernel/percpu.h>
+#include <kernel/rcu.h>
+#include <kernel/tick.h>
+#include <kernel/time.h>
+#include <kernel/timer.h>
+
+/**
+ * Length of the TSC reference window used for calibration
+ */
+#define CALIBRATION_US 10000
+
+static TickMode tick_mode;
+
+/**
+ * Calibrated LAPIC timer frequency, after the divide-by-16 configured by
+ * lapic_initialize, and the 32.32 fixed point ratio of LAPIC to TSC ticks
+ */
+static uint64_t lapic_hz;
+static uint64_t lapic_per_tsc;
+
+/**
+ * Timeslice length in TSC ticks and LAPIC timer ticks
+ */
+static uint64_t slice_tsc;
+static uint32_t slice_lapic;
+
+/**
+ * Measures the LAPIC timer frequency against the (already calibrated) TSC
+ */
+static void tick_calibrate() {
+	uint64_t window = ns_to_tsc(CALIBRATION_US * NS_PER_US);
+	uint64_t rflags = interrupts_save_disable();
+
+	lapic_timer_calibration_start();
+	uint64_t tsc_start = rdtsc();
+	uint64_t tsc_end;
+	do {
+		cpu_relax();
+		tsc_end = rdtsc();
+	} while (tsc_end - tsc_start < window);
+	uint32_t lapic_elapsed = 0xFFFFFFFF - lapic_timer_current_count();
+	lapic_timer_stop();
+
+	interrupts_restore(rflags);
+
+	lapic_hz = (lapic_elapsed * NS_PER_SEC) / tsc_to_ns(tsc_end - tsc_start);
+	lapic_per_tsc = (lapic_hz << 32) / time_tsc_hz();
+}
+
+/**
+ * Converts a TSC delta into LAPIC timer ticks, clamped to the 32-bit counter
+ */
+static uint32_t tsc_to_lapic_ticks(uint64_t delta) {
+	uint64_t count =
+		(uint64_t)(((unsigned __int128)delta * lapic_per_tsc) >> 32);
+
+	if (count == 0) {
+		return 1;
+	}
+	if (count > 0xFFFFFFFF) {
+		return 0xFFFFFFFF;
+	}
+
+	return (uint32_t)count;
+}
+
+/**
+ * Arms the hardware for the earliest of the timeslice end and the requested
+ * event. Must be called with interrupts disabled.
+ */
+static void tick_program(Cpu *cpu) {
+	uint64_t next = cpu->tick_slice_end;
+	if (cpu->tick_event != 0 && (next == 0 || cpu->tick_event < next)) {
+		next = cpu->tick_event;
+	}
+
+	if (tick_mode == TICK_MODE_TSC_DEADLINE) {
+		// A deadline of zero disarms the timer
+		lapic_timer_deadline(next);
+		return;
+	}
+
+	// In periodic mode a busy CPU keeps its periodic tick, only idle CPUs are
+	// programmed for a single event
+	if (!cpu->tick_idle) {
+		return;
+	}
+
+	if (next == 0) {
+		lapic_timer_stop();
+		return;
+	}
+
+	uint64_t now = rdtsc();
+	lapic_timer_oneshot(tsc_to_lapic_ticks(next > now ? next - now : 0));
+}
+
+void tick_initialize() {
+	tick_calibrate();
+
+	tick_mode = lapic_has_tsc_deadline() ? TICK_MODE_TSC_DEADLINE
+										 : TICK_MODE_PERIODIC;
+	slice_tsc = ns_to_tsc(TICK_TIMESLICE_US * NS_PER_US);
+	slice_lapic = tsc_to_lapic_ticks(slice_tsc);
+
+	log_message(
+		&kernel_debug_logger,
+		LOG_INFO,
+		"tick",
+		"Timer calibrated {mode=%s, lapic_hz=%llu}\n",
+		tick_mode == TICK_MODE_TSC_DEADLINE ? "tsc-deadline" : "periodic",
+		lapic_hz
+	);
+
+	tick_initialize_ap();
+}
+
+void tick_initialize_ap() {
+	uint64_t rflags = interrupts_save_disable();
+	tick_idle_exit();
+	interrupts_restore(rflags);
+}
+
+TickMode tick_get_mode() { return tick_mode; }
+
+void tick_set_event(uint64_t deadline) {
+	uint64_t rflags = interrupts_save_disable();
+	Cpu *cpu = this_cpu();
+
+	cpu->tick_event = deadline;
+	tick_program(cpu);
+
+	interrupts_restore(rflags);
+}
+
+bool tick_handler(InterruptFrame *frame, void *context) {
+	(void)frame;
+	(void)context;
+
+	Cpu *cpu = this_cpu();
+	uint64_t now = rdtsc();
+
+	cpu->tick_count++;
+
+	// Being interrupted outside of a read-side section is a quiescent state
+	rcu_tick();
+
+	// Run expired timers, they report the next deadline they need
+	cpu->tick_event = timer_run();
+
+	// Each periodic tick is a full timeslice, in deadline mode we only get
+	// here early if another event was due first
+	if (!cpu->tick_idle &&
+		(tick_mode == TICK_MODE_PERIODIC || now >= cpu->tick_slice_end)) {
+		cpu->need_resched = true;
+		cpu->tick_slice_end = now + slice_tsc;
+	}
+
+	tick_program(cpu);
+	lapic_eoi();
+	return true;
+}
+
+void tick_idle_enter() {
+	Cpu *cpu = this_cpu();
+
+	cpu->tick_idle = true;
+	cpu->tick_slice_end = 0;
+
+	if (tick_mode == TICK_MODE_PERIODIC) {
+		lapic_timer_stop();
+	}
+
+	tick_program(cpu);
+}
+
+void tick_idle_exit() {
+	Cpu *cpu = this_cpu();
+
+	cpu->tick_idle = false;
+	cpu->tick_slice_end = rdtsc() + slice_tsc;
+
+	if (tick_mode == TICK_MODE_PERIODIC) {
+		lapic_timer_periodic(slice_lapic);
+		return;
+	}
+
+	tick_program(cpu);
+}
@@ -0,0 +1,190 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <hal/cpu.h>
+#include <hal/hpet.h>
+#include <hal/pit.h>
+
+#include <kernel/acpi.h>
+#include <kernel/debug.h>
+#include <kernel/paging.h>
+#include <kernel/time.h>
+
+/**
+ * Length of the reference window used when measuring the TSC
+ */
+#define CALIBRATION_US 10000
+
+/**
+ * Fixed point shifts of the conversion multipliers. NS_PER_SEC << 32 still
+ * fits in 64 bits, and tsc_hz << 24 does for TSCs up to 2^40 Hz.
+ */
+#define NS_MULT_SHIFT 32
+#define TSC_MULT_SHIFT 24
+
+static uint64_t tsc_hz;
+static uint64_t tsc_base;
+static uint64_t ns_mult;
+static uint64_t tsc_mult;
+static bool tsc_invariant;
+static TimeCalibrationSource calibration_source;
+
+static const char *const calibration_source_strings[] = {
+	"cpuid", "hpet", "pit"
+};
+
+/**
+ * Reads the TSC frequency from CPUID leaf 0x15 (and 0x16 when the crystal
+ * frequency is not enumerated). Returns 0 if the CPU does not report it.
+ */
+static uint64_t calibrate_cpuid() {
+	CpuidResult max = cpuid(0, 0);
+	if (max.eax < 0x15) {
+		return 0;
+	}
+
+	CpuidResult ratio = cpuid(0x15, 0);
+	if (ratio.eax == 0 || ratio.ebx == 0) {
+		return 0;
+	}
+
+	uint64_t crystal_hz = ratio.ecx;
+	if (crystal_hz == 0 && max.eax >= 0x16) {
+		// Derive the crystal from the base frequency (SDM 19.7.3)
+		CpuidResult base = cpuid(0x16, 0);
+		crystal_hz = ((uint64_t)base.eax * 1000000 * ratio.eax) / ratio.ebx;
+	}
+
+	return (crystal_hz * ratio.ebx) / ratio.eax;
+}
+
+/**
+ * Measures the TSC against the HPET main counter. Returns 0 if there is no
+ * HPET.
+ */
+static uint64_t calibrate_hpet() {
+	if (!hpet_available()) {
+		return 0;
+	}
+
+	uint64_t window_ticks =
+		(CALIBRATION_US * 1000000000ULL) / hpet_period_fs();
+	uint64_t rflags = interrupts_save_disable();
+
+	uint64_t hpet_start = hpet_read_counter();
+	uint64_t tsc_start = rdtsc();
+	uint64_t hpet_end;
+	do {
+		cpu_relax();
+		hpet_end = hpet_read_counter();
+	} while (hpet_end - hpet_start < window_ticks);
+	uint64_t tsc_end = rdtsc();
+
+	interrupts_restore(rflags);
+
+	uint64_t elapsed_ns = ((hpet_end - hpet_start) * hpet_period_fs()) /
+						  1000000;
+	return ((tsc_end - tsc_start) * NS_PER_SEC) / elapsed_ns;
+}
+
+/**
+ * Measures the TSC against PIT channel 2, always available as a last resort
+ */
+static uint64_t calibrate_pit() {
+	uint64_t rflags = interrupts_save_disable();
+
+	pit_oneshot_start(CALIBRATION_US);
+	uint64_t tsc_start = rdtsc();
+	while (!pit_oneshot_expired()) {
+		cpu_relax();
+	}
+	uint64_t tsc_end = rdtsc();
+
+	interrupts_restore(rflags);
+
+	return ((tsc_end - tsc_start) * 1000000) / CALIBRATION_US;
+}
+
+/**
+ * Maps and enables the HPET if the firmware describes one
+ */
+static void hpet_probe() {
+	AcpiHpet *table = acpi_find_table("HPET");
+	if (table == NULL) {
+		return;
+	}
+
+	void *mmio = paging_map_mmio(table->base_address.address, HPET_MMIO_SIZE);
+	if (mmio != NULL) {
+		hpet_initialize((uintptr_t)mmio);
+	}
+}
+
+void time_initialize() {
+	CpuidResult max_extended = cpuid(0x80000000, 0);
+	if (max_extended.eax >= 0x80000007) {
+		tsc_invariant = (cpuid(0x80000007, 0).edx & (1 << 8)) != 0;
+	}
+
+	if ((tsc_hz = calibrate_cpuid()) != 0) {
+		calibration_source = TIME_CALIBRATION_CPUID;
+	} else {
+		hpet_probe();
+		if ((tsc_hz = calibrate_hpet()) != 0) {
+			calibration_source = TIME_CALIBRATION_HPET;
+		} else {
+			tsc_hz = calibrate_pit();
+			calibration_source = TIME_CALIBRATION_PIT;
+		}
+	}
+
+	ns_mult = (NS_PER_SEC << NS_MULT_SHIFT) / tsc_hz;
+	tsc_mult = (tsc_hz << TSC_MULT_SHIFT) / NS_PER_SEC;
+	tsc_base = rdtsc();
+
+	if (!tsc_invariant) {
+		log_message(
+			&kernel_debug_logger,
+			LOG_WARNING,
+			"time",
+			"TSC is not invariant, time may drift in deep C-states\n"
+		);
+	}
+
+	log_message(
+		&kernel_debug_logger,
+		LOG_INFO,
+		"time",
+		"TSC clocksource ready {tsc_hz=%llu, source=%s}\n",
+		tsc_hz,
+		calibration_source_strings[calibration_source]
+	);
+}
+
+uint64_t time_tsc_hz() { return tsc_hz; }
+
+bool time_tsc_invariant() { return tsc_invariant; }
+
+TimeCalibrationSource time_calibration_source() { return calibration_source; }
+
+TimeScale time_scale() {
+	return (TimeScale){
+		.tsc_base = tsc_base,
+		.ns_mult = ns_mult,
+		.ns_shift = NS_MULT_SHIFT,
+	};
+}
+
+uint64_t tsc_to_ns(uint64_t tsc_delta) {
+	unsigned __int128 scaled = (unsigned __int128)tsc_delta * ns_mult;
+	return (uint64_t)(scaled >> NS_MULT_SHIFT);
+}
+
+uint64_t ns_to_tsc(uint64_t ns) {
+	return (uint64_t)(((unsigned __int128)ns * tsc_mult) >> TSC_MULT_SHIFT);
+}
+
+uint64_t ktime_to_tsc(uint64_t ns) { return tsc_base + ns_to_tsc(ns); }
+
+uint64_t ktime_ns() { return tsc_to_ns(rdtsc() - tsc_base); }
@@ -0,0 +1,419 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <hal/cpu.h>
+
+#include <kernel/debug.h>
+#include <kernel/percpu.h>
+#include <kernel/tick.h>
+#include <kernel/time.h>
+#include <kernel/timer.h>
+
+#define WHEEL_MASK (TIMER_WHEEL_SLOTS - 1)
+#define WHEEL_MAX_DELTA                                                        \
+	((1ULL << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1)
+#define NO_EXPIRY UINT64_MAX
+
+/**
+ * Per-CPU timer state. Only touched by its own CPU with interrupts disabled.
+ */
+typedef struct {
+	Timer *heap[TIMER_HEAP_CAPACITY];
+	size_t heap_size;
+
+	Timer *wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+	uint64_t wheel_pending[TIMER_WHEEL_LEVELS]; // Bitmap of non-empty slots
+	size_t wheel_count;
+	uint64_t wheel_clk; // Next wheel tick to be processed
+
+	uint64_t programmed; // TSC deadline last handed to the tick code
+} TimerBase;
+
+static TimerBase timer_bases[MAX_CPUS];
+
+static inline TimerBase *this_timer_base() {
+	return &timer_bases[this_cpu()->id];
+}
+
+/*
+ * ============================================================================
+ * Deadline heap
+ * ============================================================================
+ */
+
+static inline void heap_place(TimerBase *base, size_t index, Timer *timer) {
+	base->heap[index] = timer;
+	timer->heap_index = index;
+}
+
+static void heap_sift_up(TimerBase *base, size_t index) {
+	Timer *timer = base->heap[index];
+
+	while (index > 0) {
+		size_t parent = (index - 1) / 2;
+		if (base->heap[parent]->expires <= timer->expires) {
+			break;
+		}
+
+		heap_place(base, index, base->heap[parent]);
+		index = parent;
+	}
+
+	heap_place(base, index, timer);
+}
+
+static void heap_sift_down(TimerBase *base, size_t index) {
+	Timer *timer = base->heap[index];
+
+	for (;;) {
+		size_t child = index * 2 + 1;
+		if (child >= base->heap_size) {
+			break;
+		}
+
+		if (child + 1 < base->heap_size &&
+			base->heap[child + 1]->expires < base->heap[child]->expires) {
+			child++;
+		}
+
+		if (timer->expires <= base->heap[child]->expires) {
+			break;
+		}
+
+		heap_place(base, index, base->heap[child]);
+		index = child;
+	}
+
+	heap_place(base, index, timer);
+}
+
+static void heap_remove(TimerBase *base, Timer *timer) {
+	size_t index = timer->heap_index;
+	Timer *last = base->heap[--base->heap_size];
+
+	if (last != timer) {
+		heap_place(base, index, last);
+		heap_sift_up(base, index);
+		heap_sift_down(base, last->heap_index);
+	}
+}
+
+/*
+ * ============================================================================
+ * Hierarchical timer wheel
+ * ============================================================================
+ */
+
+static inline uint64_t wheel_expires(const Timer *timer) {
+	return (timer->expires + TIMER_WHEEL_TICK_NS - 1) / TIMER_WHEEL_TICK_NS;
+}
+
+/**
+ * Rotates a slot bitmap right so that bit `start` ends up at bit 0
+ */
+static inline uint64_t rotate_right(uint64_t bitmap, unsigned start) {
+	start &= WHEEL_MASK;
+	if (start == 0) {
+		return bitmap;
+	}
+
+	return (bitmap >> start) | (bitmap << (TIMER_WHEEL_SLOTS - start));
+}
+
+static void wheel_link(TimerBase *base, Timer *timer) {
+	uint64_t expires = wheel_expires(timer);
+	uint64_t delta = expires > base->wheel_clk ? expires - base->wheel_clk : 0;
+	unsigned level = 0;
+
+	if (delta == 0) {
+		// Already due, run it on the next processed tick
+		expires = base->wheel_clk;
+	} else if (delta > WHEEL_MAX_DELTA) {
+		// Park it in the last level, it is re-cascaded until it fits
+		expires = base->wheel_clk + WHEEL_MAX_DELTA;
+		delta = WHEEL_MAX_DELTA;
+	}
+
+	while (level < TIMER_WHEEL_LEVELS - 1 &&
+		   delta >= (1ULL << (TIMER_WHEEL_BITS * (level + 1)))) {
+		level++;
+	}
+
+	unsigned slot = (expires >> (TIMER_WHEEL_BITS * level)) & WHEEL_MASK;
+	Timer **head = &base->wheel[level][slot];
+
+	timer->next = *head;
+	if (timer->next != NULL) {
+		timer->next->pprev = &timer->next;
+	}
+	timer->pprev = head;
+	*head = timer;
+
+	timer->wheel_slot = level * TIMER_WHEEL_SLOTS + slot;
+	timer->state = TIMER_QUEUED_WHEEL;
+	base->wheel_pending[level] |= 1ULL << slot;
+	base->wheel_count++;
+}
+
+static void wheel_unlink(TimerBase *base, Timer *timer) {
+	unsigned level = timer->wheel_slot / TIMER_WHEEL_SLOTS;
+	unsigned slot = timer->wheel_slot % TIMER_WHEEL_SLOTS;
+
+	*timer->pprev = timer->next;
+	if (timer->next != NULL) {
+		timer->next->pprev = timer->pprev;
+	}
+
+	if (base->wheel[level][slot] == NULL) {
+		base->wheel_pending[level] &= ~(1ULL << slot);
+	}
+	base->wheel_count--;
+}
+
+/**
+ * Moves all timers of a slot one or more levels down
+ */
+static void wheel_cascade(TimerBase *base, unsigned level, unsigned slot) {
+	Timer *timer = base->wheel[level][slot];
+	size_t count = 0;
+
+	for (Timer *t = timer; t != NULL; t = t->next) {
+		count++;
+	}
+
+	base->wheel[level][slot] = NULL;
+	base->wheel_pending[level] &= ~(1ULL << slot);
+	base->wheel_count -= count;
+
+	while (timer != NULL) {
+		Timer *next = timer->next;
+		wheel_link(base, timer);
+		timer = next;
+	}
+}
+
+/**
+ * Returns the first wheel tick at or after wheel_clk at which a slot has to be
+ * run or cascaded, or NO_EXPIRY if the wheel is empty
+ */
+static uint64_t wheel_next_expiry(TimerBase *base) {
+	uint64_t clk = base->wheel_clk;
+	uint64_t next = NO_EXPIRY;
+
+	if (base->wheel_count == 0) {
+		return NO_EXPIRY;
+	}
+
+	if (base->wheel_pending[0] != 0) {
+		uint64_t rotated = rotate_right(base->wheel_pending[0], clk);
+		next = clk + __builtin_ctzll(rotated);
+	}
+
+	for (unsigned level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+		if (base->wheel_pending[level] == 0) {
+			continue;
+		}
+
+		unsigned shift = TIMER_WHEEL_BITS * level;
+		uint64_t level_clk = clk >> shift;
+
+		// The slot of the current index is still due for cascading if we are
+		// exactly on its boundary, otherwise it comes around next rotation
+		unsigned first = (clk & ((1ULL << shift) - 1)) == 0 ? 0 : 1;
+		uint64_t rotated =
+			rotate_right(base->wheel_pending[level], level_clk + first);
+		uint64_t cascade_at =
+			(level_clk + first + __builtin_ctzll(rotated)) << shift;
+
+		if (cascade_at < next) {
+			next = cascade_at;
+		}
+	}
+
+	return next;
+}
+
+/**
+ * Processes wheel ticks up to and including target, skipping empty stretches
+ */
+static void wheel_advance(TimerBase *base, uint64_t target) {
+	while (base->wheel_clk <= target) {
+		uint64_t next = wheel_next_expiry(base);
+		if (next > target) {
+			base->wheel_clk = target + 1;
+			return;
+		}
+
+		uint64_t clk = base->wheel_clk = next;
+		unsigned index = clk & WHEEL_MASK;
+
+		// On a level boundary, pull the timers of the next level down first
+		for (unsigned level = 1; index == 0 && level < TIMER_WHEEL_LEVELS;
+			 level++) {
+			index = (clk >> (TIMER_WHEEL_BITS * level)) & WHEEL_MASK;
+			wheel_cascade(base, level, index);
+		}
+
+		// Detach the slot so timers re-armed by a callback cannot land in the
+		// list being run. The detached list stays properly linked, so a
+		// callback may still cancel any of the remaining timers.
+		unsigned slot = clk & WHEEL_MASK;
+		Timer *expired = base->wheel[0][slot];
+		base->wheel[0][slot] = NULL;
+		base->wheel_pending[0] &= ~(1ULL << slot);
+		if (expired != NULL) {
+			expired->pprev = &expired;
+		}
+		base->wheel_clk++;
+
+		while (expired != NULL) {
+			Timer *timer = expired;
+			expired = timer->next;
+			if (expired != NULL) {
+				expired->pprev = &expired;
+			}
+
+			base->wheel_count--;
+			timer->state = TIMER_INACTIVE;
+			timer->callback(timer);
+		}
+	}
+}
+
+/*
+ * ============================================================================
+ * Timer API
+ * ============================================================================
+ */
+
+static uint64_t timer_next_deadline(TimerBase *base) {
+	uint64_t next = NO_EXPIRY;
+
+	if (base->heap_size > 0) {
+		next = base->heap[0]->expires;
+	}
+
+	uint64_t wheel_next = wheel_next_expiry(base);
+	if (wheel_next != NO_EXPIRY && wheel_next * TIMER_WHEEL_TICK_NS < next) {
+		next = wheel_next * TIMER_WHEEL_TICK_NS;
+	}
+
+	return next == NO_EXPIRY ? 0 : ktime_to_tsc(next);
+}
+
+/**
+ * Hands the earliest deadline to the tick code if it changed
+ */
+static void timer_reprogram(TimerBase *base) {
+	uint64_t next = timer_next_deadline(base);
+
+	if (next != base->programmed) {
+		base->programmed = next;
+		tick_set_event(next);
+	}
+}
+
+static void timer_dequeue(TimerBase *base, Timer *timer) {
+	if (timer->state == TIMER_QUEUED_WHEEL) {
+		wheel_unlink(base, timer);
+	} else if (timer->state == TIMER_QUEUED_HEAP) {
+		heap_remove(base, timer);
+	}
+
+	timer->state = TIMER_INACTIVE;
+}
+
+void timer_initialize() {
+	TimerBase *base = this_timer_base();
+
+	base->wheel_clk = ktime_ns() / TIMER_WHEEL_TICK_NS;
+
+	log_message(
+		&kernel_debug_logger,
+		LOG_INFO,
+		"timer",
+		"Timer base ready {cpu=%d, wheel_tick_ns=%llu}\n",
+		this_cpu()->id,
+		TIMER_WHEEL_TICK_NS
+	);
+}
+
+void timer_init(Timer *timer, TimerCallback callback, void *data) {
+	timer->next = NULL;
+	timer->pprev = NULL;
+	timer->expires = 0;
+	timer->callback = callback;
+	timer->data = data;
+	timer->heap_index = 0;
+	timer->wheel_slot = 0;
+	timer->state = TIMER_INACTIVE;
+}
+
+void timer_start_timeout(Timer *timer, uint64_t timeout_ns) {
+	uint64_t rflags = interrupts_save_disable();
+	TimerBase *base = this_timer_base();
+
+	timer_dequeue(base, timer);
+	timer->expires = ktime_ns() + timeout_ns;
+	wheel_link(base, timer);
+	timer_reprogram(base);
+
+	interrupts_restore(rflags);
+}
+
+bool timer_start_deadline(Timer *timer, uint64_t deadline_ns) {
+	uint64_t rflags = interrupts_save_disable();
+	TimerBase *base = this_timer_base();
+
+	timer_dequeue(base, timer);
+
+	if (base->heap_size == TIMER_HEAP_CAPACITY) {
+		interrupts_restore(rflags);
+		return false;
+	}
+
+	timer->expires = deadline_ns;
+	timer->state = TIMER_QUEUED_HEAP;
+	heap_place(base, base->heap_size++, timer);
+	heap_sift_up(base, timer->heap_index);
+
+	// Only the new minimum changes the programmed deadline
+	if (timer->heap_index == 0) {
+		timer_reprogram(base);
+	}
+
+	interrupts_restore(rflags);
+	return true;
+}
+
+bool timer_cancel(Timer *timer) {
+	uint64_t rflags = interrupts_save_disable();
+	TimerBase *base = this_timer_base();
+	bool was_pending = timer_pending(timer);
+
+	if (was_pending) {
+		timer_dequeue(base, timer);
+		timer_reprogram(base);
+	}
+
+	interrupts_restore(rflags);
+	return was_pending;
+}
+
+uint64_t timer_run() {
+	TimerBase *base = this_timer_base();
+	uint64_t now = ktime_ns();
+
+	while (base->heap_size > 0 && base->heap[0]->expires <= now) {
+		Timer *timer = base->heap[0];
+		heap_remove(base, timer);
+		timer->state = TIMER_INACTIVE;
+		timer->callback(timer);
+	}
+
+	wheel_advance(base, now / TIMER_WHEEL_TICK_NS);
+
+	base->programmed = timer_next_deadline(base);
+	return base->programmed;
+}
@@ -0,0 +1,144 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libk/spinlock.h>
+#include <libk/string.h>
+
+#include <hal/cpu.h>
+
+#include <kernel/debug.h>
+#include <kernel/paging.h>
+#include <kernel/percpu.h>
+#include <kernel/pmm.h>
+#include <kernel/time.h>
+#include <kernel/vdso.h>
+
+_Static_assert(
+	VDSO_MAX_CPUS >= MAX_CPUS, "The data page must describe every CPU"
+);
+_Static_assert(sizeof(VdsoData) <= PAGE_SIZE, "VdsoData must fit one page");
+
+/**
+ * Direct map view of the page, user space sees it read-only
+ */
+static VdsoData *vdso_data;
+
+/**
+ * Serializes writers, readers only look at the sequence
+ */
+static TicketLock vdso_lock = TICKET_LOCK_INIT("vdso");
+
+/**
+ * Opens an update, readers retry until vdso_write_end. Called with vdso_lock
+ * held.
+ */
+static void vdso_write_begin() {
+	__atomic_store_n(
+		&vdso_data->sequence, vdso_data->sequence + 1, __ATOMIC_RELAXED
+	);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void vdso_write_end() {
+	__atomic_store_n(
+		&vdso_data->sequence, vdso_data->sequence + 1, __ATOMIC_RELEASE
+	);
+}
+
+static uint32_t vdso_features() {
+	uint32_t features = 0;
+
+	if (cpuid(0x80000000, 0).eax >= 0x80000001 &&
+		(cpuid(0x80000001, 0).edx & CPUID_80000001_EDX_RDTSCP)) {
+		features |= VDSO_FEATURE_RDTSCP;
+	}
+	if (cpuid(0, 0).eax >= 7 && (cpuid(7, 0).ecx & CPUID_7_ECX_RDPID)) {
+		features |= VDSO_FEATURE_RDPID;
+	}
+	if (time_tsc_invariant()) {
+		features |= VDSO_FEATURE_TSC_INVARIANT;
+	}
+
+	return features;
+}
+
+void vdso_update_time() {
+	if (vdso_data == NULL) {
+		return;
+	}
+
+	TimeScale scale = time_scale();
+	uint64_t rflags = ticket_lock_acquire_irqsave(&vdso_lock);
+
+	vdso_write_begin();
+	vdso_data->tsc_hz = time_tsc_hz();
+	vdso_data->tsc_base = scale.tsc_base;
+	vdso_data->ns_mult = scale.ns_mult;
+	vdso_data->ns_shift = scale.ns_shift;
+	vdso_write_end();
+
+	ticket_lock_release_irqrestore(&vdso_lock, rflags);
+}
+
+void vdso_register_cpu() {
+	if (vdso_data == NULL) {
+		return;
+	}
+
+	Cpu *cpu = this_cpu();
+
+	// Read by rdtscp and rdpid, the cheapest way for ring 3 to know its CPU
+	if (vdso_data->features & (VDSO_FEATURE_RDTSCP | VDSO_FEATURE_RDPID)) {
+		wrmsr(MSR_TSC_AUX, cpu->id);
+	}
+
+	uint64_t rflags = ticket_lock_acquire_irqsave(&vdso_lock);
+
+	vdso_write_begin();
+	vdso_data->cpus[cpu->id] = (VdsoCpu){
+		.apic_id = cpu->apic_id,
+		.online = 1,
+	};
+	if (cpu->id >= vdso_data->cpu_count) {
+		vdso_data->cpu_count = cpu->id + 1;
+	}
+	vdso_write_end();
+
+	ticket_lock_release_irqrestore(&vdso_lock, rflags);
+}
+
+void vdso_initialize() {
+	uintptr_t page = pmm_alloc(PAGE_SIZE);
+	if (page == 0 ||
+		!paging_map_page(
+			VDSO_DATA_ADDRESS,
+			virt_to_phys((void *)page),
+			PAGE_PRESENT | PAGE_USER | PAGE_NO_EXECUTE
+		)) {
+		log_message(
+			&kernel_debug_logger,
+			LOG_ERROR,
+			"vdso",
+			"Could not map the kernel data page\n"
+		);
+		return;
+	}
+
+	memset((void *)page, 0, PAGE_SIZE);
+	vdso_data = (VdsoData *)page;
+	vdso_data->version = VDSO_VERSION;
+	vdso_data->features = vdso_features();
+
+	vdso_update_time();
+	vdso_register_cpu();
+
+	log_message(
+		&kernel_debug_logger,
+		LOG_INFO,
+		"vdso",
+		"Kernel data page mapped {address=0x%llx, features=0x%x}\n",
+		VDSO_DATA_ADDRESS,
+		vdso_data->features
+	);
+}
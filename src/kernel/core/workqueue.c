@@ -0,0 +1,196 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libk/spinlock.h>
+#include <libk/string.h>
+
+#include <kernel/debug.h>
+#include <kernel/panic.h>
+#include <kernel/percpu.h>
+#include <kernel/pmm.h>
+#include <kernel/smp.h>
+#include <kernel/thread.h>
+#include <kernel/workqueue.h>
+
+struct WorkPool;
+
+typedef struct Worker {
+	Thread *thread;
+	struct WorkPool *pool;
+	struct Worker *next_idle;
+} Worker;
+
+/**
+ * Work and workers of one workqueue on one CPU. The number of workers is the
+ * concurrency limit, so a burst of work never creates more threads.
+ */
+typedef struct WorkPool {
+	Workqueue *workqueue;
+	TicketLock lock;
+	Work *head;
+	Work *tail;
+	Worker *idle;
+	uint32_t worker_count;
+	Worker workers[WORKQUEUE_MAX_ACTIVE];
+} __attribute__((aligned(64))) WorkPool;
+
+struct Workqueue {
+	const char *name;
+	uint32_t max_active;
+	WorkPool pools[MAX_CPUS];
+};
+
+Workqueue *system_workqueue;
+
+static void worker_thread(void *argument) {
+	Worker *worker = (Worker *)argument;
+	WorkPool *pool = worker->pool;
+
+	for (;;) {
+		uint64_t rflags = ticket_lock_acquire_irqsave(&pool->lock);
+
+		Work *work = pool->head;
+		if (work == NULL) {
+			// queue_work takes us off the idle list under the same lock
+			worker->next_idle = pool->idle;
+			pool->idle = worker;
+			worker->thread->state = THREAD_BLOCKED;
+
+			ticket_lock_release_irqrestore(&pool->lock, rflags);
+			thread_block();
+			continue;
+		}
+
+		pool->head = work->next;
+		if (pool->head == NULL) {
+			pool->tail = NULL;
+		}
+		ticket_lock_release_irqrestore(&pool->lock, rflags);
+
+		atomic_store_explicit(&work->pending, false, memory_order_release);
+		work->function(work);
+	}
+}
+
+/**
+ * Starts the workers of a pool on the calling CPU, threads stay on the CPU
+ * that created them
+ */
+static void workqueue_spawn_workers(void *argument) {
+	WorkPool *pool = (WorkPool *)argument;
+	Workqueue *workqueue = pool->workqueue;
+
+	for (uint32_t i = 0; i < workqueue->max_active; i++) {
+		Worker *worker = &pool->workers[i];
+		worker->pool = pool;
+		worker->thread = thread_create(workqueue->name, worker_thread, worker);
+		if (worker->thread == NULL) {
+			break;
+		}
+
+		pool->worker_count++;
+		thread_start(worker->thread);
+	}
+}
+
+void workqueue_initialize() {
+	system_workqueue =
+		workqueue_create("system_workqueue", WORKQUEUE_SYSTEM_MAX_ACTIVE);
+	if (system_workqueue == NULL) {
+		kernel_panic("Out of memory for the system workqueue", NULL);
+	}
+}
+
+Workqueue *workqueue_create(const char *name, uint32_t max_active) {
+	if (max_active == 0 || max_active > WORKQUEUE_MAX_ACTIVE) {
+		return NULL;
+	}
+
+	Workqueue *workqueue = (Workqueue *)pmm_alloc(sizeof(Workqueue));
+	if (workqueue == NULL) {
+		return NULL;
+	}
+	memset(workqueue, 0, sizeof(Workqueue));
+
+	workqueue->name = name;
+	workqueue->max_active = max_active;
+
+	uint32_t self = this_cpu()->id;
+	for (uint32_t cpu = 0; cpu < smp_cpu_count(); cpu++) {
+		WorkPool *pool = &workqueue->pools[cpu];
+		pool->workqueue = workqueue;
+		ticket_lock_init(&pool->lock, name);
+
+		if (cpu == self) {
+			workqueue_spawn_workers(pool);
+		} else if (smp_call(cpu, workqueue_spawn_workers, pool)) {
+			smp_call_wait(cpu);
+		}
+
+		if (pool->worker_count < max_active) {
+			log_message(
+				&kernel_debug_logger,
+				LOG_WARNING,
+				"workqueue",
+				"Could not start all workers {name=%s, cpu=%d, workers=%d}\n",
+				name,
+				cpu,
+				pool->worker_count
+			);
+		}
+	}
+
+	return workqueue;
+}
+
+void work_init(Work *work, WorkFunction function, void *data) {
+	work->next = NULL;
+	work->function = function;
+	work->data = data;
+	atomic_store(&work->pending, false);
+}
+
+bool queue_work(Workqueue *workqueue, Work *work) {
+	uint64_t rflags = interrupts_save_disable();
+	bool queued = queue_work_on(this_cpu()->id, workqueue, work);
+	interrupts_restore(rflags);
+
+	return queued;
+}
+
+bool queue_work_on(uint32_t cpu, Workqueue *workqueue, Work *work) {
+	if (cpu >= MAX_CPUS || workqueue->pools[cpu].worker_count == 0) {
+		return false;
+	}
+
+	WorkPool *pool = &workqueue->pools[cpu];
+
+	if (atomic_exchange_explicit(&work->pending, true, memory_order_acq_rel)) {
+		return false;
+	}
+
+	uint64_t rflags = ticket_lock_acquire_irqsave(&pool->lock);
+
+	work->next = NULL;
+	if (pool->tail != NULL) {
+		pool->tail->next = work;
+	} else {
+		pool->head = work;
+	}
+	pool->tail = work;
+
+	Worker *worker = pool->idle;
+	if (worker != NULL) {
+		pool->idle = worker->next_idle;
+	}
+
+	ticket_lock_release_irqrestore(&pool->lock, rflags);
+
+	if (worker != NULL) {
+		thread_wake(worker->thread);
+	}
+
+	return true;
+}
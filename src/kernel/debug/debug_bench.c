@@ -0,0 +1,1594 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libk/rwlock.h>
+#include <libk/spinlock.h>
+#include <libk/string.h>
+
+#include <hal/cpu.h>
+
+#include <kernel/aipc.h>
+#include <kernel/debug.h>
+#include <kernel/futex.h>
+#include <kernel/handle.h>
+#include <kernel/idle.h>
+#include <kernel/interrupts.h>
+#include <kernel/ipc.h>
+#include <kernel/kbench.h>
+#include <kernel/kobject.h>
+#include <kernel/paging.h>
+#include <kernel/percpu.h>
+#include <kernel/pin.h>
+#include <kernel/pmm.h>
+#include <kernel/process.h>
+#include <kernel/smp.h>
+#include <kernel/syscalls.h>
+#include <kernel/thread.h>
+#include <kernel/time.h>
+
+/**
+ * Acquisitions per CPU in each lock benchmark run
+ */
+#define BENCH_LOCK_ITERATIONS 100000
+
+/**
+ * Lock/unlock pairs in the uncontended futex benchmark, and round trips in
+ * the handoff benchmark
+ */
+#define BENCH_FUTEX_ITERATIONS 100000
+#define BENCH_FUTEX_ROUNDS 10000
+
+typedef enum {
+	BENCH_LOCK_TICKET,
+	BENCH_LOCK_MCS,
+	BENCH_LOCK_RW_WRITE,
+	BENCH_LOCK_RW_READ,
+	BENCH_LOCK_KIND_COUNT,
+} BenchLockKind;
+
+static const char *bench_lock_names[BENCH_LOCK_KIND_COUNT] = {
+	"ticket",
+	"mcs",
+	"rwlock_write",
+	"rwlock_read",
+};
+
+typedef struct {
+	BenchLockKind kind;
+	uint32_t cpus;
+	_Atomic uint32_t ready;
+	uint64_t elapsed[MAX_CPUS];
+
+	// Protected by the lock under test
+	uint64_t counter;
+} LockBench;
+
+static TicketLock bench_ticket_lock = TICKET_LOCK_INIT("bench_ticket");
+static McsLock bench_mcs_lock = MCS_LOCK_INIT("bench_mcs");
+static RwLock bench_rwlock = RWLOCK_INIT("bench_rwlock");
+
+static void bench_lock_worker(void *argument) {
+	LockBench *bench = (LockBench *)argument;
+	McsNode node;
+	uint64_t sink = 0;
+
+	// Start everyone at the same time so the lock is actually contended
+	atomic_fetch_add_explicit(&bench->ready, 1, memory_order_acq_rel);
+	while (atomic_load_explicit(&bench->ready, memory_order_acquire) <
+		   bench->cpus) {
+		cpu_relax();
+	}
+
+	uint64_t start = rdtsc();
+	for (uint32_t i = 0; i < BENCH_LOCK_ITERATIONS; i++) {
+		switch (bench->kind) {
+		case BENCH_LOCK_TICKET:
+			ticket_lock_acquire(&bench_ticket_lock);
+			bench->counter++;
+			ticket_lock_release(&bench_ticket_lock);
+			break;
+		case BENCH_LOCK_MCS:
+			mcs_lock_acquire(&bench_mcs_lock, &node);
+			bench->counter++;
+			mcs_lock_release(&bench_mcs_lock, &node);
+			break;
+		case BENCH_LOCK_RW_WRITE:
+			rwlock_write_acquire(&bench_rwlock);
+			bench->counter++;
+			rwlock_write_release(&bench_rwlock);
+			break;
+		case BENCH_LOCK_RW_READ:
+			rwlock_read_acquire(&bench_rwlock);
+			sink += *(volatile uint64_t *)&bench->counter;
+			rwlock_read_release(&bench_rwlock);
+			break;
+		default:
+			break;
+		}
+	}
+	bench->elapsed[this_cpu()->id] = rdtsc() - start;
+	(void)sink;
+}
+
+static void bench_lock_run(BenchLockKind kind, uint32_t cpus) {
+	static LockBench bench;
+
+	bench = (LockBench){.kind = kind, .cpus = cpus};
+
+	for (uint32_t cpu = 1; cpu < cpus; cpu++) {
+		smp_call(cpu, bench_lock_worker, &bench);
+	}
+
+	// The boot CPU takes part too, without being interrupted
+	uint64_t rflags = interrupts_save_disable();
+	bench_lock_worker(&bench);
+	interrupts_restore(rflags);
+
+	uint64_t slowest = 0;
+	for (uint32_t cpu = 0; cpu < cpus; cpu++) {
+		smp_call_wait(cpu);
+		if (bench.elapsed[cpu] > slowest) {
+			slowest = bench.elapsed[cpu];
+		}
+	}
+
+	uint64_t operations = (uint64_t)cpus * BENCH_LOCK_ITERATIONS;
+	bool correct =
+		kind == BENCH_LOCK_RW_READ || bench.counter == operations;
+
+	log_message(
+		&kernel_debug_logger,
+		correct ? LOG_INFO : LOG_ERROR,
+		"bench",
+		"Lock benchmark {lock=%s, cpus=%d, cycles_per_op=%llu, correct=%s}\n",
+		bench_lock_names[kind],
+		cpus,
+		slowest / operations,
+		correct ? "yes" : "no"
+	);
+}
+
+void debug_bench_locks() {
+	uint32_t online = smp_cpu_count();
+
+	log_message(
+		&kernel_debug_logger,
+		LOG_INFO,
+		"bench",
+		"Running lock benchmarks {cpus=%d, iterations=%d}\n",
+		online,
+		BENCH_LOCK_ITERATIONS
+	);
+
+	for (BenchLockKind kind = 0; kind < BENCH_LOCK_KIND_COUNT; kind++) {
+		// Powers of two, plus all CPUs if that is not one
+		for (uint32_t cpus = 1; cpus <= online; cpus *= 2) {
+			bench_lock_run(kind, cpus);
+			if (cpus < online && cpus * 2 > online) {
+				bench_lock_run(kind, online);
+			}
+		}
+	}
+
+	debug_dump_lock_stats();
+}
+
+KBENCH(ticket_lock) {
+	for (uint64_t i = 0; i < iterations; i++) {
+		ticket_lock_acquire(&bench_ticket_lock);
+		ticket_lock_release(&bench_ticket_lock);
+	}
+}
+
+KBENCH(mcs_lock) {
+	McsNode node;
+	for (uint64_t i = 0; i < iterations; i++) {
+		mcs_lock_acquire(&bench_mcs_lock, &node);
+		mcs_lock_release(&bench_mcs_lock, &node);
+	}
+}
+
+KBENCH(rwlock_read) {
+	for (uint64_t i = 0; i < iterations; i++) {
+		rwlock_read_acquire(&bench_rwlock);
+		rwlock_read_release(&bench_rwlock);
+	}
+}
+
+/**
+ * Maps a fresh page for ring 3 and returns its direct map address, or 0
+ */
+static uintptr_t bench_user_page(uintptr_t virt, uint64_t flags) {
+	uintptr_t page = pmm_alloc(PAGE_SIZE);
+	if (page == 0) {
+		return 0;
+	}
+	memset((void *)page, 0, PAGE_SIZE);
+
+	if (!paging_map_page(
+			virt, virt_to_phys((void *)page), PAGE_PRESENT | PAGE_USER | flags
+		)) {
+		return 0;
+	}
+	return page;
+}
+
+/*
+ * ============================================================================
+ * Futex benchmarks
+ * ============================================================================
+ */
+
+/**
+ * Page holding the futex words of the benchmarks, futexes live in user memory
+ */
+#define BENCH_USER_FUTEX 0x00007FFE00000000ULL
+
+typedef enum {
+	BENCH_FUTEX_MUTEX,
+	BENCH_FUTEX_HANDOFF,
+	BENCH_FUTEX_KBENCH_MUTEX,
+	BENCH_FUTEX_KBENCH_WORD,
+} BenchFutexSlot;
+
+/**
+ * Returns a cache line of the futex page, mapped on first use, or NULL
+ */
+static void *bench_futex_slot(BenchFutexSlot slot) {
+	static bool mapped = false;
+
+	if (!mapped) {
+		if (bench_user_page(
+				BENCH_USER_FUTEX, PAGE_WRITABLE | PAGE_NO_EXECUTE
+			) == 0) {
+			return NULL;
+		}
+		mapped = true;
+	}
+	return (void *)(BENCH_USER_FUTEX + slot * 64);
+}
+
+/**
+ * Futex-based mutex as a userspace runtime would build it. 0 is unlocked, 1
+ * locked and 2 locked with possible waiters, only the last needs the kernel.
+ */
+typedef struct {
+	_Atomic uint32_t state;
+	uint64_t slow_paths;
+} BenchFutexMutex;
+
+static void bench_futex_lock(BenchFutexMutex *mutex) {
+	uint32_t state = 0;
+	if (atomic_compare_exchange_strong(&mutex->state, &state, 1)) {
+		return;
+	}
+
+	mutex->slow_paths++;
+	if (state != 2) {
+		state = atomic_exchange(&mutex->state, 2);
+	}
+	while (state != 0) {
+		futex_wait(
+			(uint32_t *)&mutex->state, 2, FUTEX_NO_TIMEOUT, FUTEX_BITSET_ANY
+		);
+		state = atomic_exchange(&mutex->state, 2);
+	}
+}
+
+static void bench_futex_unlock(BenchFutexMutex *mutex) {
+	if (atomic_fetch_sub(&mutex->state, 1) != 1) {
+		atomic_store(&mutex->state, 0);
+		futex_wake((uint32_t *)&mutex->state, 1, FUTEX_BITSET_ANY);
+	}
+}
+
+/**
+ * Two threads passing a turn back and forth, each sleeping on the futex until
+ * the other hands it over
+ */
+typedef struct {
+	_Atomic uint32_t turn;
+	_Atomic uint32_t finished;
+	uint64_t elapsed;
+} BenchFutexHandoff;
+
+typedef struct {
+	BenchFutexHandoff *handoff;
+	uint32_t player;
+} BenchFutexPlayer;
+
+static void bench_futex_player(void *argument) {
+	BenchFutexPlayer *player = (BenchFutexPlayer *)argument;
+	BenchFutexHandoff *handoff = player->handoff;
+	uint32_t *turn = (uint32_t *)&handoff->turn;
+	uint32_t other = 1 - player->player;
+
+	uint64_t start = rdtsc();
+	for (uint32_t i = 0; i < BENCH_FUTEX_ROUNDS; i++) {
+		while (atomic_load(&handoff->turn) != player->player) {
+			futex_wait(turn, other, FUTEX_NO_TIMEOUT, FUTEX_BITSET_ANY);
+		}
+
+		atomic_store(&handoff->turn, other);
+		futex_wake(turn, 1, FUTEX_BITSET_ANY);
+	}
+
+	if (player->player == 0) {
+		handoff->elapsed = rdtsc() - start;
+	}
+	atomic_fetch_add(&handoff->finished, 1);
+}
+
+static void bench_futex_spawn(void *argument) {
+	Thread *thread = thread_create("bench_futex", bench_futex_player, argument);
+	if (thread != NULL) {
+		thread_start(thread);
+	}
+}
+
+void debug_bench_futex() {
+	static BenchFutexPlayer players[2];
+
+	BenchFutexMutex *mutex = bench_futex_slot(BENCH_FUTEX_MUTEX);
+	BenchFutexHandoff *handoff = bench_futex_slot(BENCH_FUTEX_HANDOFF);
+	if (mutex == NULL || handoff == NULL) {
+		log_message(
+			&kernel_debug_logger,
+			LOG_ERROR,
+			"bench",
+			"Could not map the futex benchmark page\n"
+		);
+		return;
+	}
+
+	*mutex = (BenchFutexMutex){0};
+
+	uint64_t start = rdtsc();
+	for (uint32_t i = 0; i < BENCH_FUTEX_ITERATIONS; i++) {
+		bench_futex_lock(mutex);
+		bench_futex_unlock(mutex);
+	}
+	uint64_t elapsed = rdtsc() - start;
+
+	log_message(
+		&kernel_debug_logger,
+		LOG_INFO,
+		"bench",
+		"Futex mutex uncontended {cycles_per_pair=%llu, slow_paths=%llu}\n",
+		elapsed / BENCH_FUTEX_ITERATIONS,
+		mutex->slow_paths
+	);
+
+	// Play across two CPUs when we have them, otherwise on this one
+	*handoff = (BenchFutexHandoff){0};
+	for (uint32_t i = 0; i < 2; i++) {
+		players[i] = (BenchFutexPlayer){.handoff = handoff, .player = i};
+	}
+
+	uint32_t remote = smp_cpu_count() > 1 ? 1 : 0;
+	if (remote != 0) {
+		smp_call(remote, bench_futex_spawn, &players[1]);
+	} else {
+		bench_futex_spawn(&players[1]);
+	}
+	bench_futex_spawn(&players[0]);
+
+	// The boot context is this CPU's idle thread, it cannot sleep
+	uint64_t timeout = ktime_ns() + NS_PER_SEC * 10;
+	while (atomic_load(&handoff->finished) < 2 && ktime_ns() < timeout) {
+		thread_yield();
+	}
+
+	bool finished = atomic_load(&handoff->finished) == 2;
+	log_message(
+		&kernel_debug_logger,
+		finished ? LOG_INFO : LOG_ERROR,
+		"bench",
+		"Futex handoff {cpus=%d, cycles_per_handoff=%llu, finished=%s}\n",
+		remote != 0 ? 2 : 1,
+		finished ? handoff->elapsed / (BENCH_FUTEX_ROUNDS * 2) : 0,
+		finished ? "yes" : "no"
+	);
+}
+
+KBENCH(futex_mutex) {
+	BenchFutexMutex *mutex = bench_futex_slot(BENCH_FUTEX_KBENCH_MUTEX);
+	if (mutex == NULL) {
+		return;
+	}
+
+	for (uint64_t i = 0; i < iterations; i++) {
+		bench_futex_lock(mutex);
+		bench_futex_unlock(mutex);
+	}
+}
+
+KBENCH(futex_wake_none) {
+	uint32_t *word = bench_futex_slot(BENCH_FUTEX_KBENCH_WORD);
+	if (word == NULL) {
+		return;
+	}
+
+	for (uint64_t i = 0; i < iterations; i++) {
+		futex_wake(word, 1, FUTEX_BITSET_ANY);
+	}
+}
+
+/*
+ * ============================================================================
+ * Interrupt entry
+ * ============================================================================
+ */
+
+/**
+ * Software interrupts raised in each interrupt entry run
+ */
+#define BENCH_IRQ_ITERATIONS 100000
+
+/**
+ * Unused vectors above the device range, so no EOI is sent for them
+ */
+#define BENCH_IRQ_VECTOR_FULL 0xF3
+#define BENCH_IRQ_VECTOR_LEAN 0xF4
+
+static bool bench_irq_handler(InterruptFrame *frame, void *context) {
+	(void)frame;
+	(void)context;
+	return true;
+}
+
+#define BENCH_IRQ_RUN(vector)                                                  \
+	({                                                                         \
+		uint64_t start = rdtsc();                                              \
+		for (uint32_t i = 0; i < BENCH_IRQ_ITERATIONS; i++) {                  \
+			asm volatile("int %0" : : "i"(vector) : "memory");                 \
+		}                                                                      \
+		(rdtsc() - start) / BENCH_IRQ_ITERATIONS;                              \
+	})
+
+void debug_bench_interrupts() {
+	static InterruptAction full_action;
+	static InterruptAction lean_action;
+
+	interrupt_action_init(
+		&full_action, "bench_full", bench_irq_handler, NULL, INTERRUPT_FRAME
+	);
+	interrupt_action_init(
+		&lean_action, "bench_lean", bench_irq_handler, NULL, 0
+	);
+
+	if (!interrupt_register(BENCH_IRQ_VECTOR_FULL, &full_action) ||
+		!interrupt_register(BENCH_IRQ_VECTOR_LEAN, &lean_action)) {
+		log_message(
+			&kernel_debug_logger,
+			LOG_ERROR,
+			"bench",
+			"Interrupt benchmark vectors are in use\n"
+		);
+		interrupt_unregister(BENCH_IRQ_VECTOR_FULL, &full_action);
+		return;
+	}
+
+	// Round trip through the stub, dispatch and exit path. The handler part
+	// alone is what interrupt_stats accounts.
+	uint64_t full = BENCH_IRQ_RUN(BENCH_IRQ_VECTOR_FULL);
+	uint64_t lean = BENCH_IRQ_RUN(BENCH_IRQ_VECTOR_LEAN);
+
+	InterruptStats full_stats = interrupt_stats(BENCH_IRQ_VECTOR_FULL);
+	InterruptStats lean_stats = interrupt_stats(BENCH_IRQ_VECTOR_LEAN);
+
+	log_message(
+		&kernel_debug_logger,
+		LOG_INFO,
+		"bench",
+		"Interrupt entry {full_cycles=%llu, lean_cycles=%llu, "
+		"full_dispatch=%llu, lean_dispatch=%llu}\n",
+		full,
+		lean,
+		full_stats.cycles / full_stats.count,
+		lean_stats.cycles / lean_stats.count
+	);
+
+	interrupt_unregister(BENCH_IRQ_VECTOR_FULL, &full_action);
+	interrupt_unregister(BENCH_IRQ_VECTOR_LEAN, &lean_action);
+
+	debug_dump_irqsoff();
+}
+
+/*
+ * ============================================================================
+ * Idle wakeup
+ * ============================================================================
+ */
+
+/**
+ * Wakeups per idle gap, and the gaps the sleeper is left idle for. The longer
+ * gaps let the governor pick deeper states.
+ */
+#define BENCH_IDLE_ROUNDS 200
+
+static const uint64_t bench_idle_gaps_ns[] = {
+	10 * NS_PER_US,
+	100 * NS_PER_US,
+	NS_PER_MS,
+};
+
+/**
+ * A thread on another CPU that sleeps until woken and measures how long the
+ * wakeup took to reach it. Relies on the TSCs of both CPUs being in sync.
+ */
+typedef struct {
+	Thread *thread;
+	_Atomic uint32_t asleep;
+	_Atomic uint32_t awake;
+	_Atomic bool stop;
+	uint64_t woken_at;
+	uint64_t latency;
+	uint64_t worst;
+} BenchIdleSleeper;
+
+static void bench_idle_sleeper(void *argument) {
+	BenchIdleSleeper *sleeper = (BenchIdleSleeper *)argument;
+	Thread *current = thread_current();
+
+	while (!atomic_load(&sleeper->stop)) {
+		uint64_t rflags = interrupts_save_disable();
+		current->state = THREAD_BLOCKED;
+		atomic_fetch_add(&sleeper->asleep, 1);
+		interrupts_restore(rflags);
+		thread_block();
+
+		uint64_t latency = rdtsc() - sleeper->woken_at;
+		sleeper->latency += latency;
+		if (latency > sleeper->worst) {
+			sleeper->worst = latency;
+		}
+		atomic_fetch_add(&sleeper->awake, 1);
+	}
+}
+
+static void bench_idle_spawn(void *argument) {
+	BenchIdleSleeper *sleeper = (BenchIdleSleeper *)argument;
+	sleeper->thread = thread_create("bench_idle", bench_idle_sleeper, sleeper);
+	if (sleeper->thread != NULL) {
+		thread_start(sleeper->thread);
+	}
+}
+
+static void bench_idle_run(
+	BenchIdleSleeper *sleeper, uint64_t gap_ns, bool mwait
+) {
+	if (!idle_use_mwait(mwait)) {
+		return;
+	}
+
+	sleeper->latency = 0;
+	sleeper->worst = 0;
+
+	uint32_t rounds = 0;
+	for (; rounds < BENCH_IDLE_ROUNDS; rounds++) {
+		uint32_t awake = atomic_load(&sleeper->awake);
+		while (atomic_load(&sleeper->asleep) <= awake) {
+			cpu_relax();
+		}
+
+		// Give the sleeper's CPU time to settle into its idle state
+		uint64_t until = ktime_ns() + gap_ns;
+		while (ktime_ns() < until) {
+			cpu_relax();
+		}
+
+		sleeper->woken_at = rdtsc();
+		thread_wake(sleeper->thread);
+
+		while (atomic_load(&sleeper->awake) == awake) {
+			cpu_relax();
+		}
+	}
+
+	log_message(
+		&kernel_debug_logger,
+		LOG_INFO,
+		"bench",
+		"Idle wakeup {idle=%s, gap_us=%llu, avg_cycles=%llu, "
+		"worst_cycles=%llu}\n",
+		mwait ? "mwait" : "hlt",
+		gap_ns / NS_PER_US,
+		sleeper->latency / rounds,
+		sleeper->worst
+	);
+}
+
+void debug_bench_idle() {
+	static BenchIdleSleeper sleeper;
+
+	if (smp_cpu_count() < 2) {
+		log_message(
+			&kernel_debug_logger,
+			LOG_WARNING,
+			"bench",
+			"Idle wakeup benchmark needs two CPUs\n"
+		);
+		return;
+	}
+
+	sleeper = (BenchIdleSleeper){0};
+	smp_call(1, bench_idle_spawn, &sleeper);
+	smp_call_wait(1);
+	if (sleeper.thread == NULL) {
+		return;
+	}
+
+	// A remote wakeup is a doorbell store with MWAIT and an IPI with HLT
+	for (size_t i = 0; i < sizeof(bench_idle_gaps_ns) / sizeof(uint64_t); i++) {
+		bench_idle_run(&sleeper, bench_idle_gaps_ns[i], true);
+		bench_idle_run(&sleeper, bench_idle_gaps_ns[i], false);
+	}
+	idle_use_mwait(true);
+
+	// Wake it one last time without waiting to let it exit
+	uint32_t awake = atomic_load(&sleeper.awake);
+	while (atomic_load(&sleeper.asleep) <= awake) {
+		cpu_relax();
+	}
+	atomic_store(&sleeper.stop, true);
+	sleeper.woken_at = rdtsc();
+	thread_wake(sleeper.thread);
+
+	// Residency is what the guest sees, host CPU time for the guest has to be
+	// read on the host
+	for (uint32_t i = 0; i < idle_state_count(); i++) {
+		IdleStats stats = idle_stats(i);
+		log_message(
+			&kernel_debug_logger,
+			LOG_INFO,
+			"bench",
+			"Idle state {name=%s, entries=%llu, residency_ms=%llu}\n",
+			idle_state(i)->name,
+			stats.entries,
+			tsc_to_ns(stats.cycles) / NS_PER_MS
+		);
+	}
+}
+
+/*
+ * ============================================================================
+ * System call round trip
+ * ============================================================================
+ */
+
+/**
+ * Null system calls in the round trip benchmark
+ */
+#define BENCH_SYSCALL_ITERATIONS 100000
+
+/**
+ * Pages of the ring 3 part, near the top of the lower half where nothing else
+ * maps anything
+ */
+#define BENCH_USER_CODE 0x00007FFF00000000ULL
+#define BENCH_USER_DATA (BENCH_USER_CODE + PAGE_SIZE)
+#define BENCH_USER_STACK (BENCH_USER_CODE + 2 * PAGE_SIZE)
+
+/**
+ * Shared with the ring 3 loops, which get its address in rdi
+ */
+typedef struct {
+	uint64_t iterations;
+	uint64_t number;
+	uint64_t exit_number;
+	uint64_t cycles;
+	volatile uint32_t done;
+	uint64_t argument;
+} BenchSyscallData;
+
+_Static_assert(
+	offsetof(BenchSyscallData, done) == 32 &&
+		offsetof(BenchSyscallData, argument) == 40,
+	"BenchSyscallData must match the ring 3 loops"
+);
+
+_Static_assert(
+	offsetof(VdsoData, tsc_base) == 16 && offsetof(VdsoData, ns_mult) == 24 &&
+		offsetof(VdsoData, ns_shift) == 32,
+	"VdsoData must match bench_vdso_user"
+);
+
+extern const uint8_t bench_syscall_user[];
+extern const uint8_t bench_syscall_user_end[];
+extern const uint8_t bench_vdso_user[];
+extern const uint8_t bench_vdso_user_end[];
+
+// Ring 3 loops, copied to BENCH_USER_CODE. Only relative jumps, so they run
+// anywhere. They time the loop with rdtsc, report through the shared data
+// and leave through the exit system call.
+asm(".pushsection .text\n"
+	".global bench_syscall_user\n"
+	".global bench_syscall_user_end\n"
+	"bench_syscall_user:\n"
+	"	mov %rdi, %rbx\n"
+	"	mov 0(%rbx), %r13\n"
+	"	rdtsc\n"
+	"	shl $32, %rdx\n"
+	"	or %rax, %rdx\n"
+	"	mov %rdx, %r12\n"
+	"1:\n"
+	"	mov 8(%rbx), %rax\n"
+	"	mov 40(%rbx), %rdi\n"
+	"	syscall\n"
+	"	dec %r13\n"
+	"	jnz 1b\n"
+	"	rdtsc\n"
+	"	shl $32, %rdx\n"
+	"	or %rax, %rdx\n"
+	"	sub %r12, %rdx\n"
+	"	mov %rdx, 24(%rbx)\n"
+	"	movl $1, 32(%rbx)\n"
+	"	mov 16(%rbx), %rax\n"
+	"	syscall\n"
+	"	ud2\n"
+	"bench_syscall_user_end:\n"
+	".popsection\n");
+
+// Same as user_clock_get: seqlock read of the data page, then the 128-bit
+// scale of the TSC delta
+asm(".pushsection .text\n"
+	".global bench_vdso_user\n"
+	".global bench_vdso_user_end\n"
+	"bench_vdso_user:\n"
+	"	mov %rdi, %rbx\n"
+	"	mov 0(%rbx), %r13\n"
+	"	movabs $0x7FFFFFFFF000, %rsi\n"
+	"	rdtsc\n"
+	"	shl $32, %rdx\n"
+	"	or %rax, %rdx\n"
+	"	mov %rdx, %r12\n"
+	"1:\n"
+	"	mov 0(%rsi), %r10d\n"
+	"	test $1, %r10d\n"
+	"	jnz 1b\n"
+	"	mov 16(%rsi), %r8\n"
+	"	mov 24(%rsi), %r9\n"
+	"	mov 32(%rsi), %ecx\n"
+	"	lfence\n"
+	"	rdtsc\n"
+	"	shl $32, %rdx\n"
+	"	or %rdx, %rax\n"
+	"	cmp 0(%rsi), %r10d\n"
+	"	jne 1b\n"
+	"	sub %r8, %rax\n"
+	"	mul %r9\n"
+	"	shrd %cl, %rdx, %rax\n"
+	"	dec %r13\n"
+	"	jnz 1b\n"
+	"	rdtsc\n"
+	"	shl $32, %rdx\n"
+	"	or %rax, %rdx\n"
+	"	sub %r12, %rdx\n"
+	"	mov %rdx, 24(%rbx)\n"
+	"	movl $1, 32(%rbx)\n"
+	"	mov 16(%rbx), %rax\n"
+	"	syscall\n"
+	"	ud2\n"
+	"bench_vdso_user_end:\n"
+	".popsection\n");
+
+_Static_assert(
+	VDSO_DATA_ADDRESS == 0x7FFFFFFFF000ULL, "Update bench_vdso_user"
+);
+
+static void bench_syscall_thread(void *argument) {
+	(void)argument;
+
+	jump_to_usermode(
+		(void *)BENCH_USER_CODE,
+		(void *)(BENCH_USER_STACK + PAGE_SIZE),
+		(void *)BENCH_USER_DATA
+	);
+}
+
+/**
+ * Runs one of the ring 3 loops BENCH_SYSCALL_ITERATIONS times on a new
+ * thread and waits for it
+ *
+ * @param loop Start of the loop's code, up to loop_end
+ * @param number System call made by bench_syscall_user
+ * @param argument Its first argument
+ * @return Cycles per iteration, or 0 if the loop did not finish
+ */
+static uint64_t bench_user_run(
+	const uint8_t *loop,
+	const uint8_t *loop_end,
+	uint64_t number,
+	uint64_t argument
+) {
+	// Mapped on the first run and kept, there is no unmapping yet
+	static uintptr_t code, data, stack;
+
+	if (code == 0) {
+		code = bench_user_page(BENCH_USER_CODE, 0);
+		data = bench_user_page(
+			BENCH_USER_DATA, PAGE_WRITABLE | PAGE_NO_EXECUTE
+		);
+		stack = bench_user_page(
+			BENCH_USER_STACK, PAGE_WRITABLE | PAGE_NO_EXECUTE
+		);
+		if (code == 0 || data == 0 || stack == 0) {
+			log_message(
+				&kernel_debug_logger,
+				LOG_ERROR,
+				"bench",
+				"Could not map the ring 3 pages of the syscall benchmark\n"
+			);
+			code = 0;
+			return 0;
+		}
+	}
+
+	memcpy((void *)code, loop, loop_end - loop);
+
+	// Read through the direct map, the kernel does not touch user addresses
+	BenchSyscallData *shared = (BenchSyscallData *)data;
+	*shared = (BenchSyscallData){
+		.iterations = BENCH_SYSCALL_ITERATIONS,
+		.number = number,
+		.exit_number = SYSCALL_EXIT,
+		.argument = argument,
+	};
+
+	Thread *thread = thread_create("bench_syscall", bench_syscall_thread, NULL);
+	if (thread == NULL) {
+		return 0;
+	}
+	thread_start(thread);
+
+	uint64_t timeout = ktime_ns() + NS_PER_SEC * 10;
+	while (!shared->done && ktime_ns() < timeout) {
+		thread_yield();
+	}
+
+	return shared->done ? shared->cycles / BENCH_SYSCALL_ITERATIONS : 0;
+}
+
+void debug_bench_syscall() {
+	uint64_t cycles = bench_user_run(
+		bench_syscall_user, bench_syscall_user_end, SYSCALL_NULL, 0
+	);
+
+	log_message(
+		&kernel_debug_logger,
+		cycles != 0 ? LOG_INFO : LOG_ERROR,
+		"bench",
+		"Null syscall round trip {cycles=%llu, finished=%s}\n",
+		cycles,
+		cycles != 0 ? "yes" : "no"
+	);
+}
+
+void debug_bench_vdso() {
+	uint64_t vdso = bench_user_run(bench_vdso_user, bench_vdso_user_end, 0, 0);
+	uint64_t syscall = bench_user_run(
+		bench_syscall_user,
+		bench_syscall_user_end,
+		SYSCALL_CLOCK_GET,
+		CLOCK_MONOTONIC
+	);
+
+	log_message(
+		&kernel_debug_logger,
+		vdso != 0 && syscall != 0 ? LOG_INFO : LOG_ERROR,
+		"bench",
+		"Monotonic clock read from ring 3 {vdso_cycles=%llu, "
+		"syscall_cycles=%llu}\n",
+		vdso,
+		syscall
+	);
+}
+
+KBENCH(ktime_ns) {
+	for (uint64_t i = 0; i < iterations; i++) {
+		KBENCH_KEEP(ktime_ns());
+	}
+}
+
+/*
+ * ============================================================================
+ * User buffer pinning
+ * ============================================================================
+ */
+
+#define BENCH_PIN_ITERATIONS 1000
+#define BENCH_PIN_PAGES 16
+#define BENCH_USER_PIN (BENCH_USER_CODE + 16 * PAGE_SIZE)
+
+static uint8_t bench_pin_buffer[BENCH_PIN_PAGES * PAGE_SIZE];
+
+/**
+ * Maps the user buffer on first use, from separately allocated pages so it is
+ * as scattered as a real one
+ */
+static bool bench_pin_map() {
+	static bool mapped = false;
+	if (mapped) {
+		return true;
+	}
+
+	for (size_t i = 0; i < BENCH_PIN_PAGES; i++) {
+		if (bench_user_page(
+				BENCH_USER_PIN + i * PAGE_SIZE, PAGE_WRITABLE | PAGE_NO_EXECUTE
+			) == 0) {
+			log_message(
+				&kernel_debug_logger,
+				LOG_ERROR,
+				"bench",
+				"Could not map the pinning benchmark buffer\n"
+			);
+			return false;
+		}
+	}
+	mapped = true;
+	return true;
+}
+
+void debug_bench_pin() {
+	if (!bench_pin_map()) {
+		return;
+	}
+
+	size_t crossover = 0;
+	for (size_t size = 64; size <= sizeof(bench_pin_buffer); size *= 2) {
+		uint64_t start = rdtsc();
+		for (size_t i = 0; i < BENCH_PIN_ITERATIONS; i++) {
+			user_copy_from(bench_pin_buffer, BENCH_USER_PIN, size);
+		}
+		uint64_t copy = (rdtsc() - start) / BENCH_PIN_ITERATIONS;
+
+		start = rdtsc();
+		for (size_t i = 0; i < BENCH_PIN_ITERATIONS; i++) {
+			PinList list;
+			if (pin_user_pages(BENCH_USER_PIN, size, PIN_WRITE, &list) > 0) {
+				pin_release(&list);
+			}
+		}
+		uint64_t pin = (rdtsc() - start) / BENCH_PIN_ITERATIONS;
+
+		if (crossover == 0 && pin < copy) {
+			crossover = size;
+		}
+		log_message(
+			&kernel_debug_logger,
+			LOG_INFO,
+			"bench",
+			"User buffer {bytes=%llu, copy_cycles=%llu, pin_cycles=%llu}\n",
+			(uint64_t)size,
+			copy,
+			pin
+		);
+	}
+
+	log_message(
+		&kernel_debug_logger,
+		LOG_INFO,
+		"bench",
+		"Pinning overtakes copying {bytes=%llu, threshold=%llu}\n",
+		(uint64_t)crossover,
+		(uint64_t)PIN_COPY_THRESHOLD
+	);
+}
+
+KBENCH(user_copy_4k) {
+	if (!bench_pin_map()) {
+		return;
+	}
+	for (uint64_t i = 0; i < iterations; i++) {
+		user_copy_from(bench_pin_buffer, BENCH_USER_PIN, PAGE_SIZE);
+	}
+}
+
+KBENCH(pin_4k) {
+	if (!bench_pin_map()) {
+		return;
+	}
+	for (uint64_t i = 0; i < iterations; i++) {
+		PinList list;
+		if (pin_user_pages(BENCH_USER_PIN, PAGE_SIZE, PIN_WRITE, &list) > 0) {
+			pin_release(&list);
+		}
+	}
+}
+
+/*
+ * ============================================================================
+ * Asynchronous IPC
+ * ============================================================================
+ */
+
+#define BENCH_AIPC_ROUNDS 10000
+#define BENCH_AIPC_MESSAGES 200000
+#define BENCH_AIPC_ENTRIES 256
+#define BENCH_AIPC_TRANSFERS 1000
+
+/**
+ * The channel, then two page ranges the transfer benchmark moves pages
+ * between
+ */
+#define BENCH_USER_AIPC (BENCH_USER_CODE + 64 * PAGE_SIZE)
+#define BENCH_USER_AIPC_PAGES (BENCH_USER_AIPC + 64 * PAGE_SIZE)
+#define BENCH_USER_AIPC_TARGET (BENCH_USER_AIPC_PAGES + 64 * PAGE_SIZE)
+
+/**
+ * One endpoint driven from a kernel thread, through the direct map. Same
+ * protocol as the user_aipc helpers, minus the system call per doorbell and
+ * per wait that debug_bench_syscall measures.
+ */
+typedef struct {
+	AipcQueue *send_queue;
+	AipcQueue *receive_queue;
+	AipcMessage *send;
+	AipcMessage *receive;
+	uint32_t mask;
+	uint32_t send_tail;
+	uint32_t channel;
+	uint32_t endpoint;
+	uint64_t doorbells;
+	uint64_t waits;
+} BenchAipcEndpoint;
+
+typedef enum {
+	BENCH_AIPC_PING_PONG,
+	BENCH_AIPC_BULK,
+} BenchAipcMode;
+
+typedef struct {
+	BenchAipcMode mode;
+	BenchAipcEndpoint endpoints[2];
+	_Atomic uint32_t ready;
+	_Atomic uint32_t finished;
+	uint64_t elapsed;
+} BenchAipc;
+
+typedef struct {
+	BenchAipc *bench;
+	uint32_t endpoint;
+} BenchAipcPlayer;
+
+static void bench_aipc_attach(
+	BenchAipcEndpoint *endpoint, uint32_t channel, uint32_t number
+) {
+	AipcHeader *header = aipc_header(channel);
+	AipcQueue *send = &header->queues[number];
+	AipcQueue *receive = &header->queues[1 - number];
+
+	*endpoint = (BenchAipcEndpoint){
+		.send_queue = send,
+		.receive_queue = receive,
+		.send = (AipcMessage *)((uintptr_t)header + send->offset),
+		.receive = (AipcMessage *)((uintptr_t)header + receive->offset),
+		.mask = send->entries - 1,
+		.send_tail = send->index.tail,
+		.channel = channel,
+		.endpoint = number,
+	};
+}
+
+static AipcMessage *bench_aipc_get(BenchAipcEndpoint *endpoint) {
+	uint32_t head =
+		__atomic_load_n(&endpoint->send_queue->index.head, __ATOMIC_ACQUIRE);
+	if (endpoint->send_tail - head > endpoint->mask) {
+		return NULL;
+	}
+	return &endpoint->send[endpoint->send_tail++ & endpoint->mask];
+}
+
+static void bench_aipc_send(BenchAipcEndpoint *endpoint) {
+	__atomic_store_n(
+		&endpoint->send_queue->index.tail,
+		endpoint->send_tail,
+		__ATOMIC_SEQ_CST
+	);
+	if (__atomic_load_n(&endpoint->send_queue->flags, __ATOMIC_SEQ_CST) &
+		AIPC_WAITING) {
+		aipc_notify(endpoint->channel, endpoint->endpoint);
+		endpoint->doorbells++;
+	}
+}
+
+/**
+ * Waits for messages and returns how many are ready
+ */
+static uint32_t bench_aipc_receive(BenchAipcEndpoint *endpoint) {
+	AipcQueue *queue = endpoint->receive_queue;
+	for (;;) {
+		uint32_t ready = __atomic_load_n(&queue->index.tail, __ATOMIC_ACQUIRE) -
+						 queue->index.head;
+		if (ready != 0) {
+			return ready;
+		}
+		endpoint->waits++;
+		aipc_wait(endpoint->channel, endpoint->endpoint);
+	}
+}
+
+static void bench_aipc_advance(BenchAipcEndpoint *endpoint, uint32_t count) {
+	AipcQueue *queue = endpoint->receive_queue;
+	__atomic_store_n(
+		&queue->index.head, queue->index.head + count, __ATOMIC_RELEASE
+	);
+}
+
+/**
+ * Endpoint 0: sends messages, in bulk mode whatever fits as one batch, in
+ * ping-pong mode one at a time waiting for each answer
+ */
+static void bench_aipc_produce(
+	BenchAipc *bench, BenchAipcEndpoint *endpoint, uint64_t messages
+) {
+	uint64_t sent = 0;
+	while (sent < messages) {
+		uint32_t batch = 0;
+		AipcMessage *message;
+		while (sent + batch < messages &&
+			   (bench->mode == BENCH_AIPC_BULK || batch == 0) &&
+			   (message = bench_aipc_get(endpoint)) != NULL) {
+			message->tag = sent + batch;
+			message->length = 0;
+			message->page_count = 0;
+			batch++;
+		}
+
+		// Full, the receiver is busy draining
+		if (batch == 0) {
+			thread_yield();
+			continue;
+		}
+		bench_aipc_send(endpoint);
+		sent += batch;
+
+		if (bench->mode == BENCH_AIPC_PING_PONG) {
+			bench_aipc_receive(endpoint);
+			bench_aipc_advance(endpoint, 1);
+		}
+	}
+}
+
+/**
+ * Endpoint 1: consumes messages in whatever batches they arrive, in
+ * ping-pong mode answering each with its tag
+ */
+static void bench_aipc_consume(
+	BenchAipc *bench, BenchAipcEndpoint *endpoint, uint64_t messages
+) {
+	uint64_t received = 0;
+	while (received < messages) {
+		uint32_t ready = bench_aipc_receive(endpoint);
+		if (bench->mode == BENCH_AIPC_BULK) {
+			bench_aipc_advance(endpoint, ready);
+			received += ready;
+			continue;
+		}
+
+		uint32_t head = endpoint->receive_queue->index.head;
+		AipcMessage *request = &endpoint->receive[head & endpoint->mask];
+		AipcMessage *reply;
+		while ((reply = bench_aipc_get(endpoint)) == NULL) {
+			thread_yield();
+		}
+		reply->tag = request->tag;
+		bench_aipc_advance(endpoint, 1);
+		bench_aipc_send(endpoint);
+		received++;
+	}
+}
+
+static void bench_aipc_player(void *argument) {
+	BenchAipcPlayer *player = (BenchAipcPlayer *)argument;
+	BenchAipc *bench = player->bench;
+	BenchAipcEndpoint *endpoint = &bench->endpoints[player->endpoint];
+	uint64_t messages = bench->mode == BENCH_AIPC_PING_PONG
+							? BENCH_AIPC_ROUNDS
+							: BENCH_AIPC_MESSAGES;
+
+	atomic_fetch_add(&bench->ready, 1);
+	while (atomic_load(&bench->ready) < 2) {
+		cpu_relax();
+	}
+
+	// Timed on the receiving side, until the last message is consumed
+	uint64_t start = rdtsc();
+	if (player->endpoint == 0) {
+		bench_aipc_produce(bench, endpoint, messages);
+	} else {
+		bench_aipc_consume(bench, endpoint, messages);
+		bench->elapsed = rdtsc() - start;
+	}
+	atomic_fetch_add(&bench->finished, 1);
+}
+
+static void bench_aipc_spawn(void *argument) {
+	Thread *thread = thread_create("bench_aipc", bench_aipc_player, argument);
+	if (thread != NULL) {
+		thread_start(thread);
+	}
+}
+
+/**
+ * Runs both endpoints of channel, endpoint 1 on CPU 1 if remote is set
+ *
+ * @return Cycles the receiving endpoint took, or 0 if it did not finish
+ */
+static uint64_t bench_aipc_run(
+	BenchAipc *bench, uint32_t channel, BenchAipcMode mode, bool remote
+) {
+	static BenchAipcPlayer players[2];
+
+	bench->mode = mode;
+	atomic_store(&bench->ready, 0);
+	atomic_store(&bench->finished, 0);
+	bench->elapsed = 0;
+	for (uint32_t i = 0; i < 2; i++) {
+		bench_aipc_attach(&bench->endpoints[i], channel, i);
+		players[i] = (BenchAipcPlayer){.bench = bench, .endpoint = i};
+	}
+
+	if (remote) {
+		smp_call(1, bench_aipc_spawn, &players[1]);
+	} else {
+		bench_aipc_spawn(&players[1]);
+	}
+	bench_aipc_spawn(&players[0]);
+
+	uint64_t timeout = ktime_ns() + NS_PER_SEC * 10;
+	while (atomic_load(&bench->finished) < 2 && ktime_ns() < timeout) {
+		thread_yield();
+	}
+	return atomic_load(&bench->finished) == 2 ? bench->elapsed : 0;
+}
+
+/**
+ * Cycles to move BENCH_PIN_PAGES pages from one address to another with
+ * aipc_give and aipc_take, and to copy as much through the direct map
+ */
+static void bench_aipc_transfer(uint32_t channel) {
+	static uint8_t copy_buffer[BENCH_PIN_PAGES * PAGE_SIZE];
+	static bool mapped = false;
+
+	// Every round trip of the pages ends where they started
+	if (!mapped) {
+		for (size_t i = 0; i < BENCH_PIN_PAGES; i++) {
+			if (bench_user_page(
+					BENCH_USER_AIPC_PAGES + i * PAGE_SIZE,
+					PAGE_WRITABLE | PAGE_NO_EXECUTE
+				) == 0) {
+				return;
+			}
+		}
+		mapped = true;
+	}
+
+	uintptr_t from = BENCH_USER_AIPC_PAGES, to = BENCH_USER_AIPC_TARGET;
+	uint64_t start = rdtsc();
+	for (uint32_t i = 0; i < BENCH_AIPC_TRANSFERS * 2; i++) {
+		int64_t transfer = aipc_give(channel, from, BENCH_PIN_PAGES);
+		if (transfer < 0 || aipc_take(channel, transfer, to) < 0) {
+			log_message(
+				&kernel_debug_logger,
+				LOG_ERROR,
+				"bench",
+				"AIPC page transfer failed {round=%d}\n",
+				i
+			);
+			return;
+		}
+		uintptr_t swap = from;
+		from = to;
+		to = swap;
+	}
+	uint64_t transfer = (rdtsc() - start) / (BENCH_AIPC_TRANSFERS * 2);
+
+	// The copy a transfer saves, page by page through the direct map
+	void *pages[BENCH_PIN_PAGES];
+	for (size_t i = 0; i < BENCH_PIN_PAGES; i++) {
+		uintptr_t phys = 0;
+		paging_translate(BENCH_USER_AIPC_PAGES + i * PAGE_SIZE, &phys);
+		pages[i] = phys_to_virt(phys, paging_hhdm_offset());
+	}
+	start = rdtsc();
+	for (uint32_t i = 0; i < BENCH_AIPC_TRANSFERS; i++) {
+		for (size_t page = 0; page < BENCH_PIN_PAGES; page++) {
+			memcpy(copy_buffer + page * PAGE_SIZE, pages[page], PAGE_SIZE);
+		}
+	}
+	uint64_t copy = (rdtsc() - start) / BENCH_AIPC_TRANSFERS;
+
+	log_message(
+		&kernel_debug_logger,
+		LOG_INFO,
+		"bench",
+		"AIPC page transfer {bytes=%llu, transfer_cycles=%llu, "
+		"copy_cycles=%llu}\n",
+		(uint64_t)sizeof(copy_buffer),
+		transfer,
+		copy
+	);
+}
+
+/**
+ * Returns the channel the benchmarks share, created on first use, or -1
+ */
+static int64_t bench_aipc_channel() {
+	static int64_t channel = -1;
+
+	if (channel < 0) {
+		channel = aipc_create((void *)BENCH_USER_AIPC, BENCH_AIPC_ENTRIES);
+		if (channel < 0) {
+			log_message(
+				&kernel_debug_logger,
+				LOG_ERROR,
+				"bench",
+				"Could not create the AIPC benchmark channel\n"
+			);
+		}
+	}
+	return channel;
+}
+
+void debug_bench_aipc() {
+	static BenchAipc bench;
+
+	int64_t channel = bench_aipc_channel();
+	if (channel < 0) {
+		return;
+	}
+	bool remote = smp_cpu_count() > 1;
+
+	uint64_t elapsed =
+		bench_aipc_run(&bench, channel, BENCH_AIPC_PING_PONG, remote);
+	log_message(
+		&kernel_debug_logger,
+		elapsed != 0 ? LOG_INFO : LOG_ERROR,
+		"bench",
+		"AIPC ping-pong {cpus=%d, cycles_per_round_trip=%llu, "
+		"doorbells=%llu}\n",
+		remote ? 2 : 1,
+		elapsed / BENCH_AIPC_ROUNDS,
+		bench.endpoints[0].doorbells + bench.endpoints[1].doorbells
+	);
+
+	elapsed = bench_aipc_run(&bench, channel, BENCH_AIPC_BULK, remote);
+	log_message(
+		&kernel_debug_logger,
+		elapsed != 0 ? LOG_INFO : LOG_ERROR,
+		"bench",
+		"AIPC bulk {messages=%d, cycles_per_message=%llu, "
+		"messages_per_sec=%llu, doorbells=%llu, waits=%llu}\n",
+		BENCH_AIPC_MESSAGES,
+		elapsed / BENCH_AIPC_MESSAGES,
+		elapsed != 0 ? BENCH_AIPC_MESSAGES * NS_PER_SEC / tsc_to_ns(elapsed)
+					 : 0,
+		bench.endpoints[0].doorbells,
+		bench.endpoints[1].waits
+	);
+
+	bench_aipc_transfer(channel);
+}
+
+/*
+ * ============================================================================
+ * Synchronous IPC
+ * ============================================================================
+ */
+
+#define BENCH_IPC_ROUNDS 10000
+
+/**
+ * Channel the aipc_round_trip benchmark has to itself, after the transfer
+ * pages
+ */
+#define BENCH_USER_IPC_AIPC (BENCH_USER_AIPC_TARGET + 64 * PAGE_SIZE)
+
+typedef struct {
+	uint32_t endpoint;
+	_Atomic uint32_t finished;
+	uint64_t elapsed;
+} BenchIpc;
+
+/**
+ * Echo server: answers every call with its first word plus one
+ */
+static void bench_ipc_server(void *argument) {
+	uint32_t endpoint = (uint32_t)(uintptr_t)argument;
+	IpcMessage message = {0};
+
+	// The first round has nobody to reply to
+	while (ipc_reply_wait(endpoint, &message) == 0) {
+		message.words[0]++;
+	}
+}
+
+static void bench_ipc_spawn(void *argument) {
+	Thread *thread = thread_create("bench_ipc", bench_ipc_server, argument);
+	if (thread != NULL) {
+		thread_start(thread);
+	}
+}
+
+static void bench_ipc_client(void *argument) {
+	BenchIpc *bench = (BenchIpc *)argument;
+	IpcMessage message = {0};
+
+	uint64_t start = rdtsc();
+	for (uint32_t i = 0; i < BENCH_IPC_ROUNDS; i++) {
+		message.words[0] = i;
+		if (ipc_call(bench->endpoint, &message) != 0 ||
+			message.words[0] != i + 1) {
+			atomic_store(&bench->finished, 1);
+			return;
+		}
+	}
+	bench->elapsed = rdtsc() - start;
+	atomic_store(&bench->finished, 1);
+}
+
+/**
+ * Calls the server of endpoint BENCH_IPC_ROUNDS times from a new thread on
+ * this CPU
+ *
+ * @return Cycles the calls took, or 0 if they did not all succeed
+ */
+static uint64_t bench_ipc_run(BenchIpc *bench, uint32_t endpoint) {
+	*bench = (BenchIpc){.endpoint = endpoint};
+
+	Thread *thread = thread_create("bench_ipc", bench_ipc_client, bench);
+	if (thread == NULL) {
+		return 0;
+	}
+	thread_start(thread);
+
+	// The boot context is this CPU's idle thread, it cannot sleep
+	uint64_t timeout = ktime_ns() + NS_PER_SEC * 10;
+	while (atomic_load(&bench->finished) == 0 && ktime_ns() < timeout) {
+		thread_yield();
+	}
+	return atomic_load(&bench->finished) != 0 ? bench->elapsed : 0;
+}
+
+void debug_bench_ipc() {
+	static BenchIpc bench;
+	static BenchAipc aipc;
+	static int64_t endpoints[2] = {-1, -1};
+
+	int64_t channel = bench_aipc_channel();
+	uint32_t placements = smp_cpu_count() > 1 ? 2 : 1;
+
+	// With the server on this CPU calls hand the CPU over directly, on
+	// another they wake the peer like the ring-based path does
+	for (uint32_t remote = 0; remote < placements; remote++) {
+		if (endpoints[remote] < 0) {
+			endpoints[remote] = ipc_create();
+			if (endpoints[remote] < 0) {
+				log_message(
+					&kernel_debug_logger,
+					LOG_ERROR,
+					"bench",
+					"Could not create the IPC benchmark endpoint\n"
+				);
+				return;
+			}
+
+			void *argument = (void *)(uintptr_t)endpoints[remote];
+			if (remote != 0) {
+				smp_call(1, bench_ipc_spawn, argument);
+			} else {
+				bench_ipc_spawn(argument);
+			}
+		}
+
+		uint64_t call = bench_ipc_run(&bench, endpoints[remote]);
+		uint64_t ring = 0;
+		if (channel >= 0) {
+			ring = bench_aipc_run(
+				&aipc, channel, BENCH_AIPC_PING_PONG, remote != 0
+			);
+		}
+
+		log_message(
+			&kernel_debug_logger,
+			call != 0 ? LOG_INFO : LOG_ERROR,
+			"bench",
+			"IPC call round trip {cpus=%d, call_cycles=%llu, "
+			"aipc_cycles=%llu}\n",
+			remote != 0 ? 2 : 1,
+			call / BENCH_IPC_ROUNDS,
+			ring / BENCH_AIPC_ROUNDS
+		);
+	}
+}
+
+KBENCH(ipc_call) {
+	static int64_t endpoint = -1;
+
+	// The server runs on this CPU, every call is a direct handoff
+	if (endpoint < 0) {
+		endpoint = ipc_create();
+		if (endpoint < 0) {
+			return;
+		}
+		bench_ipc_spawn((void *)(uintptr_t)endpoint);
+	}
+
+	IpcMessage message = {0};
+	for (uint64_t i = 0; i < iterations; i++) {
+		ipc_call(endpoint, &message);
+	}
+}
+
+/**
+ * Endpoint 1 of the aipc_round_trip channel, answering forever
+ */
+static void bench_ipc_aipc_echo(void *argument) {
+	static BenchAipc echo = {.mode = BENCH_AIPC_PING_PONG};
+
+	bench_aipc_attach(&echo.endpoints[1], (uint32_t)(uintptr_t)argument, 1);
+	bench_aipc_consume(&echo, &echo.endpoints[1], UINT64_MAX);
+}
+
+/**
+ * The same round trip as ipc_call through a ring, on the same CPU
+ */
+KBENCH(aipc_round_trip) {
+	static BenchAipc bench = {.mode = BENCH_AIPC_PING_PONG};
+	static int64_t channel = -1;
+	static bool started = false;
+
+	if (!started) {
+		if (channel < 0) {
+			channel =
+				aipc_create((void *)BENCH_USER_IPC_AIPC, BENCH_AIPC_ENTRIES);
+		}
+		if (channel < 0) {
+			return;
+		}
+		bench_aipc_attach(&bench.endpoints[0], channel, 0);
+
+		Thread *thread = thread_create(
+			"bench_aipc", bench_ipc_aipc_echo, (void *)(uintptr_t)channel
+		);
+		if (thread == NULL) {
+			return;
+		}
+		thread_start(thread);
+		started = true;
+	}
+
+	bench_aipc_produce(&bench, &bench.endpoints[0], iterations);
+}
+
+/*
+ * ============================================================================
+ * Handles
+ * ============================================================================
+ */
+
+/**
+ * What every system call on a channel or endpoint pays to find its object:
+ * a lock-free lookup and a per-CPU reference taken and dropped
+ */
+KBENCH(handle_get) {
+	static int64_t handle = -1;
+
+	if (handle < 0) {
+		handle = ipc_create();
+		if (handle < 0) {
+			return;
+		}
+	}
+
+	HandleTable *table = handle_table_current();
+	for (uint64_t i = 0; i < iterations; i++) {
+		KObject *object = handle_get(table, handle, KOBJECT_IPC_ENDPOINT);
+		KBENCH_KEEP(object);
+		kobject_put(object);
+	}
+}
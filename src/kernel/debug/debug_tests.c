@@ -2,6 +2,7 @@
 
 #include <kernel/debug.h>
 #include <kernel/pmm.h>
+#include <kernel/rcu.h>
 #include <kernel/syscalls.h>
 
 void debug_test_syscalls() {
@@ -130,3 +131,40 @@ void debug_test_buddy_allocator() {
 	// Print the final state of the allocator
 	pmm_debug_print_state();
 }
+
+/**
+ * Object published through RCU in debug_test_rcu
+ */
+typedef struct {
+	uint64_t block_header[2]; // Left alone for pmm_free
+	uint64_t value;
+	RcuHead rcu;
+} RcuTestObject;
+
+static RcuTestObject *rcu_test_object;
+
+void debug_test_rcu() {
+	printf_("Running RCU test\n");
+
+	for (uint64_t i = 1; i <= 3; i++) {
+		RcuTestObject *object = (RcuTestObject *)pmm_alloc(4096);
+		object->value = i;
+
+		RcuTestObject *old = rcu_test_object;
+		rcu_assign_pointer(rcu_test_object, object);
+		if (old != NULL) {
+			rcu_free_pages(&old->rcu);
+		}
+
+		rcu_read_lock();
+		RcuTestObject *current = rcu_dereference(rcu_test_object);
+		printf_("  Published value %llu, read %llu\n", i, current->value);
+		rcu_read_unlock();
+	}
+
+	// Readers are done with everything but the last object
+	synchronize_rcu();
+	printf_("  Grace period completed\n");
+
+	printf_("Done running RCU test\n");
+}
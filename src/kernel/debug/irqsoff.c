@@ -0,0 +1,118 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <jems/jems.h>
+#include <libk/irqsoff.h>
+#include <logger.h>
+#include <printf/printf.h>
+
+#include <kernel/debug.h>
+#include <kernel/time.h>
+
+#define JEMS_MAX_LEVEL 5
+
+/**
+ * Number of call sites reported, the ones with the longest sections
+ */
+#define IRQSOFF_TOP_SITES 10
+
+static void jems_writer(char ch, uintptr_t arg) {
+	logger_t *logger = (logger_t *)arg;
+	char str[2] = {ch, '\0'};
+	log_stream_data(logger, str, 1);
+}
+
+static void irqsoff_dump_site(jems_t *jems, IrqsOffSite *site) {
+	jems_object_open(jems);
+	jems_key_string(jems, "function", site->function);
+	jems_key_string(jems, "file", site->file);
+	jems_key_integer(jems, "line", site->line);
+	jems_key_integer(jems, "count", site->count);
+	jems_key_integer(jems, "max_cycles", site->max_cycles);
+	jems_key_integer(jems, "max_ns", tsc_to_ns(site->max_cycles));
+	jems_key_integer(
+		jems, "avg_ns", tsc_to_ns(site->total_cycles / site->count)
+	);
+
+	jems_key_integer(jems, "histogram_shift", IRQSOFF_HISTOGRAM_SHIFT);
+	jems_key_array_open(jems, "histogram");
+	for (size_t i = 0; i < IRQSOFF_HISTOGRAM_BUCKETS; i++) {
+		jems_integer(jems, site->histogram[i]);
+	}
+	jems_array_close(jems);
+
+	// Resolve with addr2line against kernel.sym
+	jems_key_array_open(jems, "backtrace");
+	for (size_t i = 0; i < IRQSOFF_TRACE_DEPTH && site->max_trace[i] != 0;
+		 i++) {
+		char address[19];
+		snprintf_(address, sizeof(address), "0x%lx", site->max_trace[i]);
+		jems_string(jems, address);
+	}
+	jems_array_close(jems);
+
+	jems_object_close(jems);
+}
+
+void debug_dump_irqsoff() {
+	static jems_level_t jems_levels[JEMS_MAX_LEVEL];
+	static jems_t jems;
+
+	if (!LIBK_IRQSOFF_TRACE) {
+		log_message(
+			&kernel_debug_logger,
+			LOG_WARNING,
+			"irqsoff",
+			"The irqs-off tracer is not compiled in (irqsoff_trace)\n"
+		);
+		return;
+	}
+
+	// Racy snapshot, sites in use may be torn. Select the worst sites by
+	// their longest section, the list is short enough to scan repeatedly.
+	IrqsOffSite *top[IRQSOFF_TOP_SITES];
+	size_t count = 0;
+	for (; count < IRQSOFF_TOP_SITES; count++) {
+		IrqsOffSite *worst = NULL;
+		for (IrqsOffSite *site = irqsoff_site_list(); site != NULL;
+			 site = site->next) {
+			bool taken = false;
+			for (size_t i = 0; i < count; i++) {
+				taken |= top[i] == site;
+			}
+			if (!taken &&
+				(worst == NULL || site->max_cycles > worst->max_cycles)) {
+				worst = site;
+			}
+		}
+
+		if (worst == NULL) {
+			break;
+		}
+		top[count] = worst;
+	}
+
+	log_stream_start(
+		&kernel_debug_logger, LOG_DEBUG, "irqsoff", "Irqs-off sections"
+	);
+
+	jems_init(
+		&jems,
+		jems_levels,
+		JEMS_MAX_LEVEL,
+		jems_writer,
+		(uintptr_t)&kernel_debug_logger
+	);
+	jems_object_open(&jems);
+	jems_key_array_open(&jems, "sites");
+
+	for (size_t i = 0; i < count; i++) {
+		irqsoff_dump_site(&jems, top[i]);
+	}
+
+	jems_array_close(&jems);
+	jems_object_close(&jems);
+
+	log_stream_end(&kernel_debug_logger);
+}
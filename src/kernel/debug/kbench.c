@@ -0,0 +1,279 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <jems/jems.h>
+#include <libk/string.h>
+#include <logger.h>
+
+#include <hal/cpu.h>
+#include <hal/serial.h>
+
+#include <kernel/debug.h>
+#include <kernel/kbench.h>
+#include <kernel/thread.h>
+#include <kernel/time.h>
+
+#define JEMS_MAX_LEVEL 4
+
+/**
+ * Length one timed run of a benchmark is scaled up to, long enough that the
+ * timer reads and the loop around the body disappear in it
+ */
+#define KBENCH_TARGET_NS 10000000ULL
+
+/**
+ * Cap on the iteration count, for bodies too cheap to reach the target
+ */
+#define KBENCH_MAX_ITERATIONS (1ULL << 32)
+
+/**
+ * Timed runs per benchmark once the iteration count is settled
+ */
+#define KBENCH_SAMPLES 7
+
+#define KBENCH_FILTER_SIZE 128
+
+/**
+ * Port of QEMU's isa-debug-exit device as the kbench xmake task sets it up.
+ * Writing v makes QEMU exit with status v * 2 + 1.
+ */
+#define KBENCH_EXIT_PORT 0xF4
+
+/**
+ * Bounds of the .kbench section, from meta/linker.ld
+ */
+extern KBench __kbench_start[];
+extern KBench __kbench_end[];
+
+static char kbench_filter[KBENCH_FILTER_SIZE];
+static bool kbench_exit;
+
+/**
+ * Baseline: what the runner measures for a body that does nothing
+ */
+KBENCH(empty) {
+	for (uint64_t i = 0; i < iterations; i++) {
+		KBENCH_KEEP(i);
+	}
+}
+
+static void jems_writer(char ch, uintptr_t arg) {
+	logger_t *logger = (logger_t *)arg;
+	char str[2] = {ch, '\0'};
+	log_stream_data(logger, str, 1);
+}
+
+static bool kbench_matches(const char *filter, const char *name) {
+	if (filter == NULL) {
+		return true;
+	}
+	if (strlen(filter) == 3 && memcmp(filter, "all", 3) == 0) {
+		return true;
+	}
+
+	size_t name_length = strlen(name);
+	while (*filter != '\0') {
+		size_t length = 0;
+		while (filter[length] != '\0' && filter[length] != ',') {
+			length++;
+		}
+
+		if (length != 0 && filter[length - 1] == '*') {
+			if (name_length >= length - 1 &&
+				memcmp(name, filter, length - 1) == 0) {
+				return true;
+			}
+		} else if (length == name_length && memcmp(name, filter, length) == 0) {
+			return true;
+		}
+
+		filter += length;
+		if (*filter == ',') {
+			filter++;
+		}
+	}
+	return false;
+}
+
+static uint64_t kbench_time(KBench *bench, uint64_t iterations) {
+	uint64_t start = rdtsc_serialized();
+	bench->function(iterations);
+	return rdtsc_serialized() - start;
+}
+
+static void kbench_report(
+	KBench *bench, uint64_t iterations, uint64_t *samples
+) {
+	static jems_level_t jems_levels[JEMS_MAX_LEVEL];
+	static jems_t jems;
+
+	uint64_t median = samples[KBENCH_SAMPLES / 2];
+	log_stream_start(
+		&kernel_debug_logger, LOG_INFO, "kbench", "Benchmark result"
+	);
+
+	jems_init(
+		&jems,
+		jems_levels,
+		JEMS_MAX_LEVEL,
+		jems_writer,
+		(uintptr_t)&kernel_debug_logger
+	);
+	jems_object_open(&jems);
+	jems_key_string(&jems, "name", bench->name);
+	jems_key_integer(&jems, "tsc_hz", time_tsc_hz());
+	jems_key_integer(&jems, "iterations", iterations);
+
+	// Per iteration, also in picoseconds so cheap bodies keep some precision
+	jems_key_integer(&jems, "min_cycles", samples[0] / iterations);
+	jems_key_integer(&jems, "median_cycles", median / iterations);
+	jems_key_integer(
+		&jems, "max_cycles", samples[KBENCH_SAMPLES - 1] / iterations
+	);
+	jems_key_integer(
+		&jems, "min_ps", tsc_to_ns(samples[0]) * 1000 / iterations
+	);
+	jems_key_integer(&jems, "median_ps", tsc_to_ns(median) * 1000 / iterations);
+
+	// Cycles of each whole run, sorted
+	jems_key_array_open(&jems, "samples");
+	for (size_t i = 0; i < KBENCH_SAMPLES; i++) {
+		jems_integer(&jems, samples[i]);
+	}
+	jems_array_close(&jems);
+
+	jems_object_close(&jems);
+	log_stream_end(&kernel_debug_logger);
+}
+
+static void kbench_run_one(KBench *bench) {
+	uint64_t target = ns_to_tsc(KBENCH_TARGET_NS);
+
+	// The first run pays for cold caches and TLBs, the scaling runs warm up
+	// the rest
+	kbench_time(bench, 1);
+	uint64_t iterations = 1;
+	while (iterations < KBENCH_MAX_ITERATIONS &&
+		   kbench_time(bench, iterations) < target) {
+		iterations *= 2;
+	}
+
+	uint64_t samples[KBENCH_SAMPLES];
+	for (size_t i = 0; i < KBENCH_SAMPLES; i++) {
+		uint64_t cycles = kbench_time(bench, iterations);
+
+		size_t slot = i;
+		for (; slot > 0 && samples[slot - 1] > cycles; slot--) {
+			samples[slot] = samples[slot - 1];
+		}
+		samples[slot] = cycles;
+	}
+
+	kbench_report(bench, iterations, samples);
+}
+
+size_t kbench_run(const char *filter) {
+	size_t count = 0;
+	for (KBench *bench = __kbench_start; bench < __kbench_end; bench++) {
+		if (kbench_matches(filter, bench->name)) {
+			kbench_run_one(bench);
+			count++;
+		}
+	}
+	return count;
+}
+
+static void kbench_thread(void *argument) {
+	(void)argument;
+
+	log_message(
+		&kernel_debug_logger,
+		LOG_INFO,
+		"kbench",
+		"Running benchmarks {filter=%s}\n",
+		kbench_filter
+	);
+	size_t count = kbench_run(kbench_filter);
+	log_message(
+		&kernel_debug_logger,
+		LOG_INFO,
+		"kbench",
+		"Benchmarks complete {count=%llu}\n",
+		(uint64_t)count
+	);
+
+	if (kbench_exit) {
+		write_byte(KBENCH_EXIT_PORT, 0);
+	}
+}
+
+/**
+ * Finds option in a space separated command line
+ *
+ * @return The text after "option=" up to the next space, or after "option"
+ *         if it stands alone, else NULL
+ */
+static const char *kbench_option(
+	const char *cmdline, const char *option, size_t *length
+) {
+	size_t option_length = strlen(option);
+	while (*cmdline != '\0') {
+		while (*cmdline == ' ') {
+			cmdline++;
+		}
+
+		size_t word = 0;
+		while (cmdline[word] != '\0' && cmdline[word] != ' ') {
+			word++;
+		}
+
+		if (word >= option_length &&
+			memcmp(cmdline, option, option_length) == 0) {
+			if (word == option_length) {
+				*length = 0;
+				return cmdline + word;
+			}
+			if (cmdline[option_length] == '=') {
+				*length = word - option_length - 1;
+				return cmdline + option_length + 1;
+			}
+		}
+		cmdline += word;
+	}
+	return NULL;
+}
+
+void kbench_initialize(const char *cmdline) {
+	if (cmdline == NULL) {
+		return;
+	}
+
+	size_t length;
+	const char *filter = kbench_option(cmdline, "kbench", &length);
+	if (filter == NULL) {
+		return;
+	}
+	if (length >= KBENCH_FILTER_SIZE) {
+		length = KBENCH_FILTER_SIZE - 1;
+	}
+	memcpy(kbench_filter, filter, length);
+	kbench_filter[length] = '\0';
+	if (length == 0) {
+		memcpy(kbench_filter, "all", 4);
+	}
+
+	kbench_exit = kbench_option(cmdline, "kbench.exit", &length) != NULL;
+
+	Thread *thread = thread_create("kbench", kbench_thread, NULL);
+	if (thread == NULL) {
+		log_message(
+			&kernel_debug_logger,
+			LOG_ERROR,
+			"kbench",
+			"Could not create the benchmark thread\n"
+		);
+		return;
+	}
+	thread_start(thread);
+}
@@ -0,0 +1,66 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include <jems/jems.h>
+#include <libk/spinlock.h>
+#include <logger.h>
+
+#include <kernel/debug.h>
+#include <kernel/time.h>
+
+#define JEMS_MAX_LEVEL 4
+
+static void jems_writer(char ch, uintptr_t arg) {
+	logger_t *logger = (logger_t *)arg;
+	char str[2] = {ch, '\0'};
+	log_stream_data(logger, str, 1);
+}
+
+void debug_dump_lock_stats() {
+	static jems_level_t jems_levels[JEMS_MAX_LEVEL];
+	static jems_t jems;
+
+	if (!LIBK_LOCK_STATS) {
+		log_message(
+			&kernel_debug_logger,
+			LOG_WARNING,
+			"locks",
+			"Lock statistics are not compiled in\n"
+		);
+		return;
+	}
+
+	log_stream_start(
+		&kernel_debug_logger, LOG_DEBUG, "locks", "Lock statistics"
+	);
+
+	jems_init(
+		&jems,
+		jems_levels,
+		JEMS_MAX_LEVEL,
+		jems_writer,
+		(uintptr_t)&kernel_debug_logger
+	);
+	jems_object_open(&jems);
+	jems_key_array_open(&jems, "locks");
+
+	// Racy snapshot, the counters of a lock that is in use may be torn
+	for (LockStats *stats = lock_stats_list(); stats != NULL;
+		 stats = stats->next) {
+		jems_object_open(&jems);
+		jems_key_string(&jems, "name", stats->name ? stats->name : "?");
+		jems_key_integer(&jems, "acquisitions", stats->acquisitions);
+		jems_key_integer(&jems, "contended", stats->contended);
+		jems_key_integer(&jems, "spins", stats->spins);
+		jems_key_integer(&jems, "max_hold_cycles", stats->max_hold_cycles);
+		jems_key_integer(
+			&jems, "max_hold_ns", tsc_to_ns(stats->max_hold_cycles)
+		);
+		jems_object_close(&jems);
+	}
+
+	jems_array_close(&jems);
+	jems_object_close(&jems);
+
+	log_stream_end(&kernel_debug_logger);
+}
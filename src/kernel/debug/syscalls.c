@@ -0,0 +1,122 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <jems/jems.h>
+#include <logger.h>
+
+#include <kernel/debug.h>
+#include <kernel/percpu.h>
+#include <kernel/syscall_stats.h>
+#include <kernel/time.h>
+
+#define JEMS_MAX_LEVEL 5
+
+static void jems_writer(char ch, uintptr_t arg) {
+	logger_t *logger = (logger_t *)arg;
+	char str[2] = {ch, '\0'};
+	log_stream_data(logger, str, 1);
+}
+
+/**
+ * Emits a trace record as the hex of its bytes, apps/ktracer decodes them
+ */
+static void syscalls_dump_record(jems_t *jems, const SystemCallTraceRecord *r) {
+	static const char digits[] = "0123456789abcdef";
+	char hex[sizeof(SystemCallTraceRecord) * 2 + 1];
+	const uint8_t *bytes = (const uint8_t *)r;
+
+	for (size_t i = 0; i < sizeof(SystemCallTraceRecord); i++) {
+		hex[i * 2] = digits[bytes[i] >> 4];
+		hex[i * 2 + 1] = digits[bytes[i] & 0xF];
+	}
+	hex[sizeof(hex) - 1] = '\0';
+	jems_string(jems, hex);
+}
+
+void debug_dump_syscalls() {
+	static jems_level_t jems_levels[JEMS_MAX_LEVEL];
+	static jems_t jems;
+	static SystemCallStats stats[SYSCALL_COUNT];
+	static const char *names[SYSCALL_COUNT] = {
+#define SYSCALL(number, name, NAME, ...) [number] = #name,
+#include <kernel/syscalls.def>
+#undef SYSCALL
+	};
+
+	syscall_stats_collect(stats, 0, SYSCALL_COUNT);
+
+	log_stream_start(
+		&kernel_debug_logger, LOG_DEBUG, "syscalls", "System call statistics"
+	);
+
+	jems_init(
+		&jems,
+		jems_levels,
+		JEMS_MAX_LEVEL,
+		jems_writer,
+		(uintptr_t)&kernel_debug_logger
+	);
+	jems_object_open(&jems);
+	jems_key_integer(&jems, "tsc_hz", time_tsc_hz());
+
+	jems_key_array_open(&jems, "names");
+	for (size_t i = 0; i < SYSCALL_COUNT; i++) {
+		jems_string(&jems, names[i]);
+	}
+	jems_array_close(&jems);
+
+	jems_key_array_open(&jems, "calls");
+	for (size_t i = 0; i < SYSCALL_COUNT; i++) {
+		if (stats[i].count == 0) {
+			continue;
+		}
+		jems_object_open(&jems);
+		jems_key_string(&jems, "name", names[i]);
+		jems_key_integer(&jems, "number", i);
+		jems_key_integer(&jems, "count", stats[i].count);
+		jems_key_integer(&jems, "errors", stats[i].errors);
+		jems_key_integer(&jems, "max_cycles", stats[i].max_cycles);
+		jems_key_integer(
+			&jems, "avg_ns", tsc_to_ns(stats[i].total_cycles / stats[i].count)
+		);
+
+		// Bucket j counts calls of 2^j to 2^(j + 1) cycles
+		jems_key_array_open(&jems, "histogram");
+		for (size_t j = 0; j < SYSCALL_HISTOGRAM_BUCKETS; j++) {
+			jems_integer(&jems, stats[i].histogram[j]);
+		}
+		jems_array_close(&jems);
+		jems_object_close(&jems);
+	}
+	jems_array_close(&jems);
+
+	// Racy snapshot, records written meanwhile may be torn or missing
+	jems_key_array_open(&jems, "trace");
+	for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+		uint64_t head;
+		const SystemCallTraceRecord *trace = syscall_trace_ring(cpu, &head);
+		if (trace == NULL) {
+			continue;
+		}
+
+		uint64_t first =
+			head > SYSCALL_TRACE_ENTRIES ? head - SYSCALL_TRACE_ENTRIES : 0;
+		jems_object_open(&jems);
+		jems_key_integer(&jems, "cpu", cpu);
+		jems_key_integer(&jems, "dropped", first);
+		jems_key_array_open(&jems, "records");
+		for (uint64_t i = first; i < head; i++) {
+			syscalls_dump_record(
+				&jems, &trace[i & (SYSCALL_TRACE_ENTRIES - 1)]
+			);
+		}
+		jems_array_close(&jems);
+		jems_object_close(&jems);
+	}
+	jems_array_close(&jems);
+
+	jems_object_close(&jems);
+
+	log_stream_end(&kernel_debug_logger);
+}
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Root System Description Pointer
+ */
+typedef struct {
+	char signature[8];
+	uint8_t checksum;
+	char oem_id[6];
+	uint8_t revision;
+	uint32_t rsdt_address;
+	// Fields below are only valid for revision >= 2
+	uint32_t length;
+	uint64_t xsdt_address;
+	uint8_t extended_checksum;
+	uint8_t reserved[3];
+} __attribute__((packed)) AcpiRsdp;
+
+/**
+ * Header shared by all system description tables
+ */
+typedef struct {
+	char signature[4];
+	uint32_t length;
+	uint8_t revision;
+	uint8_t checksum;
+	char oem_id[6];
+	char oem_table_id[8];
+	uint32_t oem_revision;
+	uint32_t creator_id;
+	uint32_t creator_revision;
+} __attribute__((packed)) AcpiSdtHeader;
+
+/**
+ * Generic Address Structure, describes the location of a register
+ */
+typedef struct {
+	uint8_t address_space_id;
+	uint8_t register_bit_width;
+	uint8_t register_bit_offset;
+	uint8_t access_size;
+	uint64_t address;
+} __attribute__((packed)) AcpiGenericAddress;
+
+/**
+ * High Precision Event Timer description table ("HPET")
+ */
+typedef struct {
+	AcpiSdtHeader header;
+	uint32_t event_timer_block_id;
+	AcpiGenericAddress base_address;
+	uint8_t hpet_number;
+	uint16_t minimum_tick;
+	uint8_t page_protection;
+} __attribute__((packed)) AcpiHpet;
+
+/**
+ * Multiple APIC Description Table ("APIC"), variable length interrupt
+ * controller entries follow the fixed part
+ */
+typedef struct {
+	AcpiSdtHeader header;
+	uint32_t local_apic_address;
+	uint32_t flags;
+} __attribute__((packed)) AcpiMadt;
+
+/**
+ * The system also has dual legacy PICs
+ */
+#define ACPI_MADT_PCAT_COMPAT (1 << 0)
+
+/**
+ * MADT entry types
+ */
+#define ACPI_MADT_LOCAL_APIC 0
+#define ACPI_MADT_IO_APIC 1
+#define ACPI_MADT_INTERRUPT_OVERRIDE 2
+#define ACPI_MADT_LOCAL_APIC_NMI 4
+#define ACPI_MADT_LOCAL_APIC_OVERRIDE 5
+#define ACPI_MADT_LOCAL_X2APIC 9
+#define ACPI_MADT_LOCAL_X2APIC_NMI 10
+
+/**
+ * Local APIC entry flags
+ */
+#define ACPI_MADT_ENABLED (1 << 0)
+#define ACPI_MADT_ONLINE_CAPABLE (1 << 1)
+
+/**
+ * MPS INTI flags of overrides and NMI entries. Zero in either field means
+ * "conforms to the bus", which is active high and edge triggered for ISA.
+ */
+#define ACPI_MADT_POLARITY_MASK 0x3
+#define ACPI_MADT_POLARITY_LOW 0x3
+#define ACPI_MADT_TRIGGER_MASK 0xC
+#define ACPI_MADT_TRIGGER_LEVEL 0xC
+
+/**
+ * Processor UID that applies an NMI entry to every processor
+ */
+#define ACPI_MADT_ALL_PROCESSORS 0xFF
+#define ACPI_MADT_ALL_X2_PROCESSORS 0xFFFFFFFF
+
+typedef struct {
+	uint8_t type;
+	uint8_t length;
+} __attribute__((packed)) AcpiMadtEntry;
+
+typedef struct {
+	AcpiMadtEntry header;
+	uint8_t processor_uid;
+	uint8_t apic_id;
+	uint32_t flags;
+} __attribute__((packed)) AcpiMadtLocalApic;
+
+typedef struct {
+	AcpiMadtEntry header;
+	uint8_t id;
+	uint8_t reserved;
+	uint32_t address;
+	uint32_t gsi_base;
+} __attribute__((packed)) AcpiMadtIoApic;
+
+typedef struct {
+	AcpiMadtEntry header;
+	uint8_t bus;
+	uint8_t source;
+	uint32_t gsi;
+	uint16_t flags;
+} __attribute__((packed)) AcpiMadtInterruptOverride;
+
+typedef struct {
+	AcpiMadtEntry header;
+	uint8_t processor_uid;
+	uint16_t flags;
+	uint8_t lint;
+} __attribute__((packed)) AcpiMadtLocalApicNmi;
+
+typedef struct {
+	AcpiMadtEntry header;
+	uint16_t reserved;
+	uint64_t address;
+} __attribute__((packed)) AcpiMadtLocalApicOverride;
+
+typedef struct {
+	AcpiMadtEntry header;
+	uint16_t reserved;
+	uint32_t x2apic_id;
+	uint32_t flags;
+	uint32_t processor_uid;
+} __attribute__((packed)) AcpiMadtLocalX2Apic;
+
+typedef struct {
+	AcpiMadtEntry header;
+	uint16_t flags;
+	uint32_t processor_uid;
+	uint8_t lint;
+	uint8_t reserved[3];
+} __attribute__((packed)) AcpiMadtLocalX2ApicNmi;
+
+/**
+ * Locates the RSDT/XSDT from the RSDP provided by the bootloader
+ *
+ * @param rsdp Virtual address of the RSDP
+ */
+void acpi_initialize(void *rsdp);
+
+/**
+ * Finds a system description table by its signature
+ *
+ * @param signature Four character table signature, e.g. "APIC"
+ * @return Virtual address of the table, or NULL if it does not exist
+ */
+void *acpi_find_table(const char *signature);
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libk/spinlock.h>
+
+#include <kernel/kobject.h>
+#include <kernel/syscall_abi.h>
+#include <kernel/thread.h>
+
+/**
+ * Kernel side of one queue of a channel. The message ring itself lives in
+ * shared memory and is only touched by user space, the kernel just sleeps
+ * and wakes the receiver.
+ */
+typedef struct {
+	AipcQueue *queue;
+	uint32_t mask;
+
+	TicketLock lock;
+	Thread *waiter;
+} AipcChannelQueue;
+
+/**
+ * Pages given with aipc_give and not yet taken. A slot is busy from the give
+ * to the take, count is 0 while the pages are on their way in or out.
+ * generation changes with every use of the slot, so a stale transfer id does
+ * not match.
+ */
+typedef struct {
+	bool busy;
+	uint32_t generation;
+	uint32_t count;
+	uintptr_t frames[AIPC_MAX_PAGES];
+} AipcTransfer;
+
+/**
+ * A channel: two message queues in memory shared with user space, one per
+ * direction, and the pages in flight between the endpoints. object must
+ * stay the first member, closed is set under both queue locks when the
+ * handle is closed.
+ */
+typedef struct {
+	KObject object;
+	bool closed;
+
+	AipcHeader *header;
+	AipcChannelQueue queues[2];
+
+	/**
+	 * Where user space sees the memory at header, and its size
+	 */
+	uintptr_t user_address;
+	size_t size;
+
+	TicketLock transfer_lock;
+	AipcTransfer transfers[AIPC_MAX_TRANSFERS];
+} AipcChannel;
+
+/**
+ * Creates a channel and maps its queues at a user address
+ *
+ * @param address Page-aligned address in the lower half
+ * @param entries Entries per queue, a power of two up to AIPC_MAX_ENTRIES
+ * @return The channel handle, or a negative SystemCallError
+ */
+int64_t aipc_create(void *address, uint32_t entries);
+
+/**
+ * Blocks until the receive queue of an endpoint holds messages. Sets
+ * AIPC_WAITING first, so a sender publishing meanwhile rings the doorbell.
+ *
+ * @return The number of messages ready, or a negative SystemCallError,
+ *         SYSCALL_ERROR_CANCELED once the channel is closed
+ */
+int64_t aipc_wait(uint32_t channel, uint32_t endpoint);
+
+/**
+ * Wakes the receiver of the queue endpoint sends on, if it waits
+ *
+ * @return 1 if a thread was woken, 0 if none waited, or a negative
+ *         SystemCallError
+ */
+int64_t aipc_notify(uint32_t channel, uint32_t endpoint);
+
+/**
+ * Moves pages from the caller's mapping into a transfer of the channel
+ *
+ * @return The transfer id, or a negative SystemCallError
+ */
+int64_t aipc_give(uint32_t channel, uintptr_t address, uint32_t count);
+
+/**
+ * Maps the pages of a transfer at an unmapped user address and ends it
+ *
+ * @return The number of pages mapped, or a negative SystemCallError
+ */
+int64_t aipc_take(uint32_t channel, uint64_t transfer, uintptr_t address);
+
+/**
+ * Returns the header of a channel through the direct map, for kernel code
+ * exchanging messages on it, or NULL
+ */
+AipcHeader *aipc_header(uint32_t channel);
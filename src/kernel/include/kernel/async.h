@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <kernel/syscall_abi.h>
+
+/**
+ * Asynchronous system calls in flight at once, across all threads. When none
+ * is left, calls fall back to blocking.
+ */
+#define ASYNC_MAX_CALLS 2048
+
+/**
+ * Bytes of per-call state a handler can keep in AsyncCall.context
+ */
+#define ASYNC_CONTEXT_SIZE 128
+
+struct AsyncCall;
+struct Ring;
+
+/**
+ * Continuation of an asynchronous call, run on the CPU that started it once
+ * the call has its result. Releases whatever the handler still holds, the
+ * result is posted right after.
+ */
+typedef void (*AsyncResume)(struct AsyncCall *call);
+
+/**
+ * Makes a call that still waits for its event complete at once with
+ * SYSCALL_ERROR_CANCELED. Does nothing if its result is already on the way.
+ * Runs on the CPU that started the call, with interrupts disabled.
+ */
+typedef void (*AsyncCancel)(struct AsyncCall *call);
+
+/**
+ * A system call that returned SYSCALL_PENDING. It holds everything needed to
+ * finish the call later, so no thread and no kernel stack waits for it.
+ */
+typedef struct AsyncCall {
+	/**
+	 * Link in the free list and in the ring's list of finished calls
+	 */
+	struct AsyncCall *next;
+
+	struct Ring *ring;
+	uint64_t id;
+	uint32_t cpu;
+	AsyncResume resume;
+	AsyncCancel cancel;
+	SystemCallReturn result;
+
+	/**
+	 * State of the handler, e.g. the waiter a futex wait queues
+	 */
+	uint8_t context[ASYNC_CONTEXT_SIZE] __attribute__((aligned(16)));
+} AsyncCall;
+
+/**
+ * Dispatches a system call made with SYSCALL_ASYNC. Handlers it reaches can
+ * use async_call_begin, and SYSCALL_PENDING results get the call id as value.
+ *
+ * @param number The system call number without SYSCALL_ASYNC
+ */
+SystemCallReturn async_syscall_handler(
+	SystemCallNumber number, SystemCallArgs *args
+);
+
+/**
+ * Starts completing the running system call asynchronously. Handlers call it
+ * where they would otherwise block, queue the returned call where the event
+ * will find it and return SYSCALL_PENDING.
+ *
+ * @param resume Continuation, may be NULL
+ * @param cancel Run when the ring is released before the call finishes
+ * @return The call, or NULL if the system call was not made with
+ *         SYSCALL_ASYNC or no call is free. The handler then blocks as usual.
+ */
+AsyncCall *async_call_begin(AsyncResume resume, AsyncCancel cancel);
+
+/**
+ * Returns a call from async_call_begin that was not queued after all, e.g.
+ * because the handler found it did not need to wait
+ */
+void async_call_discard(AsyncCall *call);
+
+/**
+ * Finishes a call: runs its continuation on the CPU that started it and posts
+ * the result to the ring. Callable from any CPU, but not with spinlocks held,
+ * reaching another CPU may wait for it. From another CPU interrupts must be
+ * enabled, as for smp_call. On the CPU that started the call it may also
+ * run in interrupt context, e.g. from a timer.
+ */
+void async_call_complete(AsyncCall *call, SystemCallReturn result);
+
+/**
+ * Returns a call whose result has been posted to the free list
+ */
+void async_call_free(AsyncCall *call);
+
+/**
+ * Cancels the calls of a ring still in flight and waits until every one has
+ * finished. Called by the ring's owner, once no new call can start.
+ */
+void async_cancel_ring(struct Ring *ring);
@@ -74,6 +74,22 @@ __attribute__((used, section(".requests"))
 	.id = LIMINE_HHDM_REQUEST, .revision = 0
 };
 
+/**
+ * Get the ACPI RSDP from Limine
+ */
+__attribute__((used, section(".requests"))
+) static volatile struct limine_rsdp_request rsdp_request = {
+	.id = LIMINE_RSDP_REQUEST, .revision = 0
+};
+
+/**
+ * Get the application processors from Limine
+ */
+__attribute__((used, section(".requests"))
+) static volatile struct limine_smp_request smp_request = {
+	.id = LIMINE_SMP_REQUEST, .revision = 0, .flags = 0
+};
+
 __attribute__((used, section(".requests_start_marker"))
 ) static volatile LIMINE_REQUESTS_START_MARKER;
 
@@ -5,6 +5,12 @@
 
 #define MAX_ORDER 11
 
+/**
+ * Entry of BuddyAllocator.orders for frames that do not start an allocated
+ * block
+ */
+#define BUDDY_ORDER_NONE 0xFF
+
 /**
  * Buddy allocator for physical memory.
  *
@@ -27,6 +33,12 @@ typedef struct {
 	 * to MAX_ORDER inclusive
 	 */
 	BuddyBlock *free_lists[MAX_ORDER + 1];
+	/**
+	 * Order of the allocated block starting at each frame of the pool, or
+	 * BUDDY_ORDER_NONE. Kept outside the blocks, whose owners overwrite
+	 * their headers.
+	 */
+	uint8_t *orders;
 } BuddyAllocator;
 
 uintptr_t buddy_allocator_allocate(BuddyAllocator *allocator, size_t size);
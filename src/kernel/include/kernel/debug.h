@@ -9,3 +9,71 @@ void debug_logger_initialize();
 void debug_test_syscalls();
 void debug_test_exceptions();
 void debug_test_buddy_allocator();
+void debug_test_rcu();
+
+/**
+ * Logs the contention statistics of every lock acquired so far
+ */
+void debug_dump_lock_stats();
+
+/**
+ * Logs the call sites that kept interrupts disabled the longest, with a
+ * histogram of their section lengths and the stack of the worst one
+ */
+void debug_dump_irqsoff();
+
+/**
+ * Logs the per-system call counters and latency histograms, and the trace
+ * rings if the trace was ever turned on. Decode with ktracer --syscall-trace.
+ */
+void debug_dump_syscalls();
+
+/**
+ * Stress benchmark of the lock primitives across 1..N online CPUs
+ */
+void debug_bench_locks();
+
+/**
+ * Uncontended futex mutex cost and futex handoff latency between two threads
+ */
+void debug_bench_futex();
+
+/**
+ * Cycles per interrupt through the full and the lean entry path
+ */
+void debug_bench_interrupts();
+
+/**
+ * Latency of waking a thread on an idle CPU through MWAIT and through HLT,
+ * for a few idle periods, and the time spent in each idle state
+ */
+void debug_bench_idle();
+
+/**
+ * Cycles per null system call from ring 3, through syscall_entry and back
+ */
+void debug_bench_syscall();
+
+/**
+ * Cycles per monotonic clock read from ring 3, through the kernel data page
+ * and through the clock_get system call
+ */
+void debug_bench_vdso();
+
+/**
+ * Cycles to copy a user buffer through the direct map and to pin and unpin
+ * it, for sizes up to 64 KiB, and where pinning becomes cheaper
+ */
+void debug_bench_pin();
+
+/**
+ * AIPC round trip between two threads, bulk message throughput with the
+ * doorbells it took, and moving 64 KiB by page transfer against copying it
+ */
+void debug_bench_aipc();
+
+/**
+ * Round trip of a synchronous IPC call with the server on the same CPU and
+ * on another one, next to the same round trip through an AIPC channel
+ */
+void debug_bench_ipc();
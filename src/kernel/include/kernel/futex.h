@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <kernel/syscalls.h>
+
+/**
+ * log2 of the number of wait queue buckets. Futexes are hashed by physical
+ * address, unrelated futexes that share a bucket only share its lock.
+ */
+#define FUTEX_HASH_BITS 8
+#define FUTEX_HASH_SIZE (1 << FUTEX_HASH_BITS)
+
+/**
+ * Bitset that matches every waiter, used by the plain wait and wake calls
+ */
+#define FUTEX_BITSET_ANY 0xFFFFFFFF
+
+/**
+ * Timeout value that waits until woken
+ */
+#define FUTEX_NO_TIMEOUT 0
+
+/**
+ * Blocks the calling thread until the futex is woken, if it still holds the
+ * expected value. The check and the enqueue are atomic with respect to
+ * futex_wake, so a wakeup between the caller's own check and this call is not
+ * lost.
+ *
+ * @param address The futex word, 4-byte aligned and in user memory
+ * @param expected Value the caller saw in the futex word
+ * @param timeout_ns Relative timeout, or FUTEX_NO_TIMEOUT
+ * @param bitset Only wakes with an overlapping bitset wake this waiter, must
+ *               not be 0
+ * @return SYSCALL_SUCCESS once woken, SYSCALL_ERROR_WOULD_BLOCK if the value
+ *         did not match, SYSCALL_ERROR_TIMED_OUT or SYSCALL_ERROR_INVALID_ARGS.
+ *         SYSCALL_PENDING without blocking in an asynchronous system call,
+ *         the call then completes with SYSCALL_SUCCESS, the timeout or
+ *         SYSCALL_ERROR_CANCELED if the ring is released first.
+ */
+SystemCallError futex_wait(
+	uint32_t *address, uint32_t expected, uint64_t timeout_ns, uint32_t bitset
+);
+
+/**
+ * Wakes threads waiting on a futex, oldest first
+ *
+ * @param address The futex word
+ * @param count Maximum number of threads to wake
+ * @param bitset Only waiters whose bitset overlaps this one are woken
+ * @return Number of threads woken, or a negative SystemCallError
+ */
+int64_t futex_wake(uint32_t *address, uint32_t count, uint32_t bitset);
+
+/**
+ * Wakes up to count waiters of a futex and moves up to requeue_count of the
+ * remaining ones to another futex without waking them. Avoids a thundering
+ * herd when, for example, a condition variable is broadcast and all waiters
+ * would immediately contend on the same mutex.
+ *
+ * @param address The futex word to wake and requeue from
+ * @param count Maximum number of threads to wake
+ * @param target The futex word to requeue to, not the same as address
+ * @param requeue_count Maximum number of threads to requeue
+ * @param expected Value address must still hold
+ * @return Number of threads woken or requeued, or a negative SystemCallError
+ *         (SYSCALL_ERROR_WOULD_BLOCK if the value did not match)
+ */
+int64_t futex_requeue(
+	uint32_t *address,
+	uint32_t count,
+	uint32_t *target,
+	uint32_t requeue_count,
+	uint32_t expected
+);
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libk/spinlock.h>
+
+#include <kernel/kobject.h>
+#include <kernel/percpu.h>
+
+/**
+ * A handle is the index of its slot in the low HANDLE_INDEX_BITS and the
+ * slot's generation above. Opening a handle moves the generation on, so a
+ * stale handle does not match a reused slot for 65535 more reuses.
+ */
+#define HANDLE_INDEX_BITS 16
+#define HANDLE_INDEX_MASK ((1U << HANDLE_INDEX_BITS) - 1)
+
+/**
+ * Set in HandleSlot.generation while the slot is free, no handle matches it
+ */
+#define HANDLE_SLOT_FREE (1U << 31)
+
+/**
+ * Two-level layout: the root points at leaves of one page each, added as the
+ * table grows and never freed, so readers need no lock to walk it
+ */
+#define HANDLE_LEAF_BITS 8
+#define HANDLE_LEAF_SLOTS (1U << HANDLE_LEAF_BITS)
+#define HANDLE_ROOT_SIZE (1U << (HANDLE_INDEX_BITS - HANDLE_LEAF_BITS))
+
+/**
+ * Free slots each CPU keeps, and how many it moves to or from the table's
+ * free list at once
+ */
+#define HANDLE_CACHE_SIZE 32
+#define HANDLE_CACHE_BATCH 16
+
+typedef struct {
+	/**
+	 * The object, NULL while the slot is free
+	 */
+	KObject *object;
+
+	/**
+	 * Generation of the handle naming the slot, never 0. Stored after the
+	 * object, with HANDLE_SLOT_FREE set once the handle is closed.
+	 */
+	uint32_t generation;
+
+	/**
+	 * Next slot of the free list while the slot is free, as index + 1 so 0
+	 * ends the list
+	 */
+	uint32_t next;
+} HandleSlot;
+
+_Static_assert(
+	sizeof(HandleSlot) * HANDLE_LEAF_SLOTS == 4096, "A leaf is one page"
+);
+
+/**
+ * Free slots of a table cached by one CPU, opening and closing handles only
+ * touches the table lock to refill or drain it
+ */
+typedef struct {
+	uint32_t count;
+	uint32_t slots[HANDLE_CACHE_SIZE];
+} __attribute__((aligned(64))) HandleCache;
+
+/**
+ * Handles of one protection domain. Lookups take no lock: they read the
+ * root, the leaf and the slot, and check the generation before and after
+ * taking a reference to the object.
+ */
+typedef struct {
+	HandleSlot *leaves[HANDLE_ROOT_SIZE];
+
+	/**
+	 * Guards the free list, which starts at free_head - 1, and growing the
+	 * table
+	 */
+	TicketLock lock;
+	uint32_t free_head;
+	uint32_t leaf_count;
+
+	HandleCache caches[MAX_CPUS];
+} HandleTable;
+
+/**
+ * Returns the table of the calling thread. There is a single address space
+ * and so a single table for all of user space for now.
+ */
+HandleTable *handle_table_current();
+
+/**
+ * Puts an object in a table. The handle owns the object's initial reference.
+ *
+ * @return The handle, or a negative SystemCallError if the table is full
+ */
+int64_t handle_open(HandleTable *table, KObject *object);
+
+/**
+ * Looks up a handle and takes a reference to its object, without locking.
+ * Drop it with kobject_put.
+ *
+ * @param type The type the object must have
+ * @return The object, or NULL if the handle is stale or of another type
+ */
+KObject *handle_get(HandleTable *table, uint32_t handle, KObjectType type);
+
+/**
+ * Closes a handle and kills its object (see kobject_kill)
+ *
+ * @return 0, or a negative SystemCallError if the handle is not open
+ */
+int64_t handle_close(HandleTable *table, uint32_t handle);
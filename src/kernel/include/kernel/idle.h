@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <kernel/time.h>
+
+/**
+ * Upper bound for the number of idle states, HLT or MWAIT C1 plus the deeper
+ * C-states the CPU reports
+ */
+#define IDLE_MAX_STATES 8
+
+/**
+ * Weight of the newest idle period in the predicted idle duration, as a
+ * power of two (1/8)
+ */
+#define IDLE_PREDICT_SHIFT 3
+
+/**
+ * A state the idle loop can enter. A state is only picked when the predicted
+ * idle duration is at least its target residency, otherwise waking up costs
+ * more than the state saves.
+ */
+typedef struct {
+	const char *name;
+	uint32_t mwait_hint;
+	uint64_t exit_latency_ns;
+	uint64_t target_residency_ns;
+} IdleState;
+
+/**
+ * Time spent in an idle state, summed over all CPUs
+ */
+typedef struct {
+	uint64_t entries;
+	uint64_t cycles;
+} IdleStats;
+
+/**
+ * Detects MONITOR/MWAIT and the C-states it offers. Runs once on the boot
+ * CPU, before any CPU enters the idle loop.
+ */
+void idle_initialize();
+
+/**
+ * Idle loop of a CPU with nothing to run. Stops the timeslice tick and waits
+ * in MWAIT on the CPU's doorbell (see smp_resched), or halts until the next
+ * interrupt when MWAIT is not available.
+ *
+ * NOTE: This function does not return.
+ */
+__attribute__((noreturn)) void idle_loop();
+
+/**
+ * Switches between MWAIT and HLT, for comparing the two
+ *
+ * @return false if MWAIT was requested but is not supported
+ */
+bool idle_use_mwait(bool enabled);
+
+/**
+ * Returns the number of idle states, at least one
+ */
+uint32_t idle_state_count();
+
+/**
+ * Returns an idle state, index 0 is the shallowest
+ */
+const IdleState *idle_state(uint32_t index);
+
+/**
+ * Returns the time spent in an idle state
+ */
+IdleStats idle_stats(uint32_t index);
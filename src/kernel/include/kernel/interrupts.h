@@ -1,10 +1,58 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
 #include <hal/idt.h>
 
+/**
+ * The action may share its vector with other shared actions
+ */
+#define INTERRUPT_SHARED (1 << 0)
+
+/**
+ * The handler reads the InterruptFrame. Vectors 32 and up otherwise enter
+ * through a lean path that saves only the caller-clobbered registers.
+ */
+#define INTERRUPT_FRAME (1 << 1)
+
+/**
+ * Interrupt handler. Runs in interrupt context with interrupts disabled.
+ *
+ * @param frame Interrupted context, NULL for vectors 32 and up unless an action
+ *              on the vector has INTERRUPT_FRAME
+ * @param context Pointer given when the action was set up
+ * @return true if the interrupt came from this handler's device. Every action
+ *         on a shared vector runs, the result only detects interrupts nobody
+ *         handled.
+ */
+typedef bool (*InterruptHandler)(InterruptFrame *frame, void *context);
+
+/**
+ * A handler registered on a vector. Embedded in the owner, it must stay valid
+ * until interrupt_unregister returns.
+ */
+typedef struct InterruptAction {
+	struct InterruptAction *next;
+	InterruptHandler handler;
+	void *context;
+	const char *name;
+	uint32_t flags;
+} InterruptAction;
+
+/**
+ * Interrupt load of one vector, summed over all CPUs
+ */
+typedef struct {
+	uint64_t count;
+
+	/**
+	 * TSC cycles spent in the handlers, excluding softirqs run on exit
+	 */
+	uint64_t cycles;
+} InterruptStats;
+
 /**
  * Load the IDT with interrupt handlers.
  */
@@ -14,3 +62,59 @@ void isr_initialize();
  * Common interrupt handler routine (called from assembly)
  */
 void isr_handler(InterruptFrame *frame, uint64_t interrupt_number);
+
+/**
+ * Lean interrupt path (called from assembly). The handler half runs the
+ * actions on the IRQ stack, the exit half runs softirqs and preempts on the
+ * interrupted stack.
+ *
+ * @return true if the CPU was idle, passed on to isr_lean_exit
+ */
+bool isr_lean_handler(uint64_t interrupt_number);
+void isr_lean_exit(bool from_idle);
+
+/**
+ * Prepares an action for registration
+ *
+ * @param action The action
+ * @param name Name for debugging, not copied
+ * @param handler Function to run
+ * @param context Opaque pointer for the handler
+ * @param flags INTERRUPT_SHARED and INTERRUPT_FRAME
+ */
+void interrupt_action_init(
+	InterruptAction *action,
+	const char *name,
+	InterruptHandler handler,
+	void *context,
+	uint32_t flags
+);
+
+/**
+ * Adds an action to a vector. Actions on one vector run in registration order.
+ *
+ * @param vector Interrupt vector
+ * @param action Prepared action, not registered anywhere else
+ * @return false if the vector is in use and either action is not shared
+ */
+bool interrupt_register(uint8_t vector, InterruptAction *action);
+
+/**
+ * Removes an action from a vector and waits until no CPU runs it anymore.
+ * Must be called from thread context.
+ *
+ * @param vector Vector the action was registered on
+ * @param action The action
+ */
+void interrupt_unregister(uint8_t vector, InterruptAction *action);
+
+/**
+ * Returns the vector whose actions are running on the calling CPU. Only
+ * meaningful inside an interrupt handler.
+ */
+uint8_t interrupt_current_vector();
+
+/**
+ * Returns the interrupt load of a vector since boot
+ */
+InterruptStats interrupt_stats(uint8_t vector);
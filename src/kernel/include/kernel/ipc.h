@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libk/spinlock.h>
+
+#include <kernel/kobject.h>
+#include <kernel/syscall_abi.h>
+#include <kernel/thread.h>
+
+/**
+ * Synchronous IPC
+ *
+ * A client calls an endpoint with a few words and sleeps until the server
+ * replies, the server replies and sleeps until the next call in one step.
+ * When the other side already waits on the same CPU the kernel switches to
+ * it directly with thread_handoff: no run queue, no second wakeup, and the
+ * timeslice stays with the call. Across CPUs the peer is woken instead.
+ *
+ * Each endpoint has a single server. It owes a reply to the last caller it
+ * received, callers arriving meanwhile queue up in order. object must stay
+ * the first member.
+ */
+typedef struct IpcEndpoint {
+	KObject object;
+
+	TicketLock lock;
+	bool closed;
+
+	/**
+	 * The server, while it sleeps in ipc_reply_wait
+	 */
+	Thread *server;
+
+	/**
+	 * Callers waiting for the server to pick up their call
+	 */
+	Thread *callers_head;
+	Thread *callers_tail;
+} IpcEndpoint;
+
+/**
+ * Creates an endpoint
+ *
+ * @return The endpoint handle, or a negative SystemCallError
+ */
+int64_t ipc_create();
+
+/**
+ * Sends message to the server of an endpoint and sleeps until it replies
+ *
+ * @param message The request, replaced by the reply
+ * @return 0, or a negative SystemCallError, SYSCALL_ERROR_CANCELED if the
+ *         endpoint was closed before a server took the call
+ */
+int64_t ipc_call(uint32_t endpoint, IpcMessage *message);
+
+/**
+ * Sends message as the reply to the last call the current thread received,
+ * if there was one, then sleeps until the next call on an endpoint. The reply
+ * goes out even if the call then fails.
+ *
+ * @param message The reply, replaced by the next request
+ * @return 0, or a negative SystemCallError, SYSCALL_ERROR_CANCELED once the
+ *         endpoint is closed
+ */
+int64_t ipc_reply_wait(uint32_t endpoint, IpcMessage *message);
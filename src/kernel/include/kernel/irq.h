@@ -0,0 +1,180 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <hal/idt.h>
+#include <hal/pci.h>
+
+#include <libk/spinlock.h>
+
+#include <kernel/interrupts.h>
+#include <kernel/thread.h>
+#include <kernel/time.h>
+
+/**
+ * Vectors handed out to devices. Vectors below are exceptions and the
+ * (masked) legacy PIC range, those above belong to the local APIC and IPIs.
+ * isr_handler acknowledges the local APIC after the actions of a device
+ * vector ran.
+ */
+#define IRQ_VECTOR_FIRST 0x30
+#define IRQ_VECTOR_LAST 0xEF
+
+/**
+ * Number of legacy ISA interrupts, identity mapped to GSIs unless the MADT
+ * overrides them
+ */
+#define IRQ_ISA_COUNT 16
+
+/**
+ * Lets the kernel pick the CPU that services an interrupt
+ */
+#define IRQ_AFFINITY_ANY UINT32_MAX
+
+/**
+ * Masks the legacy PICs and sets up the IOAPICs from the ACPI MADT. Runs once
+ * on the boot CPU after acpi_initialize and paging_initialize, before the
+ * local APIC is enabled.
+ */
+void irq_initialize();
+
+/**
+ * Programs the local APIC NMI inputs the MADT describes for the calling CPU.
+ * Runs once per CPU after lapic_initialize.
+ */
+void irq_initialize_cpu();
+
+/**
+ * Returns the physical address of the local APIC register page, as reported
+ * by the MADT (or the APIC base MSR without one)
+ */
+uintptr_t irq_lapic_address();
+
+/**
+ * Routes a legacy ISA interrupt, applying MADT source overrides. The
+ * interrupt is unmasked before returning.
+ *
+ * @param isa ISA interrupt number, below IRQ_ISA_COUNT
+ * @param action Prepared action to register on the vector
+ * @param cpu Index of the CPU to deliver to, or IRQ_AFFINITY_ANY
+ * @return The vector, or -1 on failure
+ */
+int irq_route_isa(uint8_t isa, InterruptAction *action, uint32_t cpu);
+
+/**
+ * Routes a global system interrupt. If the GSI is already routed, a shared
+ * action joins its vector (and cpu is ignored).
+ *
+ * @param gsi Global system interrupt
+ * @param flags IOAPIC_ACTIVE_LOW and IOAPIC_LEVEL_TRIGGERED
+ * @return The vector, or -1 on failure
+ */
+int irq_route_gsi(
+	uint32_t gsi, uint32_t flags, InterruptAction *action, uint32_t cpu
+);
+
+/**
+ * Enables MSI for a PCI function with a single vector
+ *
+ * @return The allocated vector, or -1 on failure
+ */
+int irq_msi_enable(PciAddress address, InterruptAction *action, uint32_t cpu);
+
+/**
+ * Points one MSI-X table entry at a newly allocated vector and enables MSI-X.
+ * Each entry gets its own vector, so queues can be spread across CPUs.
+ *
+ * @param entry MSI-X table index
+ * @return The allocated vector, or -1 on failure
+ */
+int irq_msix_enable(
+	PciAddress address, uint16_t entry, InterruptAction *action, uint32_t cpu
+);
+
+/**
+ * Moves an interrupt to another CPU by reprogramming its source
+ *
+ * @param vector Vector returned when the interrupt was set up
+ * @param cpu Index of an online CPU, or IRQ_AFFINITY_ANY
+ * @return false if the vector is not in use or the CPU is invalid
+ */
+bool irq_set_affinity(uint8_t vector, uint32_t cpu);
+
+/**
+ * Unregisters an action set up by one of the routing functions. The source is
+ * masked and the vector released once its last action is gone. Must be called
+ * from thread context.
+ */
+void irq_free(uint8_t vector, InterruptAction *action);
+
+/*
+ * ============================================================================
+ * Threaded handlers
+ * ============================================================================
+ */
+
+/**
+ * Longest an interrupt thread runs at its own priority without blocking. A
+ * device that keeps it busy longer drops it to THREAD_PRIORITY_NORMAL until
+ * it catches up, so a flood cannot starve other threads.
+ */
+#define IRQ_THREAD_BUDGET_NS (2 * NS_PER_MS)
+
+typedef void (*IrqThreadFunction)(void *context);
+
+/**
+ * Interrupt handler that runs in its own kernel thread. The hard interrupt
+ * part only masks level-triggered sources (the local APIC is acknowledged as
+ * usual) and wakes the thread, which runs the function and unmasks.
+ * Interrupts raised while the function runs make it run once more.
+ *
+ * Set up with irq_thread_init, route action with one of the routing
+ * functions, then call irq_thread_start with the vector. The thread lives on
+ * the CPU the vector was routed to and is never reclaimed.
+ */
+typedef struct {
+	InterruptAction action;
+	IrqThreadFunction function;
+	void *context;
+	ThreadPriority priority;
+	Thread *thread;
+
+	/**
+	 * Protects pending and masked, orders the thread going to sleep against
+	 * the hard interrupt part waking it
+	 */
+	TicketLock lock;
+	bool pending;
+	bool masked;
+	uint8_t vector;
+} IrqThread;
+
+/**
+ * Prepares a threaded handler
+ *
+ * @param irq_thread The handler
+ * @param name Name of the action and thread, not copied
+ * @param function Runs in the thread, may sleep
+ * @param context Passed to function
+ * @param priority Priority of the thread, usually THREAD_PRIORITY_HIGH
+ * @param flags INTERRUPT_SHARED or 0
+ */
+void irq_thread_init(
+	IrqThread *irq_thread,
+	const char *name,
+	IrqThreadFunction function,
+	void *context,
+	ThreadPriority priority,
+	uint32_t flags
+);
+
+/**
+ * Creates the thread on the CPU the vector is delivered to. Interrupts that
+ * arrived since the action was routed are handled once it runs.
+ *
+ * @param vector Vector returned when irq_thread->action was routed
+ * @return false if out of memory
+ */
+bool irq_thread_start(IrqThread *irq_thread, uint8_t vector);
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Body of a benchmark. Runs the measured operation iterations times, the
+ * runner picks the count and times the whole call.
+ */
+typedef void (*KBenchFunction)(uint64_t iterations);
+
+/**
+ * A benchmark registered with KBENCH. The linker gathers them in the .kbench
+ * section between __kbench_start and __kbench_end.
+ */
+typedef struct {
+	const char *name;
+	KBenchFunction function;
+} __attribute__((aligned(16))) KBench;
+
+/**
+ * Defines and registers a benchmark, followed by its body:
+ *
+ *     KBENCH(ticket_lock) {
+ *         for (uint64_t i = 0; i < iterations; i++) { ... }
+ *     }
+ *
+ * Not const, the kernel is position independent and the loader relocates the
+ * pointers in the entry.
+ */
+#define KBENCH(bench_name)                                                     \
+	static void kbench_##bench_name(uint64_t iterations);                      \
+	__attribute__((used, section(".kbench"))) static KBench                    \
+		kbench_entry_##bench_name = {                                          \
+			.name = #bench_name, .function = kbench_##bench_name               \
+	};                                                                         \
+	static void kbench_##bench_name(uint64_t iterations)
+
+/**
+ * Keeps the compiler from dropping a computation whose result is unused
+ */
+#define KBENCH_KEEP(value) asm volatile("" : : "g"(value) : "memory")
+
+/**
+ * Runs the benchmarks matching filter on the calling thread and logs one
+ * result line each, with component "kbench". Each is warmed up, its
+ * iteration count doubled until one run takes KBENCH_TARGET_NS, and then
+ * timed KBENCH_SAMPLES times.
+ *
+ * @param filter Comma separated benchmark names, a trailing * matches a
+ *               prefix. NULL or "all" runs every benchmark.
+ * @return The number of benchmarks run
+ */
+size_t kbench_run(const char *filter);
+
+/**
+ * Starts a thread running the benchmarks named by kbench=<filter> on the
+ * kernel command line, if it has that option. Once done the thread logs
+ * "Benchmarks complete" and, with kbench.exit on the command line, powers
+ * QEMU off through its isa-debug-exit device.
+ */
+void kbench_initialize(const char *cmdline);
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <kernel/rcu.h>
+
+/**
+ * Kernel objects that can exist at once, each takes a counter per CPU
+ */
+#define KOBJECT_MAX 1024
+
+/**
+ * Added to the shared count while the per-CPU counters are in use, so it
+ * cannot drop to zero before they are folded in
+ */
+#define KOBJECT_BIAS (1LL << 62)
+
+typedef enum {
+	KOBJECT_AIPC_CHANNEL = 1,
+	KOBJECT_IPC_ENDPOINT,
+} KObjectType;
+
+struct KObject;
+
+typedef struct {
+	/**
+	 * Called when the object's handle is closed. Wakes the threads sleeping
+	 * on it, they still hold references.
+	 */
+	void (*close)(struct KObject *object);
+
+	/**
+	 * Frees the object once the last reference is gone, from softirq
+	 * context. NULL leaves it allocated.
+	 */
+	void (*release)(struct KObject *object);
+} KObjectOps;
+
+/**
+ * Header of an object user space reaches through a handle (see
+ * kernel/handle.h), embedded in the object.
+ *
+ * References are counted per CPU while the object is open: taking and
+ * dropping one is a single non-atomic increment of this CPU's counter for the
+ * object, no cache line is shared. Closing the handle switches the object to
+ * the shared count. After a grace period, once no CPU can still be counting
+ * locally, the per-CPU counters are summed into it and from then on every
+ * reference is an atomic operation, the last one releases the object.
+ */
+typedef struct KObject {
+	KObjectType type;
+	const KObjectOps *ops;
+
+	/**
+	 * Column of the per-CPU counters
+	 */
+	uint32_t id;
+
+	/**
+	 * Set once the handle is closed, references then go to count
+	 */
+	volatile bool shared;
+	int64_t count;
+
+	RcuHead rcu;
+} KObject;
+
+/**
+ * Sets up an object with one reference, the one its handle will hold
+ *
+ * @return false if KOBJECT_MAX objects exist
+ */
+bool kobject_init(KObject *object, KObjectType type, const KObjectOps *ops);
+
+/**
+ * Takes a reference. The caller must hold one already, or be in the RCU
+ * read-side section it found the object in. Not from interrupt handlers.
+ */
+void kobject_get(KObject *object);
+
+/**
+ * Drops a reference. The object may be released once the last one is gone.
+ */
+void kobject_put(KObject *object);
+
+/**
+ * Closes an object: runs its close operation, switches it to the shared
+ * count and drops the initial reference after a grace period
+ */
+void kobject_kill(KObject *object);
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -9,15 +10,99 @@
 #define PAGE_SIZE 4096
 
 /**
- * Page read/write flags
+ * Page table entry flags
  */
 #define PAGE_PRESENT (1 << 0)
 #define PAGE_WRITABLE (1 << 1)
+#define PAGE_USER (1 << 2)
+#define PAGE_WRITE_THROUGH (1 << 3)
+#define PAGE_CACHE_DISABLE (1 << 4)
+#define PAGE_HUGE (1 << 7)
+#define PAGE_GLOBAL (1 << 8)
+#define PAGE_NO_EXECUTE (1ULL << 63)
+
+/**
+ * End of the lower half, user memory lies below it
+ */
+#define PAGING_USER_END 0x0000800000000000ULL
+
+/**
+ * Mask of the physical address bits in a page table entry
+ */
+#define PAGE_ADDRESS_MASK 0x000FFFFFFFFFF000ULL
 
 static inline void *phys_to_virt(uint64_t phys, uint64_t hhdm_offset) {
 	return (void *)(phys + hhdm_offset);
 }
 
-// static inline uintptr_t virt_to_phys(void *virt_addr) {
-// 	return (uintptr_t)virt_addr - hhdm_offset;
-// }
+/**
+ * Records the higher half direct map offset. Must be called before any other
+ * paging function.
+ *
+ * @param hhdm_offset Virtual offset of the direct map from the bootloader
+ */
+void paging_initialize(uint64_t hhdm_offset);
+
+/**
+ * Returns the higher half direct map offset
+ */
+uint64_t paging_hhdm_offset();
+
+static inline uintptr_t virt_to_phys(void *virt_addr) {
+	return (uintptr_t)virt_addr - paging_hhdm_offset();
+}
+
+/**
+ * Maps a single 4 KiB page in the current address space. Intermediate page
+ * tables are allocated from the physical memory manager as needed.
+ *
+ * @param virt Page-aligned virtual address
+ * @param phys Page-aligned physical address
+ * @param flags PAGE_* flags for the final entry
+ * @return false if a page table could not be allocated
+ */
+bool paging_map_page(uintptr_t virt, uintptr_t phys, uint64_t flags);
+
+/**
+ * Looks up the physical address a virtual address is mapped to in the current
+ * address space
+ *
+ * @param virt Virtual address, need not be page-aligned
+ * @param phys Receives the physical address
+ * @return false if the address is not mapped
+ */
+bool paging_translate(uintptr_t virt, uintptr_t *phys);
+
+/**
+ * Like paging_translate, and also returns which of PAGE_PRESENT,
+ * PAGE_WRITABLE and PAGE_USER hold for the address across all levels of the
+ * walk
+ *
+ * @param flags Receives the effective flags
+ */
+bool paging_lookup(uintptr_t virt, uintptr_t *phys, uint64_t *flags);
+
+/**
+ * Unmaps 4 KiB pages of the current address space and flushes them from the
+ * TLB of every CPU. Leaves the frames alone, the caller owns them from then
+ * on. Must be called with interrupts enabled, the other CPUs are waited for.
+ *
+ * @param virt Page-aligned start of the range
+ * @param count Number of pages
+ * @param frames Receives the physical address of each page
+ * @return false if a page is not mapped or part of a huge page, nothing is
+ *         unmapped then
+ */
+bool paging_unmap_pages(uintptr_t virt, size_t count, uintptr_t *frames);
+
+/**
+ * Maps a device register range uncached into the direct map. The bootloader
+ * only maps RAM there, so MMIO has to be mapped before it can be touched.
+ * Where the direct map already covers the range with a huge page, the page is
+ * split so only the registers become uncached.
+ *
+ * @param phys Physical address of the registers
+ * @param size Size of the register range in bytes
+ * @return Virtual address of the registers, or NULL on failure
+ */
+void *paging_map_mmio(uintptr_t phys, size_t size);
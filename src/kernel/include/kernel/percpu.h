@@ -0,0 +1,172 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libk/irqsoff.h>
+
+#include <hal/cpu.h>
+#include <hal/gdt.h>
+
+struct Thread;
+
+/**
+ * Maximum number of CPUs supported by the kernel
+ */
+#define MAX_CPUS 64
+
+/**
+ * Size of the per-CPU stack interrupt handlers run on
+ */
+#define IRQ_STACK_SIZE 16384
+
+/**
+ * Offset of Cpu.irq_stack_top, used by the interrupt entry stubs
+ */
+#define CPU_IRQ_STACK_OFFSET 16
+
+/**
+ * Offsets of Cpu.kernel_stack_top and Cpu.user_rsp, used by syscall_entry
+ */
+#define CPU_KERNEL_STACK_OFFSET 24
+#define CPU_USER_RSP_OFFSET 32
+
+/**
+ * Per-CPU kernel state. While running in the kernel, the GS base of each CPU
+ * points at its own Cpu structure.
+ */
+typedef struct Cpu {
+	/**
+	 * Self pointer, must stay the first member so this_cpu() can read it
+	 * through %gs:0
+	 */
+	struct Cpu *self;
+
+	/**
+	 * HAL per-CPU state, must stay at HAL_CPU_OFFSET (see hal_cpu)
+	 */
+	HalCpu hal;
+
+	/**
+	 * Top of this CPU's IRQ stack, must stay at CPU_IRQ_STACK_OFFSET
+	 */
+	uintptr_t irq_stack_top;
+
+	/**
+	 * Stack top of the running thread, which syscall_entry switches to, and
+	 * where it parks the user stack pointer meanwhile. 0 while the boot or
+	 * idle context runs. Must stay at CPU_KERNEL_STACK_OFFSET and
+	 * CPU_USER_RSP_OFFSET.
+	 */
+	uintptr_t kernel_stack_top;
+	uintptr_t user_rsp;
+
+	uint32_t id;
+	uint32_t apic_id;
+	volatile bool online;
+
+	/**
+	 * Non-zero while the CPU must not be preempted, see kernel/preempt.h
+	 */
+	volatile uint32_t preempt_count;
+
+	/**
+	 * Set by the timer when the running thread used up its timeslice, and by
+	 * wakers. Doubles as the idle doorbell: while idle_polling is set the CPU
+	 * waits in MWAIT on this line, and storing here wakes it without an IPI.
+	 */
+	volatile bool need_resched;
+	volatile bool idle_polling;
+
+	/**
+	 * Timer state, owned by core/tick.c
+	 */
+	bool tick_idle;
+	uint64_t tick_slice_end;
+	uint64_t tick_event;
+	uint64_t tick_count;
+
+	/**
+	 * Scheduler state, owned by core/thread.c. fpu_owner is the thread whose
+	 * FPU state is loaded in the registers, fpu_enabled mirrors !CR0.TS.
+	 * dead_thread exited on its way into the last switch, its stack is freed
+	 * by the thread switched to.
+	 */
+	struct Thread *current_thread;
+	struct Thread *idle_thread;
+	struct Thread *fpu_owner;
+	struct Thread *dead_thread;
+	bool fpu_enabled;
+
+	/**
+	 * Deferred work state, owned by core/softirq.c. softirq_pending is a
+	 * bitmask of SoftirqVector.
+	 */
+	volatile uint32_t softirq_pending;
+	bool softirq_active;
+	struct Thread *softirq_thread;
+
+	/**
+	 * Vector whose actions are running, owned by core/interrupts.c
+	 */
+	uint8_t irq_vector;
+
+	/**
+	 * Open irqs-off section, owned by the tracer in libk/irqsoff.h
+	 */
+	IrqsOffCpu irqsoff;
+
+	/**
+	 * Cross-CPU function call mailbox, owned by core/smp.c
+	 */
+	void (*volatile call_function)(void *argument);
+	void *call_argument;
+
+	/**
+	 * This CPU's GDT and TSS. The TSS stack for entries from ring 3 follows
+	 * kernel_stack_top.
+	 */
+	GdtCpu gdt;
+} Cpu;
+
+_Static_assert(
+	offsetof(Cpu, hal) == HAL_CPU_OFFSET, "HalCpu must be at HAL_CPU_OFFSET"
+);
+_Static_assert(
+	offsetof(Cpu, irq_stack_top) == CPU_IRQ_STACK_OFFSET,
+	"irq_stack_top must be at CPU_IRQ_STACK_OFFSET"
+);
+_Static_assert(
+	offsetof(Cpu, kernel_stack_top) == CPU_KERNEL_STACK_OFFSET &&
+		offsetof(Cpu, user_rsp) == CPU_USER_RSP_OFFSET,
+	"Syscall entry fields must be at CPU_KERNEL_STACK_OFFSET and after"
+);
+
+/**
+ * Returns the Cpu structure of the calling CPU
+ */
+static inline Cpu *this_cpu() {
+	Cpu *cpu;
+	asm volatile("movq %%gs:0, %0" : "=r"(cpu));
+	return cpu;
+}
+
+/**
+ * Returns the Cpu structure of the given CPU index
+ */
+Cpu *cpu_get(uint32_t id);
+
+/**
+ * Sets up the per-CPU area of the boot CPU, gives it its own GDT and TSS and
+ * points GS at it. Must run after gdt_initialize, whose GDT is the template.
+ */
+void percpu_initialize();
+
+/**
+ * Sets up the per-CPU area of an application processor, loads its own GDT
+ * and TSS and points its GS at it. The first thing an AP does.
+ *
+ * @param id Kernel CPU index (0 is the boot CPU)
+ */
+void percpu_initialize_ap(uint32_t id);
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Physically contiguous runs a PinList holds. Pinning stops early when a
+ * buffer needs more, callers pin the rest with another list.
+ */
+#define PIN_MAX_SEGMENTS 16
+
+/**
+ * Frames that can be pinned at once, across all lists
+ */
+#define PIN_TABLE_SIZE 4096
+
+/**
+ * Transfers up to this many bytes are copied through a kernel buffer, larger
+ * ones are pinned and handed to the device as a PinList. A placeholder that
+ * has not been measured, debug_bench_pin reports where pinning actually
+ * overtakes copying and this should be set from it.
+ */
+#define PIN_COPY_THRESHOLD 2048
+
+/**
+ * pin_user_pages flags: PIN_WRITE when the device writes to the buffer, as
+ * for a read, so every page must be writable from user space
+ */
+#define PIN_WRITE (1 << 0)
+
+/**
+ * A physically contiguous piece of a user buffer
+ */
+typedef struct {
+	uint64_t phys;
+	uint64_t length;
+} PinSegment;
+
+/**
+ * Scatter-gather list of a pinned user buffer, in buffer order
+ */
+typedef struct {
+	uint32_t count;
+	uint64_t length;
+	PinSegment segments[PIN_MAX_SEGMENTS];
+} PinList;
+
+/**
+ * Checks that a user buffer is mapped with the access flags need and pins
+ * its frames, so they stay put until pin_release. Pins from the start of the
+ * buffer until it ends or the segments run out.
+ *
+ * @param address Start of the buffer, in the lower half
+ * @param length Length of the buffer in bytes, not 0
+ * @param flags PIN_* flags
+ * @param list Receives the segments of the pinned part
+ * @return The number of bytes pinned, or a negative SystemCallError
+ */
+int64_t pin_user_pages(
+	uintptr_t address, size_t length, uint32_t flags, PinList *list
+);
+
+/**
+ * Unpins the frames of a list filled in by pin_user_pages
+ */
+void pin_release(PinList *list);
+
+/**
+ * Whether a frame is pinned. Whoever unmaps or frees user memory must leave
+ * pinned frames alone.
+ */
+bool pin_frame_pinned(uintptr_t phys);
+
+/**
+ * Copies from a user buffer through the direct map, after checking every page
+ * is mapped for user space
+ *
+ * @return false if part of the buffer is not user memory
+ */
+bool user_copy_from(void *destination, uintptr_t source, size_t length);
+
+/**
+ * Copies to a user buffer through the direct map, after checking every page
+ * is mapped writable for user space
+ *
+ * @return false if part of the buffer is not writable user memory
+ */
+bool user_copy_to(uintptr_t destination, const void *source, size_t length);
@@ -36,9 +36,10 @@ uintptr_t pmm_alloc(size_t size);
 
 /**
  * Free a previously allocated block of physical memory. We use a buddy
- * allocator to manage physical memory.
+ * allocator to manage physical memory. The allocator remembers the size of
+ * every block, so the block's contents do not matter.
  *
- * @param addr Address of the block to free
+ * @param addr Address returned by pmm_alloc
  */
 void pmm_free(uintptr_t addr);
 
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <kernel/percpu.h>
+
+/**
+ * Disables preemption on the calling CPU. Nests, and costs a single increment
+ * of the per-CPU count.
+ */
+static inline void preempt_disable() {
+	asm volatile("incl %%gs:%c0"
+				 :
+				 : "i"(offsetof(Cpu, preempt_count))
+				 : "memory");
+}
+
+/**
+ * Re-enables preemption after preempt_disable
+ */
+static inline void preempt_enable() {
+	asm volatile("decl %%gs:%c0"
+				 :
+				 : "i"(offsetof(Cpu, preempt_count))
+				 : "memory");
+}
+
+/**
+ * Returns true if the calling CPU may currently be preempted
+ */
+static inline bool preemptible() { return this_cpu()->preempt_count == 0; }
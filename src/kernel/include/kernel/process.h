@@ -5,10 +5,16 @@
 
 /**
  * Switches to usermode by setting up a new stack and jumping to the user
- * function in ring 3 using the sysretq instruction.
+ * function in ring 3 using the sysretq instruction. The calling thread's
+ * kernel stack takes the system calls and interrupts from then on.
+ *
+ * @param user_function Entry point, must be mapped with PAGE_USER
+ * @param user_stack Initial stack pointer, 16-byte aligned
+ * @param argument Passed to the user function in rdi
  *
  * NOTE: This function does not return.
  * NOTE: This function assumes that the MSRs and syscall instructions have been
  *       already set up by the system call initialization code.
  */
-void jump_to_usermode(void *user_function, void *user_stack);
+__attribute__((noreturn)) void
+jump_to_usermode(void *user_function, void *user_stack, void *argument);
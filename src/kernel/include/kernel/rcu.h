@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <kernel/preempt.h>
+
+/**
+ * Interval at which a CPU with pending callbacks drives grace periods
+ */
+#define RCU_POLL_NS 1000000ULL
+
+struct RcuHead;
+
+/**
+ * Called once all readers that could see the object have finished
+ */
+typedef void (*RcuCallback)(struct RcuHead *head);
+
+/**
+ * Embedded in objects that are reclaimed through call_rcu
+ */
+typedef struct RcuHead {
+	struct RcuHead *next;
+	RcuCallback callback;
+} RcuHead;
+
+/**
+ * Marks the start of a read-side critical section. Readers never block or
+ * spin, the section may not sleep and must be short.
+ */
+static inline void rcu_read_lock() { preempt_disable(); }
+
+/**
+ * Marks the end of a read-side critical section
+ */
+static inline void rcu_read_unlock() { preempt_enable(); }
+
+/**
+ * Loads an RCU-protected pointer inside a read-side critical section
+ */
+#define rcu_dereference(pointer) __atomic_load_n(&(pointer), __ATOMIC_CONSUME)
+
+/**
+ * Publishes a new version of an RCU-protected pointer. The object must be
+ * fully initialized before it is published.
+ */
+#define rcu_assign_pointer(pointer, value)                                     \
+	__atomic_store_n(&(pointer), (value), __ATOMIC_RELEASE)
+
+/**
+ * Runs a callback after a grace period, once every reader that was running
+ * when call_rcu was called has left its critical section. The callback runs
+ * on the calling CPU in softirq context.
+ *
+ * @param head Head embedded in the object to reclaim
+ * @param callback Function that frees the object
+ */
+void call_rcu(RcuHead *head, RcuCallback callback);
+
+/**
+ * Returns the block holding head to the physical memory manager after a grace
+ * period. head must live in the first page of a block from pmm_alloc.
+ *
+ * @param head Head embedded in the block
+ */
+void rcu_free_pages(RcuHead *head);
+
+/**
+ * Waits for a full grace period. Must not be called from a read-side critical
+ * section or with preemption disabled.
+ */
+void synchronize_rcu();
+
+/**
+ * Runs the callbacks of completed grace periods on the calling CPU and hands
+ * new ones to the next grace period (SOFTIRQ_RCU handler)
+ */
+void rcu_process_callbacks();
+
+/**
+ * Reports a quiescent state for the calling CPU if it was interrupted outside
+ * of any read-side critical section (called from the tick handler)
+ */
+void rcu_tick();
+
+/**
+ * Tells RCU that the calling CPU enters or leaves idle. Idle CPUs cannot be in
+ * a read-side critical section, so grace periods do not wait for them.
+ */
+void rcu_idle_enter();
+void rcu_idle_exit();
+
+/**
+ * Marks the calling CPU busy while it handles an interrupt that woke it from
+ * idle (called on interrupt entry)
+ *
+ * @return true if the CPU was idle, pass it on to rcu_irq_exit
+ */
+bool rcu_irq_enter();
+
+/**
+ * Returns the calling CPU to idle after an interrupt, if it was idle before
+ *
+ * @param from_idle Result of the matching rcu_irq_enter
+ */
+void rcu_irq_exit(bool from_idle);
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libk/spinlock.h>
+
+#include <kernel/pin.h>
+#include <kernel/syscall_abi.h>
+#include <kernel/thread.h>
+#include <kernel/time.h>
+
+/**
+ * How long the polling thread keeps polling an empty submission ring before
+ * it sleeps and sets RING_NEED_WAKEUP
+ */
+#define RING_POLL_IDLE_NS (2 * NS_PER_MS)
+
+/**
+ * Kernel side of a submission/completion ring pair. The memory is shared with
+ * user space, which may scribble over anything but its own indexes at any
+ * time, so sizes and the kernel's own indexes are kept here.
+ */
+typedef struct Ring {
+	RingHeader *header;
+	RingSubmission *submissions;
+	RingCompletion *completions;
+	uint32_t submission_mask;
+	uint32_t completion_mask;
+
+	/**
+	 * Where user space sees the memory at header, and its size
+	 */
+	uintptr_t user_address;
+	size_t size;
+
+	/**
+	 * Private copies of the indexes the kernel produces
+	 */
+	uint32_t submission_head;
+	uint32_t completion_tail;
+
+	/**
+	 * Set when a request of the current chain failed, the rest of the chain
+	 * is cancelled
+	 */
+	bool chain_failed;
+
+	RingBuffer buffers[RING_MAX_BUFFERS];
+	PinList pins[RING_MAX_BUFFERS];
+	uint32_t buffer_count;
+
+	/**
+	 * Thread draining the submissions with RING_SETUP_POLL, NULL otherwise
+	 */
+	Thread *poller;
+	volatile bool stopping;
+
+	/**
+	 * Set by the polling thread once it no longer touches the ring
+	 */
+	volatile bool poller_done;
+
+	/**
+	 * Thread waiting in ring_enter for wait_target completions
+	 */
+	TicketLock wait_lock;
+	Thread *waiter;
+	uint32_t wait_target;
+
+	/**
+	 * Asynchronous system calls that finished, oldest first. Whoever posts
+	 * completions moves them over: the polling thread, or the owner in
+	 * ring_enter.
+	 */
+	TicketLock async_lock;
+	struct AsyncCall *async_head;
+	struct AsyncCall *async_tail;
+
+	/**
+	 * Asynchronous system calls started on the ring that have not finished,
+	 * ring_release waits for them
+	 */
+	uint32_t async_inflight;
+} Ring;
+
+/**
+ * Maps a ring pair at a user address for the calling thread
+ *
+ * @param address Page-aligned address in the lower half
+ * @param entries Submission ring size, a power of two up to RING_MAX_ENTRIES
+ * @param flags RING_SETUP_* flags
+ * @return 0, or a negative SystemCallError
+ */
+int64_t ring_setup(void *address, uint32_t entries, uint32_t flags);
+
+/**
+ * Runs submissions of the calling thread's ring and waits for completions,
+ * including those of asynchronous system calls
+ *
+ * @return The number of submissions consumed, or a negative SystemCallError
+ */
+int64_t ring_enter(uint32_t to_submit, uint32_t min_complete, uint32_t flags);
+
+/**
+ * Registers buffers with the calling thread's ring, once. Every page of each
+ * buffer must be mapped writable, they are pinned until ring_release.
+ *
+ * @return 0, or a negative SystemCallError
+ */
+int64_t ring_register_buffers(const RingBuffer *buffers, uint32_t count);
+
+/**
+ * Queues the result of a finished asynchronous system call and wakes whoever
+ * posts it. Runs on the CPU of the ring's owner, from any context.
+ */
+void ring_complete_async(Ring *ring, struct AsyncCall *call);
+
+/**
+ * Cancels the asynchronous system calls of the calling thread's ring still
+ * in flight and stops its polling thread, if any. Waits for both before
+ * unpinning the registered buffers, then unmaps and frees the ring. Called
+ * when a thread with a ring leaves user space for good.
+ */
+void ring_release();
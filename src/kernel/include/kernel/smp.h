@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <limine/limine.h>
+
+#include <kernel/interrupts.h>
+
+/**
+ * Interrupt vector used to deliver cross-CPU function calls
+ */
+#define SMP_CALL_VECTOR 0xF1
+
+/**
+ * Interrupt vector used to make another CPU reschedule
+ */
+#define SMP_RESCHED_VECTOR 0xF2
+
+/**
+ * Function run on another CPU by smp_call. Runs in interrupt context with
+ * interrupts disabled.
+ */
+typedef void (*SmpCallFunction)(void *argument);
+
+/**
+ * Starts all application processors reported by the bootloader and waits until
+ * they are idle. The boot CPU must be fully initialized (GDT, IDT, per-CPU
+ * area, local APIC and timers).
+ *
+ * @param smp_response The Limine SMP response, may be NULL
+ */
+void smp_initialize(struct limine_smp_response *smp_response);
+
+/**
+ * Returns the number of CPUs that are online, CPU indexes are 0 to count - 1
+ */
+uint32_t smp_cpu_count();
+
+/**
+ * Runs a function on another CPU. Returns without waiting for it to finish,
+ * but waits for any earlier call on that CPU to complete first. Safe to call
+ * from several CPUs at once.
+ *
+ * Must be called with interrupts enabled: the target may itself be waiting
+ * in smp_call for this CPU's mailbox, which only drains through an IPI.
+ *
+ * @param cpu Index of the target CPU, must not be the calling CPU
+ * @param function Function to run
+ * @param argument Argument passed to the function
+ * @return false if the target CPU is not online
+ */
+bool smp_call(uint32_t cpu, SmpCallFunction function, void *argument);
+
+/**
+ * Waits until the last call sent to a CPU has completed
+ *
+ * @param cpu Index of the target CPU
+ */
+void smp_call_wait(uint32_t cpu);
+
+/**
+ * Cross-CPU call interrupt handler (registered on SMP_CALL_VECTOR)
+ */
+bool smp_call_handler(InterruptFrame *frame, void *context);
+
+/**
+ * Makes another CPU pick its next thread, e.g. after waking a thread on it.
+ * A CPU idling in MWAIT is woken through its doorbell instead of an IPI.
+ *
+ * @param cpu Index of the target CPU, must not be the calling CPU
+ * @return false if the target CPU is not online
+ */
+bool smp_resched(uint32_t cpu);
+
+/**
+ * Reschedule interrupt handler (registered on SMP_RESCHED_VECTOR)
+ */
+bool smp_resched_handler(InterruptFrame *frame, void *context);
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <kernel/time.h>
+
+/**
+ * Limits of a single softirq run on interrupt exit. Whatever is still pending
+ * afterwards is left to the CPU's softirq thread, so a flood of deferred work
+ * cannot starve threads.
+ */
+#define SOFTIRQ_MAX_RESTART 10
+#define SOFTIRQ_BUDGET_NS (2 * NS_PER_MS)
+
+/**
+ * Softirq vectors, lower vectors run first
+ */
+typedef enum {
+	/**
+	 * Tasklets scheduled with tasklet_hi_schedule
+	 */
+	SOFTIRQ_HI,
+	/**
+	 * RCU callbacks of completed grace periods
+	 */
+	SOFTIRQ_RCU,
+	/**
+	 * Tasklets scheduled with tasklet_schedule
+	 */
+	SOFTIRQ_TASKLET,
+	SOFTIRQ_COUNT,
+} SoftirqVector;
+
+/**
+ * Creates the softirq thread of the calling CPU. Runs once per CPU after
+ * thread_initialize.
+ */
+void softirq_initialize();
+
+/**
+ * Marks a softirq pending on the calling CPU. From interrupt handlers it runs
+ * on interrupt exit, otherwise the CPU's softirq thread is woken to run it
+ * (if interrupts are disabled, it runs on the next interrupt exit instead).
+ */
+void softirq_raise(SoftirqVector vector);
+
+/**
+ * Runs pending softirqs with interrupts enabled before returning from an
+ * interrupt (called at the end of isr_handler). Does nothing when the
+ * interrupt arrived while softirqs were already running.
+ */
+void softirq_irq_exit();
+
+/*
+ * ============================================================================
+ * Tasklets
+ * ============================================================================
+ */
+
+#define TASKLET_SCHEDULED (1 << 0)
+#define TASKLET_RUNNING (1 << 1)
+
+struct Tasklet;
+
+typedef void (*TaskletFunction)(struct Tasklet *tasklet);
+
+/**
+ * Deferred function run from softirq context on the CPU that scheduled it. A
+ * tasklet never runs on two CPUs at once, and scheduling it again before it
+ * ran only runs it once. Tasklets must not sleep.
+ */
+typedef struct Tasklet {
+	struct Tasklet *next;
+	TaskletFunction function;
+	void *data;
+	_Atomic uint32_t state;
+} Tasklet;
+
+/**
+ * Prepares a tasklet for use
+ *
+ * @param tasklet The tasklet
+ * @param function Function to run
+ * @param data Opaque pointer for the function
+ */
+void tasklet_init(Tasklet *tasklet, TaskletFunction function, void *data);
+
+/**
+ * Schedules a tasklet on the calling CPU
+ *
+ * @return false if it was already scheduled
+ */
+bool tasklet_schedule(Tasklet *tasklet);
+
+/**
+ * Schedules a tasklet ahead of the other softirqs, for latency-sensitive work
+ *
+ * @return false if it was already scheduled
+ */
+bool tasklet_hi_schedule(Tasklet *tasklet);
@@ -0,0 +1,485 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * System call ABI shared by the kernel and user space. Everything here is
+ * generated from kernel/syscalls.def, so it needs nothing but the compiler.
+ */
+
+/**
+ * System call error codes
+ */
+typedef enum {
+	/**
+	 * Not an error: an asynchronous call was accepted and completes later,
+	 * see SYSCALL_ASYNC
+	 */
+	SYSCALL_PENDING = 1,
+	SYSCALL_SUCCESS = 0,
+	SYSCALL_ERROR_INVALID_SYSCALL = -1,
+	SYSCALL_ERROR_INVALID_ARGS = -2,
+	SYSCALL_ERROR_PERMISSION_DENIED = -3,
+	SYSCALL_ERROR_NOT_IMPLEMENTED = -4,
+	SYSCALL_ERROR_WOULD_BLOCK = -5,
+	SYSCALL_ERROR_TIMED_OUT = -6,
+	SYSCALL_ERROR_CANCELED = -7,
+	SYSCALL_ERROR_NO_MEMORY = -8,
+} SystemCallError;
+
+/**
+ * Allows system calls to return a value and an error code simultaneously.
+ * Returned in rax and rdx.
+ */
+typedef struct {
+	int64_t value;
+	SystemCallError error;
+} SystemCallReturn;
+
+/**
+ * Syscall argument structure. System calls support up to 6 arguments according
+ * to the x86-64 calling convention.
+ */
+typedef struct {
+	uint64_t args[6];
+} SystemCallArgs;
+
+/*
+ * ============================================================================
+ * Asynchronous system calls
+ * ============================================================================
+ */
+
+/**
+ * Or'ed into the system call number to call asynchronously. A call that
+ * would block returns SYSCALL_PENDING with an id in value instead, and later
+ * completes in the calling thread's ring with RING_ASYNC_USER_DATA | id as
+ * user_data. Calls that never block, and every call of a thread without a
+ * ring, complete at once as usual.
+ */
+#define SYSCALL_ASYNC (1 << 16)
+
+/**
+ * Set in RingCompletion.user_data of asynchronous system call completions
+ */
+#define RING_ASYNC_USER_DATA (1ULL << 63)
+
+/*
+ * ============================================================================
+ * System call statistics
+ * ============================================================================
+ */
+
+/**
+ * Latency histogram buckets, bucket i counts calls of 2^i to 2^(i + 1) TSC
+ * cycles and the last one everything longer
+ */
+#define SYSCALL_HISTOGRAM_BUCKETS 32
+
+/**
+ * syscall_stats flags: clear the counters after reading them, and turn the
+ * per-CPU trace of system call entries and exits on or off
+ */
+#define SYSCALL_STATS_RESET (1 << 0)
+#define SYSCALL_STATS_TRACE_ON (1 << 1)
+#define SYSCALL_STATS_TRACE_OFF (1 << 2)
+
+/**
+ * Counters of one system call, summed over all CPUs. Calls that end the
+ * thread are not counted.
+ */
+typedef struct {
+	uint64_t count;
+	uint64_t errors;
+	uint64_t total_cycles;
+	uint64_t max_cycles;
+	uint32_t histogram[SYSCALL_HISTOGRAM_BUCKETS];
+} SystemCallStats;
+
+/*
+ * ============================================================================
+ * Submission rings
+ * ============================================================================
+ */
+
+/**
+ * Maximum submission ring size. The completion ring has twice as many
+ * entries, so it only fills up when completions are not being reaped.
+ */
+#define RING_MAX_ENTRIES 256
+
+/**
+ * Maximum number of buffers registered with a ring
+ */
+#define RING_MAX_BUFFERS 16
+
+/**
+ * ring_setup flags: RING_SETUP_POLL starts a kernel thread that drains the
+ * submission ring, so submitting needs no system call while it is awake
+ */
+#define RING_SETUP_POLL (1 << 0)
+
+/**
+ * ring_enter flags: RING_ENTER_GETEVENTS waits for min_complete completions,
+ * RING_ENTER_POLL_WAKEUP wakes a sleeping polling thread
+ */
+#define RING_ENTER_GETEVENTS (1 << 0)
+#define RING_ENTER_POLL_WAKEUP (1 << 1)
+
+/**
+ * RingHeader.flags: set while the polling thread sleeps, submitters must then
+ * call ring_enter with RING_ENTER_POLL_WAKEUP
+ */
+#define RING_NEED_WAKEUP (1 << 0)
+
+/**
+ * RingSubmission.flags. RING_SUBMIT_LINK chains the next entry to this one,
+ * it only runs if this one succeeds. RING_SUBMIT_FIXED_BUFFER takes address
+ * as an offset into the registered buffer at index buffer.
+ */
+#define RING_SUBMIT_LINK (1 << 0)
+#define RING_SUBMIT_FIXED_BUFFER (1 << 1)
+
+typedef enum {
+	RING_OP_NOP,
+	RING_OP_READ,
+	RING_OP_WRITE,
+	RING_OP_COUNT,
+} RingOpcode;
+
+/**
+ * One request in the submission ring, filled in by user space
+ */
+typedef struct {
+	uint8_t opcode;
+	uint8_t flags;
+	uint16_t buffer;
+	int32_t fd;
+	uint64_t address;
+	uint64_t length;
+
+	/**
+	 * Copied to the completion unchanged
+	 */
+	uint64_t user_data;
+} RingSubmission;
+
+/**
+ * Result of one request in the completion ring, filled in by the kernel
+ */
+typedef struct {
+	uint64_t user_data;
+	int64_t value;
+	SystemCallError error;
+	uint32_t reserved;
+} RingCompletion;
+
+/**
+ * A user buffer registered with ring_register_buffers. It is checked once at
+ * registration instead of on every request.
+ */
+typedef struct {
+	uint64_t address;
+	uint64_t length;
+} RingBuffer;
+
+/**
+ * Producer and consumer index of one ring, free-running and masked with the
+ * entry count. Each side only writes its own, on its own cache line.
+ */
+typedef struct {
+	volatile uint32_t tail __attribute__((aligned(64)));
+	volatile uint32_t head __attribute__((aligned(64)));
+} RingIndex;
+
+/**
+ * First page of the memory ring_setup maps. User space produces submissions
+ * and consumes completions, the kernel does the opposite. The entry arrays
+ * follow at the given byte offsets from the header.
+ */
+typedef struct {
+	RingIndex submission;
+	RingIndex completion;
+	uint32_t submission_entries;
+	uint32_t completion_entries;
+	uint32_t submission_offset;
+	uint32_t completion_offset;
+	volatile uint32_t flags;
+} RingHeader;
+
+/*
+ * ============================================================================
+ * Handles
+ * ============================================================================
+ */
+
+/**
+ * Kernel objects such as channels and endpoints are named by 32-bit handles.
+ * Closed handles are not reused right away, and 0 never names an object.
+ */
+#define HANDLE_INVALID 0
+
+/*
+ * ============================================================================
+ * Asynchronous IPC
+ * ============================================================================
+ */
+
+/**
+ * Maximum entries of each message queue of a channel
+ */
+#define AIPC_MAX_ENTRIES 1024
+
+/**
+ * Pages one aipc_give can hand over, and transfers a channel holds at once
+ * that were given but not yet taken
+ */
+#define AIPC_MAX_PAGES 16
+#define AIPC_MAX_TRANSFERS 32
+
+/**
+ * Bytes of payload carried in the message itself
+ */
+#define AIPC_INLINE_SIZE 40
+
+/**
+ * AipcQueue.flags: set by the receiver before it sleeps in aipc_wait, the
+ * sender then rings the doorbell with aipc_notify. Only set while the queue
+ * is empty, so the doorbell only rings for the message that makes it
+ * non-empty, once per batch.
+ */
+#define AIPC_WAITING (1 << 0)
+
+/**
+ * One message, a cache line. Large payloads travel as pages handed over with
+ * aipc_give, the message carries the transfer id.
+ */
+typedef struct {
+	uint64_t tag;
+	uint32_t length;
+	uint32_t page_count;
+	uint64_t transfer;
+	uint8_t data[AIPC_INLINE_SIZE];
+} AipcMessage;
+
+_Static_assert(sizeof(AipcMessage) == 64, "AipcMessage is a cache line");
+
+/**
+ * One direction of a channel. The sender produces at index.tail, the
+ * receiver consumes at index.head.
+ */
+typedef struct {
+	RingIndex index;
+	uint32_t entries;
+
+	/**
+	 * Byte offset of the AipcMessage array from the AipcHeader
+	 */
+	uint32_t offset;
+	volatile uint32_t flags;
+} AipcQueue;
+
+/**
+ * First page of the memory aipc_create maps. Endpoint e sends on queues[e]
+ * and receives on queues[1 - e], the message arrays follow.
+ */
+typedef struct {
+	AipcQueue queues[2];
+} AipcHeader;
+
+/*
+ * ============================================================================
+ * Synchronous IPC
+ * ============================================================================
+ */
+
+/**
+ * Words of a call or reply. They travel in registers: requests in rsi, rdx,
+ * r10 and r8 like the arguments they are, replies in rdi, rsi, r10 and r8
+ * since rdx returns the error (see user_ipc_call).
+ */
+#define IPC_MESSAGE_WORDS 4
+
+typedef struct {
+	uint64_t words[IPC_MESSAGE_WORDS];
+} IpcMessage;
+
+/*
+ * ============================================================================
+ * Kernel data page
+ * ============================================================================
+ */
+
+/**
+ * Where the kernel data page is mapped, read-only, for all of user space. The
+ * last page of the lower half.
+ */
+#define VDSO_DATA_ADDRESS 0x00007FFFFFFFF000ULL
+
+/**
+ * Bumped when the layout of VdsoData changes incompatibly
+ */
+#define VDSO_VERSION 1
+
+#define VDSO_MAX_CPUS 64
+
+/**
+ * VdsoData.features: how user space can find its CPU without a system call,
+ * and whether the TSC keeps its rate in deep C-states
+ */
+#define VDSO_FEATURE_RDTSCP (1 << 0)
+#define VDSO_FEATURE_RDPID (1 << 1)
+#define VDSO_FEATURE_TSC_INVARIANT (1 << 2)
+
+/**
+ * Clocks of clock_get
+ */
+typedef enum {
+	/**
+	 * Nanoseconds since boot, never goes backwards
+	 */
+	CLOCK_MONOTONIC,
+	CLOCK_COUNT,
+} ClockId;
+
+typedef struct {
+	uint32_t apic_id;
+	uint32_t online;
+} VdsoCpu;
+
+/**
+ * Contents of the kernel data page. sequence is odd while the kernel updates
+ * the page: readers take it before and after reading and retry if it was odd
+ * or changed.
+ */
+typedef struct {
+	volatile uint32_t sequence;
+	uint32_t version;
+	uint64_t tsc_hz;
+
+	/**
+	 * CLOCK_MONOTONIC = ((tsc - tsc_base) * ns_mult) >> ns_shift, with a
+	 * 128-bit product
+	 */
+	uint64_t tsc_base;
+	uint64_t ns_mult;
+	uint32_t ns_shift;
+
+	uint32_t features;
+	uint32_t cpu_count;
+	uint32_t reserved;
+	VdsoCpu cpus[VDSO_MAX_CPUS];
+} VdsoData;
+
+/**
+ * Human-readable system call names
+ */
+typedef enum {
+#define SYSCALL(number, name, NAME, ...) SYSCALL_##NAME = number,
+#include <kernel/syscalls.def>
+#undef SYSCALL
+} SystemCallNumber;
+
+/**
+ * Total number of system calls, one per entry of kernel/syscalls.def
+ */
+#define SYSCALL(number, name, NAME, ...) +1
+enum { SYSCALL_COUNT = 0
+#include <kernel/syscalls.def>
+};
+#undef SYSCALL
+
+// Numbers must be dense for the table, duplicates are caught by its
+// designated initializers
+#define SYSCALL(number, name, NAME, ...)                                       \
+	_Static_assert(number < SYSCALL_COUNT, "System call numbers are dense");
+#include <kernel/syscalls.def>
+#undef SYSCALL
+
+/*
+ * ============================================================================
+ * Argument lists
+ * ============================================================================
+ */
+
+/**
+ * Number of (kind, type, name) tuples in a system call specification
+ */
+#define SYSCALL_NARGS(...) SYSCALL_NARGS_(_, ##__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+#define SYSCALL_NARGS_(_, a, b, c, d, e, f, n, ...) n
+
+#define SYSCALL_CAT(a, b) SYSCALL_CAT_(a, b)
+#define SYSCALL_CAT_(a, b) a##b
+
+#define SYSCALL_ARG_KIND(arg) SYSCALL_ARG_KIND_ arg
+#define SYSCALL_ARG_KIND_(kind, type, name) kind
+#define SYSCALL_ARG_TYPE(arg) SYSCALL_ARG_TYPE_ arg
+#define SYSCALL_ARG_TYPE_(kind, type, name) type
+#define SYSCALL_ARG_NAME(arg) SYSCALL_ARG_NAME_ arg
+#define SYSCALL_ARG_NAME_(kind, type, name) name
+
+#define SYSCALL_COMMA() ,
+#define SYSCALL_NOTHING()
+
+/**
+ * Expands M(index, argument) for every argument, separated by sep()
+ */
+#define SYSCALL_MAP(M, sep, ...)                                               \
+	SYSCALL_CAT(SYSCALL_MAP_, SYSCALL_NARGS(__VA_ARGS__))(M, sep, ##__VA_ARGS__)
+#define SYSCALL_MAP_0(M, sep)
+#define SYSCALL_MAP_1(M, sep, a) M(0, a)
+#define SYSCALL_MAP_2(M, sep, a, b) SYSCALL_MAP_1(M, sep, a) sep() M(1, b)
+#define SYSCALL_MAP_3(M, sep, a, b, c)                                         \
+	SYSCALL_MAP_2(M, sep, a, b) sep() M(2, c)
+#define SYSCALL_MAP_4(M, sep, a, b, c, d)                                      \
+	SYSCALL_MAP_3(M, sep, a, b, c) sep() M(3, d)
+#define SYSCALL_MAP_5(M, sep, a, b, c, d, e)                                   \
+	SYSCALL_MAP_4(M, sep, a, b, c, d) sep() M(4, e)
+#define SYSCALL_MAP_6(M, sep, a, b, c, d, e, f)                                \
+	SYSCALL_MAP_5(M, sep, a, b, c, d, e) sep() M(5, f)
+
+/**
+ * Parameter list of a system call, as in its handler and user stub
+ */
+#define SYSCALL_PARAM(index, arg) SYSCALL_ARG_TYPE(arg) SYSCALL_ARG_NAME(arg)
+#define SYSCALL_PARAMS(...)                                                    \
+	SYSCALL_MAP(SYSCALL_PARAM, SYSCALL_COMMA, ##__VA_ARGS__)
+
+/*
+ * ============================================================================
+ * Argument validators
+ * ============================================================================
+ */
+
+/**
+ * Whether the raw register value is acceptable for an argument of the given
+ * kind and type. Only constants besides value, so each folds to a compare or
+ * nothing at all.
+ */
+#define SYSCALL_VALID(kind, type, value)                                       \
+	SYSCALL_CAT(syscall_valid_, kind)(value, sizeof(type))
+
+static inline bool syscall_valid_INT(uint64_t value, size_t size) {
+	if (size >= sizeof(uint64_t)) {
+		return true;
+	}
+	int64_t high = (int64_t)value >> (size * 8 - 1);
+	return high == 0 || high == -1;
+}
+
+static inline bool syscall_valid_UINT(uint64_t value, size_t size) {
+	return size >= sizeof(uint64_t) || value >> (size * 8) == 0;
+}
+
+static inline bool syscall_valid_PTR(uint64_t value, size_t size) {
+	(void)value;
+	(void)size;
+	return true;
+}
+
+static inline bool syscall_valid_SIZE(uint64_t value, size_t size) {
+	(void)size;
+	return value > 0;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <kernel/syscall_abi.h>
+
+/**
+ * Records kept per CPU in the trace ring, a power of two. The ring is a
+ * flight recorder: once full, new records overwrite the oldest.
+ */
+#define SYSCALL_TRACE_ENTRIES 1024
+
+typedef enum {
+	SYSCALL_TRACE_ENTER,
+	SYSCALL_TRACE_EXIT,
+} SystemCallTraceType;
+
+/**
+ * One binary trace record, little endian. Entries carry the first two
+ * arguments, exits the value and error returned. apps/ktracer decodes them
+ * from the debug_dump_syscalls output.
+ */
+typedef struct {
+	uint64_t tsc;
+	uint32_t thread;
+	uint16_t number;
+	uint8_t type;
+	uint8_t reserved;
+	uint64_t data[2];
+} SystemCallTraceRecord;
+
+_Static_assert(
+	sizeof(SystemCallTraceRecord) == 32, "The trace format is fixed"
+);
+
+/**
+ * Accounts one completed system call on the calling CPU. Interrupt-safe
+ * without atomics, the counters are per CPU.
+ *
+ * @param number A valid system call number
+ * @param cycles TSC cycles spent in the handler
+ * @param error What the handler returned
+ */
+void syscall_stats_account(
+	SystemCallNumber number, uint64_t cycles, SystemCallError error
+);
+
+/**
+ * Sums the counters of every CPU into a kernel buffer
+ *
+ * @param stats Receives the counters of system calls first to
+ *              first + count - 1
+ */
+void syscall_stats_collect(
+	SystemCallStats *stats, uint32_t first, uint32_t count
+);
+
+/**
+ * Clears the counters of every CPU. Calls in flight on other CPUs may land
+ * on either side.
+ */
+void syscall_stats_reset();
+
+/**
+ * Whether system call entries and exits are traced, checked on every call
+ */
+extern volatile bool syscall_trace_enabled;
+
+/**
+ * Turns the trace on or off. The per-CPU rings are allocated the first time
+ * it is turned on.
+ *
+ * @return false if the rings could not be allocated
+ */
+bool syscall_trace_set(bool enabled);
+
+/**
+ * Appends a record to the calling CPU's trace ring
+ */
+void syscall_trace_record(
+	SystemCallTraceType type,
+	SystemCallNumber number,
+	uint64_t first,
+	uint64_t second
+);
+
+/**
+ * Returns the trace ring of a CPU and the number of records ever written to
+ * it, or NULL if the trace was never turned on. Record i lives at index
+ * i % SYSCALL_TRACE_ENTRIES.
+ */
+const SystemCallTraceRecord *syscall_trace_ring(uint32_t cpu, uint64_t *head);
@@ -0,0 +1,444 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <kernel/syscall_abi.h>
+
+/*
+ * User space system call stubs, one sys_<name> per entry of
+ * kernel/syscalls.def. Freestanding and header-only, for code running in
+ * ring 3.
+ */
+
+/**
+ * Issues a system call. The kernel restores every argument register but rdx,
+ * which returns the error.
+ */
+static inline SystemCallReturn syscall_invoke(
+	SystemCallNumber number, const SystemCallArgs *args
+) {
+	register uint64_t r10 asm("r10") = args->args[3];
+	register uint64_t r8 asm("r8") = args->args[4];
+	register uint64_t r9 asm("r9") = args->args[5];
+	uint64_t rax = number;
+	uint64_t rdx = args->args[2];
+
+	asm volatile("syscall"
+				 : "+a"(rax), "+d"(rdx)
+				 : "D"(args->args[0]),
+				   "S"(args->args[1]),
+				   "r"(r10),
+				   "r"(r8),
+				   "r"(r9)
+				 : "rcx", "r11", "memory");
+
+	return (SystemCallReturn){
+		.value = (int64_t)rax,
+		.error = (SystemCallError)(int32_t)rdx,
+	};
+}
+
+#define SYSCALL_STUB_ARG(index, arg)                                           \
+	args.args[index] = (uint64_t)(SYSCALL_ARG_NAME(arg));
+
+#define SYSCALL(number, name, NAME, ...)                                       \
+	static inline SystemCallReturn sys_##name(SYSCALL_PARAMS(__VA_ARGS__)) {   \
+		SystemCallArgs args = {0};                                             \
+		SYSCALL_MAP(SYSCALL_STUB_ARG, SYSCALL_NOTHING, ##__VA_ARGS__)          \
+		return syscall_invoke(SYSCALL_##NAME, &args);                          \
+	}
+#include <kernel/syscalls.def>
+#undef SYSCALL
+
+/**
+ * Issues a system call asynchronously (see SYSCALL_ASYNC). On SYSCALL_PENDING
+ * the result comes later in the thread's ring, reap it with user_ring_submit.
+ */
+static inline SystemCallReturn syscall_invoke_async(
+	SystemCallNumber number, const SystemCallArgs *args
+) {
+	return syscall_invoke((SystemCallNumber)(number | SYSCALL_ASYNC), args);
+}
+
+/*
+ * ============================================================================
+ * Kernel data page
+ * ============================================================================
+ */
+
+static inline const VdsoData *user_vdso_data() {
+	return (const VdsoData *)VDSO_DATA_ADDRESS;
+}
+
+/**
+ * Reads a clock from the kernel data page, without entering the kernel
+ *
+ * @param clock A ClockId
+ * @param ns Receives the clock in nanoseconds
+ */
+static inline SystemCallError user_clock_get(ClockId clock, uint64_t *ns) {
+	if (clock != CLOCK_MONOTONIC) {
+		return SYSCALL_ERROR_INVALID_ARGS;
+	}
+
+	const VdsoData *data = user_vdso_data();
+	uint64_t tsc_base, ns_mult, tsc;
+	uint32_t ns_shift;
+
+	for (;;) {
+		uint32_t sequence = __atomic_load_n(&data->sequence, __ATOMIC_ACQUIRE);
+		if (sequence & 1) {
+			asm volatile("pause");
+			continue;
+		}
+
+		tsc_base = data->tsc_base;
+		ns_mult = data->ns_mult;
+		ns_shift = data->ns_shift;
+
+		// lfence keeps rdtsc from running ahead of the loads above
+		uint32_t low, high;
+		asm volatile("lfence\n"
+					 "rdtsc"
+					 : "=a"(low), "=d"(high)
+					 :
+					 : "memory");
+		tsc = ((uint64_t)high << 32) | low;
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&data->sequence, __ATOMIC_RELAXED) == sequence) {
+			break;
+		}
+	}
+
+	*ns = (uint64_t)(((unsigned __int128)(tsc - tsc_base) * ns_mult) >>
+					 ns_shift);
+	return SYSCALL_SUCCESS;
+}
+
+/**
+ * Returns the number of the CPU the caller runs on. Only a hint, the thread
+ * may be moved right after.
+ */
+static inline uint32_t user_getcpu() {
+	uint32_t features = user_vdso_data()->features;
+	uint64_t aux;
+
+	if (features & VDSO_FEATURE_RDPID) {
+		asm volatile("rdpid %0" : "=r"(aux));
+		return (uint32_t)aux;
+	}
+	if (features & VDSO_FEATURE_RDTSCP) {
+		uint32_t low, high, cpu;
+		asm volatile("rdtscp" : "=a"(low), "=d"(high), "=c"(cpu));
+		return cpu;
+	}
+	return (uint32_t)sys_getcpu().value;
+}
+
+/*
+ * ============================================================================
+ * Submission rings
+ * ============================================================================
+ */
+
+/**
+ * User view of a ring pair mapped by sys_ring_setup
+ */
+typedef struct {
+	RingHeader *header;
+	RingSubmission *submissions;
+	RingCompletion *completions;
+	uint32_t submission_mask;
+	uint32_t completion_mask;
+
+	/**
+	 * Submissions filled in but not yet published
+	 */
+	uint32_t submission_tail;
+	bool poll;
+} UserRing;
+
+/**
+ * Sets up a ring pair at address, see sys_ring_setup
+ */
+static inline SystemCallError user_ring_setup(
+	UserRing *ring, void *address, uint32_t entries, uint32_t flags
+) {
+	SystemCallReturn result = sys_ring_setup(address, entries, flags);
+	if (result.error != SYSCALL_SUCCESS) {
+		return result.error;
+	}
+
+	RingHeader *header = (RingHeader *)address;
+	ring->header = header;
+	ring->submissions =
+		(RingSubmission *)((uintptr_t)header + header->submission_offset);
+	ring->completions =
+		(RingCompletion *)((uintptr_t)header + header->completion_offset);
+	ring->submission_mask = header->submission_entries - 1;
+	ring->completion_mask = header->completion_entries - 1;
+	ring->submission_tail = header->submission.tail;
+	ring->poll = (flags & RING_SETUP_POLL) != 0;
+	return SYSCALL_SUCCESS;
+}
+
+/**
+ * Returns the next free submission entry, or NULL if the ring is full
+ */
+static inline RingSubmission *user_ring_get_submission(UserRing *ring) {
+	uint32_t head =
+		__atomic_load_n(&ring->header->submission.head, __ATOMIC_ACQUIRE);
+	if (ring->submission_tail - head > ring->submission_mask) {
+		return NULL;
+	}
+	return &ring->submissions[ring->submission_tail++ & ring->submission_mask];
+}
+
+/**
+ * Publishes the filled-in submissions. Enters the kernel only without a
+ * polling thread, or when it sleeps, or to wait for wait_for completions.
+ *
+ * @return The result of ring_enter, or 0 if it was not needed
+ */
+static inline SystemCallReturn user_ring_submit(
+	UserRing *ring, uint32_t wait_for
+) {
+	uint32_t tail = ring->header->submission.tail;
+	uint32_t count = ring->submission_tail - tail;
+	__atomic_store_n(
+		&ring->header->submission.tail, ring->submission_tail, __ATOMIC_SEQ_CST
+	);
+
+	uint32_t flags = wait_for != 0 ? RING_ENTER_GETEVENTS : 0;
+	if (ring->poll) {
+		// Pairs with the polling thread setting the flag before it sleeps
+		if (__atomic_load_n(&ring->header->flags, __ATOMIC_SEQ_CST) &
+			RING_NEED_WAKEUP) {
+			flags |= RING_ENTER_POLL_WAKEUP;
+		}
+		if (flags == 0) {
+			return (SystemCallReturn){.value = 0, .error = SYSCALL_SUCCESS};
+		}
+	}
+	return sys_ring_enter(count, wait_for, flags);
+}
+
+/**
+ * Returns the oldest completion not yet consumed, or NULL if there is none
+ */
+static inline RingCompletion *user_ring_peek_completion(UserRing *ring) {
+	uint32_t head = ring->header->completion.head;
+	uint32_t tail =
+		__atomic_load_n(&ring->header->completion.tail, __ATOMIC_ACQUIRE);
+	if (head == tail) {
+		return NULL;
+	}
+	return &ring->completions[head & ring->completion_mask];
+}
+
+/**
+ * Hands the completions returned by user_ring_peek_completion back to the
+ * kernel
+ */
+static inline void user_ring_advance(UserRing *ring, uint32_t count) {
+	__atomic_store_n(
+		&ring->header->completion.head,
+		ring->header->completion.head + count,
+		__ATOMIC_RELEASE
+	);
+}
+
+/*
+ * ============================================================================
+ * Asynchronous IPC
+ * ============================================================================
+ */
+
+/**
+ * One endpoint's view of a channel mapped by sys_aipc_create
+ */
+typedef struct {
+	AipcQueue *send_queue;
+	AipcQueue *receive_queue;
+	AipcMessage *send;
+	AipcMessage *receive;
+	uint32_t send_mask;
+	uint32_t receive_mask;
+
+	/**
+	 * Messages filled in but not yet published
+	 */
+	uint32_t send_tail;
+	uint32_t channel;
+	uint32_t endpoint;
+} UserAipc;
+
+/**
+ * Attaches to a channel someone created at address, as endpoint 0 or 1
+ */
+static inline void user_aipc_attach(
+	UserAipc *aipc, void *address, uint32_t channel, uint32_t endpoint
+) {
+	AipcHeader *header = (AipcHeader *)address;
+	AipcQueue *send = &header->queues[endpoint];
+	AipcQueue *receive = &header->queues[1 - endpoint];
+
+	aipc->send_queue = send;
+	aipc->receive_queue = receive;
+	aipc->send = (AipcMessage *)((uintptr_t)header + send->offset);
+	aipc->receive = (AipcMessage *)((uintptr_t)header + receive->offset);
+	aipc->send_mask = send->entries - 1;
+	aipc->receive_mask = receive->entries - 1;
+	aipc->send_tail = send->index.tail;
+	aipc->channel = channel;
+	aipc->endpoint = endpoint;
+}
+
+/**
+ * Creates a channel at address and attaches to it as endpoint 0. The peer
+ * attaches as endpoint 1 with the channel handle in aipc->channel.
+ */
+static inline SystemCallError user_aipc_create(
+	UserAipc *aipc, void *address, uint32_t entries
+) {
+	SystemCallReturn result = sys_aipc_create(address, entries);
+	if (result.error != SYSCALL_SUCCESS) {
+		return result.error;
+	}
+	user_aipc_attach(aipc, address, (uint32_t)result.value, 0);
+	return SYSCALL_SUCCESS;
+}
+
+/**
+ * Returns the next free message slot, or NULL if the peer has not caught up
+ */
+static inline AipcMessage *user_aipc_get_message(UserAipc *aipc) {
+	uint32_t head =
+		__atomic_load_n(&aipc->send_queue->index.head, __ATOMIC_ACQUIRE);
+	if (aipc->send_tail - head > aipc->send_mask) {
+		return NULL;
+	}
+	return &aipc->send[aipc->send_tail++ & aipc->send_mask];
+}
+
+/**
+ * Publishes the filled-in messages as one batch. Enters the kernel only if
+ * the peer sleeps, which it only does with its queue empty.
+ *
+ * @return Whether the doorbell was rung
+ */
+static inline bool user_aipc_send(UserAipc *aipc) {
+	// Pairs with aipc_wait setting the flag before it checks the tail
+	__atomic_store_n(
+		&aipc->send_queue->index.tail, aipc->send_tail, __ATOMIC_SEQ_CST
+	);
+	if (!(__atomic_load_n(&aipc->send_queue->flags, __ATOMIC_SEQ_CST) &
+		  AIPC_WAITING)) {
+		return false;
+	}
+	sys_aipc_notify(aipc->channel, aipc->endpoint);
+	return true;
+}
+
+/**
+ * Returns the oldest message not yet consumed, or NULL if there is none
+ */
+static inline AipcMessage *user_aipc_peek(UserAipc *aipc) {
+	uint32_t head = aipc->receive_queue->index.head;
+	uint32_t tail =
+		__atomic_load_n(&aipc->receive_queue->index.tail, __ATOMIC_ACQUIRE);
+	if (head == tail) {
+		return NULL;
+	}
+	return &aipc->receive[head & aipc->receive_mask];
+}
+
+/**
+ * Hands the messages returned by user_aipc_peek back to the sender
+ */
+static inline void user_aipc_advance(UserAipc *aipc, uint32_t count) {
+	__atomic_store_n(
+		&aipc->receive_queue->index.head,
+		aipc->receive_queue->index.head + count,
+		__ATOMIC_RELEASE
+	);
+}
+
+/**
+ * Returns the oldest message, sleeping until one arrives if the queue is
+ * empty. Drain everything peek returns before calling it again, so the
+ * sender batches while this endpoint is busy.
+ */
+static inline AipcMessage *user_aipc_receive(UserAipc *aipc) {
+	AipcMessage *message = user_aipc_peek(aipc);
+	while (message == NULL) {
+		SystemCallReturn result = sys_aipc_wait(aipc->channel, aipc->endpoint);
+		if (result.error != SYSCALL_SUCCESS) {
+			return NULL;
+		}
+		message = user_aipc_peek(aipc);
+	}
+	return message;
+}
+
+/*
+ * ============================================================================
+ * Synchronous IPC
+ * ============================================================================
+ */
+
+/**
+ * Issues ipc_call or ipc_reply_wait with message in the argument registers
+ * and takes the words the kernel leaves in rdi, rsi, r10 and r8
+ */
+static inline SystemCallError user_ipc_invoke(
+	SystemCallNumber number, uint32_t endpoint, IpcMessage *message
+) {
+	register uint64_t r10 asm("r10") = message->words[2];
+	register uint64_t r8 asm("r8") = message->words[3];
+	uint64_t rax = number;
+	uint64_t rdi = endpoint;
+	uint64_t rsi = message->words[0];
+	uint64_t rdx = message->words[1];
+
+	asm volatile("syscall"
+				 : "+a"(rax), "+D"(rdi), "+S"(rsi), "+d"(rdx), "+r"(r10),
+				   "+r"(r8)
+				 :
+				 : "rcx", "r11", "memory");
+
+	SystemCallError error = (SystemCallError)(int32_t)rdx;
+	if (error == SYSCALL_SUCCESS) {
+		message->words[0] = rdi;
+		message->words[1] = rsi;
+		message->words[2] = r10;
+		message->words[3] = r8;
+	}
+	return error;
+}
+
+/**
+ * Calls the server of an endpoint and waits for its reply
+ *
+ * @param message The request, replaced by the reply
+ */
+static inline SystemCallError user_ipc_call(
+	uint32_t endpoint, IpcMessage *message
+) {
+	return user_ipc_invoke(SYSCALL_IPC_CALL, endpoint, message);
+}
+
+/**
+ * Replies to the last call received, if any, and waits for the next one on
+ * an endpoint. Start a server loop with a first call that has no reply.
+ *
+ * @param message The reply, replaced by the next request
+ */
+static inline SystemCallError user_ipc_reply_wait(
+	uint32_t endpoint, IpcMessage *message
+) {
+	return user_ipc_invoke(SYSCALL_IPC_REPLY_WAIT, endpoint, message);
+}
@@ -1,62 +1,14 @@
 #pragma once
 
-#include <stdarg.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
-/**
- * Total number of system calls. Increment each time a new system call is added.
- */
-#define SYSCALL_COUNT 2
-
-/**
- * Human-readable system call names
- */
-typedef enum {
-	SYSCALL_READ = 0,
-	SYSCALL_WRITE = 1,
-} SystemCallNumber;
+#include <kernel/syscall_abi.h>
 
 /**
- * System call error codes
- */
-typedef enum {
-	SYSCALL_SUCCESS = 0,
-	SYSCALL_ERROR_INVALID_SYSCALL = -1,
-	SYSCALL_ERROR_INVALID_ARGS = -2,
-	SYSCALL_ERROR_PERMISSION_DENIED = -3,
-	SYSCALL_ERROR_NOT_IMPLEMENTED = -4,
-} SystemCallError;
-
-/**
- * Syscall argument structure. System calls support up to 6 arguments according
- * to the x86-64 calling convention.
- */
-typedef struct {
-	uint64_t args[6];
-} SystemCallArgs;
-
-/**
- * Possible system call argument types
- */
-typedef enum {
-	ARG_INT,
-	ARG_UINT,
-	ARG_PTR,
-	ARG_SIZE,
-} SystemCallArgType;
-
-/**
- * Allows system calls to return a value and an error code simultaneously.
- */
-typedef struct {
-	int64_t value;
-	SystemCallError error;
-} SystemCallReturn;
-
-/**
- * System call handler function pointer type
+ * Table entry point of a system call. Generated from kernel/syscalls.def, it
+ * validates and unpacks the raw arguments for the typed handler.
  *
  * @param args The arguments passed to the system call
  * @return The return value of the system call
@@ -73,17 +25,8 @@ typedef struct {
 } SystemCallEntry;
 
 /**
- * Helper function used during debug logging to format system call arguments
- */
-char *format_syscall_args(const SystemCallArgs *args, int num_args);
-
-/**
- * Validates the types of arguments passed to a system call
- */
-bool syscall_validate_args(const SystemCallArgs *args, int num_args, ...);
-
-/**
- * Dispatches a system call to the appropriate handler
+ * Dispatches a system call to the appropriate handler and accounts it in the
+ * per-CPU statistics (see kernel/syscall_stats.h)
  *
  * @param syscall_number The system call number
  * @param args The arguments passed to the system call
@@ -93,21 +36,51 @@ __attribute__((hot)) SystemCallReturn
 syscall_handler(SystemCallNumber syscall_number, SystemCallArgs *args);
 
 /**
- * Assembly function that calls the syscall_handler function once the syscall
- * instruction is called
+ * Registers saved by syscall_entry on the calling thread's kernel stack. The
+ * arguments come first so they double as the SystemCallArgs.
+ */
+typedef struct {
+	SystemCallArgs args; // rdi, rsi, rdx, r10, r8, r9
+	uint64_t number;	 // rax
+	uint64_t rip;		 // rcx
+	uint64_t rflags;	 // r11
+	uint64_t rsp;
+} SystemCallFrame;
+
+_Static_assert(
+	offsetof(SystemCallFrame, rip) == 56 &&
+		offsetof(SystemCallFrame, rflags) == 64,
+	"SystemCallFrame must match core/syscalls.asm"
+);
+
+/**
+ * Entry point of the syscall instruction (see core/syscalls.asm). Switches
+ * to the thread's kernel stack, calls syscall_dispatch with interrupts
+ * enabled and returns with sysretq. The result comes back in rax (value) and
+ * rdx (error).
+ */
+void syscall_entry();
+
+/**
+ * Called by syscall_entry with the saved user registers
+ */
+SystemCallReturn syscall_dispatch(SystemCallFrame *frame);
+
+/**
+ * Called by syscall_entry instead of returning to a rip sysretq cannot take
+ * (non-canonical or in the kernel half). Ends the calling thread.
  */
-__attribute__((naked)) void syscall_entry();
+__attribute__((noreturn)) void syscall_bad_return(SystemCallFrame *frame);
 
 /**
- * Initializes the MSRs and the syscall instruction
+ * Initializes the MSRs and the syscall instruction on the boot CPU
  */
 void syscalls_initialize();
 
 /**
- * Macro for defining a system call handler
+ * Programs the syscall MSRs of an application processor
  */
-#define DEFINE_SYSCALL(name, num_args, ...)                                    \
-	SystemCallReturn syscall_##name(SystemCallArgs *args)
+void syscalls_initialize_ap();
 
 /*
  * ============================================================================
@@ -116,21 +89,10 @@ void syscalls_initialize();
  */
 
 /**
- * Reads data from a file descriptor
- *
- * @param fd The file descriptor to read from
- * @param buf The buffer to read into
- * @param count The number of bytes to read
- * @return The number of bytes read, or -1 on error
- */
-DEFINE_SYSCALL(read, 3, ARG_INT, ARG_PTR, ARG_SIZE);
-
-/**
- * Writes data from to file descriptor
- *
- * @param fd The file descriptor to write to
- * @param buf The buffer to write from
- * @param count The number of bytes to write
- * @return The number of bytes written, or -1 on error
+ * Typed handlers, SystemCallReturn syscall_<name>(arguments) for every entry
+ * of kernel/syscalls.def, where each one is documented
  */
-DEFINE_SYSCALL(write, 3, ARG_INT, ARG_PTR, ARG_SIZE);
+#define SYSCALL(number, name, NAME, ...)                                       \
+	SystemCallReturn syscall_##name(SYSCALL_PARAMS(__VA_ARGS__));
+#include <kernel/syscalls.def>
+#undef SYSCALL
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <kernel/interrupts.h>
+#include <kernel/syscall_abi.h>
+
+/**
+ * Size of a kernel thread stack
+ */
+#define THREAD_STACK_SIZE 16384
+
+/**
+ * Registers saved by context_switch, lowest address first. Callee-saved
+ * registers only, in the same relative order as InterruptFrame.
+ */
+typedef struct {
+	uint64_t r15;
+	uint64_t r14;
+	uint64_t r13;
+	uint64_t r12;
+	uint64_t rbp;
+	uint64_t rbx;
+	uint64_t rip;
+} SwitchFrame;
+
+typedef enum {
+	/**
+	 * Queued on its CPU's run queue
+	 */
+	THREAD_RUNNABLE,
+	THREAD_RUNNING,
+	/**
+	 * Waiting for thread_wake. A thread marks itself blocked while still
+	 * running, then calls thread_block.
+	 */
+	THREAD_BLOCKED,
+	THREAD_DEAD,
+} ThreadState;
+
+/**
+ * Scheduling priorities, lower values run first. A runnable thread always
+ * runs before those of lower priority, threads of one priority share the CPU
+ * round-robin.
+ */
+typedef enum {
+	/**
+	 * Latency-sensitive work such as threaded interrupt handlers
+	 */
+	THREAD_PRIORITY_HIGH,
+	THREAD_PRIORITY_NORMAL,
+	THREAD_PRIORITY_LOW,
+	THREAD_PRIORITY_COUNT,
+} ThreadPriority;
+
+typedef void (*ThreadEntry)(void *argument);
+
+/**
+ * A kernel thread. Threads stay on the CPU they were created on.
+ */
+typedef struct Thread {
+	/**
+	 * Saved stack pointer while switched out, must stay the first member
+	 */
+	SwitchFrame *context;
+
+	uint32_t id;
+	uint32_t cpu;
+	volatile ThreadState state;
+	ThreadPriority priority;
+	const char *name;
+
+	ThreadEntry entry;
+	void *argument;
+	uintptr_t stack;
+
+	/**
+	 * FPU/SIMD state, saved lazily (see core/thread.c). fpu_cpu is the CPU
+	 * whose registers last had this state loaded.
+	 */
+	void *fpu_state;
+	uint32_t fpu_cpu;
+
+	/**
+	 * Submission/completion rings set up from user space (see kernel/ring.h)
+	 */
+	struct Ring *ring;
+
+	/**
+	 * Id of the asynchronous system call being dispatched, 0 outside of one,
+	 * and the last id handed out (see kernel/async.h)
+	 */
+	uint64_t async_id;
+	uint64_t async_last_id;
+
+	/**
+	 * Synchronous IPC (see kernel/ipc.h), guarded by the endpoint's lock: the
+	 * message on its way in or out, the endpoint called, the caller a server
+	 * owes a reply, the link in an endpoint's queue of callers and the
+	 * status of a call, SYSCALL_PENDING until the reply arrives
+	 */
+	IpcMessage ipc_message;
+	struct IpcEndpoint *ipc_endpoint;
+	struct Thread *ipc_caller;
+	struct Thread *ipc_next;
+	SystemCallError ipc_status;
+
+	/**
+	 * Run queue link
+	 */
+	struct Thread *next;
+} Thread;
+
+/**
+ * Turns the boot context of the calling CPU into its idle thread and sets up
+ * lazy FPU switching. Runs once per CPU after the per-CPU area, the FPU and
+ * the physical memory manager are ready.
+ */
+void thread_initialize();
+
+/**
+ * Creates a kernel thread on the calling CPU with THREAD_PRIORITY_NORMAL. The
+ * thread does not run until thread_start is called.
+ *
+ * @param name Name for debugging, not copied
+ * @param entry Function the thread runs, returning from it exits the thread
+ * @param argument Passed to entry
+ * @return The thread, or NULL if out of memory
+ */
+Thread *thread_create(const char *name, ThreadEntry entry, void *argument);
+
+/**
+ * Makes a new thread runnable
+ */
+void thread_start(Thread *thread);
+
+/**
+ * Changes the priority of a thread that is not on a run queue: the current
+ * thread, a blocked one or one that has not been started
+ */
+void thread_set_priority(Thread *thread, ThreadPriority priority);
+
+/**
+ * Returns the thread running on the calling CPU
+ */
+Thread *thread_current();
+
+/**
+ * Gives up the CPU to the next runnable thread, if any
+ */
+void thread_yield();
+
+/**
+ * Switches away from the current thread after it set its state to
+ * THREAD_BLOCKED. Returns at once if it was woken in between.
+ */
+void thread_block();
+
+/**
+ * Makes a blocked thread runnable again. Safe from interrupt handlers and
+ * other CPUs.
+ *
+ * @return false if the thread was not blocked
+ */
+bool thread_wake(Thread *thread);
+
+/**
+ * Wakes a blocked thread and, if it lives on the calling CPU, switches to it
+ * right away without going through the run queue. It runs on the rest of the
+ * current timeslice, ahead of queued threads whatever their priority, and a
+ * pending need_resched is left for the next preemption point. The current
+ * thread blocks as in thread_block if it set THREAD_BLOCKED, otherwise it is
+ * queued as in thread_yield.
+ *
+ * A thread on another CPU, or one that was not blocked, is only woken and the
+ * current thread goes through schedule.
+ */
+void thread_handoff(Thread *next);
+
+/**
+ * Ends the current thread
+ */
+__attribute__((noreturn)) void thread_exit();
+
+/**
+ * Picks the next thread to run on the calling CPU and switches to it. Must be
+ * called with interrupts disabled.
+ */
+void schedule();
+
+/**
+ * Preempts the current thread on the way out of an interrupt if its timeslice
+ * is used up (called at the end of isr_handler)
+ */
+void thread_preempt();
+
+/**
+ * Device-not-available exception handler. Loads the current thread's FPU
+ * state on its first FPU/SIMD instruction after a switch (registered on
+ * vector 7).
+ */
+bool thread_fpu_trap(InterruptFrame *frame, void *context);
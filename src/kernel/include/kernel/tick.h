@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <kernel/interrupts.h>
+
+/**
+ * Length of a scheduler timeslice in microseconds
+ */
+#define TICK_TIMESLICE_US 10000
+
+/**
+ * How the local APIC timer is being driven
+ */
+typedef enum {
+	/**
+	 * Every event is programmed as an absolute TSC deadline
+	 */
+	TICK_MODE_TSC_DEADLINE,
+	/**
+	 * Busy CPUs get a periodic tick every timeslice, idle CPUs are armed in
+	 * one-shot mode for their next deadline only
+	 */
+	TICK_MODE_PERIODIC,
+} TickMode;
+
+/**
+ * Calibrates the local APIC timer against the TSC and starts the preemption
+ * timer on the calling CPU. The local APIC and the clocksource (see
+ * time_initialize) must be running.
+ */
+void tick_initialize();
+
+/**
+ * Starts the preemption timer on an application processor, reusing the
+ * calibration done by tick_initialize on the boot CPU
+ */
+void tick_initialize_ap();
+
+/**
+ * Returns the mode the timer is running in
+ */
+TickMode tick_get_mode();
+
+/**
+ * Requests a timer interrupt at the given TSC value on the calling CPU. This
+ * replaces any previously requested event, pass 0 to cancel it. In periodic
+ * mode a busy CPU only notices the event on its next periodic tick.
+ *
+ * @param deadline Absolute TSC value of the next event
+ */
+void tick_set_event(uint64_t deadline);
+
+/**
+ * Timer interrupt handler (registered on LAPIC_TIMER_VECTOR)
+ */
+bool tick_handler(InterruptFrame *frame, void *context);
+
+/**
+ * Stops the periodic/timeslice tick before the CPU goes idle. The timer is
+ * only re-armed for the next requested event, if any. Must be called with
+ * interrupts disabled.
+ */
+void tick_idle_enter();
+
+/**
+ * Restarts timeslice accounting after the CPU leaves idle
+ */
+void tick_idle_exit();
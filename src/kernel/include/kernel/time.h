@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define NS_PER_US 1000ULL
+#define NS_PER_MS 1000000ULL
+#define NS_PER_SEC 1000000000ULL
+
+/**
+ * Reference used to determine the TSC frequency
+ */
+typedef enum {
+	TIME_CALIBRATION_CPUID,
+	TIME_CALIBRATION_HPET,
+	TIME_CALIBRATION_PIT,
+} TimeCalibrationSource;
+
+/**
+ * Parameters of the monotonic clock: ns = ((tsc - tsc_base) * ns_mult) >>
+ * ns_shift, with a 128-bit product
+ */
+typedef struct {
+	uint64_t tsc_base;
+	uint64_t ns_mult;
+	uint32_t ns_shift;
+} TimeScale;
+
+/**
+ * Determines the TSC frequency and starts the monotonic clock. Uses CPUID leaf
+ * 0x15 when the CPU reports its crystal ratio, otherwise measures the TSC
+ * against the HPET (found through ACPI) or the PIT.
+ */
+void time_initialize();
+
+/**
+ * Returns the TSC frequency in Hz
+ */
+uint64_t time_tsc_hz();
+
+/**
+ * Returns true if the TSC runs at a constant rate in all power states
+ */
+bool time_tsc_invariant();
+
+/**
+ * Returns the source the TSC frequency was calibrated against
+ */
+TimeCalibrationSource time_calibration_source();
+
+/**
+ * Returns the parameters of ktime_ns, for code that converts TSC values
+ * itself
+ */
+TimeScale time_scale();
+
+/**
+ * Converts a TSC delta to nanoseconds
+ */
+uint64_t tsc_to_ns(uint64_t tsc_delta);
+
+/**
+ * Converts nanoseconds to a TSC delta
+ */
+uint64_t ns_to_tsc(uint64_t ns);
+
+/**
+ * Converts a monotonic clock value to the absolute TSC value it corresponds to
+ */
+uint64_t ktime_to_tsc(uint64_t ns);
+
+/**
+ * Monotonic nanoseconds since time_initialize
+ */
+uint64_t ktime_ns();
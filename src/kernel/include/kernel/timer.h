@@ -0,0 +1,109 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Resolution of the timer wheel used for coarse timeouts
+ */
+#define TIMER_WHEEL_TICK_NS 1000000ULL
+
+/**
+ * The timer wheel has TIMER_WHEEL_LEVELS levels of TIMER_WHEEL_SLOTS slots.
+ * Each level is TIMER_WHEEL_SLOTS times coarser than the one below it, so four
+ * levels of 64 slots cover timeouts up to ~4.6 hours at 1ms resolution. Longer
+ * timeouts are parked in the last level and re-cascaded.
+ */
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4
+
+/**
+ * Maximum number of pending precise timers per CPU
+ */
+#define TIMER_HEAP_CAPACITY 128
+
+struct Timer;
+
+/**
+ * Called from the timer interrupt when a timer expires. The timer is inactive
+ * again when this runs, so the callback may re-arm it.
+ */
+typedef void (*TimerCallback)(struct Timer *timer);
+
+typedef enum {
+	TIMER_INACTIVE,
+	TIMER_QUEUED_WHEEL,
+	TIMER_QUEUED_HEAP,
+} TimerState;
+
+/**
+ * A one-shot timer. Embed it in the owning object and use data or the
+ * containing structure to find the context in the callback.
+ */
+typedef struct Timer {
+	struct Timer *next;
+	struct Timer **pprev;
+	uint64_t expires; // Monotonic deadline in nanoseconds
+	TimerCallback callback;
+	void *data;
+	uint32_t heap_index;
+	uint16_t wheel_slot;
+	uint8_t state;
+} Timer;
+
+/**
+ * Sets up the timer base of the calling CPU. The clocksource and the tick must
+ * be running.
+ */
+void timer_initialize();
+
+/**
+ * Prepares a timer for use
+ *
+ * @param timer The timer
+ * @param callback Function to run on expiry
+ * @param data Opaque pointer for the callback
+ */
+void timer_init(Timer *timer, TimerCallback callback, void *data);
+
+/**
+ * Arms a coarse timeout on the timer wheel. O(1), fires up to one wheel tick
+ * late. Use for timeouts that are usually cancelled before they expire.
+ *
+ * @param timer The timer, re-armed if already pending
+ * @param timeout_ns Relative timeout in nanoseconds
+ */
+void timer_start_timeout(Timer *timer, uint64_t timeout_ns);
+
+/**
+ * Arms a precise timer on the per-CPU deadline heap
+ *
+ * @param timer The timer, re-armed if already pending
+ * @param deadline_ns Absolute monotonic deadline (see ktime_ns)
+ * @return false if the heap of this CPU is full
+ */
+bool timer_start_deadline(Timer *timer, uint64_t deadline_ns);
+
+/**
+ * Disarms a pending timer. Does nothing if the timer is not pending. Timers
+ * must be cancelled on the CPU that armed them.
+ *
+ * @return true if the timer was pending
+ */
+bool timer_cancel(Timer *timer);
+
+/**
+ * Returns true if the timer is armed and has not expired yet
+ */
+static inline bool timer_pending(const Timer *timer) {
+	return timer->state != TIMER_INACTIVE;
+}
+
+/**
+ * Runs all expired timers of the calling CPU (called from the tick handler)
+ *
+ * @return The TSC deadline of the next pending timer, or 0 if there is none
+ */
+uint64_t timer_run();
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <kernel/syscall_abi.h>
+
+/**
+ * Maps the kernel data page at VDSO_DATA_ADDRESS, publishes the clock and
+ * registers the boot CPU. Runs after the clocksource and the local APIC are
+ * up.
+ */
+void vdso_initialize();
+
+/**
+ * Adds the calling CPU to the data page and points its MSR_TSC_AUX at its
+ * number, called once on every application processor
+ */
+void vdso_register_cpu();
+
+/**
+ * Republishes the clock parameters, for whenever the clocksource changes
+ */
+void vdso_update_time();
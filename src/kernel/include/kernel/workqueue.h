@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Upper bound for the number of workers a workqueue runs on each CPU
+ */
+#define WORKQUEUE_MAX_ACTIVE 8
+
+/**
+ * Workers per CPU of the system workqueue
+ */
+#define WORKQUEUE_SYSTEM_MAX_ACTIVE 2
+
+struct Work;
+
+typedef void (*WorkFunction)(struct Work *work);
+
+/**
+ * Deferred function run by a workqueue worker thread. Unlike tasklets, work
+ * may sleep. Embed it in the owning object and use data or the containing
+ * structure to find the context in the function.
+ */
+typedef struct Work {
+	struct Work *next;
+	WorkFunction function;
+	void *data;
+
+	/**
+	 * Set while the work is queued, cleared just before it runs so it can
+	 * queue itself again
+	 */
+	_Atomic bool pending;
+} Work;
+
+typedef struct Workqueue Workqueue;
+
+/**
+ * General purpose workqueue, set up by workqueue_initialize
+ */
+extern Workqueue *system_workqueue;
+
+/**
+ * Creates the system workqueue. Runs once after all CPUs are online.
+ */
+void workqueue_initialize();
+
+/**
+ * Creates a workqueue with its own worker threads on every online CPU. At most
+ * max_active work items of the workqueue run at once on each CPU, the rest
+ * wait in FIFO order.
+ *
+ * @param name Name for debugging, not copied
+ * @param max_active Concurrency limit per CPU, 1 to WORKQUEUE_MAX_ACTIVE
+ * @return The workqueue, or NULL if out of memory
+ */
+Workqueue *workqueue_create(const char *name, uint32_t max_active);
+
+/**
+ * Prepares work for use
+ *
+ * @param work The work
+ * @param function Function to run
+ * @param data Opaque pointer for the function
+ */
+void work_init(Work *work, WorkFunction function, void *data);
+
+/**
+ * Queues work on the calling CPU. Safe from interrupt handlers and softirqs.
+ *
+ * @return false if the work was already pending
+ */
+bool queue_work(Workqueue *workqueue, Work *work);
+
+/**
+ * Queues work on a specific CPU
+ *
+ * @param cpu Index of a CPU that was online when the workqueue was created
+ * @return false if the work was already pending or the CPU has no workers
+ */
+bool queue_work_on(uint32_t cpu, Workqueue *workqueue, Work *work);
+
+/**
+ * Returns true if the work is queued and has not started running yet
+ */
+static inline bool work_pending(Work *work) {
+	return atomic_load_explicit(&work->pending, memory_order_acquire);
+}
@@ -32,6 +32,13 @@ static int find_order(size_t size) {
 	return order;
 }
 
+/**
+ * Utility function to get the index of a frame in the pool
+ */
+static size_t frame_index(BuddyAllocator *allocator, uintptr_t address) {
+	return (address - allocator->start_address) / PAGE_SIZE;
+}
+
 /**
  * Utility function to split a block into two smaller blocks
  */
@@ -79,6 +86,7 @@ uintptr_t buddy_allocator_allocate(BuddyAllocator *allocator, size_t size) {
 			// Allocate the block
 			BuddyBlock *block = allocator->free_lists[i];
 			allocator->free_lists[i] = block->next;
+			allocator->orders[frame_index(allocator, (uintptr_t)block)] = order;
 			return (uintptr_t)block;
 		}
 	}
@@ -87,8 +95,26 @@ uintptr_t buddy_allocator_allocate(BuddyAllocator *allocator, size_t size) {
 }
 
 void buddy_allocator_free(BuddyAllocator *allocator, uintptr_t address) {
+	size_t frame = frame_index(allocator, address);
+	if (address < allocator->start_address ||
+		(address & (PAGE_SIZE - 1)) != 0 ||
+		frame >= allocator->pool_size / PAGE_SIZE ||
+		allocator->orders[frame] == BUDDY_ORDER_NONE) {
+		log_message(
+			&kernel_debug_logger,
+			LOG_ERROR,
+			"memory_manager",
+			"Freeing a block that is not allocated {address=0x%016llx}\n",
+			(unsigned long long)address
+		);
+		return;
+	}
+
+	int order = allocator->orders[frame];
+	allocator->orders[frame] = BUDDY_ORDER_NONE;
+
 	BuddyBlock *block = (BuddyBlock *)address;
-	int order = find_order(block->size);
+	block->size = PAGE_SIZE << order;
 
 	while (order < MAX_ORDER) {
 		uintptr_t buddy_addr = find_buddy(address, block->size);
@@ -149,6 +175,14 @@ void buddy_allocator_init(
 		);
 	}
 
+	// The order table takes the first pages of the pool, one byte per frame
+	size_t table_size = (pool_size / PAGE_SIZE + PAGE_SIZE - 1) &
+						~(size_t)(PAGE_SIZE - 1);
+	allocator->orders = (uint8_t *)start_address;
+	memset(allocator->orders, BUDDY_ORDER_NONE, table_size);
+	start_address += table_size;
+	pool_size -= table_size;
+
 	// Set up allocator struct
 	allocator->start_address = start_address;
 	allocator->pool_size = pool_size;
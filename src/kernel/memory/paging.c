@@ -0,0 +1,262 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libk/string.h>
+
+#include <kernel/debug.h>
+#include <kernel/paging.h>
+#include <kernel/percpu.h>
+#include <kernel/pmm.h>
+#include <kernel/smp.h>
+
+#define PAGE_TABLE_ENTRIES 512
+
+static uint64_t hhdm_offset;
+
+static inline uint64_t read_cr3() {
+	uint64_t value;
+	asm volatile("mov %%cr3, %0" : "=r"(value));
+	return value;
+}
+
+static inline void invlpg(uintptr_t virt) {
+	asm volatile("invlpg (%0)" : : "r"(virt) : "memory");
+}
+
+/**
+ * PAT bit of a 1 GiB or 2 MiB entry. In a 4 KiB entry the PAT bit sits where
+ * PAGE_HUGE is.
+ */
+#define PAGE_HUGE_PAT (1 << 12)
+
+/**
+ * Replaces a huge page entry by a table of 512 entries mapping the same range
+ * with the same attributes, so single pages of it can be remapped.
+ *
+ * @param shift Shift of the address bits the entry translates, 30 for a 1 GiB
+ *              and 21 for a 2 MiB page
+ * @return The new table, or NULL if it could not be allocated
+ */
+static uint64_t *split_huge_page(uint64_t *table, size_t index, int shift) {
+	uint64_t entry = table[index];
+	uint64_t child_size = 1ULL << (shift - 9);
+
+	uintptr_t page = pmm_alloc(PAGE_SIZE);
+	if (page == 0) {
+		return NULL;
+	}
+
+	uint64_t base = entry & PAGE_ADDRESS_MASK & ~((1ULL << shift) - 1);
+	uint64_t attributes = entry & ~PAGE_ADDRESS_MASK;
+	if (child_size == PAGE_SIZE) {
+		attributes &= ~(uint64_t)PAGE_HUGE;
+		if (entry & PAGE_HUGE_PAT) {
+			attributes |= PAGE_HUGE;
+		}
+	} else {
+		attributes |= entry & PAGE_HUGE_PAT;
+	}
+
+	uint64_t *children = (uint64_t *)page;
+	for (size_t i = 0; i < PAGE_TABLE_ENTRIES; i++) {
+		children[i] = (base + i * child_size) | attributes;
+	}
+
+	// The children carry the attributes, the table entry only has to let
+	// them through. The old translation stays valid for every page until
+	// one is remapped, which invalidates it.
+	table[index] = virt_to_phys(children) |
+				   (entry & (PAGE_PRESENT | PAGE_WRITABLE | PAGE_USER));
+	return children;
+}
+
+/**
+ * Returns the next level table referenced by an entry, allocating it if it is
+ * not present and splitting the page if the entry maps a huge page. Returns
+ * NULL if the allocation failed.
+ *
+ * @param shift Shift of the address bits the entry translates
+ */
+static uint64_t *
+next_table(uint64_t *table, size_t index, int shift, uint64_t flags) {
+	uint64_t entry = table[index];
+
+	if (entry & PAGE_PRESENT) {
+		uint64_t *next;
+		if (entry & PAGE_HUGE) {
+			next = split_huge_page(table, index, shift);
+			if (next == NULL) {
+				return NULL;
+			}
+		} else {
+			next = phys_to_virt(entry & PAGE_ADDRESS_MASK, hhdm_offset);
+		}
+
+		// Upper levels have to allow everything the leaf allows
+		table[index] |= flags & (PAGE_WRITABLE | PAGE_USER);
+		return next;
+	}
+
+	uintptr_t page = pmm_alloc(PAGE_SIZE);
+	if (page == 0) {
+		return NULL;
+	}
+	memset((void *)page, 0, PAGE_SIZE);
+
+	table[index] = virt_to_phys((void *)page) | PAGE_PRESENT |
+				   (flags & (PAGE_WRITABLE | PAGE_USER));
+	return (uint64_t *)page;
+}
+
+void paging_initialize(uint64_t offset) { hhdm_offset = offset; }
+
+uint64_t paging_hhdm_offset() { return hhdm_offset; }
+
+bool paging_map_page(uintptr_t virt, uintptr_t phys, uint64_t flags) {
+	uint64_t *pml4 = phys_to_virt(read_cr3() & PAGE_ADDRESS_MASK, hhdm_offset);
+
+	uint64_t *pdpt = next_table(pml4, (virt >> 39) & 0x1FF, 39, flags);
+	if (pdpt == NULL) {
+		return false;
+	}
+
+	uint64_t *pd = next_table(pdpt, (virt >> 30) & 0x1FF, 30, flags);
+	if (pd == NULL) {
+		return false;
+	}
+
+	uint64_t *pt = next_table(pd, (virt >> 21) & 0x1FF, 21, flags);
+	if (pt == NULL) {
+		return false;
+	}
+
+	pt[(virt >> 12) & 0x1FF] = (phys & PAGE_ADDRESS_MASK) | flags;
+	invlpg(virt);
+
+	return true;
+}
+
+bool paging_lookup(uintptr_t virt, uintptr_t *phys, uint64_t *flags) {
+	uint64_t *table =
+		phys_to_virt(read_cr3() & PAGE_ADDRESS_MASK, hhdm_offset);
+
+	// Writable and user only hold if every level on the walk allows them
+	uint64_t allowed = PAGE_PRESENT | PAGE_WRITABLE | PAGE_USER;
+
+	// Walk down from the PML4, stopping early at 1 GiB and 2 MiB pages
+	for (int shift = 39; shift >= 12; shift -= 9) {
+		uint64_t entry = table[(virt >> shift) & 0x1FF];
+		if (!(entry & PAGE_PRESENT)) {
+			return false;
+		}
+		allowed &= entry;
+
+		if (shift == 12 || (shift <= 30 && (entry & PAGE_HUGE))) {
+			uint64_t offset_mask = (1ULL << shift) - 1;
+			*phys = (entry & PAGE_ADDRESS_MASK & ~offset_mask) |
+					(virt & offset_mask);
+			*flags = allowed;
+			return true;
+		}
+
+		table = phys_to_virt(entry & PAGE_ADDRESS_MASK, hhdm_offset);
+	}
+
+	return false;
+}
+
+bool paging_translate(uintptr_t virt, uintptr_t *phys) {
+	uint64_t flags;
+	return paging_lookup(virt, phys, &flags);
+}
+
+/**
+ * Returns the page table entry mapping a 4 KiB page, or NULL if the walk
+ * ends before it or at a huge page. Never allocates.
+ */
+static uint64_t *paging_leaf(uintptr_t virt) {
+	uint64_t *table =
+		phys_to_virt(read_cr3() & PAGE_ADDRESS_MASK, hhdm_offset);
+
+	for (int shift = 39; shift > 12; shift -= 9) {
+		uint64_t entry = table[(virt >> shift) & 0x1FF];
+		if (!(entry & PAGE_PRESENT) || (entry & PAGE_HUGE)) {
+			return NULL;
+		}
+		table = phys_to_virt(entry & PAGE_ADDRESS_MASK, hhdm_offset);
+	}
+
+	uint64_t *leaf = &table[(virt >> 12) & 0x1FF];
+	return (*leaf & PAGE_PRESENT) ? leaf : NULL;
+}
+
+typedef struct {
+	uintptr_t virt;
+	size_t count;
+} PagingFlush;
+
+static void paging_flush(void *argument) {
+	PagingFlush *flush = (PagingFlush *)argument;
+	for (size_t i = 0; i < flush->count; i++) {
+		invlpg(flush->virt + i * PAGE_SIZE);
+	}
+}
+
+bool paging_unmap_pages(uintptr_t virt, size_t count, uintptr_t *frames) {
+	for (size_t i = 0; i < count; i++) {
+		if (paging_leaf(virt + i * PAGE_SIZE) == NULL) {
+			return false;
+		}
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		uint64_t *leaf = paging_leaf(virt + i * PAGE_SIZE);
+		frames[i] = *leaf & PAGE_ADDRESS_MASK;
+		*leaf = 0;
+	}
+
+	// Every CPU runs on these page tables, any of them may have the pages
+	// cached. The flush lives on our stack, so wait for all of them.
+	PagingFlush flush = {.virt = virt, .count = count};
+	paging_flush(&flush);
+
+	uint32_t self = this_cpu()->id;
+	for (uint32_t cpu = 0; cpu < smp_cpu_count(); cpu++) {
+		if (cpu != self) {
+			smp_call(cpu, paging_flush, &flush);
+		}
+	}
+	for (uint32_t cpu = 0; cpu < smp_cpu_count(); cpu++) {
+		if (cpu != self) {
+			smp_call_wait(cpu);
+		}
+	}
+
+	return true;
+}
+
+void *paging_map_mmio(uintptr_t phys, size_t size) {
+	uintptr_t start = phys & ~(uintptr_t)(PAGE_SIZE - 1);
+	uintptr_t end = (phys + size + PAGE_SIZE - 1) & ~(uintptr_t)(PAGE_SIZE - 1);
+
+	for (uintptr_t page = start; page < end; page += PAGE_SIZE) {
+		if (!paging_map_page(
+				page + hhdm_offset,
+				page,
+				PAGE_PRESENT | PAGE_WRITABLE | PAGE_CACHE_DISABLE |
+					PAGE_WRITE_THROUGH | PAGE_NO_EXECUTE
+			)) {
+			log_message(
+				&kernel_debug_logger,
+				LOG_ERROR,
+				"paging",
+				"Failed to map MMIO page {phys=0x%llx}\n",
+				page
+			);
+			return NULL;
+		}
+	}
+
+	return phys_to_virt(phys, hhdm_offset);
+}
@@ -0,0 +1,236 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libk/spinlock.h>
+#include <libk/string.h>
+
+#include <kernel/paging.h>
+#include <kernel/pin.h>
+#include <kernel/syscall_abi.h>
+
+#define PIN_TABLE_BITS 12
+#define PIN_TABLE_MASK (PIN_TABLE_SIZE - 1)
+
+_Static_assert(
+	PIN_TABLE_SIZE == 1 << PIN_TABLE_BITS, "PIN_TABLE_SIZE is 2^PIN_TABLE_BITS"
+);
+
+/**
+ * Pin count of one frame. key is the frame number plus one, 0 marks a free
+ * slot.
+ */
+typedef struct {
+	uint64_t key;
+	uint32_t count;
+} PinEntry;
+
+/**
+ * Open-addressed table of pinned frames, with linear probing. Kept at most
+ * three quarters full so probes stay short.
+ */
+static PinEntry pin_table[PIN_TABLE_SIZE];
+static uint32_t pin_table_used;
+static TicketLock pin_lock = TICKET_LOCK_INIT("pin");
+
+static uint32_t pin_hash(uint64_t key) {
+	return (key * 0x9E3779B97F4A7C15ULL) >> (64 - PIN_TABLE_BITS);
+}
+
+static uint64_t pin_key(uintptr_t phys) { return (phys >> 12) + 1; }
+
+/**
+ * Returns the slot holding key, or the free slot ending its probe sequence
+ */
+static uint32_t pin_find(uint64_t key) {
+	uint32_t slot = pin_hash(key);
+	while (pin_table[slot].key != 0 && pin_table[slot].key != key) {
+		slot = (slot + 1) & PIN_TABLE_MASK;
+	}
+	return slot;
+}
+
+static bool pin_frame_get(uintptr_t phys) {
+	uint64_t key = pin_key(phys);
+	bool pinned = true;
+
+	uint64_t rflags = ticket_lock_acquire_irqsave(&pin_lock);
+	uint32_t slot = pin_find(key);
+	if (pin_table[slot].key == key) {
+		pin_table[slot].count++;
+	} else if (pin_table_used < PIN_TABLE_SIZE / 4 * 3) {
+		pin_table[slot] = (PinEntry){.key = key, .count = 1};
+		pin_table_used++;
+	} else {
+		pinned = false;
+	}
+	ticket_lock_release_irqrestore(&pin_lock, rflags);
+
+	return pinned;
+}
+
+static void pin_frame_put(uintptr_t phys) {
+	uint64_t key = pin_key(phys);
+
+	uint64_t rflags = ticket_lock_acquire_irqsave(&pin_lock);
+	uint32_t hole = pin_find(key);
+	if (pin_table[hole].key != key || --pin_table[hole].count != 0) {
+		ticket_lock_release_irqrestore(&pin_lock, rflags);
+		return;
+	}
+
+	// Backward-shift deletion: pull later entries of the run into the hole
+	// unless that would put them before their home slot
+	for (uint32_t slot = (hole + 1) & PIN_TABLE_MASK; pin_table[slot].key != 0;
+		 slot = (slot + 1) & PIN_TABLE_MASK) {
+		uint32_t home = pin_hash(pin_table[slot].key);
+		if (((slot - home) & PIN_TABLE_MASK) >=
+			((slot - hole) & PIN_TABLE_MASK)) {
+			pin_table[hole] = pin_table[slot];
+			hole = slot;
+		}
+	}
+	pin_table[hole] = (PinEntry){0};
+	pin_table_used--;
+	ticket_lock_release_irqrestore(&pin_lock, rflags);
+}
+
+static bool pin_user_range(uintptr_t address, size_t length) {
+	return address + length >= address && address + length <= PAGING_USER_END;
+}
+
+/**
+ * Bytes from address to the end of its page or to end, whichever is first
+ */
+static size_t pin_chunk(uintptr_t address, uintptr_t end) {
+	uintptr_t page_end = (address & ~(uintptr_t)(PAGE_SIZE - 1)) + PAGE_SIZE;
+	return (page_end < end ? page_end : end) - address;
+}
+
+int64_t pin_user_pages(
+	uintptr_t address, size_t length, uint32_t flags, PinList *list
+) {
+	list->count = 0;
+	list->length = 0;
+	if (length == 0 || !pin_user_range(address, length)) {
+		return SYSCALL_ERROR_INVALID_ARGS;
+	}
+
+	uint64_t required = PAGE_PRESENT | PAGE_USER;
+	if (flags & PIN_WRITE) {
+		required |= PAGE_WRITABLE;
+	}
+
+	uintptr_t end = address + length;
+	uintptr_t current = address;
+	while (current < end) {
+		uint64_t chunk = pin_chunk(current, end);
+
+		uintptr_t phys;
+		uint64_t page_flags;
+		if (!paging_lookup(current, &phys, &page_flags) ||
+			(page_flags & required) != required) {
+			pin_release(list);
+			return SYSCALL_ERROR_INVALID_ARGS;
+		}
+
+		PinSegment *last =
+			list->count != 0 ? &list->segments[list->count - 1] : NULL;
+		bool extends = last != NULL && last->phys + last->length == phys;
+		if (!extends && list->count == PIN_MAX_SEGMENTS) {
+			break;
+		}
+
+		if (!pin_frame_get(phys)) {
+			if (list->count != 0) {
+				break;
+			}
+			return SYSCALL_ERROR_NO_MEMORY;
+		}
+
+		if (extends) {
+			last->length += chunk;
+		} else {
+			list->segments[list->count++] =
+				(PinSegment){.phys = phys, .length = chunk};
+		}
+		current += chunk;
+	}
+
+	list->length = current - address;
+	return list->length;
+}
+
+void pin_release(PinList *list) {
+	for (uint32_t i = 0; i < list->count; i++) {
+		PinSegment *segment = &list->segments[i];
+		uintptr_t last = segment->phys + segment->length - 1;
+		for (uintptr_t frame = segment->phys & ~(uintptr_t)(PAGE_SIZE - 1);
+			 frame <= last;
+			 frame += PAGE_SIZE) {
+			pin_frame_put(frame);
+		}
+	}
+	list->count = 0;
+	list->length = 0;
+}
+
+bool pin_frame_pinned(uintptr_t phys) {
+	uint64_t key = pin_key(phys);
+
+	uint64_t rflags = ticket_lock_acquire_irqsave(&pin_lock);
+	bool pinned = pin_table[pin_find(key)].key == key;
+	ticket_lock_release_irqrestore(&pin_lock, rflags);
+
+	return pinned;
+}
+
+/**
+ * Copies between a user buffer and kernel memory page by page through the
+ * direct map. The buffer is checked page by page, so a copy that fails may
+ * have been partly done.
+ */
+static bool user_copy(
+	void *kernel, uintptr_t user, size_t length, bool to_user
+) {
+	if (!pin_user_range(user, length)) {
+		return false;
+	}
+
+	uint64_t required = PAGE_PRESENT | PAGE_USER;
+	if (to_user) {
+		required |= PAGE_WRITABLE;
+	}
+
+	uint8_t *cursor = (uint8_t *)kernel;
+	uintptr_t end = user + length;
+	while (user < end) {
+		size_t chunk = pin_chunk(user, end);
+
+		uintptr_t phys;
+		uint64_t flags;
+		if (!paging_lookup(user, &phys, &flags) ||
+			(flags & required) != required) {
+			return false;
+		}
+
+		void *mapped = phys_to_virt(phys, paging_hhdm_offset());
+		if (to_user) {
+			memcpy(mapped, cursor, chunk);
+		} else {
+			memcpy(cursor, mapped, chunk);
+		}
+		cursor += chunk;
+		user += chunk;
+	}
+
+	return true;
+}
+
+bool user_copy_from(void *destination, uintptr_t source, size_t length) {
+	return user_copy(destination, source, length, false);
+}
+
+bool user_copy_to(uintptr_t destination, const void *source, size_t length) {
+	return user_copy((void *)source, destination, length, true);
+}
@@ -2,6 +2,7 @@
 #include <stdint.h>
 
 #include <jems/jems.h>
+#include <libk/spinlock.h>
 #include <limine/limine.h>
 #include <logger.h>
 #include <printf/printf.h>
@@ -16,6 +17,7 @@
 #define JEMS_MAX_LEVEL 10
 
 static BuddyAllocator buddy_allocator;
+static TicketLock pmm_lock = TICKET_LOCK_INIT("pmm");
 
 /**
  * Human-readable names for memory map entry types
@@ -284,11 +286,17 @@ void pmm_initialize(
 }
 
 uintptr_t pmm_alloc(size_t size) {
-	return buddy_allocator_allocate(&buddy_allocator, size);
+	uint64_t rflags = ticket_lock_acquire_irqsave(&pmm_lock);
+	uintptr_t address = buddy_allocator_allocate(&buddy_allocator, size);
+	ticket_lock_release_irqrestore(&pmm_lock, rflags);
+
+	return address;
 }
 
 void pmm_free(uintptr_t address) {
+	uint64_t rflags = ticket_lock_acquire_irqsave(&pmm_lock);
 	buddy_allocator_free(&buddy_allocator, address);
+	ticket_lock_release_irqrestore(&pmm_lock, rflags);
 }
 
 void pmm_debug_print_state() { buddy_allocator_debug_state(&buddy_allocator); }
@@ -29,6 +29,11 @@ target("kernel")
     add_deps("limine")
     add_deps("ssfn")
 
+    -- No SSE, MMX or x87 in generated code. The FPU state is switched
+    -- lazily, so kernel and interrupt code must not touch it behind the
+    -- owning thread's back (clang would otherwise copy structs through XMM).
+    add_cxflags("-mgeneral-regs-only")
+
     -- Debug configuration (always on for now)
     add_cxflags("-DDEBUG=1")
     add_cxflags("-g")
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The irqs-off latency tracer is compiled in when LIBK_IRQSOFF_TRACE is set,
+ * by the irqsoff_trace option (see xmake.lua). Without it the primitives
+ * below are a bare cli/sti and call sites carry no data.
+ */
+#ifndef LIBK_IRQSOFF_TRACE
+#define LIBK_IRQSOFF_TRACE 0
+#endif
+
+/**
+ * Histogram buckets per call site. Bucket i counts sections of 2^(i + 10) to
+ * 2^(i + 11) cycles, the first and last bucket are open-ended.
+ */
+#define IRQSOFF_HISTOGRAM_BUCKETS 16
+#define IRQSOFF_HISTOGRAM_SHIFT 10
+
+/**
+ * Return addresses kept of the longest section of each call site
+ */
+#define IRQSOFF_TRACE_DEPTH 8
+
+#define IRQSOFF_RFLAGS_IF (1 << 9)
+
+/**
+ * Statistics of one place that disables interrupts. Updated by every CPU that
+ * passes through it, so the counters are atomic.
+ */
+typedef struct IrqsOffSite {
+	const char *file;
+	const char *function;
+	uint32_t line;
+	bool registered;
+	struct IrqsOffSite *next;
+	uint64_t count;
+	uint64_t total_cycles;
+	uint64_t max_cycles;
+	uint64_t histogram[IRQSOFF_HISTOGRAM_BUCKETS];
+
+	/**
+	 * Stack of the longest section where interrupts were enabled again, the
+	 * site that disabled them is above. Only taken when a section sets a new
+	 * maximum, may be torn if two CPUs do at once.
+	 */
+	uintptr_t max_trace[IRQSOFF_TRACE_DEPTH];
+} IrqsOffSite;
+
+/**
+ * Per-CPU tracer state, provided by the kernel through irqsoff_set_cpu_hook.
+ * site is the call site that disabled interrupts, NULL while they are on.
+ */
+typedef struct {
+	IrqsOffSite *site;
+	uint64_t start;
+} IrqsOffCpu;
+
+/**
+ * Static statistics for the calling location, NULL when the tracer is off
+ */
+#if LIBK_IRQSOFF_TRACE
+#define IRQSOFF_SITE()                                                         \
+	({                                                                         \
+		static IrqsOffSite irqsoff_site = {                                    \
+			.file = __FILE__,                                                  \
+			.function = __func__,                                              \
+			.line = __LINE__,                                                  \
+		};                                                                     \
+		&irqsoff_site;                                                         \
+	})
+#else
+#define IRQSOFF_SITE() ((IrqsOffSite *)NULL)
+#endif
+
+/**
+ * Installs the function that returns the calling CPU's tracer state. Nothing
+ * is recorded before it is set, so early boot code needs no per-CPU area.
+ */
+void irqsoff_set_cpu_hook(IrqsOffCpu *(*hook)());
+
+/**
+ * Returns the head of the list of sites that have been left at least once
+ */
+IrqsOffSite *irqsoff_site_list();
+
+#if LIBK_IRQSOFF_TRACE
+/**
+ * Starts timing an irqs-off section, called with interrupts just disabled.
+ * Does nothing if a section is already open on this CPU: interrupts stay off
+ * across a context switch, and the section belongs to whoever turned them off.
+ */
+void irqsoff_begin(IrqsOffSite *site);
+
+/**
+ * Closes the open section of this CPU, called right before interrupts are
+ * enabled again
+ */
+void irqsoff_end();
+#else
+static inline void irqsoff_begin(IrqsOffSite *site) { (void)site; }
+
+static inline void irqsoff_end() {}
+#endif
+
+/**
+ * Saves RFLAGS and disables interrupts, opening a section at site if they
+ * were enabled
+ */
+static inline uint64_t irqsoff_save(IrqsOffSite *site) {
+	uint64_t rflags;
+	asm volatile("pushfq\n"
+				 "popq %0\n"
+				 "cli"
+				 : "=r"(rflags)
+				 :
+				 : "memory");
+
+	if (LIBK_IRQSOFF_TRACE && (rflags & IRQSOFF_RFLAGS_IF)) {
+		irqsoff_begin(site);
+	}
+	return rflags;
+}
+
+/**
+ * Re-enables interrupts if they were enabled when irqsoff_save was called
+ */
+static inline void irqsoff_restore(uint64_t rflags) {
+	if (rflags & IRQSOFF_RFLAGS_IF) {
+		irqsoff_end();
+		asm volatile("sti" ::: "memory");
+	}
+}
+
+/**
+ * Disables interrupts, for code that knows they are enabled
+ */
+static inline void irqsoff_disable(IrqsOffSite *site) {
+	asm volatile("cli" ::: "memory");
+	irqsoff_begin(site);
+}
+
+/**
+ * Enables interrupts unconditionally
+ */
+static inline void irqsoff_enable() {
+	irqsoff_end();
+	asm volatile("sti" ::: "memory");
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libk/ring.h>
+
+/**
+ * Link embedded in objects queued on an MpscQueue
+ */
+typedef struct MpscNode {
+	_Atomic(struct MpscNode *) next;
+} MpscNode;
+
+/**
+ * Unbounded intrusive multi-producer single-consumer queue. Pushing is a
+ * single exchange and never fails, the consumer never blocks producers.
+ */
+typedef struct {
+	// Newest node, shared by producers
+	_Alignas(RING_CACHE_LINE) _Atomic(MpscNode *) head;
+
+	// Oldest node and the placeholder that keeps the list non-empty, consumer
+	// side
+	_Alignas(RING_CACHE_LINE) MpscNode *tail;
+	MpscNode stub;
+} MpscQueue;
+
+static inline void mpsc_queue_init(MpscQueue *queue) {
+	atomic_store_explicit(&queue->stub.next, NULL, memory_order_relaxed);
+	atomic_store_explicit(&queue->head, &queue->stub, memory_order_relaxed);
+	queue->tail = &queue->stub;
+	atomic_thread_fence(memory_order_release);
+}
+
+/**
+ * Appends a node (any number of producers)
+ */
+static inline void mpsc_queue_push(MpscQueue *queue, MpscNode *node) {
+	atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+
+	MpscNode *prev =
+		atomic_exchange_explicit(&queue->head, node, memory_order_acq_rel);
+
+	// Between the exchange and this store the consumer cannot see past prev
+	atomic_store_explicit(&prev->next, node, memory_order_release);
+}
+
+/**
+ * Removes the oldest node (single consumer only)
+ *
+ * @return The node, or NULL if the queue is empty or a producer is halfway
+ *         through a push (try again later)
+ */
+static inline MpscNode *mpsc_queue_pop(MpscQueue *queue) {
+	MpscNode *tail = queue->tail;
+	MpscNode *next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+	// Skip the stub
+	if (tail == &queue->stub) {
+		if (next == NULL) {
+			return NULL;
+		}
+		queue->tail = next;
+		tail = next;
+		next = atomic_load_explicit(&tail->next, memory_order_acquire);
+	}
+
+	if (next != NULL) {
+		queue->tail = next;
+		return tail;
+	}
+
+	// tail is the last linked node. If it is not the head either, a producer
+	// has swapped in a new head but not linked it yet.
+	if (tail != atomic_load_explicit(&queue->head, memory_order_acquire)) {
+		return NULL;
+	}
+
+	// Re-insert the stub behind tail so tail can be handed out
+	mpsc_queue_push(queue, &queue->stub);
+
+	next = atomic_load_explicit(&tail->next, memory_order_acquire);
+	if (next != NULL) {
+		queue->tail = next;
+		return tail;
+	}
+
+	return NULL;
+}
+
+/**
+ * Returns true if no node has been pushed since the queue was last drained.
+ * Only meaningful for the consumer.
+ */
+static inline bool mpsc_queue_empty(MpscQueue *queue) {
+	return queue->tail == &queue->stub &&
+		   atomic_load_explicit(&queue->stub.next, memory_order_acquire) ==
+			   NULL;
+}
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Size of a cache line, producer and consumer state live on separate lines so
+ * they do not false-share
+ */
+#define RING_CACHE_LINE 64
+
+/*
+ * ============================================================================
+ * SPSC ring
+ * ============================================================================
+ */
+
+/**
+ * Bounded single-producer single-consumer ring of pointer-sized values. The
+ * producer and the consumer each keep a cached copy of the other side's index
+ * and only re-read it when the ring looks full (or empty).
+ */
+typedef struct {
+	// Producer side
+	_Alignas(RING_CACHE_LINE) _Atomic size_t tail;
+	size_t cached_head;
+
+	// Consumer side
+	_Alignas(RING_CACHE_LINE) _Atomic size_t head;
+	size_t cached_tail;
+
+	// Read-only after initialization
+	_Alignas(RING_CACHE_LINE) uintptr_t *slots;
+	size_t mask;
+} SpscRing;
+
+/**
+ * Prepares a ring over caller-provided storage
+ *
+ * @param ring The ring
+ * @param slots Storage for capacity values
+ * @param capacity Number of slots, must be a power of two
+ */
+static inline void spsc_ring_init(
+	SpscRing *ring, uintptr_t *slots, size_t capacity
+) {
+	atomic_store_explicit(&ring->tail, 0, memory_order_relaxed);
+	atomic_store_explicit(&ring->head, 0, memory_order_relaxed);
+	ring->cached_head = 0;
+	ring->cached_tail = 0;
+	ring->slots = slots;
+	ring->mask = capacity - 1;
+}
+
+/**
+ * Appends a value (producer only)
+ *
+ * @return false if the ring is full
+ */
+static inline bool spsc_ring_push(SpscRing *ring, uintptr_t value) {
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+	if (tail - ring->cached_head > ring->mask) {
+		ring->cached_head =
+			atomic_load_explicit(&ring->head, memory_order_acquire);
+		if (tail - ring->cached_head > ring->mask) {
+			return false;
+		}
+	}
+
+	ring->slots[tail & ring->mask] = value;
+	atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+	return true;
+}
+
+/**
+ * Removes the oldest value (consumer only)
+ *
+ * @return false if the ring is empty
+ */
+static inline bool spsc_ring_pop(SpscRing *ring, uintptr_t *value) {
+	size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+	if (head == ring->cached_tail) {
+		ring->cached_tail =
+			atomic_load_explicit(&ring->tail, memory_order_acquire);
+		if (head == ring->cached_tail) {
+			return false;
+		}
+	}
+
+	*value = ring->slots[head & ring->mask];
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+	return true;
+}
+
+/**
+ * Returns true if the ring holds no values. Only exact when called by the
+ * consumer.
+ */
+static inline bool spsc_ring_empty(SpscRing *ring) {
+	return atomic_load_explicit(&ring->head, memory_order_relaxed) ==
+		   atomic_load_explicit(&ring->tail, memory_order_acquire);
+}
+
+/*
+ * ============================================================================
+ * MPSC ring
+ * ============================================================================
+ */
+
+/**
+ * Slot of an MPSC ring. The sequence number tells producers and the consumer
+ * whose turn it is: it equals the position for a free slot and position + 1
+ * for a filled one.
+ */
+typedef struct {
+	_Atomic size_t sequence;
+	uintptr_t value;
+} MpscRingSlot;
+
+/**
+ * Bounded multi-producer single-consumer ring of pointer-sized values.
+ * Producers claim a position with a CAS on tail and publish through the
+ * slot's sequence number, so a slow producer only delays the consumer at its
+ * own slot.
+ */
+typedef struct {
+	// Shared by producers
+	_Alignas(RING_CACHE_LINE) _Atomic size_t tail;
+
+	// Consumer side
+	_Alignas(RING_CACHE_LINE) size_t head;
+
+	// Read-only after initialization
+	_Alignas(RING_CACHE_LINE) MpscRingSlot *slots;
+	size_t mask;
+} MpscRing;
+
+/**
+ * Prepares a ring over caller-provided storage
+ *
+ * @param ring The ring
+ * @param slots Storage for capacity slots
+ * @param capacity Number of slots, must be a power of two
+ */
+static inline void mpsc_ring_init(
+	MpscRing *ring, MpscRingSlot *slots, size_t capacity
+) {
+	for (size_t i = 0; i < capacity; i++) {
+		atomic_store_explicit(&slots[i].sequence, i, memory_order_relaxed);
+	}
+
+	atomic_store_explicit(&ring->tail, 0, memory_order_relaxed);
+	ring->head = 0;
+	ring->slots = slots;
+	ring->mask = capacity - 1;
+	atomic_thread_fence(memory_order_release);
+}
+
+/**
+ * Appends a value (any number of producers)
+ *
+ * @return false if the ring is full
+ */
+static inline bool mpsc_ring_push(MpscRing *ring, uintptr_t value) {
+	size_t position = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	MpscRingSlot *slot;
+
+	for (;;) {
+		slot = &ring->slots[position & ring->mask];
+		size_t sequence =
+			atomic_load_explicit(&slot->sequence, memory_order_acquire);
+		intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+
+		if (difference == 0) {
+			if (atomic_compare_exchange_weak_explicit(
+					&ring->tail,
+					&position,
+					position + 1,
+					memory_order_relaxed,
+					memory_order_relaxed
+				)) {
+				break;
+			}
+		} else if (difference < 0) {
+			// The consumer has not freed this slot yet
+			return false;
+		} else {
+			position =
+				atomic_load_explicit(&ring->tail, memory_order_relaxed);
+		}
+	}
+
+	slot->value = value;
+	atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+	return true;
+}
+
+/**
+ * Removes the oldest value (single consumer only)
+ *
+ * @return false if the ring is empty, or the next producer has claimed its
+ *         slot but not filled it yet
+ */
+static inline bool mpsc_ring_pop(MpscRing *ring, uintptr_t *value) {
+	size_t position = ring->head;
+	MpscRingSlot *slot = &ring->slots[position & ring->mask];
+
+	if (atomic_load_explicit(&slot->sequence, memory_order_acquire) !=
+		position + 1) {
+		return false;
+	}
+
+	*value = slot->value;
+	atomic_store_explicit(
+		&slot->sequence, position + ring->mask + 1, memory_order_release
+	);
+	ring->head = position + 1;
+	return true;
+}
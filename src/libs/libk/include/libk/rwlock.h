@@ -0,0 +1,138 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libk/spinlock.h>
+
+/**
+ * Lock state: bit 31 is set while a writer holds the lock, bit 30 while a
+ * writer is waiting, and the low bits count active readers
+ */
+#define RWLOCK_WRITER (1u << 31)
+#define RWLOCK_WRITER_WAITING (1u << 30)
+#define RWLOCK_READER_MASK (RWLOCK_WRITER_WAITING - 1)
+
+/**
+ * Reader-writer spinlock. Readers share the lock, writers are exclusive. A
+ * waiting writer holds off new readers so writers cannot starve. Statistics
+ * cover writers only, readers do not own the lock exclusively.
+ */
+typedef struct {
+	_Atomic uint32_t state;
+	LOCK_STATS_FIELD
+} RwLock;
+
+#define RWLOCK_INIT(lock_name) { .state = 0, LOCK_STATS_INIT(lock_name) }
+
+static inline void rwlock_init(RwLock *lock, const char *name) {
+	*lock = (RwLock)RWLOCK_INIT(name);
+	(void)name;
+}
+
+static inline void rwlock_read_acquire(RwLock *lock) {
+	for (;;) {
+		uint32_t state =
+			atomic_load_explicit(&lock->state, memory_order_relaxed);
+
+		if (!(state & (RWLOCK_WRITER | RWLOCK_WRITER_WAITING)) &&
+			atomic_compare_exchange_weak_explicit(
+				&lock->state,
+				&state,
+				state + 1,
+				memory_order_acquire,
+				memory_order_relaxed
+			)) {
+			return;
+		}
+
+		lock_spin_hint();
+	}
+}
+
+static inline void rwlock_read_release(RwLock *lock) {
+	atomic_fetch_sub_explicit(&lock->state, 1, memory_order_release);
+}
+
+static inline void rwlock_write_acquire(RwLock *lock) {
+	uint64_t spins = 0;
+
+	for (;;) {
+		uint32_t state =
+			atomic_load_explicit(&lock->state, memory_order_relaxed);
+
+		// Free apart from (possibly our own) waiting flag, try to take it.
+		// This clears the waiting flag, other waiting writers set it again.
+		if ((state & ~RWLOCK_WRITER_WAITING) == 0 &&
+			atomic_compare_exchange_weak_explicit(
+				&lock->state,
+				&state,
+				RWLOCK_WRITER,
+				memory_order_acquire,
+				memory_order_relaxed
+			)) {
+			break;
+		}
+
+		if (!(state & RWLOCK_WRITER_WAITING)) {
+			atomic_fetch_or_explicit(
+				&lock->state, RWLOCK_WRITER_WAITING, memory_order_relaxed
+			);
+		}
+
+		lock_spin_hint();
+		spins++;
+	}
+
+#if LIBK_LOCK_STATS
+	lock_stats_acquired(&lock->stats, spins);
+#endif
+	(void)spins;
+}
+
+static inline void rwlock_write_release(RwLock *lock) {
+#if LIBK_LOCK_STATS
+	lock_stats_released(&lock->stats);
+#endif
+
+	// Leave the waiting flag of other writers in place
+	atomic_fetch_and_explicit(
+		&lock->state, ~RWLOCK_WRITER, memory_order_release
+	);
+}
+
+#define rwlock_read_acquire_irqsave(lock)                                      \
+	rwlock_read_acquire_irqsave_at((lock), IRQSOFF_SITE())
+
+static inline uint64_t
+rwlock_read_acquire_irqsave_at(RwLock *lock, IrqsOffSite *site) {
+	uint64_t rflags = irqsoff_save(site);
+	rwlock_read_acquire(lock);
+	return rflags;
+}
+
+static inline void rwlock_read_release_irqrestore(
+	RwLock *lock, uint64_t rflags
+) {
+	rwlock_read_release(lock);
+	irqsoff_restore(rflags);
+}
+
+#define rwlock_write_acquire_irqsave(lock)                                     \
+	rwlock_write_acquire_irqsave_at((lock), IRQSOFF_SITE())
+
+static inline uint64_t
+rwlock_write_acquire_irqsave_at(RwLock *lock, IrqsOffSite *site) {
+	uint64_t rflags = irqsoff_save(site);
+	rwlock_write_acquire(lock);
+	return rflags;
+}
+
+static inline void rwlock_write_release_irqrestore(
+	RwLock *lock, uint64_t rflags
+) {
+	rwlock_write_release(lock);
+	irqsoff_restore(rflags);
+}
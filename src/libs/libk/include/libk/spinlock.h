@@ -0,0 +1,303 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libk/irqsoff.h>
+
+/**
+ * Contention statistics are compiled in when LIBK_LOCK_STATS is set (see
+ * xmake.lua). They are updated by the lock holder only, so they need no
+ * atomics of their own.
+ */
+#ifndef LIBK_LOCK_STATS
+#define LIBK_LOCK_STATS 0
+#endif
+
+/**
+ * Spin iterations per ticket ahead of us before re-reading the owner. Keeps
+ * waiters from hammering the lock's cache line.
+ */
+#define TICKET_LOCK_BACKOFF 32
+
+/**
+ * Per-lock contention statistics
+ */
+typedef struct LockStats {
+	const char *name;
+	struct LockStats *next;
+	uint64_t acquisitions;
+	uint64_t contended; // Acquisitions that had to wait
+	uint64_t spins;		// Total wait iterations
+	uint64_t max_hold_cycles;
+	uint64_t acquired_at;
+	bool registered;
+} LockStats;
+
+#if LIBK_LOCK_STATS
+#define LOCK_STATS_FIELD LockStats stats;
+#define LOCK_STATS_INIT(lock_name) .stats = {.name = (lock_name)}
+#else
+#define LOCK_STATS_FIELD
+#define LOCK_STATS_INIT(lock_name)
+#endif
+
+/**
+ * Adds a lock to the global statistics list (called on first acquisition)
+ */
+void lock_stats_register(LockStats *stats);
+
+/**
+ * Returns the head of the list of locks that have been acquired at least once
+ */
+LockStats *lock_stats_list();
+
+static inline uint64_t lock_stats_clock() { return __builtin_ia32_rdtsc(); }
+
+static inline void lock_stats_acquired(LockStats *stats, uint64_t spins) {
+	if (!stats->registered) {
+		lock_stats_register(stats);
+	}
+
+	stats->acquisitions++;
+	if (spins != 0) {
+		stats->contended++;
+		stats->spins += spins;
+	}
+	stats->acquired_at = lock_stats_clock();
+}
+
+static inline void lock_stats_released(LockStats *stats) {
+	uint64_t held = lock_stats_clock() - stats->acquired_at;
+	if (held > stats->max_hold_cycles) {
+		stats->max_hold_cycles = held;
+	}
+}
+
+static inline void lock_spin_hint() { asm volatile("pause" ::: "memory"); }
+
+/*
+ * ============================================================================
+ * Ticket lock
+ * ============================================================================
+ */
+
+/**
+ * FIFO-fair spinlock. Cheap when uncontended, but every waiter spins on the
+ * same cache line, so prefer McsLock for heavily contended paths.
+ */
+typedef struct {
+	_Atomic uint32_t next;
+	_Atomic uint32_t owner;
+	LOCK_STATS_FIELD
+} TicketLock;
+
+#define TICKET_LOCK_INIT(lock_name)                                            \
+	{ .next = 0, .owner = 0, LOCK_STATS_INIT(lock_name) }
+
+static inline void ticket_lock_init(TicketLock *lock, const char *name) {
+	*lock = (TicketLock)TICKET_LOCK_INIT(name);
+	(void)name;
+}
+
+static inline void ticket_lock_acquire(TicketLock *lock) {
+	uint32_t ticket =
+		atomic_fetch_add_explicit(&lock->next, 1, memory_order_relaxed);
+	uint64_t spins = 0;
+
+	for (;;) {
+		uint32_t owner =
+			atomic_load_explicit(&lock->owner, memory_order_acquire);
+		if (owner == ticket) {
+			break;
+		}
+
+		// Back off in proportion to our place in the queue
+		for (uint32_t i = 0; i < (ticket - owner) * TICKET_LOCK_BACKOFF; i++) {
+			lock_spin_hint();
+		}
+		spins++;
+	}
+
+#if LIBK_LOCK_STATS
+	lock_stats_acquired(&lock->stats, spins);
+#endif
+	(void)spins;
+}
+
+static inline bool ticket_lock_try_acquire(TicketLock *lock) {
+	uint32_t owner = atomic_load_explicit(&lock->owner, memory_order_relaxed);
+	uint32_t expected = owner;
+
+	if (!atomic_compare_exchange_strong_explicit(
+			&lock->next,
+			&expected,
+			owner + 1,
+			memory_order_acquire,
+			memory_order_relaxed
+		)) {
+		return false;
+	}
+
+#if LIBK_LOCK_STATS
+	lock_stats_acquired(&lock->stats, 0);
+#endif
+	return true;
+}
+
+static inline void ticket_lock_release(TicketLock *lock) {
+#if LIBK_LOCK_STATS
+	lock_stats_released(&lock->stats);
+#endif
+
+	// Only the holder writes owner, a plain increment is enough
+	uint32_t owner = atomic_load_explicit(&lock->owner, memory_order_relaxed);
+	atomic_store_explicit(&lock->owner, owner + 1, memory_order_release);
+}
+
+static inline bool ticket_lock_is_locked(TicketLock *lock) {
+	return atomic_load_explicit(&lock->owner, memory_order_relaxed) !=
+		   atomic_load_explicit(&lock->next, memory_order_relaxed);
+}
+
+/**
+ * Disables interrupts and acquires the lock. A macro so the irqs-off tracer
+ * charges the section to the caller rather than to this header.
+ */
+#define ticket_lock_acquire_irqsave(lock)                                      \
+	ticket_lock_acquire_irqsave_at((lock), IRQSOFF_SITE())
+
+static inline uint64_t
+ticket_lock_acquire_irqsave_at(TicketLock *lock, IrqsOffSite *site) {
+	uint64_t rflags = irqsoff_save(site);
+	ticket_lock_acquire(lock);
+	return rflags;
+}
+
+static inline void ticket_lock_release_irqrestore(
+	TicketLock *lock, uint64_t rflags
+) {
+	ticket_lock_release(lock);
+	irqsoff_restore(rflags);
+}
+
+/*
+ * ============================================================================
+ * MCS queued lock
+ * ============================================================================
+ */
+
+/**
+ * Queue node of an MCS lock waiter. Each waiter spins on its own node, so
+ * contention does not bounce the lock's cache line between CPUs. The node
+ * must stay alive (usually on the stack) until the lock is released.
+ */
+typedef struct McsNode {
+	_Atomic(struct McsNode *) next;
+	_Atomic bool locked;
+} __attribute__((aligned(64))) McsNode;
+
+typedef struct {
+	_Atomic(McsNode *) tail;
+	LOCK_STATS_FIELD
+} McsLock;
+
+#define MCS_LOCK_INIT(lock_name) { .tail = NULL, LOCK_STATS_INIT(lock_name) }
+
+static inline void mcs_lock_init(McsLock *lock, const char *name) {
+	*lock = (McsLock)MCS_LOCK_INIT(name);
+	(void)name;
+}
+
+static inline void mcs_lock_acquire(McsLock *lock, McsNode *node) {
+	uint64_t spins = 0;
+
+	atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+	atomic_store_explicit(&node->locked, true, memory_order_relaxed);
+
+	McsNode *prev =
+		atomic_exchange_explicit(&lock->tail, node, memory_order_acq_rel);
+	if (prev != NULL) {
+		atomic_store_explicit(&prev->next, node, memory_order_release);
+
+		while (atomic_load_explicit(&node->locked, memory_order_acquire)) {
+			lock_spin_hint();
+			spins++;
+		}
+	}
+
+#if LIBK_LOCK_STATS
+	lock_stats_acquired(&lock->stats, spins);
+#endif
+	(void)spins;
+}
+
+static inline bool mcs_lock_try_acquire(McsLock *lock, McsNode *node) {
+	McsNode *expected = NULL;
+
+	atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+	if (!atomic_compare_exchange_strong_explicit(
+			&lock->tail,
+			&expected,
+			node,
+			memory_order_acquire,
+			memory_order_relaxed
+		)) {
+		return false;
+	}
+
+#if LIBK_LOCK_STATS
+	lock_stats_acquired(&lock->stats, 0);
+#endif
+	return true;
+}
+
+static inline void mcs_lock_release(McsLock *lock, McsNode *node) {
+#if LIBK_LOCK_STATS
+	lock_stats_released(&lock->stats);
+#endif
+
+	McsNode *next = atomic_load_explicit(&node->next, memory_order_acquire);
+	if (next == NULL) {
+		// No known successor, try to mark the lock free
+		McsNode *expected = node;
+		if (atomic_compare_exchange_strong_explicit(
+				&lock->tail,
+				&expected,
+				NULL,
+				memory_order_release,
+				memory_order_relaxed
+			)) {
+			return;
+		}
+
+		// A successor swapped itself in but has not linked up yet
+		while ((next = atomic_load_explicit(
+					&node->next, memory_order_acquire
+				)) == NULL) {
+			lock_spin_hint();
+		}
+	}
+
+	atomic_store_explicit(&next->locked, false, memory_order_release);
+}
+
+#define mcs_lock_acquire_irqsave(lock, node)                                   \
+	mcs_lock_acquire_irqsave_at((lock), (node), IRQSOFF_SITE())
+
+static inline uint64_t mcs_lock_acquire_irqsave_at(
+	McsLock *lock, McsNode *node, IrqsOffSite *site
+) {
+	uint64_t rflags = irqsoff_save(site);
+	mcs_lock_acquire(lock, node);
+	return rflags;
+}
+
+static inline void mcs_lock_release_irqrestore(
+	McsLock *lock, McsNode *node, uint64_t rflags
+) {
+	mcs_lock_release(lock, node);
+	irqsoff_restore(rflags);
+}
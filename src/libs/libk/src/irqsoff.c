@@ -0,0 +1,129 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libk/irqsoff.h>
+
+static IrqsOffCpu *(*irqsoff_cpu_hook)();
+static _Atomic(IrqsOffSite *) irqsoff_site_head;
+
+void irqsoff_set_cpu_hook(IrqsOffCpu *(*hook)()) { irqsoff_cpu_hook = hook; }
+
+IrqsOffSite *irqsoff_site_list() {
+	return atomic_load_explicit(&irqsoff_site_head, memory_order_acquire);
+}
+
+#if LIBK_IRQSOFF_TRACE
+
+static void irqsoff_register(IrqsOffSite *site) {
+	// Several CPUs may leave a new site at once, only the first pushes it
+	if (__atomic_exchange_n(&site->registered, true, __ATOMIC_RELAXED)) {
+		return;
+	}
+
+	IrqsOffSite *head =
+		atomic_load_explicit(&irqsoff_site_head, memory_order_relaxed);
+	do {
+		site->next = head;
+	} while (!atomic_compare_exchange_weak_explicit(
+		&irqsoff_site_head,
+		&head,
+		site,
+		memory_order_release,
+		memory_order_relaxed
+	));
+}
+
+/**
+ * Records the return addresses of the frame pointer chain above us
+ */
+static void irqsoff_backtrace(uintptr_t trace[IRQSOFF_TRACE_DEPTH]) {
+	uintptr_t *frame = (uintptr_t *)__builtin_frame_address(0);
+
+	for (size_t i = 0; i < IRQSOFF_TRACE_DEPTH; i++) {
+		uintptr_t *next = frame != NULL ? (uintptr_t *)frame[0] : NULL;
+		trace[i] = frame != NULL ? frame[1] : 0;
+
+		// Stacks grow down, anything else is the end of the chain or garbage
+		if (next <= frame || (uintptr_t)next - (uintptr_t)frame > 0x10000) {
+			next = NULL;
+		}
+		frame = next;
+	}
+}
+
+static size_t irqsoff_bucket(uint64_t cycles) {
+	if (cycles == 0) {
+		return 0;
+	}
+
+	size_t order = 63 - __builtin_clzll(cycles);
+	if (order < IRQSOFF_HISTOGRAM_SHIFT) {
+		return 0;
+	}
+	if (order - IRQSOFF_HISTOGRAM_SHIFT >= IRQSOFF_HISTOGRAM_BUCKETS) {
+		return IRQSOFF_HISTOGRAM_BUCKETS - 1;
+	}
+	return order - IRQSOFF_HISTOGRAM_SHIFT;
+}
+
+void irqsoff_begin(IrqsOffSite *site) {
+	if (irqsoff_cpu_hook == NULL || site == NULL) {
+		return;
+	}
+
+	IrqsOffCpu *cpu = irqsoff_cpu_hook();
+	if (cpu->site != NULL) {
+		return;
+	}
+
+	// Kept to the bare minimum, this runs on every interrupt entry
+	cpu->site = site;
+	cpu->start = __builtin_ia32_rdtsc();
+}
+
+void irqsoff_end() {
+	uint64_t end = __builtin_ia32_rdtsc();
+
+	if (irqsoff_cpu_hook == NULL) {
+		return;
+	}
+
+	IrqsOffCpu *cpu = irqsoff_cpu_hook();
+	IrqsOffSite *site = cpu->site;
+	if (site == NULL) {
+		return;
+	}
+	cpu->site = NULL;
+
+	uint64_t cycles = end - cpu->start;
+
+	__atomic_fetch_add(&site->count, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&site->total_cycles, cycles, __ATOMIC_RELAXED);
+	__atomic_fetch_add(
+		&site->histogram[irqsoff_bucket(cycles)], 1, __ATOMIC_RELAXED
+	);
+
+	uint64_t max = __atomic_load_n(&site->max_cycles, __ATOMIC_RELAXED);
+	while (cycles > max) {
+		if (__atomic_compare_exchange_n(
+				&site->max_cycles,
+				&max,
+				cycles,
+				true,
+				__ATOMIC_RELAXED,
+				__ATOMIC_RELAXED
+			)) {
+			// Rare once the site has run for a while, and after end was read
+			irqsoff_backtrace(site->max_trace);
+			break;
+		}
+	}
+
+	if (!site->registered) {
+		irqsoff_register(site);
+	}
+}
+
+#endif
@@ -0,0 +1,29 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libk/spinlock.h>
+
+static _Atomic(LockStats *) lock_stats_head;
+
+void lock_stats_register(LockStats *stats) {
+	// Only the lock holder gets here, so each lock is pushed exactly once
+	stats->registered = true;
+
+	LockStats *head =
+		atomic_load_explicit(&lock_stats_head, memory_order_relaxed);
+	do {
+		stats->next = head;
+	} while (!atomic_compare_exchange_weak_explicit(
+		&lock_stats_head,
+		&head,
+		stats,
+		memory_order_release,
+		memory_order_relaxed
+	));
+}
+
+LockStats *lock_stats_list() {
+	return atomic_load_explicit(&lock_stats_head, memory_order_acquire);
+}
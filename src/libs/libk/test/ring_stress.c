@@ -0,0 +1,305 @@
+/*
+ * Host stress test and throughput measurement of the lock-free queues in
+ * libk/ring.h and libk/mpsc_queue.h. Built with the host compiler and run on
+ * Linux threads, see the libk_stress target in src/libs/libk/xmake.lua.
+ *
+ * Producers tag every value with their index and a sequence number, the
+ * consumer checks that nothing is lost, duplicated or reordered within a
+ * producer.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <libk/mpsc_queue.h>
+#include <libk/ring.h>
+
+/**
+ * Values each producer sends unless given on the command line, and the
+ * number of producers of the MPSC tests
+ */
+#define STRESS_DEFAULT_COUNT 5000000
+#define STRESS_PRODUCERS 4
+
+#define STRESS_RING_CAPACITY 1024
+
+/**
+ * Values carry the producer index above STRESS_SEQUENCE_BITS and the
+ * sequence number below, starting at 1 so no value is 0
+ */
+#define STRESS_SEQUENCE_BITS 40
+#define STRESS_SEQUENCE_MASK ((1ULL << STRESS_SEQUENCE_BITS) - 1)
+
+typedef struct {
+	MpscNode node;
+	uint64_t value;
+} StressNode;
+
+typedef struct {
+	uint32_t producers;
+	uint64_t count;
+	_Atomic uint32_t ready;
+
+	SpscRing spsc;
+	MpscRing mpsc;
+	MpscQueue queue;
+	StressNode *nodes;
+} Stress;
+
+typedef struct {
+	Stress *stress;
+	uint32_t index;
+} StressProducer;
+
+static uintptr_t spsc_slots[STRESS_RING_CAPACITY];
+static MpscRingSlot mpsc_slots[STRESS_RING_CAPACITY];
+
+static uint64_t stress_now_ns() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+static uint64_t stress_value(uint32_t producer, uint64_t sequence) {
+	return ((uint64_t)producer << STRESS_SEQUENCE_BITS) | sequence;
+}
+
+/**
+ * Starts everyone at the same time, so the queue is actually contended
+ */
+static void stress_start(Stress *stress) {
+	atomic_fetch_add(&stress->ready, 1);
+	while (atomic_load(&stress->ready) < stress->producers + 1) {
+		sched_yield();
+	}
+}
+
+/**
+ * Checks one value against the next sequence number expected of its
+ * producer
+ */
+static bool stress_check(
+	const char *name, Stress *stress, uint64_t *expected, uint64_t value
+) {
+	uint64_t producer = value >> STRESS_SEQUENCE_BITS;
+	uint64_t sequence = value & STRESS_SEQUENCE_MASK;
+
+	if (producer >= stress->producers || sequence != expected[producer]) {
+		fprintf(
+			stderr,
+			"%s: got sequence %llu of producer %llu, expected %llu\n",
+			name,
+			(unsigned long long)sequence,
+			(unsigned long long)producer,
+			producer < stress->producers
+				? (unsigned long long)expected[producer]
+				: 0ULL
+		);
+		return false;
+	}
+	expected[producer]++;
+	return true;
+}
+
+/*
+ * ============================================================================
+ * Producers
+ * ============================================================================
+ */
+
+static void *stress_spsc_producer(void *argument) {
+	StressProducer *producer = (StressProducer *)argument;
+	Stress *stress = producer->stress;
+
+	stress_start(stress);
+	for (uint64_t i = 1; i <= stress->count; i++) {
+		while (!spsc_ring_push(&stress->spsc, stress_value(0, i))) {
+			sched_yield();
+		}
+	}
+	return NULL;
+}
+
+static void *stress_mpsc_producer(void *argument) {
+	StressProducer *producer = (StressProducer *)argument;
+	Stress *stress = producer->stress;
+
+	stress_start(stress);
+	for (uint64_t i = 1; i <= stress->count; i++) {
+		uint64_t value = stress_value(producer->index, i);
+		while (!mpsc_ring_push(&stress->mpsc, value)) {
+			sched_yield();
+		}
+	}
+	return NULL;
+}
+
+static void *stress_queue_producer(void *argument) {
+	StressProducer *producer = (StressProducer *)argument;
+	Stress *stress = producer->stress;
+	StressNode *nodes = &stress->nodes[producer->index * stress->count];
+
+	stress_start(stress);
+	for (uint64_t i = 0; i < stress->count; i++) {
+		nodes[i].value = stress_value(producer->index, i + 1);
+		mpsc_queue_push(&stress->queue, &nodes[i].node);
+	}
+	return NULL;
+}
+
+/*
+ * ============================================================================
+ * Consumers
+ * ============================================================================
+ */
+
+typedef enum {
+	STRESS_SPSC,
+	STRESS_MPSC_RING,
+	STRESS_MPSC_QUEUE,
+} StressKind;
+
+static bool stress_pop(Stress *stress, StressKind kind, uint64_t *value) {
+	uintptr_t raw;
+
+	switch (kind) {
+	case STRESS_SPSC:
+		if (!spsc_ring_pop(&stress->spsc, &raw)) {
+			return false;
+		}
+		*value = raw;
+		return true;
+	case STRESS_MPSC_RING:
+		if (!mpsc_ring_pop(&stress->mpsc, &raw)) {
+			return false;
+		}
+		*value = raw;
+		return true;
+	case STRESS_MPSC_QUEUE: {
+		MpscNode *node = mpsc_queue_pop(&stress->queue);
+		if (node == NULL) {
+			return false;
+		}
+		*value = ((StressNode *)node)->value;
+		return true;
+	}
+	}
+	return false;
+}
+
+static void *(*const stress_producers[])(void *) = {
+	[STRESS_SPSC] = stress_spsc_producer,
+	[STRESS_MPSC_RING] = stress_mpsc_producer,
+	[STRESS_MPSC_QUEUE] = stress_queue_producer,
+};
+
+/**
+ * Runs producers against this thread as the consumer and reports the
+ * throughput. Exits at the first value lost or out of order.
+ *
+ * @return false if a value was duplicated
+ */
+static bool stress_run(
+	const char *name, StressKind kind, uint32_t producers, uint64_t count
+) {
+	static Stress stress;
+	static StressProducer arguments[STRESS_PRODUCERS];
+	pthread_t threads[STRESS_PRODUCERS];
+	uint64_t expected[STRESS_PRODUCERS];
+
+	stress = (Stress){.producers = producers, .count = count};
+	spsc_ring_init(&stress.spsc, spsc_slots, STRESS_RING_CAPACITY);
+	mpsc_ring_init(&stress.mpsc, mpsc_slots, STRESS_RING_CAPACITY);
+	mpsc_queue_init(&stress.queue);
+	if (kind == STRESS_MPSC_QUEUE) {
+		stress.nodes = calloc(producers * count, sizeof(StressNode));
+		if (stress.nodes == NULL) {
+			fprintf(stderr, "%s: out of memory\n", name);
+			return false;
+		}
+	}
+
+	for (uint32_t i = 0; i < producers; i++) {
+		arguments[i] = (StressProducer){.stress = &stress, .index = i};
+		expected[i] = 1;
+		if (pthread_create(
+				&threads[i], NULL, stress_producers[kind], &arguments[i]
+			) != 0) {
+			fprintf(stderr, "%s: could not start producer %u\n", name, i);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	stress_start(&stress);
+	uint64_t start = stress_now_ns();
+
+	// Producers may be stuck on a full ring after a failure, do not wait
+	uint64_t total = producers * count;
+	for (uint64_t received = 0; received < total;) {
+		uint64_t value;
+		if (!stress_pop(&stress, kind, &value)) {
+			sched_yield();
+			continue;
+		}
+		if (!stress_check(name, &stress, expected, value)) {
+			exit(EXIT_FAILURE);
+		}
+		received++;
+	}
+	uint64_t elapsed = stress_now_ns() - start;
+
+	for (uint32_t i = 0; i < producers; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	// Anything left over was sent twice
+	uint64_t extra;
+	bool passed = !stress_pop(&stress, kind, &extra);
+	if (!passed) {
+		fprintf(stderr, "%s: more values than were sent\n", name);
+	}
+
+	free(stress.nodes);
+
+	printf(
+		"%-12s producers=%u values=%llu %8.2f Mops/s %7.2f ns/op %s\n",
+		name,
+		producers,
+		(unsigned long long)total,
+		elapsed != 0 ? (double)total * 1000.0 / (double)elapsed : 0.0,
+		(double)elapsed / (double)total,
+		passed ? "ok" : "FAILED"
+	);
+	return passed;
+}
+
+int main(int argc, char **argv) {
+	uint64_t count = STRESS_DEFAULT_COUNT;
+	if (argc > 1) {
+		count = strtoull(argv[1], NULL, 0);
+		if (count == 0 || count > STRESS_SEQUENCE_MASK) {
+			fprintf(stderr, "usage: %s [values per producer]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	bool passed = true;
+	passed &= stress_run("spsc_ring", STRESS_SPSC, 1, count);
+	passed &= stress_run("mpsc_ring", STRESS_MPSC_RING, 1, count);
+	passed &= stress_run(
+		"mpsc_ring", STRESS_MPSC_RING, STRESS_PRODUCERS, count
+	);
+	passed &= stress_run("mpsc_queue", STRESS_MPSC_QUEUE, 1, count);
+	passed &= stress_run(
+		"mpsc_queue", STRESS_MPSC_QUEUE, STRESS_PRODUCERS, count
+	);
+
+	return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -1,5 +1,48 @@
+-- Off by default, every irqs-off section pays for it:
+-- xmake f --irqsoff_trace=y
+option("irqsoff_trace")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Compile in the irqs-off latency tracer (libk/irqsoff.h)")
+option_end()
+
 target("libk")
     set_kind("static")
     add_files("src/*.c")
     add_includedirs("include", {public = true})
     add_defines("LIBK_BUILD", {public = true})
+
+    -- Runs in kernel and interrupt context, see the kernel target
+    add_cxflags("-mgeneral-regs-only")
+
+    -- Lock contention statistics, exported to everything that links libk
+    -- (always on while the kernel only has a debug configuration)
+    add_defines("LIBK_LOCK_STATS=1", {public = true})
+
+    -- Irqs-off latency tracer, see libk/irqsoff.h
+    if has_config("irqsoff_trace") then
+        add_defines("LIBK_IRQSOFF_TRACE=1", {public = true})
+    end
+
+-- Stress test and throughput measurement of the lock-free rings and queue
+-- (test/ring_stress.c), built with the host compiler and run on Linux
+-- threads: xmake build libk_stress && xmake run libk_stress [values]
+target("libk_stress")
+    set_kind("phony")
+    set_default(false)
+
+    on_build(function (target)
+        import("core.project.config")
+        local output = path.join(config.buildir(), "host", "ring_stress")
+        os.mkdir(path.directory(output))
+        os.execv("cc", {"-std=gnu11", "-O2", "-Wall", "-Wextra", "-pthread",
+                        "-I" .. path.join(target:scriptdir(), "include"),
+                        path.join(target:scriptdir(), "test", "ring_stress.c"),
+                        "-o", output})
+    end)
+
+    on_run(function (target)
+        import("core.base.option")
+        import("core.project.config")
+        os.execv(path.join(config.buildir(), "host", "ring_stress"), option.get("arguments") or {})
+    end)
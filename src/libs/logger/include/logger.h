@@ -3,6 +3,9 @@
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+
+#include <libk/spinlock.h>
 
 #define MAX_LOG_MESSAGE_SIZE 4096
 
@@ -17,14 +20,23 @@ typedef enum {
 
 typedef void (*log_writer_t)(const char *);
 
+// Returns the current time in nanoseconds, used to timestamp records
+typedef uint64_t (*log_clock_t)();
+
 // Logger structure
 typedef struct {
 	log_writer_t *writers;
 	int num_writers;
+	log_clock_t clock;
+	// Serializes records from different CPUs. A stream holds it from
+	// log_stream_start until log_stream_end.
+	TicketLock lock;
+	uint64_t stream_rflags;
 } logger_t;
 
 // Logger API
 void log_init(logger_t *logger, log_writer_t *writers, int num_writers);
+void log_set_clock(logger_t *logger, log_clock_t clock);
 void log_message(
 	logger_t *logger,
 	log_level_t level,
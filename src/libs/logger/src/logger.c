@@ -37,6 +37,12 @@ const char *log_level_to_string(log_level_t level) {
 void log_init(logger_t *logger, log_writer_t *writers, int num_writers) {
 	logger->writers = writers;
 	logger->num_writers = num_writers;
+	logger->clock = NULL;
+	ticket_lock_init(&logger->lock, "logger");
+}
+
+void log_set_clock(logger_t *logger, log_clock_t clock) {
+	logger->clock = clock;
 }
 
 static void jems_writer(char ch, uintptr_t arg) {
@@ -47,12 +53,16 @@ static void jems_writer(char ch, uintptr_t arg) {
 
 static void create_json_log(
 	jems_t *jems,
+	logger_t *logger,
 	log_level_t level,
 	const char *component,
 	const char *message,
 	bool include_data
 ) {
 	jems_object_open(jems);
+	if (logger->clock != NULL) {
+		jems_key_integer(jems, "timestamp_ns", (int64_t)logger->clock());
+	}
 	jems_key_string(jems, "level", log_level_to_string(level));
 	jems_key_string(jems, "component", component);
 	jems_key_string(jems, "message", message);
@@ -89,11 +99,12 @@ void log_message(
 	char *json_ptr = json_output;
 	static jems_level_t jems_levels[JEMS_MAX_LEVEL];
 	jems_t jems;
+	uint64_t rflags = ticket_lock_acquire_irqsave(&logger->lock);
 	jems_init(
 		&jems, jems_levels, JEMS_MAX_LEVEL, jems_writer, (uintptr_t)&json_ptr
 	);
 
-	create_json_log(&jems, level, component, message, false);
+	create_json_log(&jems, logger, level, component, message, false);
 
 	*json_ptr = '\n';
 	*(json_ptr + 1) = '\0';
@@ -101,6 +112,7 @@ void log_message(
 	for (int i = 0; i < logger->num_writers; i++) {
 		logger->writers[i](json_output);
 	}
+	ticket_lock_release_irqrestore(&logger->lock, rflags);
 }
 
 void log_stream_start(
@@ -113,11 +125,16 @@ void log_stream_start(
 	char *json_ptr = json_output;
 	static jems_level_t jems_levels[JEMS_MAX_LEVEL];
 	jems_t jems;
+	uint64_t rflags = ticket_lock_acquire_irqsave(&logger->lock);
+	logger->stream_rflags = rflags;
 	jems_init(
 		&jems, jems_levels, JEMS_MAX_LEVEL, jems_writer, (uintptr_t)&json_ptr
 	);
 
 	jems_object_open(&jems);
+	if (logger->clock != NULL) {
+		jems_key_integer(&jems, "timestamp_ns", (int64_t)logger->clock());
+	}
 	jems_key_string(&jems, "level", log_level_to_string(level));
 	jems_key_string(&jems, "component", component);
 	jems_key_string(&jems, "message", message);
@@ -156,6 +173,7 @@ void log_stream_end(logger_t *logger) {
 	for (int i = 0; i < logger->num_writers; i++) {
 		logger->writers[i](json_output);
 	}
+	ticket_lock_release_irqrestore(&logger->lock, logger->stream_rflags);
 }
 
 void log_complex(
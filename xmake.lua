@@ -45,6 +45,7 @@ includes("src/kernel")
 task("make-iso")
     set_category("build")
     on_run(function ()
+        import("core.base.option")
         import("core.project.project")
         import("core.project.config")
 
@@ -52,6 +53,12 @@ task("make-iso")
         local build_dir = config.buildir()
         local mode = config.mode() or "release"
 
+        -- Variants get their own ISO root and image next to the default one
+        local name = mode
+        if option.get("variant") then
+            name = mode .. "_" .. option.get("variant")
+        end
+
         local kernel_target = project.target("kernel")
         if not kernel_target then
             raise("Kernel target not found!")
@@ -77,7 +84,7 @@ task("make-iso")
         os.cd(project_root)
 
         -- Create ISO root directory in the build directory
-        local iso_root = path.join(build_dir, "iso_root_" .. mode)
+        local iso_root = path.join(build_dir, "iso_root_" .. name)
         os.mkdir(iso_root)
         os.mkdir(path.join(iso_root, "boot"))
         os.mkdir(path.join(iso_root, "boot/limine"))
@@ -87,6 +94,10 @@ task("make-iso")
         os.cp("meta/*.sfn", iso_root)
         os.cp(kernel_path, path.join(iso_root, "boot"))
         os.cp("meta/limine.cfg", path.join(iso_root, "boot/limine"))
+        if option.get("cmdline") then
+            local limine_cfg = path.join(iso_root, "boot/limine/limine.cfg")
+            io.writefile(limine_cfg, io.readfile(limine_cfg) .. "    CMDLINE=" .. option.get("cmdline") .. "\n")
+        end
         os.cp(path.join(limine_dir, "limine-bios.sys"), path.join(iso_root, "boot/limine"))
         os.cp(path.join(limine_dir, "limine-bios-cd.bin"), path.join(iso_root, "boot/limine"))
         os.cp(path.join(limine_dir, "limine-uefi-cd.bin"), path.join(iso_root, "boot/limine"))
@@ -94,7 +105,7 @@ task("make-iso")
         os.cp(path.join(limine_dir, "BOOTIA32.EFI"), path.join(iso_root, "EFI/BOOT"))
 
         -- Create bootable ISO in the build directory
-        local iso_file = path.join(build_dir, "image_" .. mode .. ".iso")
+        local iso_file = path.join(build_dir, "image_" .. name .. ".iso")
         os.execv("xorriso", {"-as", "mkisofs", "-b", "boot/limine/limine-bios-cd.bin",
                              "-no-emul-boot", "-boot-load-size", "4", "-boot-info-table",
                              "--efi-boot", "boot/limine/limine-uefi-cd.bin",
@@ -108,8 +119,12 @@ task("make-iso")
         print("ISO file created at: " .. iso_file)
     end)
     set_menu {
-        usage = "xmake make-iso",
-        description = "Create a bootable ISO image"
+        usage = "xmake make-iso [options]",
+        description = "Create a bootable ISO image",
+        options = {
+            {nil, "cmdline", "kv", nil, "Kernel command line, e.g. kbench=all"},
+            {nil, "variant", "kv", nil, "Suffix of the image name, keeps the default image as it is"}
+        }
     }
 
 task("run-qemu-uefi")
@@ -131,12 +146,12 @@ task("run-qemu-uefi")
 
         -- Construct the QEMU command
         local qemu_cmd = string.format(
-            "qemu-system-x86_64 -chardev stdio,id=char0,logfile=kdebug.json -M q35 -m 2G -bios %s -cdrom %s -boot d -serial chardev:char0 -d int,cpu_reset,in_asm -D qemu.log -no-reboot -no-shutdown",
+            "qemu-system-x86_64 -chardev stdio,id=char0,logfile=kdebug.json -M q35 -smp 4 -m 2G -bios %s -cdrom %s -boot d -serial chardev:char0 -d int,cpu_reset,in_asm -D qemu.log -no-reboot -no-shutdown",
             ovmf_path,
             iso_file
          )
         --local qemu_cmd = string.format(
-        --    "qemu-system-x86_64 -chardev stdio,id=char0,logfile=kdebug.json -M q35 -m 2G -bios %s -cdrom %s -boot d -serial chardev:char0 -d int,cpu_reset,in_asm -D qemu.log -no-reboot -no-shutdown -s -S",
+        --    "qemu-system-x86_64 -chardev stdio,id=char0,logfile=kdebug.json -M q35 -smp 4 -m 2G -bios %s -cdrom %s -boot d -serial chardev:char0 -d int,cpu_reset,in_asm -D qemu.log -no-reboot -no-shutdown -s -S",
         --    ovmf_path,
         --    iso_file
         --)
@@ -149,3 +164,72 @@ task("run-qemu-uefi")
         usage = "xmake run",
         description = "Run the OS in QEMU"
     }
+
+task("kbench")
+    set_category("run")
+    on_run(function ()
+        import("core.base.json")
+        import("core.base.option")
+        import("core.base.task")
+        import("core.project.config")
+
+        local build_dir = config.buildir()
+        local mode = config.mode() or "release"
+        local filter = option.get("filter") or "all"
+        local output = option.get("output") or path.join(build_dir, "kbench_" .. mode .. ".json")
+
+        -- An image whose kernel runs the benchmarks and then powers QEMU off
+        task.run("make-iso", {cmdline = "kbench=" .. filter .. " kbench.exit", variant = "kbench"})
+        local iso_file = path.join(build_dir, "image_" .. mode .. "_kbench.iso")
+        local ovmf_path = path.join(os.projectdir(), "meta", "OVMF_CODE.fd")
+        local log_file = path.join(build_dir, "kbench_" .. mode .. ".log")
+        os.tryrm(log_file)
+
+        -- Headless with the serial log going to a file. The kernel ends QEMU
+        -- through isa-debug-exit, which makes it exit with status 1, and
+        -- timeout ends a kernel that hangs.
+        local argv = {option.get("timeout") or "600", "qemu-system-x86_64",
+                      "-M", "q35", "-smp", "4", "-m", "2G", "-bios", ovmf_path,
+                      "-cdrom", iso_file, "-boot", "d", "-display", "none",
+                      "-serial", "file:" .. log_file,
+                      "-device", "isa-debug-exit,iobase=0xf4,iosize=0x04", "-no-reboot"}
+        print("Running benchmarks " .. filter .. " in QEMU, serial log at " .. log_file)
+        try { function () os.execv("timeout", argv) end }
+
+        -- One JSON object per line, keep the results of the kbench component
+        local results = {}
+        local complete = false
+        for line in io.lines(log_file) do
+            if line:startswith("{") and line:find("\"kbench\"", 1, true) then
+                local entry = try { function () return json.decode(line) end }
+                local message = entry and entry.message or ""
+                if message == "Benchmark result" then
+                    table.insert(results, entry.data)
+                    print(string.format("%-24s %12d cycles %12d ps", entry.data.name,
+                                        entry.data.median_cycles, entry.data.median_ps))
+                elseif message:startswith("Benchmarks complete") then
+                    complete = true
+                end
+            end
+        end
+
+        local lines = {}
+        for _, result in ipairs(results) do
+            table.insert(lines, json.encode(result))
+        end
+        io.writefile(output, table.concat(lines, "\n") .. "\n")
+        print("Results of " .. #results .. " benchmarks written to " .. output)
+
+        if not complete then
+            raise("The benchmarks did not complete, see " .. log_file)
+        end
+    end)
+    set_menu {
+        usage = "xmake kbench [options]",
+        description = "Run kernel benchmarks in headless QEMU and save the results",
+        options = {
+            {'f', "filter", "kv", "all", "Comma separated benchmark names, a trailing * matches a prefix"},
+            {'o', "output", "kv", nil, "Results file, one JSON line per benchmark"},
+            {nil, "timeout", "kv", "600", "Seconds before QEMU is killed"}
+        }
+    }